@@ -83,6 +83,8 @@
  * <tr><td>@ref ups_txn_begin</td><td>Begins a new Txn</td></tr>
  * <tr><td>@ref ups_txn_commit</td><td>Commits the current
   Txn</td></tr>
+ * <tr><td>@ref ups_txn_commit_async</td><td>Commits the current
+  Txn without waiting for the journal</td></tr>
  * <tr><td>@ref ups_txn_abort</td><td>Aborts the current Txn</td></tr>
  * </table>
  *
@@ -571,6 +573,12 @@ ups_get_version(uint32_t *major, uint32_t *minor,
  *      By default, upscaledb checks if it can use mmap,
  *      since mmap is faster than read/write. For performance
  *      reasons, this flag should not be used.
+ *     <li>@ref UPS_ENABLE_DIRECT_IO</li> Bypasses the operating system's
+ *      file cache (O_DIRECT), therefore pages are only cached once, in
+ *      the upscaledb cache. Implies @ref UPS_DISABLE_MMAP. The page size
+ *      has to be a multiple of 4096. If the file system does not
+ *      support direct I/O then buffered I/O is used. Not allowed in
+ *      combination with @ref UPS_IN_MEMORY or AES encryption.
  *     <li>@ref UPS_CACHE_UNLIMITED</li> Do not limit the cache. Nearly as
  *      fast as an In-Memory Database. Not allowed in combination
  *      with a limited cache size.
@@ -580,6 +588,14 @@ ups_get_version(uint32_t *major, uint32_t *minor,
  *      Environment.
  *     <li>@ref UPS_ENABLE_CRC32</li> Stores (and verifies) CRC32
  *      checksums. Not allowed in combination with @ref UPS_IN_MEMORY.
+ *     <li>@ref UPS_ENABLE_CONCURRENT_READS</li> Lookups (@ref ups_db_find,
+ *      @ref ups_cursor_find, @ref ups_cursor_move and @ref ups_db_count)
+ *      run in parallel if they are called from multiple threads. All
+ *      other operations (including @ref uqi_select) are still serialized.
+ *      Key and record buffers which are owned by the Database (i.e. if
+ *      no Txn is used) are then allocated per thread. Transactional
+ *      Databases and Databases with key or record compression do not
+ *      run lookups in parallel.
  *    </ul>
  *
  * @param mode File access rights for the new file. This is the @a mode
@@ -595,6 +611,38 @@ ups_get_version(uint32_t *major, uint32_t *minor,
  *      posix_fadvise(). Only on supported platforms. Allowed values are
  *      @ref UPS_POSIX_FADVICE_NORMAL (which is the default) or
  *      @ref UPS_POSIX_FADVICE_RANDOM.
+ *    <li>@ref UPS_PARAM_CACHE_POLICY</li> The eviction policy of the
+ *      page cache. Allowed values are @ref UPS_CACHE_POLICY_LRU (which is
+ *      the default) or @ref UPS_CACHE_POLICY_2Q.
+ *    <li>@ref UPS_PARAM_FLUSH_THREADS</li> The number of threads which
+ *      write dirty pages to disk when the cache is purged. Adjacent pages
+ *      are coalesced into a single vectored write; with more than one
+ *      thread, independent ranges of pages are written in parallel.
+ *      Allowed values are 1 (the default) to 64.
+ *    <li>@ref UPS_PARAM_IO_ENGINE</li> The I/O backend for disk-based
+ *      Environments. Allowed values are @ref UPS_IO_ENGINE_DEFAULT
+ *      (synchronous pread/pwrite, which is the default) or
+ *      @ref UPS_IO_ENGINE_IO_URING. Falls back to the default backend
+ *      if io_uring is not available.
+ *    <li>@ref UPS_PARAM_RECOVERY_TARGET_SEC</li> The target time (in
+ *      seconds) for recovering the journal after a crash. If set, a
+ *      background thread periodically writes checkpoints to the journal,
+ *      and committed Transactions are flushed early if replaying them
+ *      would take longer. The default is 0 (no target).
+ *    <li>@ref UPS_PARAM_JOURNAL_PAGE_DELTAS</li> If non-zero, the journal
+ *      logs only the modified ranges of pages which were already written
+ *      to disk, instead of their full images. Costs a copy of every page
+ *      which was logged. Disabled by default.
+ *    <li>@ref UPS_PARAM_UNLOGGED_NEW_PAGES</li> If non-zero, pages which
+ *      were appended to the file are written directly when a multi-page
+ *      modification is flushed; only the pages which already existed on
+ *      disk are logged in the journal. Disabled by default.
+ *    <li>@ref UPS_PARAM_TXN_FLUSH_THRESHOLD</li> The memory (in bytes)
+ *      of committed Transactions which are buffered before they are
+ *      flushed to the Btree. When it is exceeded, the committed
+ *      Transactions are flushed in the background; if it is exceeded
+ *      by far, then the committing thread flushes them. The default
+ *      is 1 MB.
  *    <li>@ref UPS_PARAM_PAGE_SIZE</li> The size of a file page, in
  *      bytes. It is recommended not to change the default size. The
  *      default size depends on hardware and operating system.
@@ -688,6 +736,9 @@ ups_env_create(ups_env_t **env, const char *filename,
  *      By default, upscaledb checks if it can use mmap,
  *      since mmap is faster than read/write. For performance
  *      reasons, this flag should not be used.
+ *     <li>@ref UPS_ENABLE_DIRECT_IO </li> Bypasses the operating system's
+ *      file cache. See @ref ups_env_create. Returns @ref UPS_INV_PAGE_SIZE
+ *      if the page size of the file is not a multiple of 4096.
  *     <li>@ref UPS_CACHE_UNLIMITED </li> Do not limit the cache. Nearly as
  *      fast as an In-Memory Database. Not allowed in combination
  *      with a limited cache size.
@@ -699,6 +750,13 @@ ups_env_create(ups_env_t **env, const char *filename,
  *      if necessary.
  *     <li>@ref UPS_ENABLE_CRC32</li> Stores (and verifies) CRC32
  *      checksums.
+ *     <li>@ref UPS_ENABLE_CONCURRENT_READS</li> Lookups run in parallel
+ *      if they are called from multiple threads. See @ref ups_env_create.
+ *     <li>@ref UPS_STANDBY</li> Opens the Environment as a "hot standby"
+ *      of another Environment. The Databases can only be modified by
+ *      @ref ups_env_apply_journal; all other operations that need write
+ *      access return @ref UPS_WRITE_PROTECTED. Requires
+ *      @ref UPS_ENABLE_TRANSACTIONS.
  *    </ul>
  * @param param An array of ups_parameter_t structures. The following
  *      parameters are available:
@@ -710,6 +768,38 @@ ups_env_create(ups_env_t **env, const char *filename,
  *      posix_fadvise(). Only on supported platforms. Allowed values are
  *      @ref UPS_POSIX_FADVICE_NORMAL (which is the default) or
  *      @ref UPS_POSIX_FADVICE_RANDOM.
+ *    <li>@ref UPS_PARAM_CACHE_POLICY</li> The eviction policy of the
+ *      page cache. Allowed values are @ref UPS_CACHE_POLICY_LRU (which is
+ *      the default) or @ref UPS_CACHE_POLICY_2Q.
+ *    <li>@ref UPS_PARAM_FLUSH_THREADS</li> The number of threads which
+ *      write dirty pages to disk when the cache is purged. Adjacent pages
+ *      are coalesced into a single vectored write; with more than one
+ *      thread, independent ranges of pages are written in parallel.
+ *      Allowed values are 1 (the default) to 64.
+ *    <li>@ref UPS_PARAM_IO_ENGINE</li> The I/O backend for disk-based
+ *      Environments. Allowed values are @ref UPS_IO_ENGINE_DEFAULT
+ *      (synchronous pread/pwrite, which is the default) or
+ *      @ref UPS_IO_ENGINE_IO_URING. Falls back to the default backend
+ *      if io_uring is not available.
+ *    <li>@ref UPS_PARAM_RECOVERY_TARGET_SEC</li> The target time (in
+ *      seconds) for recovering the journal after a crash. If set, a
+ *      background thread periodically writes checkpoints to the journal,
+ *      and committed Transactions are flushed early if replaying them
+ *      would take longer. The default is 0 (no target).
+ *    <li>@ref UPS_PARAM_JOURNAL_PAGE_DELTAS</li> If non-zero, the journal
+ *      logs only the modified ranges of pages which were already written
+ *      to disk, instead of their full images. Costs a copy of every page
+ *      which was logged. Disabled by default.
+ *    <li>@ref UPS_PARAM_UNLOGGED_NEW_PAGES</li> If non-zero, pages which
+ *      were appended to the file are written directly when a multi-page
+ *      modification is flushed; only the pages which already existed on
+ *      disk are logged in the journal. Disabled by default.
+ *    <li>@ref UPS_PARAM_TXN_FLUSH_THRESHOLD</li> The memory (in bytes)
+ *      of committed Transactions which are buffered before they are
+ *      flushed to the Btree. When it is exceeded, the committed
+ *      Transactions are flushed in the background; if it is exceeded
+ *      by far, then the committing thread flushes them. The default
+ *      is 1 MB.
  *    <li>@ref UPS_PARAM_FILE_SIZE_LIMIT</li> Sets a file size limit (in bytes).
  *      Disabled by default. If the limit is exceeded, API functions
  *      return @ref UPS_LIMITS_REACHED.
@@ -766,6 +856,20 @@ ups_env_open(ups_env_t **env, const char *filename,
  *    <li>@ref UPS_PARAM_JOURNAL_COMPRESSION</li> Returns the
  *        selected algorithm for journal compression, or 0 if compression
  *        is disabled
+ *    <li>@ref UPS_PARAM_CACHE_POLICY</li> Returns the eviction policy
+ *        of the page cache
+ *    <li>@ref UPS_PARAM_FLUSH_THREADS</li> Returns the number of threads
+ *        which flush dirty pages
+ *    <li>@ref UPS_PARAM_IO_ENGINE</li> Returns the requested I/O backend
+ *    <li>@ref UPS_PARAM_RECOVERY_TARGET_SEC</li> Returns the target
+ *        recovery time
+ *    <li>@ref UPS_PARAM_JOURNAL_PAGE_DELTAS</li> Returns 1 if the journal
+ *        logs page deltas, otherwise 0
+ *    <li>@ref UPS_PARAM_UNLOGGED_NEW_PAGES</li> Returns 1 if new pages
+ *        are not logged, otherwise 0
+ *    <li>@ref UPS_PARAM_TXN_FLUSH_THRESHOLD</li> Returns the memory
+ *        of committed Transactions which is buffered before they are
+ *        flushed
  *    </ul>
  *
  * @param env A valid Environment handle
@@ -1147,6 +1251,74 @@ ups_env_get_database_names(ups_env_t *env, uint16_t *names,
 UPS_EXPORT ups_status_t UPS_CALLCONV
 ups_env_close(ups_env_t *env, uint32_t flags);
 
+/**
+ * Reads the committed Transactions from the journal
+ *
+ * Returns the journal entries of all Transactions which were committed
+ * after the commit with the lsn @a lsn, in the order of their commits.
+ * The stream can be re-applied to a "hot standby" (see @ref UPS_STANDBY)
+ * with @ref ups_env_apply_journal, i.e. after sending it to another
+ * process or host. Operations without a Txn are included as well.
+ *
+ * Start with @a lsn 0, and continue with the lsn which is returned in
+ * @a last_lsn. Only commits which are durable are returned. If the stream
+ * grows too large then it ends early, and the next call returns the
+ * remaining commits.
+ *
+ * The journal only stores the Transactions till its files are recycled,
+ * and it is cleared when the Environment is closed. Then this function
+ * returns @ref UPS_LIMITS_REACHED, and the standby has to be re-created
+ * from a copy of the Environment's file.
+ *
+ * @param env A valid Environment handle; the Environment must have a
+ *        journal (see @ref UPS_ENABLE_TRANSACTIONS)
+ * @param lsn The lsn of the last commit which was already read, or 0
+ * @param data Returns a pointer to the stream. The memory belongs to the
+ *        Environment and is valid till the next call of this function
+ * @param size Returns the size of the stream; 0 if nothing was committed
+ *        after @a lsn
+ * @param last_lsn Returns the lsn of the last commit in the stream, or
+ *        @a lsn if the stream is empty
+ *
+ * @return @ref UPS_SUCCESS upon success
+ * @return @ref UPS_INV_PARAMETER if a pointer is NULL or the Environment
+ *        does not have a journal
+ * @return @ref UPS_LIMITS_REACHED if the journal no longer stores all
+ *        Transactions which were committed after @a lsn
+ * @return @ref UPS_NOT_IMPLEMENTED if the Environment is remote
+ */
+UPS_EXPORT ups_status_t UPS_CALLCONV
+ups_env_read_journal(ups_env_t *env, uint64_t lsn, const void **data,
+            uint32_t *size, uint64_t *last_lsn);
+
+/**
+ * Applies committed Transactions to a standby
+ *
+ * Replays a stream which was returned by @ref ups_env_read_journal. The
+ * Environment must be opened with @ref UPS_STANDBY. It is a copy of the
+ * other Environment's file which was made while that Environment was
+ * closed; afterwards the stream is read starting with lsn 0. The
+ * Databases which are modified by the stream must already exist.
+ *
+ * The Transactions are replayed like during recovery, while the
+ * Environment is locked. The stream is not applied atomically, though: if
+ * an operation fails, then the Transactions which were committed before
+ * it remain applied, and the following ones are discarded. The standby
+ * then has to be re-created.
+ *
+ * @param env A valid Environment handle
+ * @param data The stream
+ * @param size The size of the stream
+ *
+ * @return @ref UPS_SUCCESS upon success
+ * @return @ref UPS_INV_PARAMETER if @a env is NULL, the Environment was not
+ *        opened with @ref UPS_STANDBY or the stream is corrupt
+ * @return @ref UPS_DATABASE_NOT_FOUND if a Database does not exist
+ * @return @ref UPS_NOT_IMPLEMENTED if the Environment is remote
+ */
+UPS_EXPORT ups_status_t UPS_CALLCONV
+ups_env_apply_journal(ups_env_t *env, const void *data, uint32_t size);
+
 /**
  * @}
  */
@@ -1188,7 +1360,12 @@ typedef struct ups_txn_t ups_txn_t;
  *    bitwise OR. Possible flags are:
  *    <ul>
  *     <li>@ref UPS_TXN_READ_ONLY </li> This Txn is read-only and
- *      will not modify the Database.
+ *      will not modify the Database. It reads a consistent snapshot of
+ *      all Transactions which were committed before it began, and never
+ *      fails with @ref UPS_TXN_CONFLICT. Modifications of Transactions
+ *      which are committed while the snapshot is active are kept in
+ *      memory till the snapshot is committed or aborted. Inserting or
+ *      erasing keys in this Txn fails with @ref UPS_WRITE_PROTECTED.
  *    </ul>
  *
  * @return @ref UPS_SUCCESS upon success
@@ -1221,6 +1398,10 @@ ups_txn_get_name(ups_txn_t *txn);
  * a Cursor was attached to this Txn (with @ref ups_cursor_create
  * or @ref ups_cursor_clone), and the Cursor was not closed.
  *
+ * If the committed Txns were flushed in the background, and this flush
+ * failed, then the error is returned by the next call to this function.
+ * The Txn is then not committed and remains active.
+ *
  * @param txn Pointer to a Txn structure
  * @param flags Optional flags for committing the Txn, combined with
  *    bitwise OR. Unused, set to 0.
@@ -1233,6 +1414,53 @@ ups_txn_get_name(ups_txn_t *txn);
 UPS_EXPORT ups_status_t
 ups_txn_commit(ups_txn_t *txn, uint32_t flags);
 
+/**
+ * A callback function which is invoked by @ref ups_txn_commit_async
+ * as soon as the committed Txn is durable
+ *
+ * @param status @ref UPS_SUCCESS, or @ref UPS_IO_ERROR if the journal
+ *    could not be synced
+ * @param context The @a context parameter of @ref ups_txn_commit_async
+ */
+typedef void UPS_CALLCONV (*ups_txn_commit_callback_t)(ups_status_t status,
+                void *context);
+
+/**
+ * Commits a Txn without waiting till it is durable
+ *
+ * Same as @ref ups_txn_commit, but the function returns as soon as the
+ * commit was written to the journal. The @a callback is invoked as soon as
+ * the commit is durable.
+ *
+ * If the commit is not yet durable (i.e. if the Environment was created
+ * or opened with @ref UPS_ENABLE_FSYNC) then the @a callback is invoked
+ * by the background thread which writes the journal, after the journal
+ * file was synced; then the @a callback must not call @ref ups_txn_commit
+ * and must not close the Environment. All pending callbacks are invoked
+ * before @ref ups_env_close returns. Otherwise (and for remote
+ * Environments) the @a callback is invoked by the calling thread before
+ * this function returns, but after the Environment was unlocked; it can
+ * then call any other function.
+ *
+ * The @a callback is only invoked if this function returns
+ * @ref UPS_SUCCESS.
+ *
+ * @param txn Pointer to a Txn structure
+ * @param flags Optional flags for committing the Txn, combined with
+ *    bitwise OR. Unused, set to 0.
+ * @param callback The function which is invoked when the commit is durable
+ * @param context An arbitrary pointer which is passed to @a callback
+ *
+ * @return @ref UPS_SUCCESS upon success
+ * @return @ref UPS_INV_PARAMETER if @a txn or @a callback is NULL
+ * @return @ref UPS_IO_ERROR if writing to the file failed
+ * @return @ref UPS_CURSOR_STILL_OPEN if there are Cursors attached to this
+ *      Txn
+ */
+UPS_EXPORT ups_status_t
+ups_txn_commit_async(ups_txn_t *txn, uint32_t flags,
+                ups_txn_commit_callback_t callback, void *context);
+
 /**
  * Aborts a Txn
  *
@@ -1275,9 +1503,20 @@ ups_txn_abort(ups_txn_t *txn, uint32_t flags);
  * This flag is non persistent. */
 #define UPS_READ_ONLY                               0x00000004
 
-/* unused                                           0x00000008 */
+/** Flag for @ref ups_env_open, @ref ups_env_create.
+ * Lookups are performed under a shared lock and can run in parallel.
+ * Exact-match lookups with @ref ups_db_find also run in parallel to
+ * @ref ups_db_insert and @ref ups_db_erase; the btree pages are latched.
+ * Operations on transactional Databases and on Databases with key or
+ * record compression are still serialized. Not supported for remote
+ * Environments.
+ * This flag is non persistent. */
+#define UPS_ENABLE_CONCURRENT_READS                 0x00000008
 
-/* unused                                           0x00000010 */
+/** Flag for @ref ups_env_open.
+ * The Environment is a standby; see @ref ups_env_apply_journal.
+ * This flag is non persistent. */
+#define UPS_STANDBY                                 0x00000010
 
 /* reserved                                         0x00000020 */
 
@@ -1349,6 +1588,14 @@ ups_txn_abort(ups_txn_t *txn, uint32_t flags);
  * This flag is non persistent. */
 #define UPS_FLUSH_TRANSACTIONS_IMMEDIATELY          0x08000000
 
+/** Flag for @ref ups_env_open, @ref ups_env_create.
+ * Reads and writes bypass the operating system's file cache (i.e. the
+ * file is opened with O_DIRECT). Page buffers are then allocated from
+ * a pool of buffers which are aligned to 4096 bytes. The page size has to
+ * be a multiple of 4096. Implies @ref UPS_DISABLE_MMAP.
+ * This flag is non persistent. */
+#define UPS_ENABLE_DIRECT_IO                        0x10000000
+
 /**
  * Typedef for a key comparison function
  *
@@ -1682,8 +1929,8 @@ UPS_EXPORT ups_status_t UPS_CALLCONV
 ups_db_get_parameters(ups_db_t *db, ups_parameter_t *param);
 
 /** Parameter name for @ref ups_env_open, @ref ups_env_create;
- * Journal files are switched whenever the number of new Transactions exceeds
- * this threshold. */
+ * Journal segments are switched when they are full, or whenever the number
+ * of new Transactions exceeds this threshold. The default is 0 (no limit). */
 #define UPS_PARAM_JOURNAL_SWITCH_THRESHOLD 0x00001
 
 /** Parameter name for @ref ups_env_open, @ref ups_env_create;
@@ -1738,12 +1985,60 @@ ups_db_get_parameters(ups_db_t *db, ups_parameter_t *param);
 /** Parameter name for @ref ups_env_create_db; sets the record type */
 #define UPS_PARAM_RECORD_TYPE           0x00000112
 
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * eviction policy of the page cache */
+#define UPS_PARAM_CACHE_POLICY          0x00000113
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * number of threads which flush dirty pages */
+#define UPS_PARAM_FLUSH_THREADS         0x00000114
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * I/O backend */
+#define UPS_PARAM_IO_ENGINE             0x00000115
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * target recovery time (in seconds) */
+#define UPS_PARAM_RECOVERY_TARGET_SEC   0x00000116
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; logs page
+ * deltas instead of full page images */
+#define UPS_PARAM_JOURNAL_PAGE_DELTAS   0x00000117
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; writes new
+ * pages directly instead of logging them */
+#define UPS_PARAM_UNLOGGED_NEW_PAGES    0x00000118
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * memory of committed Transactions which is buffered before they are
+ * flushed */
+#define UPS_PARAM_TXN_FLUSH_THRESHOLD   0x00000119
+
 /** Value for @ref UPS_PARAM_POSIX_FADVISE */
 #define UPS_POSIX_FADVICE_NORMAL                 0
 
 /** Value for @ref UPS_PARAM_POSIX_FADVISE */
 #define UPS_POSIX_FADVICE_RANDOM                 1
 
+/** Value for @ref UPS_PARAM_CACHE_POLICY: evicts the least recently used
+ * pages (the default) */
+#define UPS_CACHE_POLICY_LRU                     0
+
+/** Value for @ref UPS_PARAM_CACHE_POLICY: scan-resistant "2Q" policy. New
+ * pages are admitted to a probationary queue and are only promoted to the
+ * protected LRU queue when they are accessed again. Pages which are read
+ * only once (i.e. during a full table scan) are evicted first and do not
+ * flush the "hot" pages from the cache */
+#define UPS_CACHE_POLICY_2Q                      1
+
+/** Value for @ref UPS_PARAM_IO_ENGINE: synchronous pread/pwrite (the
+ * default) */
+#define UPS_IO_ENGINE_DEFAULT                    0
+
+/** Value for @ref UPS_PARAM_IO_ENGINE: batches reads and writes with
+ * Linux' io_uring */
+#define UPS_IO_ENGINE_IO_URING                   1
+
 /** Value for unlimited record sizes */
 #define UPS_RECORD_SIZE_UNLIMITED       ((uint32_t)-1)
 
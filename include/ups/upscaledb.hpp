@@ -249,6 +249,13 @@ class txn {
         throw error(st);
     }
 
+    /** Commit the Txn; @a callback is invoked when it is durable */
+    void commit_async(ups_txn_commit_callback_t callback, void *context) {
+      ups_status_t st = ups_txn_commit_async(_txn, 0, callback, context);
+      if (st)
+        throw error(st);
+    }
+
     std::string get_name() {
       const char *p = ups_txn_get_name(_txn);
       return p ? p : "";
@@ -686,6 +693,23 @@ class env {
       return txn(h);
     }
 
+    /** Reads the Txns which were committed after the |lsn|. */
+    uint64_t read_journal(uint64_t lsn, const void **data, uint32_t *size) {
+      uint64_t last_lsn;
+      ups_status_t st = ups_env_read_journal(_env, lsn, data, size,
+                      &last_lsn);
+      if (st)
+        throw error(st);
+      return last_lsn;
+    }
+
+    /** Applies a stream of committed Txns to a standby. */
+    void apply_journal(const void *data, uint32_t size) {
+      ups_status_t st = ups_env_apply_journal(_env, data, size);
+      if (st)
+        throw error(st);
+    }
+
 
     /** Closes the Environment. */
     void close(uint32_t flags = 0) {
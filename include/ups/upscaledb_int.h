@@ -209,7 +209,10 @@ typedef struct btree_metrics_t {
  * Metrics marked "global" are stored globally and shared between multiple
  * Environments.
  */
-#define UPS_METRICS_VERSION         9
+#define UPS_METRICS_VERSION         11
+
+/** The number of shards of the page cache */
+#define UPS_CACHE_SHARDS            16
 
 typedef struct ups_env_metrics_t {
   /* the version indicator - must be UPS_METRICS_VERSION */
@@ -259,6 +262,12 @@ typedef struct ups_env_metrics_t {
   /* number of cache misses */
   uint64_t cache_misses;
 
+  /* number of successful cache hits, per cache shard */
+  uint64_t cache_shard_hits[UPS_CACHE_SHARDS];
+
+  /* number of cache misses, per cache shard */
+  uint64_t cache_shard_misses[UPS_CACHE_SHARDS];
+
   /* number of blobs allocated */
   uint64_t blob_total_allocated;
 
@@ -286,6 +295,12 @@ typedef struct ups_env_metrics_t {
   /* log/journal bytes after compression */
   uint64_t journal_bytes_after_compression;
 
+  /* microseconds spent compressing log/journal entries */
+  uint64_t journal_compression_usec;
+
+  /* size of the log/journal compression dictionary (0 if there is none) */
+  uint64_t journal_dictionary_size;
+
   /* record bytes before compression */
   uint64_t record_bytes_before_compression;
 
@@ -354,6 +369,9 @@ ups_env_get_open_database(ups_env_t *env, uint16_t name);
 
 /**
  * Sets the threshold for flushing batched (committed) Transactions to disk.
+ * If non-zero, the committed Transactions are also flushed as soon as
+ * there are at least |threshold| of them, regardless of their size (see
+ * @ref UPS_PARAM_TXN_FLUSH_THRESHOLD). The default is 0.
  */
 UPS_EXPORT void UPS_CALLCONV
 ups_set_committed_flush_threshold(int threshold);
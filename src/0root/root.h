@@ -45,6 +45,9 @@
 // the default page size is 16 kb
 #define UPS_DEFAULT_PAGE_SIZE     (16 * 1024)
 
+// committed Transactions are flushed when they use more than 1 MB
+#define UPS_DEFAULT_TXN_FLUSH_THRESHOLD (1024 * 1024)
+
 // boost/asio has nasty build dependencies and requires Windows.h,
 // therefore it is included here
 #ifdef WIN32
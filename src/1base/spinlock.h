@@ -45,6 +45,26 @@ namespace upscaledb {
 
 #ifdef UPS_ENABLE_HELGRIND
 typedef Mutex Spinlock;
+
+struct RwSpinlock : public SharedMutex
+{
+  void acquire_ownership() {
+  }
+
+  void safe_unlock() {
+    try_lock();
+    unlock();
+  }
+
+  // Optimistic reads are not supported; the version is always "locked"
+  uint32_t version() const {
+    return 1;
+  }
+
+  bool validate(uint32_t) const {
+    return false;
+  }
+};
 #else
 
 class Spinlock {
@@ -137,6 +157,125 @@ class Spinlock {
     boost::thread::id m_owner;
 #endif
 };
+
+// A reader/writer spinlock. The exclusive interface (lock(), try_lock(),
+// unlock()) is compatible to the Spinlock; in addition, the lock can
+// be shared by several readers. A waiting writer blocks new readers.
+//
+// The version is incremented whenever the exclusive lock is acquired and
+// whenever it is released; it is odd while a writer holds the lock. Readers
+// can use it to validate data which was read without acquiring the lock.
+class RwSpinlock {
+    enum {
+      kUnlocked      = 0,
+      kWriter        = 0x40000000,
+      kWriterPending = 0x20000000,
+      kReaderMask    = 0x1fffffff
+    };
+
+  public:
+    RwSpinlock()
+      : m_state(kUnlocked), m_version(0) {
+    }
+
+    // Need user-defined copy constructor because boost::atomic<> is not
+    // copyable. Initializes an *unlocked* RwSpinlock.
+    RwSpinlock(const RwSpinlock &other)
+      : m_state(kUnlocked), m_version(0) {
+    }
+
+    ~RwSpinlock() {
+      assert((m_state & (kWriter | kReaderMask)) == kUnlocked);
+    }
+
+    // Only for test verification: lets the current thread acquire ownership
+    // of a locked mutex
+    void acquire_ownership() {
+#ifndef NDEBUG
+      assert(m_state != kUnlocked);
+      m_owner = boost::this_thread::get_id();
+#endif
+    }
+
+    // For debugging and verification; unlocks the mutex, even if it was
+    // locked by a different thread
+    void safe_unlock() {
+#ifndef NDEBUG
+      m_owner = boost::this_thread::get_id();
+#endif
+      if (m_state & kWriter)
+        m_version.fetch_add(1, boost::memory_order_release);
+      m_state.store(kUnlocked, boost::memory_order_release);
+    }
+
+    bool try_lock() {
+      int state = m_state.load(boost::memory_order_relaxed);
+      if ((state & (kWriter | kReaderMask)) != kUnlocked)
+        return false;
+      if (!m_state.compare_exchange_strong(state, kWriter,
+                              boost::memory_order_acquire))
+        return false;
+      m_version.fetch_add(1, boost::memory_order_relaxed);
+      boost::atomic_thread_fence(boost::memory_order_release);
+#ifndef NDEBUG
+      m_owner = boost::this_thread::get_id();
+#endif
+      return true;
+    }
+
+    void lock() {
+      int k = 0;
+      while (!try_lock()) {
+        m_state.fetch_or(kWriterPending, boost::memory_order_relaxed);
+        Spinlock::spin(k++);
+      }
+    }
+
+    void unlock() {
+      assert(m_state & kWriter);
+      assert(m_owner == boost::this_thread::get_id());
+      m_version.fetch_add(1, boost::memory_order_release);
+      m_state.fetch_and(~kWriter, boost::memory_order_release);
+    }
+
+    bool try_lock_shared() {
+      int state = m_state.load(boost::memory_order_relaxed);
+      if (state & (kWriter | kWriterPending))
+        return false;
+      return m_state.compare_exchange_weak(state, state + 1,
+                              boost::memory_order_acquire);
+    }
+
+    void lock_shared() {
+      int k = 0;
+      while (!try_lock_shared())
+        Spinlock::spin(k++);
+    }
+
+    void unlock_shared() {
+      assert((m_state & kReaderMask) != 0);
+      m_state.fetch_sub(1, boost::memory_order_release);
+    }
+
+    // Returns the current version; odd if a writer holds the lock
+    uint32_t version() const {
+      return m_version.load(boost::memory_order_acquire);
+    }
+
+    // Returns true if the version did not change since |version| was
+    // retrieved, i.e. if the data read in the meantime is consistent
+    bool validate(uint32_t version) const {
+      boost::atomic_thread_fence(boost::memory_order_acquire);
+      return m_version.load(boost::memory_order_relaxed) == version;
+    }
+
+  private:
+    boost::atomic<int> m_state;
+    boost::atomic<uint32_t> m_version;
+#ifndef NDEBUG
+    boost::thread::id m_owner;
+#endif
+};
 #endif // UPS_ENABLE_HELGRIND
 
 class ScopedSpinlock {
@@ -61,6 +61,9 @@ struct ErrorInducer {
     // let mmap fail
     kFileMmap,
 
+    // let fsync fail
+    kFileFlush,
+
     kMaxActions
   };
 
@@ -64,7 +64,9 @@ uint64_t Globals::ms_btree_smo_merge;
 
 uint64_t Globals::ms_btree_smo_shift;
 
-int Globals::ms_flush_threshold = 10;
+int Globals::ms_flush_threshold;
+
+int Globals::ms_recovery_decode_threads;
 
 } // namespace upscaledb
 
@@ -91,8 +91,13 @@ struct Globals {
   // usage metrics - number of page shifts
   static uint64_t ms_btree_smo_shift;
 
-  // flush threshold for committed transactions
+  // flush threshold for committed transactions (a number of Txns); 0 if
+  // only the memory of the Txns is considered
   static int ms_flush_threshold;
+
+  // number of threads which decode a compressed journal during recovery;
+  // 0 means one thread per core
+  static int ms_recovery_decode_threads;
 };
 
 } // namespace upscaledb
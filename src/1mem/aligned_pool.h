@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2005-2017 Christoph Rupp (chris@crupp.de).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See the file COPYING for License information.
+ */
+
+/*
+ * A pool of fixed-size buffers with a common alignment, i.e. for page
+ * buffers which are used for direct I/O.
+ *
+ * The buffers are carved from large aligned slabs. Released buffers are
+ * kept in a free list and are handed out again; the slabs are only
+ * returned to the operating system when the pool is destroyed.
+ *
+ * @exception_safe: strong
+ * @thread_safe: yes
+ */
+
+#ifndef UPS_ALIGNED_POOL_H
+#define UPS_ALIGNED_POOL_H
+
+#include "0root/root.h"
+
+#include <vector>
+
+// Always verify that a file of level N does not include headers > N!
+#include "1base/spinlock.h"
+#include "1base/uncopyable.h"
+#include "1mem/mem.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+class AlignedPool : Uncopyable
+{
+  public:
+    enum {
+      // number of buffers per slab
+      kBuffersPerSlab = 64
+    };
+
+    // Constructor; |buffer_size| must be a multiple of |alignment|, and
+    // |alignment| must be a power of two
+    AlignedPool(size_t buffer_size, size_t alignment)
+      : m_buffer_size(buffer_size), m_alignment(alignment) {
+      assert(buffer_size > 0 && buffer_size % alignment == 0);
+    }
+
+    // Destructor; releases all slabs. All buffers have to be released
+    // before the pool is destroyed
+    ~AlignedPool() {
+      assert(m_free.size() == m_slabs.size() * kBuffersPerSlab);
+      for (size_t i = 0; i < m_slabs.size(); i++)
+        Memory::release_aligned(m_slabs[i]);
+    }
+
+    // Returns an aligned buffer; allocates a new slab if the free list
+    // is empty
+    void *allocate() {
+      ScopedSpinlock lock(m_mutex);
+      if (unlikely(m_free.empty()))
+        grow();
+      void *p = m_free.back();
+      m_free.pop_back();
+      return p;
+    }
+
+    // Returns a buffer to the pool
+    void release(void *p) {
+      ScopedSpinlock lock(m_mutex);
+      assert(p != 0);
+      m_free.push_back(p);
+    }
+
+    // Returns the size of a single buffer
+    size_t buffer_size() const {
+      return m_buffer_size;
+    }
+
+    // Returns the alignment of the buffers
+    size_t alignment() const {
+      return m_alignment;
+    }
+
+    // Returns the number of allocated slabs
+    size_t slab_count() {
+      ScopedSpinlock lock(m_mutex);
+      return m_slabs.size();
+    }
+
+  private:
+    // Allocates a new slab and pushes its buffers to the free list
+    void grow() {
+      m_slabs.reserve(m_slabs.size() + 1);
+      m_free.reserve(m_free.size() + kBuffersPerSlab);
+
+      uint8_t *slab = Memory::allocate_aligned<uint8_t>(
+                      m_buffer_size * kBuffersPerSlab, m_alignment);
+      m_slabs.push_back(slab);
+
+      // push in reverse order; the first buffer of the slab is handed
+      // out first
+      for (size_t i = kBuffersPerSlab; i > 0; i--)
+        m_free.push_back(slab + (i - 1) * m_buffer_size);
+    }
+
+    // For synchronizing access
+    Spinlock m_mutex;
+
+    // The size of each buffer
+    size_t m_buffer_size;
+
+    // The alignment of each buffer
+    size_t m_alignment;
+
+    // The allocated slabs
+    std::vector<uint8_t *> m_slabs;
+
+    // The buffers which are currently unused
+    std::vector<void *> m_free;
+};
+
+} // namespace upscaledb
+
+#endif // UPS_ALIGNED_POOL_H
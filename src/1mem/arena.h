@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2005-2017 Christoph Rupp (chris@crupp.de).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See the file COPYING for License information.
+ */
+
+/*
+ * A bump allocator. Memory is carved from fixed-size chunks which are
+ * borrowed from an AlignedPool; it cannot be released individually, but
+ * only all at once with |clear()|, which returns the chunks to the pool.
+ *
+ * Allocations which do not fit into a chunk are allocated from the heap.
+ *
+ * @exception_safe: strong
+ * @thread_safe: no
+ */
+
+#ifndef UPS_ARENA_H
+#define UPS_ARENA_H
+
+#include "0root/root.h"
+
+// Always verify that a file of level N does not include headers > N!
+#include "1base/uncopyable.h"
+#include "1mem/mem.h"
+#include "1mem/aligned_pool.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+class Arena : Uncopyable
+{
+  public:
+    enum {
+      // the alignment of all allocations
+      kAlignment = 8,
+
+      // each chunk (and each heap allocation) starts with a pointer to
+      // the previous one
+      kHeaderSize = 8
+    };
+
+    // Constructor; the chunks are borrowed from |pool|
+    Arena(AlignedPool *pool)
+      : m_pool(pool), m_chunk(0), m_offset(0), m_large(0),
+        m_allocated_bytes(0) {
+    }
+
+    // Destructor; returns all memory
+    ~Arena() {
+      clear();
+    }
+
+    // Allocates |size| bytes
+    void *allocate(size_t size) {
+      size = (size + kAlignment - 1) & ~((size_t)kAlignment - 1);
+
+      // too large for a chunk? then allocate from the heap
+      if (unlikely(size > m_pool->buffer_size() - kHeaderSize)) {
+        uint8_t *p = Memory::allocate<uint8_t>(kHeaderSize + size);
+        *(uint8_t **)p = m_large;
+        m_large = p;
+        m_allocated_bytes += size;
+        return p + kHeaderSize;
+      }
+
+      if (unlikely(m_chunk == 0 || m_offset + size > m_pool->buffer_size())) {
+        uint8_t *p = (uint8_t *)m_pool->allocate();
+        *(uint8_t **)p = m_chunk;
+        m_chunk = p;
+        m_offset = kHeaderSize;
+      }
+
+      void *p = m_chunk + m_offset;
+      m_offset += size;
+      m_allocated_bytes += size;
+      return p;
+    }
+
+    // Releases all allocations; the chunks are returned to the pool
+    void clear() {
+      while (m_chunk) {
+        uint8_t *previous = *(uint8_t **)m_chunk;
+        m_pool->release(m_chunk);
+        m_chunk = previous;
+      }
+      while (m_large) {
+        uint8_t *previous = *(uint8_t **)m_large;
+        Memory::release(m_large);
+        m_large = previous;
+      }
+      m_offset = 0;
+      m_allocated_bytes = 0;
+    }
+
+    // Returns the number of bytes which were allocated since the last
+    // call to |clear()|
+    size_t allocated_bytes() const {
+      return m_allocated_bytes;
+    }
+
+  private:
+    // The pool for the chunks
+    AlignedPool *m_pool;
+
+    // The current chunk; the previous chunks are chained through their
+    // headers
+    uint8_t *m_chunk;
+
+    // The offset of the unused space in the current chunk
+    size_t m_offset;
+
+    // The most recent heap allocation; chained like the chunks
+    uint8_t *m_large;
+
+    // The number of allocated bytes
+    size_t m_allocated_bytes;
+};
+
+} // namespace upscaledb
+
+#endif // UPS_ARENA_H
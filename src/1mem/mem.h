@@ -118,6 +118,44 @@ struct Memory {
     return t;
   }
 
+  // allocates |size| bytes at an address which is a multiple of
+  // |alignment|, casted into type |T *|. |alignment| must be a power of
+  // two. The memory has to be freed with |release_aligned()|.
+  template<typename T>
+  static T *allocate_aligned(size_t size, size_t alignment) {
+    ms_total_allocations++;
+    ms_current_allocations++;
+#ifdef WIN32
+    T *t = (T *)::_aligned_malloc(size, alignment);
+#else
+    T *t = 0;
+#  ifdef UPS_USE_TCMALLOC
+    if (::tc_posix_memalign((void **)&t, alignment, size) != 0)
+#  else
+    if (::posix_memalign((void **)&t, alignment, size) != 0)
+#  endif
+      t = 0;
+#endif
+    if (unlikely(!t))
+      throw Exception(UPS_OUT_OF_MEMORY);
+    return t;
+  }
+
+  // releases a memory block which was allocated with |allocate_aligned()|;
+  // can deal with NULL pointers.
+  static void release_aligned(void *ptr) {
+    if (likely(ptr != 0)) {
+      ms_current_allocations--;
+#ifdef WIN32
+      ::_aligned_free(ptr);
+#elif defined(UPS_USE_TCMALLOC)
+      ::tc_free(ptr);
+#else
+      ::free(ptr);
+#endif
+    }
+  }
+
   // releases a memory block; can deal with NULL pointers.
   static void release(void *ptr) {
     if (likely(ptr != 0)) {
@@ -49,13 +49,18 @@ class File
       kSeekSet = SEEK_SET,
       kSeekEnd = SEEK_END,
       kSeekCur = SEEK_CUR,
-      kMaxPath = PATH_MAX
+      kMaxPath = PATH_MAX,
 #else
       kSeekSet = FILE_BEGIN,
       kSeekEnd = FILE_END,
       kSeekCur = FILE_CURRENT,
-      kMaxPath = MAX_PATH
+      kMaxPath = MAX_PATH,
 #endif
+
+      // buffers, file offsets and lengths of direct I/O requests have to
+      // be aligned to this boundary; it's the largest logical block size
+      // of common storage devices
+      kDirectIoAlignment = 4096
     };
 
     // Constructor: creates an empty File handle
@@ -94,12 +99,25 @@ class File
       return m_fd != UPS_INVALID_FD;
     }
 
+    // Returns the file descriptor
+    ups_fd_t fd() const {
+      return m_fd;
+    }
+
     // Flushes a file
     void flush();
 
     // Sets the parameter for posix_fadvise()
     void set_posix_advice(int parameter);
 
+    // Bypasses the operating system's page cache (O_DIRECT). Returns false
+    // if this is not supported by the platform or the file system. Then
+    // the file continues to use buffered I/O.
+    //
+    // If enabled, all buffers, file offsets and lengths have to be
+    // aligned to |kDirectIoAlignment|
+    bool set_direct_io(bool enable);
+
     // Maps a file in memory
     //
     // mmap is called with MAP_PRIVATE - the allocated buffer
@@ -117,12 +135,21 @@ class File
     // Positional write to a file
     void pwrite(uint64_t addr, const void *buffer, size_t len);
 
+    // Positional write of |count| buffers with |len| bytes each to
+    // consecutive file addresses; uses a single pwritev() call if
+    // available
+    void pwritev(uint64_t addr, void * const *buffers, size_t count,
+                    size_t len);
+
     // Write data to a file; uses the current file position
     void write(const void *buffer, size_t len);
 
     // Get the page allocation granularity of the operating system
     static size_t granularity();
 
+    // Returns true if the file exists
+    static bool exists(const char *filename);
+
     // Seek position in a file
     void seek(uint64_t offset, int whence) const;
 
@@ -135,6 +162,10 @@ class File
     // Truncate/resize the file
     void truncate(uint64_t newsize);
 
+    // Reserves disk space for the first |size| bytes of the file (with
+    // fallocate(), if available); grows the file if it is smaller
+    void preallocate(uint64_t size);
+
     // Closes the file descriptor
     void close();
 
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2005-2017 Christoph Rupp (chris@crupp.de).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See the file COPYING for License information.
+ */
+
+#include "0root/root.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// Always verify that a file of level N does not include headers > N!
+#include "1base/error.h"
+#include "1os/io_uring.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+static inline int
+sys_io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+  return (int)::syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int
+sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                unsigned flags)
+{
+  return (int)::syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                  flags, (void *)0, (size_t)0);
+}
+
+static inline void *
+map_ring(int fd, size_t size, off_t offset)
+{
+  void *p = ::mmap(0, size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, offset);
+  if (p == MAP_FAILED) {
+    ups_log(("mmap of io_uring failed with status %u (%s)",
+                errno, strerror(errno)));
+    throw Exception(UPS_IO_ERROR);
+  }
+  return p;
+}
+
+IoUring::IoUring(unsigned entries)
+  : m_fd(-1), m_sq_ptr(0), m_sq_size(0), m_cq_ptr(0), m_cq_size(0),
+    m_sqes(0), m_sqes_size(0), m_entries(0), m_queued(0), m_inflight(0),
+    m_failed(false)
+{
+  struct io_uring_params params;
+  ::memset(&params, 0, sizeof(params));
+
+  m_fd = sys_io_uring_setup(entries, &params);
+  if (m_fd < 0) {
+    ups_log(("io_uring_setup failed with status %u (%s)",
+                errno, strerror(errno)));
+    throw Exception(UPS_IO_ERROR);
+  }
+
+  try {
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes
+                    + params.cq_entries * sizeof(struct io_uring_cqe);
+    m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    m_sq_ptr = map_ring(m_fd, m_sq_size, IORING_OFF_SQ_RING);
+    m_cq_ptr = map_ring(m_fd, m_cq_size, IORING_OFF_CQ_RING);
+    m_sqes = map_ring(m_fd, m_sqes_size, IORING_OFF_SQES);
+  }
+  catch (Exception &) {
+    close();
+    throw;
+  }
+
+  uint8_t *sq = (uint8_t *)m_sq_ptr;
+  m_sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  m_sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  m_sq_array = (unsigned *)(sq + params.sq_off.array);
+
+  uint8_t *cq = (uint8_t *)m_cq_ptr;
+  m_cq_head = (unsigned *)(cq + params.cq_off.head);
+  m_cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  m_cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  m_cqes = cq + params.cq_off.cqes;
+
+  m_entries = params.sq_entries;
+}
+
+IoUring::~IoUring()
+{
+  close();
+}
+
+void
+IoUring::close()
+{
+  if (m_sqes)
+    ::munmap(m_sqes, m_sqes_size);
+  if (m_cq_ptr)
+    ::munmap(m_cq_ptr, m_cq_size);
+  if (m_sq_ptr)
+    ::munmap(m_sq_ptr, m_sq_size);
+  if (m_fd >= 0)
+    ::close(m_fd);
+  m_sqes = m_cq_ptr = m_sq_ptr = 0;
+  m_fd = -1;
+}
+
+bool
+IoUring::is_supported()
+{
+  struct io_uring_params params;
+  ::memset(&params, 0, sizeof(params));
+
+  int fd = sys_io_uring_setup(1, &params);
+  if (fd < 0)
+    return false;
+  ::close(fd);
+  return true;
+}
+
+struct io_uring_sqe *
+IoUring::next_sqe()
+{
+  if (m_queued == m_entries)
+    drain();
+
+  unsigned index = (*m_sq_tail + m_queued) & *m_sq_mask;
+  struct io_uring_sqe *sqe = &((struct io_uring_sqe *)m_sqes)[index];
+  ::memset(sqe, 0, sizeof(*sqe));
+  m_sq_array[index] = index;
+  m_queued++;
+  return sqe;
+}
+
+void
+IoUring::prepare_read(int fd, void *buffer, size_t len, uint64_t offset)
+{
+  struct io_uring_sqe *sqe = next_sqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->off = offset;
+  sqe->addr = (uint64_t)(uintptr_t)buffer;
+  sqe->len = (uint32_t)len;
+  sqe->user_data = len;
+}
+
+void
+IoUring::prepare_writev(int fd, const struct iovec *iov, unsigned count,
+                uint64_t offset)
+{
+  size_t len = 0;
+  for (unsigned i = 0; i < count; i++)
+    len += iov[i].iov_len;
+
+  struct io_uring_sqe *sqe = next_sqe();
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = fd;
+  sqe->off = offset;
+  sqe->addr = (uint64_t)(uintptr_t)iov;
+  sqe->len = count;
+  sqe->user_data = len;
+}
+
+void
+IoUring::drain()
+{
+  // publish the queued entries
+  unsigned to_submit = m_queued;
+  if (to_submit) {
+    __atomic_store_n(m_sq_tail, *m_sq_tail + to_submit, __ATOMIC_RELEASE);
+    m_inflight += to_submit;
+    m_queued = 0;
+  }
+
+  while (m_inflight > 0) {
+    int r = sys_io_uring_enter(m_fd, to_submit, m_inflight,
+                    IORING_ENTER_GETEVENTS);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      ups_log(("io_uring_enter failed with status %u (%s)",
+                  errno, strerror(errno)));
+      throw Exception(UPS_IO_ERROR);
+    }
+    to_submit -= (unsigned)r < to_submit ? (unsigned)r : to_submit;
+
+    // reap the completions
+    unsigned head = *m_cq_head;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      struct io_uring_cqe *cqe = &((struct io_uring_cqe *)m_cqes)[head
+                                        & *m_cq_mask];
+      if (cqe->res < 0) {
+        ups_log(("io_uring request failed with status %d (%s)",
+                    -cqe->res, strerror(-cqe->res)));
+        m_failed = true;
+      }
+      else if ((uint64_t)cqe->res != cqe->user_data) {
+        ups_log(("io_uring request failed with short read/write"));
+        m_failed = true;
+      }
+      m_inflight--;
+    }
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+  }
+}
+
+void
+IoUring::submit_and_wait()
+{
+  drain();
+
+  if (m_failed) {
+    m_failed = false;
+    throw Exception(UPS_IO_ERROR);
+  }
+}
+
+} // namespace upscaledb
+
+#endif // HAVE_LINUX_IO_URING_H
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2005-2017 Christoph Rupp (chris@crupp.de).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See the file COPYING for License information.
+ */
+
+/*
+ * A minimal wrapper around a Linux io_uring instance. It uses the raw
+ * system calls and does not depend on liburing. Requests are queued with
+ * |prepare_read()| or |prepare_writev()|, then submitted with a single
+ * system call by |submit_and_wait()|. Throws exceptions in case of errors.
+ *
+ * Only available if HAVE_LINUX_IO_URING_H is defined.
+ *
+ * @exception_safe: basic
+ * @thread_safe: no
+ */
+
+#ifndef UPS_IO_URING_H
+#define UPS_IO_URING_H
+
+#include "0root/root.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "ups/types.h"
+
+// Always verify that a file of level N does not include headers > N!
+#include "1base/uncopyable.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+class IoUring : Uncopyable
+{
+  public:
+    // Constructor; creates a ring with |entries| submission slots
+    IoUring(unsigned entries);
+
+    // Destructor; releases the ring
+    ~IoUring();
+
+    // Returns true if the kernel supports io_uring
+    static bool is_supported();
+
+    // Queues a positional read of |len| bytes
+    void prepare_read(int fd, void *buffer, size_t len, uint64_t offset);
+
+    // Queues a positional vectored write of |count| buffers; |iov| must
+    // remain valid till |submit_and_wait()| returns
+    void prepare_writev(int fd, const struct iovec *iov, unsigned count,
+                    uint64_t offset);
+
+    // Submits all queued requests and waits till they are completed.
+    // Throws if any request failed or was incomplete
+    void submit_and_wait();
+
+  private:
+    // Returns a cleared submission queue entry; drains the ring if the
+    // submission queue is full
+    struct io_uring_sqe *next_sqe();
+
+    // Submits the queued requests and reaps all completions
+    void drain();
+
+    // Unmaps the queues and closes the ring
+    void close();
+
+    // the ring's file descriptor
+    int m_fd;
+
+    // the mapped submission and completion queues
+    void *m_sq_ptr;
+    size_t m_sq_size;
+    void *m_cq_ptr;
+    size_t m_cq_size;
+    void *m_sqes;
+    size_t m_sqes_size;
+
+    // pointers into the mapped queues
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_array;
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    void *m_cqes;
+
+    // number of slots in the submission queue
+    unsigned m_entries;
+
+    // number of queued, but not yet submitted requests
+    unsigned m_queued;
+
+    // number of submitted requests which are not yet completed
+    unsigned m_inflight;
+
+    // set if a completed request failed
+    bool m_failed;
+};
+
+} // namespace upscaledb
+
+#endif // HAVE_LINUX_IO_URING_H
+
+#endif // UPS_IO_URING_H
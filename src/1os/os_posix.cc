@@ -27,7 +27,7 @@
 #if HAVE_MMAP
 #  include <sys/mman.h>
 #endif
-#if HAVE_WRITEV
+#if HAVE_WRITEV || HAVE_PWRITEV
 #  include <sys/uio.h>
 #endif
 #include <sys/types.h>
@@ -151,6 +151,13 @@ File::granularity()
   return (size_t)sysconf(_SC_PAGE_SIZE);
 }
 
+bool
+File::exists(const char *filename)
+{
+  struct stat st;
+  return ::stat(filename, &st) == 0;
+}
+
 void
 File::set_posix_advice(int advice)
 {
@@ -169,6 +176,33 @@ File::set_posix_advice(int advice)
 #endif
 }
 
+bool
+File::set_direct_io(bool enable)
+{
+#if defined(O_DIRECT)
+  int oflag = fcntl(m_fd, F_GETFL, 0);
+  if (enable)
+    oflag |= O_DIRECT;
+  else
+    oflag &= ~O_DIRECT;
+  if (fcntl(m_fd, F_SETFL, oflag) == -1) {
+    ups_log(("fcntl(O_DIRECT) failed with status %u (%s)", errno,
+        strerror(errno)));
+    return false;
+  }
+  return true;
+#elif defined(F_NOCACHE)
+  if (fcntl(m_fd, F_NOCACHE, enable ? 1 : 0) == -1) {
+    ups_log(("fcntl(F_NOCACHE) failed with status %u (%s)", errno,
+        strerror(errno)));
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
 void
 File::mmap(uint64_t position, size_t size, bool readonly, uint8_t **buffer)
 {
@@ -280,6 +314,53 @@ File::pwrite(uint64_t addr, const void *buffer, size_t len)
 #endif
 }
 
+void
+File::pwritev(uint64_t addr, void * const *buffers, size_t count, size_t len)
+{
+  os_log(("File::pwritev: fd=%d, address=%lld, count=%lld, size=%lld",
+              m_fd, addr, count, len));
+
+#if HAVE_PWRITEV
+  struct iovec iov[64];
+  size_t max_iov = sizeof(iov) / sizeof(iov[0]);
+
+  while (count > 0) {
+    size_t n = count < max_iov ? count : max_iov;
+    for (size_t i = 0; i < n; i++) {
+      iov[i].iov_base = buffers[i];
+      iov[i].iov_len = len;
+    }
+
+    ssize_t s = ::pwritev(m_fd, iov, (int)n, addr);
+    if (s < 0) {
+      ups_log(("pwritev() failed with status %u (%s)",
+                  errno, strerror(errno)));
+      throw Exception(UPS_IO_ERROR);
+    }
+    if (s == 0) {
+      ups_log(("pwritev() failed with short write (%s)", strerror(errno)));
+      throw Exception(UPS_IO_ERROR);
+    }
+
+    // complete a partially written buffer
+    size_t written = (size_t)s / len;
+    size_t remainder = (size_t)s % len;
+    if (remainder) {
+      pwrite(addr + written * len + remainder,
+                  (uint8_t *)buffers[written] + remainder, len - remainder);
+      written++;
+    }
+
+    buffers += written;
+    count -= written;
+    addr += written * len;
+  }
+#else
+  for (size_t i = 0; i < count; i++)
+    pwrite(addr + i * len, buffers[i], len);
+#endif
+}
+
 void
 File::write(const void *buffer, size_t len)
 {
@@ -322,6 +403,23 @@ File::truncate(uint64_t newsize)
     throw Exception(UPS_IO_ERROR);
 }
 
+void
+File::preallocate(uint64_t size)
+{
+  os_log(("File::preallocate: fd=%d, size=%lld", m_fd, size));
+#if HAVE_FALLOCATE
+  if (::fallocate(m_fd, 0, 0, size) == 0)
+    return;
+  // fall back to ftruncate() if the file system does not support it
+  if (errno != EOPNOTSUPP && errno != ENOSYS) {
+    ups_log(("fallocate failed with status %u (%s)", errno, strerror(errno)));
+    throw Exception(UPS_IO_ERROR);
+  }
+#endif
+  if (file_size() < size)
+    truncate(size);
+}
+
 void
 File::create(const char *filename, uint32_t mode)
 {
@@ -350,6 +448,7 @@ void
 File::flush()
 {
   os_log(("File::flush: fd=%d", m_fd));
+  UPS_INDUCE_ERROR(ErrorInducer::kFileFlush);
   /* unlike fsync(), fdatasync() does not flush the metadata unless
    * it's really required. it's therefore a lot faster. */
 #if HAVE_FDATASYNC && !__APPLE__
@@ -99,12 +99,25 @@ File::granularity()
   return (size_t)info.dwAllocationGranularity;
 }
 
+bool
+File::exists(const char *filename)
+{
+  return GetFileAttributesA(filename) != INVALID_FILE_ATTRIBUTES;
+}
+
 void
 File::set_posix_advice(int advice)
 {
   // Only available for posix platforms
 }
 
+bool
+File::set_direct_io(bool enable)
+{
+  // FILE_FLAG_NO_BUFFERING can only be specified when the file is opened
+  return false;
+}
+
 void
 File::mmap(uint64_t position, size_t size, bool readonly, uint8_t **buffer)
 {
@@ -231,6 +244,13 @@ File::pwrite(uint64_t addr, const void *buffer, size_t len)
     throw Exception(UPS_IO_ERROR);
 }
 
+void
+File::pwritev(uint64_t addr, void * const *buffers, size_t count, size_t len)
+{
+  for (size_t i = 0; i < count; i++)
+    pwrite(addr + i * len, buffers[i], len);
+}
+
 void
 File::write(const void *buffer, size_t len)
 {
@@ -329,6 +349,13 @@ File::truncate(uint64_t newsize)
   assert(newsize == file_size());
 }
 
+void
+File::preallocate(uint64_t size)
+{
+  if (file_size() < size)
+    truncate(size);
+}
+
 void
 File::create(const char *filename, uint32_t mode)
 {
@@ -72,6 +72,11 @@ struct Compressor {
   virtual void decompress(const uint8_t *inp, uint32_t inlength,
                   uint32_t outlength, uint8_t *destination) = 0;
 
+  // Sets a "preset dictionary": data which is expected to be similar to
+  // the compressed data. The same dictionary must be set for decompressing
+  // the data. Returns false if the library does not support dictionaries.
+  virtual bool set_dictionary(const uint8_t *data, uint32_t size) = 0;
+
   // Reserves |n| bytes in the output buffer; can be used by the caller
   // to insert flags or sizes
   void reserve(int n) {
@@ -134,6 +139,12 @@ struct CompressorImpl : public Compressor
     impl.decompress(inp, inlength, destination, outlength);
   }
 
+  // Sets a "preset dictionary"; returns false if the library does not
+  // support dictionaries
+  virtual bool set_dictionary(const uint8_t *data, uint32_t size) {
+    return impl.set_dictionary(data, size);
+  }
+
   // The implementation object
   T impl;
 };
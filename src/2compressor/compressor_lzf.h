@@ -63,6 +63,11 @@ struct LzfCompressor {
     if (!::lzf_decompress(inp, inlength, outp, outlength))
       throw Exception(UPS_INTERNAL_ERROR);
   }
+
+  // Dictionaries are not supported
+  bool set_dictionary(const uint8_t *, uint32_t) {
+    return false;
+  }
 };
 
 }; // namespace upscaledb
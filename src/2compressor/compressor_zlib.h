@@ -37,28 +37,100 @@
 namespace upscaledb {
 
 struct ZlibCompressor {
+  ZlibCompressor()
+    : has_stream(false) {
+  }
+
+  ~ZlibCompressor() {
+    if (has_stream)
+      ::deflateEnd(&stream);
+  }
+
+  // A preset dictionary adds its 4 byte id to the output
   uint32_t compressed_length(uint32_t length) {
-    return ::compressBound(length);
+    return ::compressBound(length) + (dictionary.is_empty() ? 0 : 4);
   }
 
   uint32_t compress(const uint8_t *inp, uint32_t inlength,
                             uint8_t *outp, uint32_t outlength) {
-    uLongf real_outlength = outlength;
-    int zret = ::compress((Bytef *)outp, &real_outlength,
-                      (const Bytef *)inp, inlength);
-    if (zret != 0)
+    if (dictionary.is_empty()) {
+      uLongf real_outlength = outlength;
+      int zret = ::compress((Bytef *)outp, &real_outlength,
+                        (const Bytef *)inp, inlength);
+      if (zret != 0)
+        throw Exception(UPS_INTERNAL_ERROR);
+      return real_outlength;
+    }
+
+    // the stream is re-used; resetting it is cheaper than re-initializing
+    if (::deflateReset(&stream) != Z_OK
+          || ::deflateSetDictionary(&stream, (const Bytef *)dictionary.data(),
+                        dictionary.size()) != Z_OK)
+      throw Exception(UPS_INTERNAL_ERROR);
+    stream.next_in = (Bytef *)inp;
+    stream.avail_in = inlength;
+    stream.next_out = (Bytef *)outp;
+    stream.avail_out = outlength;
+    if (::deflate(&stream, Z_FINISH) != Z_STREAM_END)
       throw Exception(UPS_INTERNAL_ERROR);
-    return real_outlength;
+    return (uint32_t)stream.total_out;
   }
 
+  // Uses a separate stream for each call; data can be decompressed by
+  // several threads in parallel
   void decompress(const uint8_t *inp, uint32_t inlength,
                             uint8_t *outp, uint32_t outlength) {
-    uLongf real_outlength = outlength;
-    int zret = ::uncompress((Bytef *)outp, &real_outlength,
-                          (const Bytef *)inp, inlength);
-    if (zret != 0)
+    if (dictionary.is_empty()) {
+      uLongf real_outlength = outlength;
+      int zret = ::uncompress((Bytef *)outp, &real_outlength,
+                            (const Bytef *)inp, inlength);
+      if (zret != 0)
+        throw Exception(UPS_INTERNAL_ERROR);
+      return;
+    }
+
+    z_stream s;
+    ::memset(&s, 0, sizeof(s));
+    if (::inflateInit(&s) != Z_OK)
       throw Exception(UPS_INTERNAL_ERROR);
+    s.next_in = (Bytef *)inp;
+    s.avail_in = inlength;
+    s.next_out = (Bytef *)outp;
+    s.avail_out = outlength;
+    int zret = ::inflate(&s, Z_FINISH);
+    if (zret == Z_NEED_DICT) {
+      zret = ::inflateSetDictionary(&s, (const Bytef *)dictionary.data(),
+                      dictionary.size());
+      if (zret == Z_OK)
+        zret = ::inflate(&s, Z_FINISH);
+    }
+    ::inflateEnd(&s);
+    if (zret != Z_STREAM_END)
+      throw Exception(UPS_INTERNAL_ERROR);
+  }
+
+  // Sets the preset dictionary; data which was compressed without a
+  // dictionary can still be decompressed
+  bool set_dictionary(const uint8_t *data, uint32_t size) {
+    if (!has_stream) {
+      ::memset(&stream, 0, sizeof(stream));
+      if (::deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+        throw Exception(UPS_INTERNAL_ERROR);
+      has_stream = true;
+    }
+    dictionary.clear();
+    dictionary.append(data, size);
+    return true;
   }
+
+  // The preset dictionary; can be empty
+  ByteArray dictionary;
+
+  // The stream for compressing with a dictionary
+  z_stream stream;
+
+  // True if |stream| was initialized
+  bool has_stream;
 };
 
 }; // namespace upscaledb;
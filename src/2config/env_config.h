@@ -53,7 +53,11 @@ struct EnvConfig
       file_size_limit_bytes(std::numeric_limits<size_t>::max()), 
       remote_timeout_sec(0), journal_compressor(0),
       is_encryption_enabled(false), journal_switch_threshold(0),
-      posix_advice(UPS_POSIX_FADVICE_NORMAL) {
+      posix_advice(UPS_POSIX_FADVICE_NORMAL),
+      cache_policy(UPS_CACHE_POLICY_LRU), flush_threads(1),
+      io_engine(UPS_IO_ENGINE_DEFAULT), recovery_target_sec(0),
+      journal_page_deltas(false), unlogged_new_pages(false),
+      txn_flush_threshold_bytes(UPS_DEFAULT_TXN_FLUSH_THRESHOLD) {
   }
 
   // the environment's flags
@@ -97,6 +101,27 @@ struct EnvConfig
 
   // parameter for posix_fadvise()
   int posix_advice;
+
+  // the eviction policy of the cache
+  int cache_policy;
+
+  // number of threads which flush dirty pages
+  uint32_t flush_threads;
+
+  // the I/O backend of the Device
+  int io_engine;
+
+  // the target recovery time, in seconds (0: unlimited)
+  uint32_t recovery_target_sec;
+
+  // log page deltas instead of full page images
+  bool journal_page_deltas;
+
+  // write new pages directly instead of logging them
+  bool unlogged_new_pages;
+
+  // the memory of committed Txns which is buffered before they are flushed
+  uint64_t txn_flush_threshold_bytes;
 };
 
 } // namespace upscaledb
@@ -90,6 +90,10 @@ struct Device {
   // Writes to the device; this function does not use mmap
   virtual void write(uint64_t offset, void *buffer, size_t len) = 0;
 
+  // Writes the persisted data of |count| pages, sorted by address, with
+  // as few requests as possible; this function does not use mmap
+  virtual void write_pages(Page **pages, size_t count) = 0;
+
   // Allocate storage from this device; this function
   // will *NOT* use mmap. returns the offset of the allocated storage.
   virtual uint64_t alloc(size_t len) = 0;
@@ -97,6 +101,11 @@ struct Device {
   // Reads a page from the device; this function CAN use mmap
   virtual void read_page(Page *page, uint64_t address) = 0;
 
+  // Reads |count| pages from the device with as few requests as possible;
+  // this function CAN use mmap
+  virtual void read_pages(Page **pages, const uint64_t *addresses,
+                  size_t count) = 0;
+
   // Allocate storage for a page from this device; this function
   // can use mmap if available
   virtual void alloc_page(Page *page) = 0;
@@ -21,6 +21,16 @@
  * for most operations, but currently it's possible that the Page is modified
  * if DiskDevice::read_page fails in the middle.
  *
+ * The file is mapped in segments. The first segment covers the file as it
+ * was opened; whenever the file grew by a large enough chunk then another
+ * segment is mapped behind the last one. Segments are only unmapped when
+ * the device is closed, because pages and records can point into them.
+ *
+ * With UPS_ENABLE_DIRECT_IO the file bypasses the operating system's page
+ * cache. Page buffers are then borrowed from an AlignedPool, and unaligned
+ * reads or writes (i.e. of the file header) are bounced through an aligned
+ * buffer.
+ *
  * @exception_safe: basic/strong
  * @thread_safe: no
  */
@@ -28,14 +38,18 @@
 #ifndef UPS_DEVICE_DISK_H
 #define UPS_DEVICE_DISK_H
 
+#include <algorithm>
 #include <utility>
+#include <boost/integer/common_factor.hpp>
 
 #include "0root/root.h"
 
 // Always verify that a file of level N does not include headers > N!
 #include "1base/error.h"
 #include "1base/dynamic_array.h"
+#include "1base/scoped_ptr.h"
 #include "1mem/mem.h"
+#include "1mem/aligned_pool.h"
 #include "1os/file.h"
 #ifdef UPS_ENABLE_ENCRYPTION
 #  include "2aes/aes.h"
@@ -53,6 +67,28 @@ namespace upscaledb {
  * a File-based device
  */
 class DiskDevice : public Device {
+  public:
+    enum {
+      // the maximum number of mapped segments
+      kMaxMappedSegments = 64,
+
+      // the minimum size of a new segment
+      kMinMappingIncrement = 64 * 1024 * 1024
+    };
+
+  protected:
+    // A mapped range of the file
+    struct MappedSegment {
+      // the file offset of the first byte
+      uint64_t address;
+
+      // the size of the range
+      uint64_t size;
+
+      // pointer to the mapped data
+      uint8_t *ptr;
+    };
+
     struct State {
       State() = default;
       State(const State&) = delete;
@@ -61,19 +97,25 @@ class DiskDevice : public Device {
 #if defined(_MSC_VER)
 	  State(State&& rhs){
 		  file = std::move(rhs.file);
-		  mmapptr = rhs.mmapptr;
+		  ::memcpy(segments, rhs.segments, sizeof(segments));
+		  segment_count = rhs.segment_count;
 		  mapped_size = rhs.mapped_size;
+		  grow_mapping = rhs.grow_mapping;
 		  file_size = rhs.file_size;
 		  excess_at_end = rhs.excess_at_end;
+		  direct_io = rhs.direct_io;
 	  }
 
 	  State& operator=(State&& rhs)
 	  {
 		  file = std::move(rhs.file);
-		  mmapptr = rhs.mmapptr;
+		  ::memcpy(segments, rhs.segments, sizeof(segments));
+		  segment_count = rhs.segment_count;
 		  mapped_size = rhs.mapped_size;
+		  grow_mapping = rhs.grow_mapping;
 		  file_size = rhs.file_size;
 		  excess_at_end = rhs.excess_at_end;
+		  direct_io = rhs.direct_io;
 		  return *this;
 	  }
 #else
@@ -84,18 +126,29 @@ class DiskDevice : public Device {
       // the database file
       File file;
 
-      // pointer to the the mmapped data
-      uint8_t *mmapptr;
+      // the mapped segments; they are adjacent, the first one starts at
+      // offset 0. This is a fixed array, therefore a pointer to a segment
+      // remains valid when more segments are mapped
+      MappedSegment segments[kMaxMappedSegments];
+
+      // the number of used |segments|
+      size_t segment_count;
 
-      // the size of mmapptr as used in mmap
+      // the total size of all mapped segments
       uint64_t mapped_size;
 
+      // true if more segments are mapped when the file grows
+      bool grow_mapping;
+
       // the (cached) size of the file
       uint64_t file_size;
 
       // excess storage at the end of the file
       uint64_t excess_at_end;
 
+      // true if the file bypasses the operating system's page cache
+      bool direct_io;
+
       // Allow state to be swapped
       friend void swap(State& oldState, State& newState) 
       {
@@ -107,10 +160,12 @@ class DiskDevice : public Device {
     DiskDevice(const EnvConfig &config)
       : Device(config) {
       State state;
-      state.mmapptr = 0;
+      state.segment_count = 0;
       state.mapped_size = 0;
+      state.grow_mapping = false;
       state.file_size = 0;
       state.excess_at_end = 0;
+      state.direct_io = false;
       swap(m_state, state);
     }
 
@@ -122,11 +177,17 @@ class DiskDevice : public Device {
       file.create(config.filename.c_str(), config.file_mode);
       file.set_posix_advice(config.posix_advice);
       m_state.file = std::move(file);
+      m_state.grow_mapping = NOTSET(config.flags, UPS_DISABLE_MMAP);
+
+      if (ISSET(config.flags, UPS_ENABLE_DIRECT_IO))
+        m_state.direct_io = enable_direct_io(m_state.file);
     }
 
     // opens an existing device
     //
-    // tries to map the file; if it fails then continue with read/write 
+    // tries to map the file; if it fails then continue with read/write.
+    // If the file is not mapped because its size is not aligned then it
+    // will be mapped as soon as it grows
     virtual void open() {
       bool read_only = (config.flags & UPS_READ_ONLY) != 0;
 
@@ -139,11 +200,20 @@ class DiskDevice : public Device {
       // the file size which backs the mapped ptr
       state.file_size = state.file.file_size();
 
+      // a file with a page size which is not aligned for direct I/O
+      // (i.e. 1024 bytes) can be shorter than a single aligned block; then
+      // the header cannot be read. The caller will reject the page size
+      if (ISSET(config.flags, UPS_ENABLE_DIRECT_IO)
+            && state.file_size % File::kDirectIoAlignment == 0)
+        state.direct_io = enable_direct_io(state.file);
+
       if (ISSET(config.flags, UPS_DISABLE_MMAP)) {
         swap(m_state, state);
         return;
       }
 
+      state.grow_mapping = true;
+
       // make sure we do not exceed the "real" size of the file, otherwise
       // we crash when accessing memory which exceeds the mapping (at least
       // on Win32)
@@ -153,14 +223,8 @@ class DiskDevice : public Device {
         return;
       }
 
-      state.mapped_size = state.file_size;
-      try {
-        state.file.mmap(0, state.mapped_size, read_only, &state.mmapptr);
-      }
-      catch (Exception &ex) {
-        ups_log(("mmap failed with error %d, falling back to read/write",
-                    ex.code));
-      }
+      if (!map_segment(state, state.file_size))
+        state.grow_mapping = false;
       swap(m_state, state);
     }
 
@@ -174,9 +238,14 @@ class DiskDevice : public Device {
     virtual void close() {
       ScopedSpinlock lock(m_mutex);
       State state = std::move(m_state);
-      if (state.mmapptr)
-        state.file.munmap(state.mmapptr, state.mapped_size);
+      for (size_t i = 0; i < state.segment_count; i++)
+        state.file.munmap(state.segments[i].ptr,
+                        (size_t)state.segments[i].size);
+      state.segment_count = 0;
+      state.mapped_size = 0;
+      state.grow_mapping = false;
       state.file.close();
+      state.direct_io = false;
 
       swap(m_state, state);
     }
@@ -215,7 +284,10 @@ class DiskDevice : public Device {
     // reads from the device; this function does NOT use mmap
     virtual void read(uint64_t offset, void *buffer, size_t len) {
       ScopedSpinlock lock(m_mutex);
-      m_state.file.pread(offset, buffer, len);
+      if (unlikely(m_state.direct_io && !is_aligned(offset, buffer, len)))
+        read_unaligned(offset, buffer, len);
+      else
+        m_state.file.pread(offset, buffer, len);
 #ifdef UPS_ENABLE_ENCRYPTION
       if (config.is_encryption_enabled) {
         AesCipher aes(config.encryption_key, offset);
@@ -241,7 +313,40 @@ class DiskDevice : public Device {
         return;
       }
 #endif
-      m_state.file.pwrite(offset, buffer, len);
+      if (unlikely(m_state.direct_io && !is_aligned(offset, buffer, len)))
+        write_unaligned(offset, buffer, len);
+      else
+        m_state.file.pwrite(offset, buffer, len);
+    }
+
+    // writes multiple pages; adjacent pages are coalesced into a single
+    // vectored write. Positional writes to disjoint ranges do not interfere,
+    // therefore the mutex is not held during the I/O and the flusher
+    // threads can write in parallel
+    virtual void write_pages(Page **pages, size_t count) {
+      void *buffers[Page::kMaxFlushBatch];
+      size_t page_size = config.page_size_bytes;
+
+      for (size_t i = 0; i < count; ) {
+        uint64_t address = pages[i]->address();
+        size_t n = 0;
+        while (i + n < count && n < Page::kMaxFlushBatch
+                && pages[i + n]->address() == address + n * page_size) {
+          buffers[n] = pages[i + n]->data();
+          n++;
+        }
+
+#ifdef UPS_ENABLE_ENCRYPTION
+        if (config.is_encryption_enabled) {
+          for (size_t j = 0; j < n; j++)
+            write(address + j * page_size, buffers[j], page_size);
+          i += n;
+          continue;
+        }
+#endif
+        m_state.file.pwritev(address, buffers, n, page_size);
+        i += n;
+      }
     }
 
     // allocate storage from this device; this function
@@ -292,21 +397,21 @@ class DiskDevice : public Device {
       ScopedSpinlock lock(m_mutex);
       // if this page is in the mapped area: return a pointer into that area.
       // otherwise fall back to read/write.
-      if (address < m_state.mapped_size && m_state.mmapptr != 0) {
+      uint8_t *p = mapped_page_nolock(address);
+      if (p != 0) {
         // the following line will not throw a C++ exception, but can
         // raise a signal. If that's the case then we don't catch it because
         // something is seriously wrong and proper recovery is not possible.
-        page->assign_mapped_buffer(&m_state.mmapptr[address], address);
+        page->assign_mapped_buffer(p, address);
         return;
       }
 
       // this page is not in the mapped area; allocate a buffer
       if (page->data() == 0) {
-        // note that |p| will not leak if file.pread() throws; |p| is stored
-        // in the |page| object and will be cleaned up by the caller in
-        // case of an exception.
-        uint8_t *p = Memory::allocate<uint8_t>(config.page_size_bytes);
-        page->assign_allocated_buffer(p, address);
+        // note that the buffer will not leak if file.pread() throws; it
+        // is stored in the |page| object and will be cleaned up by the
+        // caller in case of an exception.
+        assign_page_buffer(page, address);
       }
 
       m_state.file.pread(address, page->data(), config.page_size_bytes);
@@ -319,6 +424,13 @@ class DiskDevice : public Device {
 #endif
     }
 
+    // reads multiple pages from the device
+    virtual void read_pages(Page **pages, const uint64_t *addresses,
+                    size_t count) {
+      for (size_t i = 0; i < count; i++)
+        read_page(pages[i], addresses[i]);
+    }
+
     // Allocates storage for a page from this device; this function
     // will *NOT* return mmapped memory
     virtual void alloc_page(Page *page) {
@@ -326,8 +438,7 @@ class DiskDevice : public Device {
       page->set_address(address);
 
       // allocate a memory buffer
-      uint8_t *p = Memory::allocate<uint8_t>(config.page_size_bytes);
-      page->assign_allocated_buffer(p, address);
+      assign_page_buffer(page, address);
     }
 
     // Frees a page on the device; plays counterpoint to |alloc_page|
@@ -337,9 +448,14 @@ class DiskDevice : public Device {
       page->free_buffer();
     }
 
-    // Returns true if the specified range is in mapped memory
+    // Returns true if the specified range is in mapped memory. The range
+    // must not span two segments because they are not adjacent in memory
     virtual bool is_mapped(uint64_t file_offset, size_t size) const {
-      return file_offset + size <= m_state.mapped_size;
+      ScopedSpinlock lock(m_mutex);
+      if (file_offset + size > m_state.mapped_size)
+        return false;
+      const MappedSegment *segment = find_segment(file_offset);
+      return file_offset + size <= segment->address + segment->size;
     }
 
     // Removes unused space at the end of the file
@@ -353,10 +469,195 @@ class DiskDevice : public Device {
 
     // Returns a pointer directly into mapped memory
     uint8_t *mapped_pointer(uint64_t address) const {
-      return &m_state.mmapptr[address];
+      ScopedSpinlock lock(m_mutex);
+      const MappedSegment *segment = find_segment(address);
+      return &segment->ptr[address - segment->address];
+    }
+
+    // Returns the number of mapped segments
+    size_t mapped_segment_count() {
+      ScopedSpinlock lock(m_mutex);
+      return m_state.segment_count;
+    }
+
+    // Returns true if the file bypasses the operating system's page cache
+    bool is_direct_io() {
+      ScopedSpinlock lock(m_mutex);
+      return m_state.direct_io;
+    }
+
+  protected:
+    // Returns the segment which contains |address|; the address must be
+    // mapped
+    const MappedSegment *find_segment(uint64_t address) const {
+      assert(address < m_state.mapped_size);
+      size_t lo = 0, hi = m_state.segment_count;
+      while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (m_state.segments[mid].address <= address)
+          lo = mid;
+        else
+          hi = mid;
+      }
+      return &m_state.segments[lo];
+    }
+
+    // Returns a pointer to the mapped page at |address|, or null if the
+    // page is not mapped. Maps a new segment if the file grew far enough
+    // beyond the mapped area. Sans locking
+    uint8_t *mapped_page_nolock(uint64_t address) {
+      if (address >= m_state.mapped_size && !grow_mapping_nolock(address))
+        return 0;
+      const MappedSegment *segment = find_segment(address);
+      return &segment->ptr[address - segment->address];
+    }
+
+    // Maps a new segment behind the last one if the unmapped part of the
+    // file is large enough; returns true if |address| is now mapped.
+    //
+    // The new segment grows with the mapped size (by at least 25%) to
+    // limit the number of segments. Its end is aligned to the page size,
+    // otherwise a page could span two segments. Disabled on Win32
+    // because a File only has a single mapping handle
+    bool grow_mapping_nolock(uint64_t address) {
+#ifdef WIN32
+      (void)address;
+      return false;
+#else
+      if (!m_state.grow_mapping
+            || m_state.segment_count == kMaxMappedSegments)
+        return false;
+
+      uint64_t increment = std::max((uint64_t)kMinMappingIncrement,
+                      m_state.mapped_size / 4);
+      uint64_t alignment = boost::integer::lcm((uint64_t)File::granularity(),
+                      (uint64_t)config.page_size_bytes);
+      uint64_t end = m_state.file_size - m_state.file_size % alignment;
+      if (end <= address || end - m_state.mapped_size < increment)
+        return false;
+
+      if (!map_segment(m_state, end)) {
+        m_state.grow_mapping = false;
+        return false;
+      }
+      return true;
+#endif
+    }
+
+    // Maps the range between the last segment and |end|; returns false
+    // if mmap failed
+    bool map_segment(State &state, uint64_t end) {
+      bool read_only = ISSET(config.flags, UPS_READ_ONLY);
+      MappedSegment &segment = state.segments[state.segment_count];
+      segment.address = state.mapped_size;
+      segment.size = end - state.mapped_size;
+      try {
+        state.file.mmap(segment.address, (size_t)segment.size, read_only,
+                        &segment.ptr);
+      }
+      catch (Exception &ex) {
+        ups_log(("mmap failed with error %d, falling back to read/write",
+                    ex.code));
+        return false;
+      }
+
+      state.segment_count++;
+      state.mapped_size = end;
+      return true;
+    }
+
+    // Enables direct I/O for |file|; falls back to buffered I/O if the
+    // platform or the file system does not support it
+    static bool enable_direct_io(File &file) {
+      if (file.set_direct_io(true))
+        return true;
+      ups_log(("direct I/O is not supported, falling back to buffered I/O"));
+      return false;
+    }
+
+    // Returns true if a request can be sent to a file with direct I/O
+    static bool is_aligned(uint64_t offset, const void *buffer, size_t len) {
+      return offset % File::kDirectIoAlignment == 0
+              && len % File::kDirectIoAlignment == 0
+              && (size_t)buffer % File::kDirectIoAlignment == 0;
+    }
+
+    // Allocates a buffer for a page and assigns it. With direct I/O the
+    // buffers are borrowed from |m_pool|, which is created on demand
+    // because the page size of an existing file is only known after the
+    // header was read
+    void assign_page_buffer(Page *page, uint64_t address) {
+      if (ISSET(config.flags, UPS_ENABLE_DIRECT_IO)) {
+        {
+          ScopedSpinlock lock(m_pool_mutex);
+          if (unlikely(!m_pool.get()))
+            m_pool.reset(new AlignedPool(config.page_size_bytes,
+                                    File::kDirectIoAlignment));
+        }
+        assert(m_pool->buffer_size() == config.page_size_bytes);
+        page->assign_allocated_buffer(m_pool->allocate(), address,
+                        m_pool.get());
+        return;
+      }
+
+      uint8_t *p = Memory::allocate<uint8_t>(config.page_size_bytes);
+      page->assign_allocated_buffer(p, address);
+    }
+
+    // Reads an unaligned range through an aligned bounce buffer,
+    // sans locking
+    void read_unaligned(uint64_t offset, void *buffer, size_t len) {
+      uint64_t start, end;
+      aligned_range(offset, len, &start, &end);
+
+      uint8_t *p = Memory::allocate_aligned<uint8_t>((size_t)(end - start),
+                      File::kDirectIoAlignment);
+      try {
+        m_state.file.pread(start, p, (size_t)(end - start));
+        ::memcpy(buffer, p + (offset - start), len);
+      }
+      catch (Exception &) {
+        Memory::release_aligned(p);
+        throw;
+      }
+      Memory::release_aligned(p);
+    }
+
+    // Writes an unaligned range through an aligned bounce buffer; the
+    // surrounding bytes are read first (read-modify-write), sans locking
+    void write_unaligned(uint64_t offset, const void *buffer, size_t len) {
+      uint64_t start, end;
+      aligned_range(offset, len, &start, &end);
+
+      uint8_t *p = Memory::allocate_aligned<uint8_t>((size_t)(end - start),
+                      File::kDirectIoAlignment);
+      try {
+        // only read what is backed by the file; the remainder is zeroed
+        uint64_t existing = m_state.file_size > start
+                              ? std::min(m_state.file_size, end) - start
+                              : 0;
+        existing -= existing % File::kDirectIoAlignment;
+        if (existing > 0)
+          m_state.file.pread(start, p, (size_t)existing);
+        ::memset(p + existing, 0, (size_t)(end - start - existing));
+        ::memcpy(p + (offset - start), buffer, len);
+        m_state.file.pwrite(start, p, (size_t)(end - start));
+      }
+      catch (Exception &) {
+        Memory::release_aligned(p);
+        throw;
+      }
+      Memory::release_aligned(p);
+    }
+
+    // Widens [offset, offset + len) to the direct I/O alignment
+    static void aligned_range(uint64_t offset, size_t len, uint64_t *start,
+                    uint64_t *end) {
+      const uint64_t alignment = File::kDirectIoAlignment;
+      *start = offset - offset % alignment;
+      *end = ((offset + len + alignment - 1) / alignment) * alignment;
     }
 
-  private:
     // truncate/resize the device, sans locking
     void truncate_nolock(uint64_t new_file_size) {
       if (new_file_size > config.file_size_limit_bytes)
@@ -366,9 +667,15 @@ class DiskDevice : public Device {
     }
 
     // For synchronizing access
-    Spinlock m_mutex;
+    mutable Spinlock m_mutex;
 
     State m_state;
+
+    // Protects the creation of |m_pool|
+    Spinlock m_pool_mutex;
+
+    // The page buffers for direct I/O
+    ScopedPtr<AlignedPool> m_pool;
 };
 
 } // namespace upscaledb
@@ -32,6 +32,7 @@
 #include "2config/env_config.h"
 #include "2device/device_disk.h"
 #include "2device/device_inmem.h"
+#include "2device/device_uring.h"
 
 #ifndef UPS_ROOT_H
 #  error "root.h was not included"
@@ -44,8 +45,13 @@ struct DeviceFactory {
   static Device *create(const EnvConfig &config) {
     if (ISSET(config.flags, UPS_IN_MEMORY))
       return new InMemoryDevice(config);
-    else
-      return new DiskDevice(config);
+#ifdef HAVE_LINUX_IO_URING_H
+    // fall back to the DiskDevice if the kernel does not support io_uring
+    if (config.io_engine == UPS_IO_ENGINE_IO_URING
+          && IoUring::is_supported())
+      return new UringDevice(config);
+#endif
+    return new DiskDevice(config);
   }
 };
 
@@ -106,12 +106,23 @@ struct InMemoryDevice : public Device {
   virtual void write(uint64_t offset, void *buffer, size_t len) {
   }
 
+  // writes multiple pages to the device
+  virtual void write_pages(Page **pages, size_t count) {
+  }
+
   // reads a page from the device 
   virtual void read_page(Page *page, uint64_t address) {
     assert(!"operation is not possible for in-memory-databases");
     throw Exception(UPS_NOT_IMPLEMENTED);
   }
 
+  // reads multiple pages from the device
+  virtual void read_pages(Page **pages, const uint64_t *addresses,
+                  size_t count) {
+    assert(!"operation is not possible for in-memory-databases");
+    throw Exception(UPS_NOT_IMPLEMENTED);
+  }
+
   // allocate storage from this device; this function
   // will *NOT* use mmap.  
   virtual uint64_t alloc(size_t size) {
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2005-2017 Christoph Rupp (chris@crupp.de).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See the file COPYING for License information.
+ */
+
+/*
+ * Device-implementation for disk-based files which uses Linux' io_uring
+ * for batched requests. All other operations (and the memory mapping) are
+ * inherited from the DiskDevice.
+ *
+ * Batched reads (|read_pages|) and writes (|write_pages|) are queued in a
+ * ring and submitted with a single system call. Every thread which
+ * performs batched I/O borrows a ring from a small pool, therefore the
+ * flusher threads can submit their requests in parallel.
+ *
+ * @exception_safe: basic
+ * @thread_safe: no
+ */
+
+#ifndef UPS_DEVICE_URING_H
+#define UPS_DEVICE_URING_H
+
+#include "0root/root.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <vector>
+
+// Always verify that a file of level N does not include headers > N!
+#include "1os/io_uring.h"
+#include "2device/device_disk.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+class UringDevice : public DiskDevice {
+    // Borrows a ring from the pool, and returns it when going out of scope
+    struct ScopedRing {
+      ScopedRing(UringDevice *device_)
+        : device(device_), ring(device_->acquire_ring()) {
+      }
+
+      ~ScopedRing() {
+        device->release_ring(ring);
+      }
+
+      UringDevice *device;
+      IoUring *ring;
+    };
+
+  public:
+    UringDevice(const EnvConfig &config)
+      : DiskDevice(config) {
+    }
+
+    virtual ~UringDevice() {
+      for (size_t i = 0; i < m_rings.size(); i++)
+        delete m_rings[i];
+    }
+
+    // reads multiple pages with a single system call; mapped pages are
+    // assigned immediately
+    virtual void read_pages(Page **pages, const uint64_t *addresses,
+                    size_t count) {
+#ifdef UPS_ENABLE_ENCRYPTION
+      if (config.is_encryption_enabled) {
+        DiskDevice::read_pages(pages, addresses, count);
+        return;
+      }
+#endif
+      ScopedRing sr(this);
+
+      {
+        ScopedSpinlock lock(m_mutex);
+        int fd = m_state.file.fd();
+
+        for (size_t i = 0; i < count; i++) {
+          uint64_t address = addresses[i];
+          Page *page = pages[i];
+
+          uint8_t *p = mapped_page_nolock(address);
+          if (p != 0) {
+            page->assign_mapped_buffer(p, address);
+            continue;
+          }
+
+          if (page->data() == 0)
+            assign_page_buffer(page, address);
+          sr.ring->prepare_read(fd, page->data(), config.page_size_bytes,
+                          address);
+        }
+      }
+
+      sr.ring->submit_and_wait();
+    }
+
+    // writes multiple pages with a single system call; each run of
+    // adjacent pages becomes a single vectored write
+    virtual void write_pages(Page **pages, size_t count) {
+#ifdef UPS_ENABLE_ENCRYPTION
+      if (config.is_encryption_enabled) {
+        DiskDevice::write_pages(pages, count);
+        return;
+      }
+#endif
+      struct iovec iov[Page::kMaxFlushBatch];
+      size_t page_size = config.page_size_bytes;
+      assert(count <= Page::kMaxFlushBatch);
+
+      ScopedRing sr(this);
+      int fd = m_state.file.fd();
+
+      for (size_t i = 0; i < count; ) {
+        uint64_t address = pages[i]->address();
+        size_t n = 0;
+        while (i + n < count
+                && pages[i + n]->address() == address + n * page_size) {
+          iov[i + n].iov_base = pages[i + n]->data();
+          iov[i + n].iov_len = page_size;
+          n++;
+        }
+        sr.ring->prepare_writev(fd, &iov[i], (unsigned)n, address);
+        i += n;
+      }
+      sr.ring->submit_and_wait();
+    }
+
+  private:
+    // Returns an idle ring from the pool, or creates a new one
+    IoUring *acquire_ring() {
+      {
+        ScopedSpinlock lock(m_ring_mutex);
+        if (!m_rings.empty()) {
+          IoUring *ring = m_rings.back();
+          m_rings.pop_back();
+          return ring;
+        }
+      }
+      return new IoUring(Page::kMaxFlushBatch);
+    }
+
+    // Returns a ring to the pool
+    void release_ring(IoUring *ring) {
+      ScopedSpinlock lock(m_ring_mutex);
+      m_rings.push_back(ring);
+    }
+
+    // Protects |m_rings|
+    Spinlock m_ring_mutex;
+
+    // The idle rings
+    std::vector<IoUring *> m_rings;
+};
+
+} // namespace upscaledb
+
+#endif // HAVE_LINUX_IO_URING_H
+
+#endif /* UPS_DEVICE_URING_H */
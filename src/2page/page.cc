@@ -29,10 +29,11 @@
 
 namespace upscaledb {
 
-uint64_t Page::ms_page_count_flushed = 0;
+boost::atomic<uint64_t> Page::ms_page_count_flushed(0);
 
 Page::Page(Device *device, LocalDb *db)
-  : device_(device), db_(db), node_proxy_(0)
+  : device_(device), db_(db), node_proxy_(0), is_disk_image_valid_(false),
+    is_new_(false)
 {
   persisted_data.raw_data = 0;
   persisted_data.is_dirty = false;
@@ -58,6 +59,8 @@ void
 Page::alloc(uint32_t type, uint32_t flags)
 {
   device_->alloc_page(this);
+  is_disk_image_valid_ = false;
+  is_new_ = true;
 
   if (flags & kInitializeWithZeroes) {
     size_t page_size = device_->page_size();
@@ -71,6 +74,8 @@ Page::alloc(uint32_t type, uint32_t flags)
 void
 Page::fetch(uint64_t address)
 {
+  is_disk_image_valid_ = false;
+  is_new_ = false;
   device_->read_page(this, address);
   set_address(address);
 }
@@ -79,21 +84,59 @@ void
 Page::flush()
 {
   if (persisted_data.is_dirty) {
-    // update crc32
-    if (ISSET(device_->config.flags, UPS_ENABLE_CRC32)
-        && likely(!persisted_data.is_without_header)) {
-      MurmurHash3_x86_32(persisted_data.raw_data->header.payload,
-                         persisted_data.size - (sizeof(PPageHeader) - 1),
-                         (uint32_t)persisted_data.address,
-                         &persisted_data.raw_data->header.crc32);
-    }
+    update_crc32();
+    is_disk_image_valid_ = false;
     device_->write(persisted_data.address, persisted_data.raw_data,
                     persisted_data.size);
     persisted_data.is_dirty = false;
+    is_new_ = false;
+    update_disk_image();
     ms_page_count_flushed++;
   }
 }
 
+void
+Page::flush(Page **pages, size_t count)
+{
+  assert(count > 0 && count <= kMaxFlushBatch);
+
+  for (size_t i = 0; i < count; i++) {
+    assert(i == 0 || pages[i]->address() > pages[i - 1]->address());
+    pages[i]->update_crc32();
+    pages[i]->is_disk_image_valid_ = false;
+  }
+
+  pages[0]->device_->write_pages(pages, count);
+
+  for (size_t i = 0; i < count; i++) {
+    pages[i]->persisted_data.is_dirty = false;
+    pages[i]->is_new_ = false;
+    pages[i]->update_disk_image();
+  }
+  ms_page_count_flushed += count;
+}
+
+void
+Page::update_crc32()
+{
+  if (ISSET(device_->config.flags, UPS_ENABLE_CRC32)
+      && likely(!persisted_data.is_without_header)) {
+    MurmurHash3_x86_32(persisted_data.raw_data->header.payload,
+                       persisted_data.size - (sizeof(PPageHeader) - 1),
+                       (uint32_t)persisted_data.address,
+                       &persisted_data.raw_data->header.crc32);
+  }
+}
+
+void
+Page::update_disk_image()
+{
+  if (!disk_image_.is_empty()) {
+    ::memcpy(disk_image_.data(), persisted_data.raw_data, persisted_data.size);
+    is_disk_image_valid_ = true;
+  }
+}
+
 void
 Page::free_buffer()
 {
@@ -23,8 +23,10 @@
 #include <stdint.h>
 
 #include "1base/error.h"
+#include "1base/dynamic_array.h"
 #include "1base/spinlock.h"
 #include "1mem/mem.h"
+#include "1mem/aligned_pool.h"
 #include "1base/intrusive_list.h"
 #include "3btree/btree_cursor.h"
 
@@ -84,26 +86,32 @@ class Page {
     struct PersistedData {
       PersistedData()
         : address(0), size(0), is_dirty(false), is_allocated(false),
-          is_without_header(false), raw_data(0) {
+          is_without_header(false), raw_data(0), pool(0) {
       }
 
       PersistedData(const PersistedData &other)
         : address(other.address), size(other.size), is_dirty(other.is_dirty),
           is_allocated(other.is_allocated),
-          is_without_header(other.is_without_header), raw_data(other.raw_data) {
+          is_without_header(other.is_without_header), raw_data(other.raw_data),
+          pool(other.pool) {
       }
 
       ~PersistedData() {
 #ifdef NDEBUG
         mutex.safe_unlock();
 #endif
-        if (is_allocated)
-          Memory::release(raw_data);
+        if (is_allocated) {
+          if (pool)
+            pool->release(raw_data);
+          else
+            Memory::release(raw_data);
+        }
         raw_data = 0;
       }
 
-      // The spinlock is locked if the page is in use or written to disk
-      Spinlock mutex;
+      // The latch is locked exclusively if the page is in use or written to
+      // disk; concurrent lookups lock it in shared mode
+      RwSpinlock mutex;
 
       // address of this page - the absolute offset in the file
       uint64_t address;
@@ -123,6 +131,10 @@ class Page {
 
       // the persistent data of this page
       PPageData *raw_data;
+
+      // the pool which owns |raw_data|; null if the buffer was allocated
+      // with malloc()
+      AlignedPool *pool;
     };
 
     // Misc. enums
@@ -132,6 +144,10 @@ class Page {
 
       // instruct Page::alloc() to reset the page with zeroes
       kInitializeWithZeroes,
+
+      // max. number of pages which are flushed with a single call to
+      // Device::write_pages()
+      kMaxFlushBatch = 64,
     };
 
     // The various linked lists (indices in m_prev, m_next)
@@ -145,8 +161,11 @@ class Page {
       // a bucket in the hash table of the cache
       kListBucket             = 2,
 
+      // probationary queue of the cache
+      kListProbation          = 3,
+
       // array limit
-      kListMax                = 3
+      kListMax                = 4
     };
 
     // non-persistent page flags
@@ -195,11 +214,31 @@ class Page {
     // (page_size minus the overhead of the page header)
     uint32_t usable_page_size();
 
-    // Returns the spinlock
-    Spinlock &mutex() {
+    // Returns the latch
+    RwSpinlock &mutex() {
       return persisted_data.mutex;
     }
 
+    // Returns the version of the page. The page is only modified while
+    // its latch is held exclusively, and the version is incremented when
+    // the latch is acquired and released; it is odd while the page is
+    // modified.
+    uint32_t version() const {
+      return persisted_data.mutex.version();
+    }
+
+    // Returns true if the page was not modified since |version| was
+    // retrieved
+    bool validate_version(uint32_t version) const {
+      return persisted_data.mutex.validate(version);
+    }
+
+    // Returns the spinlock which protects |cursor_list| and the cached
+    // BtreeNodeProxy if lookups run in parallel (UPS_ENABLE_CONCURRENT_READS)
+    Spinlock &cursor_mutex() {
+      return cursor_mutex_;
+    }
+
     // Returns the database which manages this page; can be NULL if this
     // page belongs to the Environment (i.e. for freelist-pages)
     LocalDb *db() {
@@ -301,25 +340,62 @@ class Page {
       persisted_data.is_without_header = is_without_header;
     }
 
-    // Assign a buffer which was allocated with malloc()
-    void assign_allocated_buffer(void *buffer, uint64_t address) {
+    // Assign a buffer which was allocated with malloc(), or which was
+    // borrowed from |pool|
+    void assign_allocated_buffer(void *buffer, uint64_t address,
+                    AlignedPool *pool = 0) {
       free_buffer();
+      is_disk_image_valid_ = false;
       persisted_data.raw_data = (PPageData *)buffer;
       persisted_data.is_allocated = true;
       persisted_data.address = address;
+      persisted_data.pool = pool;
     }
 
     // Assign a buffer from mmapped storage
     void assign_mapped_buffer(void *buffer, uint64_t address) {
       free_buffer();
+      is_disk_image_valid_ = false;
       persisted_data.raw_data = (PPageData *)buffer;
       persisted_data.is_allocated = false;
       persisted_data.address = address;
+      persisted_data.pool = 0;
     }
 
     // Free resources associated with the buffer
     void free_buffer();
 
+    // Returns true if the page was appended to the file by alloc() and was
+    // not yet written; nothing on disk refers to such a page
+    bool is_new() const {
+      return is_new_;
+    }
+
+    // Keeps a copy of the page data whenever the page is written to disk.
+    // The journal logs the differences to this copy instead of the
+    // whole page (see UPS_PARAM_JOURNAL_PAGE_DELTAS)
+    void keep_disk_image() {
+      if (disk_image_.is_empty())
+        disk_image_.resize(persisted_data.size);
+    }
+
+    // Returns true if the page keeps a copy of its data on disk
+    bool has_disk_image() const {
+      return !disk_image_.is_empty();
+    }
+
+    // Releases the copy of the page data
+    void release_disk_image() {
+      disk_image_.clear();
+      is_disk_image_valid_ = false;
+    }
+
+    // Returns the page data as it was last written to disk, or null if
+    // it is unknown
+    const uint8_t *disk_image() const {
+      return is_disk_image_valid_ ? disk_image_.data() : 0;
+    }
+
     // Allocates a new page from the device
     // |flags|: either 0 or kInitializeWithZeroes
     void alloc(uint32_t type, uint32_t flags = 0);
@@ -330,6 +406,11 @@ class Page {
     // Flushes the page to disk, clears the "dirty" flag
     void flush();
 
+    // Flushes |count| dirty pages, sorted by address, with as few device
+    // requests as possible; clears their "dirty" flags. |count| must not
+    // exceed |kMaxFlushBatch|
+    static void flush(Page **pages, size_t count);
+
     // Returns the cached BtreeNodeProxy
     BtreeNodeProxy *node_proxy() {
       return node_proxy_;
@@ -351,7 +432,7 @@ class Page {
     }
 
     // tracks number of flushed pages
-    static uint64_t ms_page_count_flushed;
+    static boost::atomic<uint64_t> ms_page_count_flushed;
 
     // the persistent data of this page
     PersistedData persisted_data;
@@ -363,6 +444,12 @@ class Page {
     IntrusiveList<BtreeCursor> cursor_list;
 
   private:
+    // Updates the crc32 of the page header, if enabled
+    void update_crc32();
+
+    // Refreshes the copy of the page data after it was written to disk
+    void update_disk_image();
+
     // the Device for allocating storage
     Device *device_;
 
@@ -371,6 +458,19 @@ class Page {
 
     // the cached BtreeNodeProxy object
     BtreeNodeProxy *node_proxy_;
+
+    // protects |cursor_list| and |node_proxy_|
+    Spinlock cursor_mutex_;
+
+    // a copy of the page data as it was last written to disk; empty
+    // unless keep_disk_image() was called
+    ByteArray disk_image_;
+
+    // true if |disk_image_| is identical to the data on disk
+    bool is_disk_image_valid_;
+
+    // true if the page was allocated but not yet written
+    bool is_new_;
 };
 
 } // namespace upscaledb
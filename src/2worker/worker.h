@@ -59,12 +59,24 @@ struct WorkerPool {
       workers.push_back(new boost::thread(WorkerThread(*this)));
   }
 
-  // Add a new work item to the pool
+  // Add a new work item to the pool; all items are processed in order
   template<typename F>
   void enqueue(F &f) {
     strand.post(f);
   }
 
+  // Add a new work item which is processed by any idle thread, in
+  // parallel to the (serialized) items of the strand
+  template<typename F>
+  void enqueue_parallel(F f) {
+    service.post(f);
+  }
+
+  // Returns the number of threads
+  size_t size() const {
+    return workers.size();
+  }
+
   // the destructor joins all threads
   ~WorkerPool() {
     service.stop();
@@ -27,6 +27,8 @@
 
 #include "0root/root.h"
 
+#include <boost/atomic.hpp>
+
 #include "ups/upscaledb_int.h"
 
 // Always verify that a file of level N does not include headers > N!
@@ -179,8 +181,8 @@ struct BlobManager {
   // Usage tracking - number of blobs allocated
   uint64_t metric_total_allocated;
 
-  // Usage tracking - number of blobs read
-  uint64_t metric_total_read;
+  // Usage tracking - number of blobs read; updated by concurrent lookups
+  boost::atomic<uint64_t> metric_total_read;
 };
 
 } // namespace upscaledb
@@ -19,6 +19,8 @@
 #include "0root/root.h"
 
 #include <string.h>
+#include <algorithm>
+#include <vector>
 
 // Always verify that a file of level N does not include headers > N!
 #include "1base/error.h"
@@ -39,7 +41,10 @@ namespace upscaledb {
 static inline void
 remove_cursor_from_page(BtreeCursor *cursor, Page *page)
 {
-  page->cursor_list.del(cursor);
+  {
+    ScopedSpinlock lock(page->cursor_mutex());
+    page->cursor_list.del(cursor);
+  }
 
   BtreeCursorState &st_ = cursor->st_;
   st_.coupled_page = 0;
@@ -281,6 +286,146 @@ move_previous(BtreeCursor *cursor, Context *context, uint32_t flags)
   return 0;
 }
 
+// Collects the addresses of up to |count| leaves to the right of |page|,
+// skipping the first |skip| of them. The addresses are read from the
+// parent nodes; the leaves themselves are not yet in memory. Returns the
+// number of addresses.
+static inline size_t
+collect_right_leaves(BtreeCursor *cursor, Context *context, Page *page,
+                size_t skip, uint64_t *addresses, size_t count)
+{
+  BtreeCursorState &st_ = cursor->st_;
+  LocalEnv *env = (LocalEnv *)st_.parent->db->env;
+  BtreeNodeProxy *node = st_.btree->get_node_from_page(page);
+
+  if (node->length() == 0)
+    return 0;
+
+  // descend to the parent of this leaf, using its smallest key
+  ByteArray arena;
+  ups_key_t key = {0};
+  node->key(context, 0, &arena, &key);
+
+  Page *parent = 0;
+  Page *child = st_.btree->root_page(context);
+  int slot = -1;
+  while (child != page) {
+    if (st_.btree->get_node_from_page(child)->is_leaf())
+      return 0;
+    parent = child;
+    child = st_.btree->find_lower_bound(context, parent, &key,
+                    PageManager::kReadOnly, &slot);
+  }
+
+  // the root is a leaf: there are no siblings
+  if (!parent)
+    return 0;
+
+  // then collect the following children of the parent (and of its right
+  // siblings); -1 is the left child
+  BtreeNodeProxy *pnode = st_.btree->get_node_from_page(parent);
+  int next = slot + 1;
+  size_t n = 0;
+  while (n < count) {
+    if (next == (int)pnode->length()) {
+      if (!pnode->right_sibling())
+        break;
+      parent = env->page_manager->fetch(context, pnode->right_sibling(),
+                      PageManager::kReadOnly);
+      pnode = st_.btree->get_node_from_page(parent);
+      next = -1;
+    }
+
+    uint64_t address = next == -1
+                          ? pnode->left_child()
+                          : pnode->record_id(context, next);
+    next++;
+    if (skip > 0)
+      skip--;
+    else
+      addresses[n++] = address;
+  }
+
+  return n;
+}
+
+// Prefetches the pages with the blobs of the records in the right sibling
+// of |page|, if the sibling is already cached
+static inline void
+prefetch_blob_pages(BtreeCursor *cursor, Context *context, Page *page)
+{
+  BtreeCursorState &st_ = cursor->st_;
+  LocalEnv *env = (LocalEnv *)st_.parent->db->env;
+  BtreeNodeProxy *node = st_.btree->get_node_from_page(page);
+
+  if (!node->right_sibling())
+    return;
+  Page *right = env->page_manager->fetch(context, node->right_sibling(),
+                  PageManager::kOnlyFromCache | PageManager::kReadOnly);
+  if (!right)
+    return;
+
+  std::vector<uint64_t> blob_ids;
+  st_.btree->get_node_from_page(right)->blob_ids(&blob_ids);
+  if (blob_ids.empty())
+    return;
+
+  // convert the blob ids to page addresses; blobs of adjacent records
+  // are often stored in the same page
+  uint32_t page_size = env->config.page_size_bytes;
+  size_t n = 0;
+  for (size_t i = 0; i < blob_ids.size(); i++) {
+    uint64_t address = blob_ids[i] - (blob_ids[i] % page_size);
+    if (n == 0 || blob_ids[n - 1] != address)
+      blob_ids[n++] = address;
+  }
+
+  for (size_t i = 0; i < n; i += Page::kMaxFlushBatch)
+    env->page_manager->prefetch_async(context, &blob_ids[i],
+                    std::min(n - i, (size_t)Page::kMaxFlushBatch));
+}
+
+// Called after the cursor moved from the leaf at |previous| to its right
+// sibling. After |kReadaheadThreshold| consecutive moves the following
+// leaves (and, if |records| is true, their blobs) are prefetched
+// asynchronously, so that a range scan does not wait for one synchronous
+// read per leaf
+static inline void
+readahead(BtreeCursor *cursor, Context *context, uint64_t previous,
+                bool records)
+{
+  BtreeCursorState &st_ = cursor->st_;
+  LocalEnv *env = (LocalEnv *)st_.parent->db->env;
+  Page *page = st_.coupled_page;
+
+  if (previous == st_.readahead_leaf) {
+    st_.sequential_leaves++;
+    if (st_.readahead_leaves > 0)
+      st_.readahead_leaves--;
+  }
+  else {
+    st_.sequential_leaves = 1;
+    st_.readahead_leaves = 0;
+  }
+  st_.readahead_leaf = page->address();
+
+  if (st_.sequential_leaves < BtreeCursor::kReadaheadThreshold)
+    return;
+
+  // top up the window once half of it was consumed
+  if (st_.readahead_leaves <= BtreeCursor::kReadaheadWindow / 2) {
+    uint64_t addresses[BtreeCursor::kReadaheadWindow];
+    size_t n = collect_right_leaves(cursor, context, page,
+                    st_.readahead_leaves, addresses,
+                    BtreeCursor::kReadaheadWindow - st_.readahead_leaves);
+    if (n > 0)
+      env->page_manager->prefetch_async(context, addresses, n);
+    st_.readahead_leaves += (int)n;
+  }
+
+  if (records)
+    prefetch_blob_pages(cursor, context, page);
+}
 
 BtreeCursor::BtreeCursor(LocalCursor *parent)
 {
@@ -289,6 +434,9 @@ BtreeCursor::BtreeCursor(LocalCursor *parent)
   st_.duplicate_index = 0;
   st_.coupled_page = 0;
   st_.coupled_index = 0;
+  st_.readahead_leaf = 0;
+  st_.sequential_leaves = 0;
+  st_.readahead_leaves = 0;
   ::memset(&st_.uncoupled_key, 0, sizeof(st_.uncoupled_key));
   st_.btree = ((LocalDb *)parent->db)->btree_index.get();
 }
@@ -349,6 +497,7 @@ BtreeCursor::couple_to(Page *page, uint32_t index, int duplicate_index)
   st_.coupled_page = page;
 
   // add the cursor to the page
+  ScopedSpinlock lock(page->cursor_mutex());
   page->cursor_list.put(this);
 }
 
@@ -421,8 +570,24 @@ BtreeCursor::move(Context *context, ups_key_t *key, ByteArray *key_arena,
     st = move_first(this, context, flags);
   else if (ISSET(flags, UPS_CURSOR_LAST))
     st = move_last(this, context, flags);
-  else if (ISSET(flags, UPS_CURSOR_NEXT))
+  else if (ISSET(flags, UPS_CURSOR_NEXT)) {
+    if (st_.state == kStateUncoupled)
+      couple(this, context);
+    Page *previous = st_.state == kStateCoupled ? st_.coupled_page : 0;
+    uint64_t address = previous ? previous->address() : 0;
     st = move_next(this, context, flags);
+    if (likely(st == 0) && previous && st_.coupled_page != previous
+          && NOTSET(((LocalEnv *)st_.parent->db->env)->config.flags,
+                  UPS_IN_MEMORY)) {
+      // prefetching is optional; errors are reported when the pages
+      // are fetched
+      try {
+        readahead(this, context, address, record != 0);
+      }
+      catch (Exception &) {
+      }
+    }
+  }
   else if (ISSET(flags, UPS_CURSOR_PREVIOUS))
     st = move_previous(this, context, flags);
   // no move, but cursor is nil? return error
@@ -90,6 +90,16 @@ struct BtreeCursorState {
 
   // a ByteArray which backs |uncoupled_key.data|
   ByteArray uncoupled_arena;
+
+  // the leaf which was reached with the last move to the right sibling
+  uint64_t readahead_leaf;
+
+  // number of consecutive moves to the right sibling
+  int sequential_leaves;
+
+  // number of leaves (to the right of the current one) which were
+  // already prefetched
+  int readahead_leaves;
 };
 
 
@@ -103,7 +113,14 @@ struct BtreeCursor {
     // Cursor flag: the cursor is coupled
     kStateCoupled   = 1,
     // Cursor flag: the cursor is uncoupled
-    kStateUncoupled = 2
+    kStateUncoupled = 2,
+
+    // number of consecutive moves to the right sibling before the
+    // following leaves are prefetched
+    kReadaheadThreshold = 2,
+
+    // number of leaves which are prefetched ahead of the cursor
+    kReadaheadWindow = 16
   };
 
   // Constructor
@@ -190,8 +190,12 @@ fall_through:
         throw ex;
 
       // Split the page in the middle. This will invalidate the |node| pointer
-      // and the |slot| of the key, therefore restart the whole operation
+      // and the |slot| of the key, therefore restart the whole operation.
+      // If only the leaf is latched then latch the whole path first, like
+      // an insert does before it splits the leaf.
       BtreeStatistics::InsertHints hints = {0};
+      if (unlikely(is_leaf_latched_only))
+        page = latch_path(page, key, hints, &parent);
       split_page(page, parent, key, hints);
       return erase();
     }
@@ -41,6 +41,39 @@
 
 namespace upscaledb {
 
+// Holds a shared latch of a btree page; used by lookups which run in
+// parallel to an update of the same Database (Context::latch_pages)
+struct SharedPageLatch
+{
+  // Constructor; latches the root page of |btree|. A concurrent update can
+  // replace the root page (i.e. when the root is split), therefore verify
+  // that the latched page is still the root.
+  SharedPageLatch(BtreeIndex *btree, Context *context)
+    : page(btree->root_page(context)) {
+    page->mutex().lock_shared();
+    while (unlikely(page != btree->root_page(context))) {
+      page->mutex().unlock_shared();
+      page = btree->root_page(context);
+      page->mutex().lock_shared();
+    }
+  }
+
+  // Destructor; releases the latch
+  ~SharedPageLatch() {
+    page->mutex().unlock_shared();
+  }
+
+  // Latches |child|, then releases the latch of the current page
+  void couple(Page *child) {
+    child->mutex().lock_shared();
+    page->mutex().unlock_shared();
+    page = child;
+  }
+
+  // The latched page
+  Page *page;
+};
+
 struct BtreeFindAction
 {
   BtreeFindAction(BtreeIndex *btree_, Context *context_, BtreeCursor *cursor_,
@@ -53,6 +86,9 @@ struct BtreeFindAction
   }
 
   ups_status_t run() {
+    if (context->latch_pages)
+      return run_latched();
+
     LocalEnv *env = (LocalEnv *)btree->db()->env;
     Page *page = 0;
     int slot = -1;
@@ -178,6 +214,73 @@ return_result:
     return 0;
   }
 
+  // Performs an exact-match lookup which runs in parallel to an update of
+  // the same Database. The pages are latched in shared mode while the tree
+  // is descended, and the latch of a node is released as soon as its child
+  // is latched ("latch coupling").
+  //
+  // The leaf is first read without latch; the page version is validated
+  // afterwards, and the read is repeated if the leaf was modified in the
+  // meantime. The parent remains latched, therefore the leaf cannot be
+  // split, merged or moved to the freelist. If the leaf is currently
+  // modified then the lookup falls back to latching it.
+  ups_status_t run_latched() {
+    assert(cursor == 0);
+    assert(flags == 0);
+
+    SharedPageLatch latch(btree, context);
+    Page *page = latch.page;
+    BtreeNodeProxy *node = btree->get_node_from_page(page);
+    bool optimistic = supports_optimistic_reads(btree->db());
+
+    while (!node->is_leaf()) {
+      page = btree->find_lower_bound(context, latch.page, key,
+                              PageManager::kReadOnly, 0);
+      if (unlikely(!page))
+        return UPS_KEY_NOT_FOUND;
+
+      node = btree->get_node_from_page(page);
+      if (optimistic && node->is_leaf())
+        break;
+      latch.couple(page);
+    }
+
+    if (page != latch.page) {
+      for (int i = 0; i < kMaxOptimisticReads; i++) {
+        uint32_t version = page->version();
+        if (version & 1)
+          break;
+
+        int slot = node->find(context, key);
+        if (slot >= 0 && likely(record != 0))
+          node->record(context, slot, record_arena, record, flags);
+
+        if (likely(page->validate_version(version)))
+          return slot >= 0 ? 0 : UPS_KEY_NOT_FOUND;
+      }
+
+      latch.couple(page);
+    }
+
+    int slot = node->find(context, key);
+    if (unlikely(slot == -1))
+      return UPS_KEY_NOT_FOUND;
+
+    if (likely(record != 0))
+      node->record(context, slot, record_arena, record, flags);
+    return 0;
+  }
+
+  // Returns true if the leaf nodes of |db| can be read without latching
+  // them. Keys and records must have a fixed size and must be stored in
+  // the leaf; otherwise a concurrent modification could make the lookup
+  // follow a stale blob id.
+  static bool supports_optimistic_reads(LocalDb *db) {
+    return db->config.key_size != UPS_KEY_SIZE_UNLIMITED
+              && db->config.key_type != UPS_TYPE_CUSTOM
+              && ISSET(db->config.flags, UPS_FORCE_RECORDS_INLINE);
+  }
+
   // Searches a leaf node for a key.
   //
   // !!!
@@ -248,6 +351,9 @@ return_result:
 
   // allocator for the record data
   ByteArray *record_arena;
+
+  // Number of attempts to read a leaf without latch
+  enum { kMaxOptimisticReads = 3 };
 };
 
 ups_status_t
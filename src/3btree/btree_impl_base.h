@@ -385,6 +385,11 @@ struct BaseNodeImpl {
       return false;
     }
 
+    // Appends the ids of the blobs of all records to |blob_ids|
+    void blob_ids(size_t node_length, std::vector<uint64_t> *blob_ids) const {
+      records.blob_ids(node_length, blob_ids);
+    }
+
     // Fills the btree_metrics structure
     void fill_metrics(btree_metrics_t *metrics, size_t node_length) {
       metrics->number_of_pages++;
@@ -272,6 +272,11 @@ struct BtreeIndex {
     if (likely(page->node_proxy() != 0))
       return page->node_proxy();
 
+    // concurrent lookups can race to create the proxy
+    ScopedSpinlock lock(page->cursor_mutex());
+    if (page->node_proxy() != 0)
+      return page->node_proxy();
+
     BtreeNodeProxy *proxy;
     PBtreeNode *node = PBtreeNode::from_page(page);
     if (node->is_leaf())
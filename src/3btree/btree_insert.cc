@@ -73,11 +73,16 @@ struct BtreeInsertAction : public BtreeUpdateAction {
      * prepend the key; if this fails because the key is NOT the largest
      * (or smallest) key in the database or because the current page is
      * already full, it will remove the HINT_APPEND (or HINT_PREPEND)
-     * flag and call insert()
+     * flag and call insert().
+     *
+     * Updates which latch their pages (Context::latch_pages) skip this
+     * shortcut, because the fallback would latch the path from the
+     * root while the leaf is already latched.
      */
     ups_status_t st;
     if (hints.leaf_page_addr
-            && ISSETANY(hints.flags, UPS_HINT_APPEND | UPS_HINT_PREPEND)) {
+            && ISSETANY(hints.flags, UPS_HINT_APPEND | UPS_HINT_PREPEND)
+            && !context->latch_pages) {
       st = append_or_prepend_key();
       if (unlikely(st == UPS_LIMITS_REACHED))
         st = insert();
@@ -174,6 +179,8 @@ struct BtreeInsertAction : public BtreeUpdateAction {
     // split the page, therefore this case has to be handled
     ups_status_t st = insert_in_page(page, key, record, hints);
     if (unlikely(st == UPS_LIMITS_REACHED)) {
+      if (unlikely(is_leaf_latched_only))
+        page = latch_path(page, key, hints, &parent);
       page = split_page(page, parent, key, hints);
       return insert_in_page(page, key, record, hints);
     }
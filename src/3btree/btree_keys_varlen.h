@@ -455,15 +455,20 @@ struct VariableLengthKeyList : BaseKeyList {
 
   // Retrieves the extended key at |blobid| and stores it in |key|; will
   // use the cache.
+  // The cache is shared by concurrent lookups (UPS_ENABLE_CONCURRENT_READS)
+  // and therefore protected by |_extkey_mutex|.
   void get_extended_key(Context *context, uint64_t blob_id, ups_key_t *key) {
-    if (unlikely(!_extkey_cache))
-      _extkey_cache.reset(new ExtKeyCache());
-    else {
-      ExtKeyCache::iterator it = _extkey_cache->find(blob_id);
-      if (it != _extkey_cache->end()) {
-        key->size = it->second.size();
-        key->data = it->second.data();
-        return;
+    {
+      ScopedSpinlock lock(_extkey_mutex);
+      if (unlikely(!_extkey_cache))
+        _extkey_cache.reset(new ExtKeyCache());
+      else {
+        ExtKeyCache::iterator it = _extkey_cache->find(blob_id);
+        if (it != _extkey_cache->end()) {
+          key->size = it->second.size();
+          key->data = it->second.data();
+          return;
+        }
       }
     }
 
@@ -471,6 +476,15 @@ struct VariableLengthKeyList : BaseKeyList {
     ups_record_t record = {0};
     _blob_manager->read(context, blob_id, &record, UPS_FORCE_DEEP_COPY,
                     &arena);
+
+    ScopedSpinlock lock(_extkey_mutex);
+    // another thread might have cached the same key in the meantime
+    ExtKeyCache::iterator it = _extkey_cache->find(blob_id);
+    if (unlikely(it != _extkey_cache->end())) {
+      key->size = it->second.size();
+      key->data = it->second.data();
+      return;
+    }
     (*_extkey_cache)[blob_id] = arena;
     arena.disown();
     key->data = record.data;
@@ -558,6 +572,9 @@ struct VariableLengthKeyList : BaseKeyList {
   // Cache for extended keys
   ScopedPtr<ExtKeyCache> _extkey_cache;
 
+  // Protects |_extkey_cache| against concurrent lookups
+  Spinlock _extkey_mutex;
+
   // Threshold for extended keys; if key size is > threshold then the
   // key is moved to a blob
   size_t _extkey_threshold;
@@ -22,6 +22,7 @@
 #include "0root/root.h"
 
 #include <set>
+#include <vector>
 #include <string.h>
 #include <iostream>
 #include <sstream>
@@ -234,6 +235,10 @@ struct BtreeNodeProxy {
   // Fills the btree_metrics structure
   virtual void fill_metrics(btree_metrics_t *metrics) = 0;
 
+  // Appends the ids of the blobs of all records to |blob_ids|. Only for
+  // leaf nodes!
+  virtual void blob_ids(std::vector<uint64_t> *blob_ids) const = 0;
+
   // Prints the node to stdout. Only for testing and debugging!
   virtual void print(Context *context, size_t length = 0) = 0;
 
@@ -560,6 +565,11 @@ struct BtreeNodeProxyImpl : BtreeNodeProxy {
     impl.fill_metrics(metrics, length());
   }
 
+  // Appends the ids of the blobs of all records to |blob_ids|
+  virtual void blob_ids(std::vector<uint64_t> *blob_ids) const {
+    impl.blob_ids(length(), blob_ids);
+  }
+
   // Prints the node to stdout (for debugging)
   virtual void print(Context *context, size_t length = 0) {
     std::cout << "page " << page->address() << ": " << this->length()
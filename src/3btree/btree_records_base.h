@@ -25,6 +25,8 @@
 
 #include "0root/root.h"
 
+#include <vector>
+
 // Always verify that a file of level N does not include headers > N!
 #include "3btree/btree_list_base.h"
 
@@ -53,6 +55,11 @@ struct BaseRecordList : BaseList {
                         range_size);
   }
 
+  // Appends the ids of all blobs which are referenced by the records to
+  // |blob_ids|. Not required for records without blobs
+  void blob_ids(size_t node_count, std::vector<uint64_t> *blob_ids) const {
+  }
+
   // Returns the record id. Only required for internal nodes
   uint64_t record_id(int slot, int duplicate_index = 0) const {
     assert(!"shouldn't be here");
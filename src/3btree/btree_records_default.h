@@ -297,6 +297,15 @@ struct DefaultRecordList : BaseRecordList {
                         range_size - required_range_size(node_count));
   }
 
+  // Appends the ids of all blobs which are referenced by the records to
+  // |blob_ids|
+  void blob_ids(size_t node_count, std::vector<uint64_t> *blob_ids) const {
+    for (size_t i = 0; i < node_count; i++) {
+      if (!is_record_inline(i) && record_id(i) != 0)
+        blob_ids->push_back(record_id(i));
+    }
+  }
+
   // Prints a slot to |out| (for debugging)
   void print(Context *context, int slot, std::stringstream &out) const {
     out << "(" << record_size(context, slot) << " bytes)";
@@ -149,16 +149,86 @@ collapse_root(BtreeUpdateAction &state, Page *root_page)
   return new_root;
 }
 
+// Marks a Changeset as "shared" while an update descends the tree without
+// latching the pages
+struct UnlatchedDescent
+{
+  UnlatchedDescent(Changeset *changeset_)
+    : changeset(changeset_) {
+    changeset->is_shared = true;
+  }
+
+  ~UnlatchedDescent() {
+    changeset->is_shared = false;
+  }
+
+  Changeset *changeset;
+};
+
+// Descends the tree of an update which runs in parallel to lookups
+// (Context::latch_pages). Updates are serialized, therefore the pages are
+// not latched while descending. Then only the leaf is latched (exclusively);
+// concurrent lookups latch the parent while they read the leaf without
+// latch, and validate the page version afterwards.
+// Returns null if the leaf has to be merged; in this case the caller falls
+// back to the regular traversal, which latches the whole path.
+static inline Page *
+traverse_tree_latched(BtreeUpdateAction &state, const ups_key_t *key,
+                Page **parent)
+{
+  Context *context = state.context;
+  BtreeIndex *btree = state.btree;
+  Page *page;
+
+  *parent = 0;
+
+  {
+    UnlatchedDescent descent(&context->changeset);
+
+    page = btree->root_page(context);
+    BtreeNodeProxy *node = btree->get_node_from_page(page);
+    if (unlikely(node->length() == 0 && !node->is_leaf()))
+      return 0;
+
+    while (!node->is_leaf()) {
+      Page *child_page = btree->find_lower_bound(context, page, key, 0, 0);
+      BtreeNodeProxy *child_node = btree->get_node_from_page(child_page);
+      if (child_node->is_leaf() && child_node->requires_merge())
+        return 0;
+
+      *parent = page;
+      page = child_page;
+      node = child_node;
+    }
+  }
+
+  context->changeset.put(page);
+  return page;
+}
+
 // Traverses the tree, looking for the leaf with the specified |key|. Will
 // split or merge nodes while descending.
 // Returns the leaf page and the |parent| of the leaf (can be null if
 // there is no parent).
 Page *
 BtreeUpdateAction::traverse_tree(Context *context, const ups_key_t *key,
-                BtreeStatistics::InsertHints &hints, Page **parent)
+                BtreeStatistics::InsertHints &hints, Page **parent,
+                bool optimistic)
 {
   LocalEnv *env = (LocalEnv *)btree->db()->env;
 
+  // Databases with duplicate keys do not support latched lookups; their
+  // updates latch the whole path
+  is_leaf_latched_only = false;
+  if (context->latch_pages && optimistic
+          && NOTSET(btree->db()->flags(), UPS_ENABLE_DUPLICATE_KEYS)) {
+    Page *page = traverse_tree_latched(*this, key, parent);
+    if (likely(page != 0)) {
+      is_leaf_latched_only = true;
+      return page;
+    }
+  }
+
   Page *page = btree->root_page(context);
   BtreeNodeProxy *node = btree->get_node_from_page(page);
 
@@ -243,6 +313,18 @@ BtreeUpdateAction::traverse_tree(Context *context, const ups_key_t *key,
   return page;
 }
 
+Page *
+BtreeUpdateAction::latch_path(Page *leaf, const ups_key_t *key,
+                BtreeStatistics::InsertHints &hints, Page **parent)
+{
+  assert(is_leaf_latched_only);
+
+  // the leaf was not yet modified; release it, otherwise the path would
+  // be latched bottom-up, and a concurrent lookup could deadlock
+  context->changeset.del(leaf);
+  return traverse_tree(context, key, hints, parent, false);
+}
+
 Page *
 BtreeUpdateAction::split_page(Page *old_page, Page *parent,
                 const ups_key_t *key, BtreeStatistics::InsertHints &hints)
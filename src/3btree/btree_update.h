@@ -43,14 +43,24 @@ struct BtreeUpdateAction {
   BtreeUpdateAction(BtreeIndex *btree_, Context *context_,
                   BtreeCursor *cursor_, uint32_t duplicate_index_)
     : btree(btree_), context(context_), cursor(cursor_),
-      duplicate_index(duplicate_index_) {
+      duplicate_index(duplicate_index_), is_leaf_latched_only(false) {
   }
 
   // Traverses the tree, looking for the leaf with the specified |key|. Will
   // split or merge nodes while descending.
   // Returns the leaf page and the |parent| of the leaf (can be null if
   // there is no parent).
+  // If the update runs in parallel to lookups (Context::latch_pages) then
+  // the leaf is latched without its parent, if possible
+  // (see |is_leaf_latched_only|), unless |optimistic| is false.
   Page *traverse_tree(Context *context, const ups_key_t *key,
+                      BtreeStatistics::InsertHints &hints, Page **parent,
+                      bool optimistic = true);
+
+  // Releases the |leaf| which was latched by traverse_tree() without its
+  // parent, then traverses the tree again and latches the whole path.
+  // Required before the leaf is split.
+  Page *latch_path(Page *leaf, const ups_key_t *key,
                       BtreeStatistics::InsertHints &hints, Page **parent);
 
   // Splits |page| and updates the |parent|. If |parent| is null then
@@ -78,6 +88,9 @@ struct BtreeUpdateAction {
   // the duplicate index (in case the update is for a duplicate key)
   // 1-based (if 0 then this update is not for a duplicate)
   uint32_t duplicate_index;
+
+  // True if traverse_tree() latched the leaf, but not its parent
+  bool is_leaf_latched_only;
 };
 
 } // namespace upscaledb
@@ -22,6 +22,8 @@
 
 #include "0root/root.h"
 
+#include <vector>
+
 // Always verify that a file of level N does not include headers > N!
 #include "3page_manager/page_manager.h"
 #include "3btree/btree_index.h"
@@ -34,8 +36,30 @@
 
 namespace upscaledb {
 
+// Marks the Context of a visit as a "scan"; the previous value is restored
+// when the visit is finished
+struct ScopedScan
+{
+  ScopedScan(Context *context_)
+    : context(context_), old_scan(context_->scan) {
+    context->scan = true;
+  }
+
+  ~ScopedScan() {
+    context->scan = old_scan;
+  }
+
+  Context *context;
+  bool old_scan;
+};
+
 struct BtreeVisitAction
 {
+  enum {
+    // number of leaves which are prefetched with a single request
+    kPrefetchWindow = 32
+  };
+
   BtreeVisitAction(BtreeIndex *btree_, Context *context_,
                   BtreeVisitor &visitor_, bool visit_internal_nodes_)
     : btree(btree_), context(context_), visitor(visitor_),
@@ -49,13 +73,21 @@ struct BtreeVisitAction
     if (visitor.is_read_only())
       page_manager_flags = PageManager::kReadOnly;
 
+    // all nodes are visited once; don't let them evict the working set
+    // of the cache
+    ScopedScan scan(context);
+
     // get the root page of the tree
     Page *page = btree->root_page(context);
 
+    // the parent of the leftmost leaf
+    uint64_t parent = 0;
+
     // go down to the leaf
     while (page) {
       BtreeNodeProxy *node = btree->get_node_from_page(page);
       uint64_t left_child = node->left_child();
+      uint64_t address = page->address();
 
       // visit internal nodes as well?
       if (left_child != 0 && visit_internal_nodes) {
@@ -74,14 +106,28 @@ struct BtreeVisitAction
       }
 
       // follow the pointer to the smallest child
-      if (likely(left_child))
+      if (likely(left_child)) {
+        parent = address;
         page = env->page_manager->fetch(context, left_child, page_manager_flags);
+      }
       else
         break;
     }
 
     assert(page != 0);
 
+    // Read-only visitors prefetch the leaves in batches. The leaves are
+    // visited in the same order as they are referenced by their parents,
+    // therefore the next batch is prefetched as soon as the previous one
+    // was visited. Other visitors free the nodes, and the parents must not
+    // be read again.
+    if (!visitor.is_read_only())
+      parent = 0;
+
+    std::vector<uint64_t> children;
+    size_t next_child = 0;
+    size_t prefetched = 0;
+
     // now visit all leaf nodes
     while (page) {
       BtreeNodeProxy *node = btree->get_node_from_page(page);
@@ -89,6 +135,31 @@ struct BtreeVisitAction
 
       visitor(context, node);
 
+      if (prefetched > 0)
+        prefetched--;
+
+      if (prefetched == 0 && (parent || next_child < children.size())) {
+        if (next_child == children.size()) {
+          Page *p = env->page_manager->fetch(context, parent,
+                          page_manager_flags);
+          BtreeNodeProxy *pnode = btree->get_node_from_page(p);
+          // the first child of the first parent was already visited
+          next_child = children.empty() ? 1 : 0;
+          children.clear();
+          children.push_back(pnode->left_child());
+          for (size_t i = 0; i < pnode->length(); i++)
+            children.push_back(pnode->record_id(context, i));
+          parent = pnode->right_sibling();
+        }
+
+        prefetched = children.size() - next_child;
+        if (prefetched > kPrefetchWindow)
+          prefetched = kPrefetchWindow;
+        env->page_manager->prefetch(context, &children[next_child],
+                        prefetched);
+        next_child += prefetched;
+      }
+
       /* follow the pointer to the right sibling */
       if (likely(right))
         page = env->page_manager->fetch(context, right, page_manager_flags);
@@ -20,12 +20,29 @@
  * The Cache Manager
  *
  * Stores pages in a non-intrusive hash table (each Page instance keeps
- * next/previous pointers for the overflow bucket). Can efficiently purge
- * unused pages, because all pages are also stored in a (non-intrusive)
+ * next/previous pointers for the overflow bucket). The hash table is split
+ * into independent shards (selected by the page address); each shard has its
+ * own lock, buckets, counters and eviction lists, therefore concurrent
+ * lookups of different pages do not contend on a single list head.
+ *
+ * Two eviction policies are available:
+ *
+ * UPS_CACHE_POLICY_LRU: all pages of a shard are stored in a (non-intrusive)
  * linked list, and whenever a page is accessed it is removed and re-inserted
  * at the head. The tail therefore points to the page which was not used
  * in a long time, and is the primary candidate for purging.
  *
+ * UPS_CACHE_POLICY_2Q: new pages are inserted in a "probationary" queue. Only
+ * if they are accessed again they are promoted to the "protected" LRU list.
+ * The protected lists are limited to 3/4 of the capacity; overflowing pages
+ * are demoted to the probationary queue. Pages are purged from the
+ * probationary queue first, therefore a single scan cannot flush the
+ * working set.
+ *
+ * Scans (i.e. uqi_select_range, ups_db_count) fetch pages with the
+ * kStreaming hint: new pages are always stored in the probationary queue
+ * (with both policies), and they are not promoted by the scan itself.
+ *
  * @exception_safe: nothrow
  * @thread_safe: yes
  */
@@ -36,10 +53,13 @@
 #include "0root/root.h"
 
 #include <vector>
+#include <limits>
+#include <algorithm>
 
 #include "ups/upscaledb_int.h"
 
 // Always verify that a file of level N does not include headers > N!
+#include "1base/spinlock.h"
 #include "2page/page.h"
 #include "2page/page_collection.h"
 #include "2config/env_config.h"
@@ -52,135 +72,241 @@
 namespace upscaledb {
 
 namespace Impl {
+// Calculates the shard of a page address. Page addresses are aligned to
+// the page size, therefore the address is scrambled (fibonacci hashing)
+static inline size_t
+calc_shard(uint64_t value)
+{
+  return (size_t)(((value * 0x9e3779b97f4a7c15ull) >> 32)
+                  % CacheState::kShards);
+}
+
 // Calculates the hash of a page address
 static inline size_t
 calc_hash(uint64_t value)
 {
-  return (size_t)(value % CacheState::kBucketSize);
+  return (size_t)(value % CacheShard::kBucketSize);
 }
 } // namespace Impl
 
 struct Cache
 {
+  enum {
+    // flag for get(), put(): the page is read by a scan. New pages are
+    // stored in the probationary queue, and cached pages are neither
+    // promoted nor moved to the front
+    kStreaming = 1,
+
+    // flag for get(): a miss is not counted because the caller retries
+    // the lookup
+    kIgnoreMiss = 2
+  };
+
   template<typename Purger>
   struct PurgeIfSelector {
-    PurgeIfSelector(Cache *cache, Purger &purger)
-      : cache_(cache), purger_(purger) {
+    PurgeIfSelector(Cache *cache, CacheShard &shard, Purger &purger)
+      : cache_(cache), shard_(shard), purger_(purger) {
     }
 
     bool operator()(Page *page) {
       if (purger_(page))
-        cache_->del(page);
+        cache_->del_impl(shard_, page);
       // don't remove page from list; it was already removed above
       return false;
     }
 
     Cache *cache_;
+    CacheShard &shard_;
     Purger &purger_;
   };
 
   // The default constructor
   Cache(const EnvConfig &config)
     : state(config) {
+    // the protected lists of the 2Q policy get 3/4 of the capacity
+    uint64_t capacity = state.capacity_bytes / state.page_size_bytes;
+    max_protected_elements = (size_t)std::min(capacity / 4 * 3,
+                    (uint64_t)std::numeric_limits<size_t>::max());
   }
 
   // Fills in the current metrics
-  void fill_metrics(ups_env_metrics_t *metrics) const {
-    metrics->cache_hits = state.cache_hits;
-    metrics->cache_misses = state.cache_misses;
+  void fill_metrics(ups_env_metrics_t *metrics) {
+    metrics->cache_hits = 0;
+    metrics->cache_misses = 0;
+    for (int i = 0; i < CacheState::kShards; i++) {
+      CacheShard &shard = state.shards[i];
+      ScopedSpinlock lock(shard.mutex);
+      metrics->cache_shard_hits[i] = shard.cache_hits;
+      metrics->cache_shard_misses[i] = shard.cache_misses;
+      metrics->cache_hits += shard.cache_hits;
+      metrics->cache_misses += shard.cache_misses;
+    }
   }
 
   // Retrieves a page from the cache, also removes the page from the cache
   // and re-inserts it at the front. Returns null if the page was not cached.
-  Page *get(uint64_t address) {
-    size_t hash = Impl::calc_hash(address);
+  // |flags| is a combination of kStreaming and kIgnoreMiss.
+  Page *get(uint64_t address, uint32_t flags = 0) {
+    CacheShard &shard = state.shards[Impl::calc_shard(address)];
+    ScopedSpinlock lock(shard.mutex);
 
-    Page *page = state.buckets[hash].get(address);
+    Page *page = shard.buckets[Impl::calc_hash(address)].get(address);
     if (!page) {
-      state.cache_misses++;
+      if (NOTSET(flags, kIgnoreMiss))
+        shard.cache_misses++;
       return 0;
     }
 
-    // Now re-insert the page at the head of the "totallist", and
-    // thus move far away from the tail. The pages at the tail are highest
-    // candidates to be deleted when the cache is purged.
-    state.totallist.del(page);
-    state.totallist.put(page);
-    state.cache_hits++;
+    if (NOTSET(flags, kStreaming))
+      touch(shard, page);
+    shard.cache_hits++;
     return page;
   }
 
-  // Stores a page in the cache
-  void put(Page *page) {
-    size_t hash = Impl::calc_hash(page->address());
+  // Same as |get()|, but neither updates the counters nor the position of
+  // the page in the eviction lists. Used for internal bookkeeping (i.e.
+  // by the flusher), which should not keep pages in the cache.
+  Page *peek(uint64_t address) {
+    CacheShard &shard = state.shards[Impl::calc_shard(address)];
+    ScopedSpinlock lock(shard.mutex);
+    return shard.buckets[Impl::calc_hash(address)].get(address);
+  }
+
+  // Stores a page in the cache. |flags| is either 0 or kStreaming.
+  void put(Page *page, uint32_t flags = 0) {
+    CacheShard &shard = state.shards[Impl::calc_shard(page->address())];
+    ScopedSpinlock lock(shard.mutex);
+
+    // a page which is already cached is treated like a cache hit
+    if (shard.totallist.has(page) || shard.probation.has(page)) {
+      if (NOTSET(flags, kStreaming))
+        touch(shard, page);
+    }
+    else {
+      // Insert the page at the head of the list. The tail will point to
+      // the least recently used page. Pages of a scan are always
+      // probationary, even with the LRU policy.
+      if (state.policy == UPS_CACHE_POLICY_2Q || ISSET(flags, kStreaming))
+        shard.probation.put(page);
+      else
+        shard.totallist.put(page);
+      if (page->is_allocated())
+        shard.alloc_elements++;
+      if (page->has_disk_image())
+        shard.image_elements++;
+    }
+
+    shard.buckets[Impl::calc_hash(page->address())].put(page);
+  }
 
-    /* First remove the page from the cache, if it's already cached
-     *
-     * Then re-insert the page at the head of the list. The tail will
-     * point to the least recently used page.
-     */
-    state.totallist.del(page);
-    state.totallist.put(page);
-    if (page->is_allocated())
-      state.alloc_elements++;
+  // Lets |page| keep a copy of its data on disk, and charges the copy
+  // to the cache capacity
+  void keep_disk_image(Page *page) {
+    CacheShard &shard = state.shards[Impl::calc_shard(page->address())];
+    ScopedSpinlock lock(shard.mutex);
+    if (page->has_disk_image())
+      return;
+
+    page->keep_disk_image();
+    if (shard.totallist.has(page) || shard.probation.has(page))
+      shard.image_elements++;
+  }
 
-    state.buckets[hash].put(page);
+  // Releases the copy of the page data which was kept by
+  // |keep_disk_image()|
+  void release_disk_image(Page *page) {
+    CacheShard &shard = state.shards[Impl::calc_shard(page->address())];
+    ScopedSpinlock lock(shard.mutex);
+    if (!page->has_disk_image())
+      return;
+
+    page->release_disk_image();
+    if (shard.totallist.has(page) || shard.probation.has(page))
+      shard.image_elements--;
   }
 
   // Removes a page from the cache
   void del(Page *page) {
     assert(page->address() != 0);
 
-    /* remove it from the list of all cached pages */
-    if (state.totallist.del(page) && page->is_allocated())
-      state.alloc_elements--;
-
-    /* remove the page from the cache buckets */
-    size_t hash = Impl::calc_hash(page->address());
-    state.buckets[hash].del(page);
+    CacheShard &shard = state.shards[Impl::calc_shard(page->address())];
+    ScopedSpinlock lock(shard.mutex);
+    del_impl(shard, page);
   }
 
-  // Purges the cache. Implements a LRU eviction algorithm. Dirty pages are
-  // forwarded to the |processor()| for flushing.
+  // Purges the cache. Implements the eviction policy: pages from the
+  // probationary queues (2Q, or pages of a scan) are purged first, then
+  // pages from the
+  // (protected) LRU lists. Each shard contributes a share of the candidates
+  // proportional to its size. Dirty pages are forwarded to the
+  // |processor()| for flushing.
   // The |ignore_page| is passed by the caller; this page will not be purged
   // under any circumstance. This is used by the PageManager to make sure
   // that the "last blob page" is not evicted by the cache.
   void purge_candidates(std::vector<uint64_t> &candidates,
                   std::vector<Page *> &garbage,
                   Page *ignore_page) {
-    int limit = (int)(current_elements()
-                      - (state.capacity_bytes / state.page_size_bytes));
-
-    Page *page = state.totallist.tail();
-    for (int i = 0; i < limit && page != 0; i++) {
-      if (page->mutex().try_lock()) {
-        if (page->cursor_list.size() == 0
-              && page != ignore_page
-              && page->type() != Page::kTypeBroot) {
-          if (page->is_dirty())
-            candidates.push_back(page->address());
-          else
-            garbage.push_back(page);
+    size_t total = charged_elements();
+    size_t capacity = state.capacity_bytes / state.page_size_bytes;
+    if (total <= capacity)
+      return;
+
+    size_t limit = total - capacity;
+    size_t probation = 0;
+    for (int i = 0; i < CacheState::kShards; i++)
+      probation += state.shards[i].probation.size();
+
+    // first pass: the probationary queues
+    if (probation > 0) {
+      for (int i = 0; i < CacheState::kShards; i++) {
+        CacheShard &shard = state.shards[i];
+        ScopedSpinlock lock(shard.mutex);
+        size_t quota = (total - capacity) * shard.probation.size()
+                            / probation + 1;
+
+        Page *page = shard.probation.tail();
+        for (; quota > 0 && page != 0 && limit > 0; quota--, limit--) {
+          select_candidate(page, candidates, garbage, ignore_page);
+          page = page->previous(Page::kListProbation);
         }
-        page->mutex().unlock();
       }
+    }
 
-      page = page->previous(Page::kListCache);
+    // second pass: the LRU lists
+    if (limit > 0 && total > probation) {
+      size_t remaining = limit;
+      for (int i = 0; i < CacheState::kShards; i++) {
+        CacheShard &shard = state.shards[i];
+        ScopedSpinlock lock(shard.mutex);
+        size_t quota = remaining * shard.totallist.size()
+                            / (total - probation) + 1;
+
+        Page *page = shard.totallist.tail();
+        for (; quota > 0 && page != 0 && limit > 0; quota--, limit--) {
+          select_candidate(page, candidates, garbage, ignore_page);
+          page = page->previous(Page::kListCache);
+        }
+      }
     }
   }
 
-  // Visits all pages in the "totallist". If |cb| returns true then the
+  // Visits all cached pages. If |cb| returns true then the
   // page is removed and deleted. This is used by the Environment
   // to flush (and delete) pages.
   template<typename Purger>
   void purge_if(Purger &purger) {
-    PurgeIfSelector<Purger> selector(this, purger);
-    state.totallist.extract(selector);
+    for (int i = 0; i < CacheState::kShards; i++) {
+      CacheShard &shard = state.shards[i];
+      ScopedSpinlock lock(shard.mutex);
+      PurgeIfSelector<Purger> selector(this, shard, purger);
+      shard.probation.extract(selector);
+      shard.totallist.extract(selector);
+    }
   }
 
   // Returns true if the capacity limits are exceeded
   bool is_cache_full() const {
-    return state.totallist.size() * state.page_size_bytes
+    return charged_elements() * state.page_size_bytes
             > state.capacity_bytes;
   }
 
@@ -191,16 +317,96 @@ struct Cache
 
   // Returns the number of currently cached elements
   size_t current_elements() const {
-    return state.totallist.size();
+    size_t size = 0;
+    for (int i = 0; i < CacheState::kShards; i++)
+      size += state.shards[i].size();
+    return size;
+  }
+
+  // Returns the number of elements which are charged to the capacity:
+  // the cached pages, and the copies of their data on disk
+  size_t charged_elements() const {
+    size_t size = 0;
+    for (int i = 0; i < CacheState::kShards; i++)
+      size += state.shards[i].size() + state.shards[i].image_elements;
+    return size;
   }
 
   // Returns the number of currently cached elements (excluding those that
   // are mmapped)
   size_t allocated_elements() const {
-    return state.alloc_elements;
+    size_t size = 0;
+    for (int i = 0; i < CacheState::kShards; i++)
+      size += state.shards[i].alloc_elements;
+    return size;
+  }
+
+  // Returns the number of pages in the protected lists
+  size_t protected_elements() const {
+    size_t size = 0;
+    for (int i = 0; i < CacheState::kShards; i++)
+      size += state.shards[i].totallist.size();
+    return size;
+  }
+
+  // Moves an accessed page to the head of the protected list. The caller
+  // holds the shard's lock.
+  void touch(CacheShard &shard, Page *page) {
+    if (shard.probation.has(page)) {
+      shard.probation.del(page);
+      shard.totallist.put(page);
+
+      // demote pages of this shard if the protected lists exceed their
+      // limit; the sizes of the other shards are read without locking
+      // them, they are only needed as an estimate
+      while (state.policy == UPS_CACHE_POLICY_2Q
+              && shard.totallist.size() > 1
+              && protected_elements() > max_protected_elements) {
+        Page *tail = shard.totallist.tail();
+        shard.totallist.del(tail);
+        shard.probation.put(tail);
+      }
+      return;
+    }
+
+    shard.totallist.del(page);
+    shard.totallist.put(page);
+  }
+
+  // Removes a page from the cache. The caller holds the shard's lock.
+  void del_impl(CacheShard &shard, Page *page) {
+    // remove it from the list of all cached pages
+    bool removed = shard.totallist.del(page) || shard.probation.del(page);
+    if (removed && page->is_allocated())
+      shard.alloc_elements--;
+    if (removed && page->has_disk_image())
+      shard.image_elements--;
+
+    // remove the page from the cache buckets
+    shard.buckets[Impl::calc_hash(page->address())].del(page);
+  }
+
+  // Adds |page| to the purge candidates (if it's dirty) or to the
+  // garbage (if it's not), unless the page must not be evicted
+  static void select_candidate(Page *page, std::vector<uint64_t> &candidates,
+                  std::vector<Page *> &garbage, Page *ignore_page) {
+    if (page->mutex().try_lock()) {
+      if (page->cursor_list.size() == 0
+            && page != ignore_page
+            && page->type() != Page::kTypeBroot) {
+        if (page->is_dirty())
+          candidates.push_back(page->address());
+        else
+          garbage.push_back(page);
+      }
+      page->mutex().unlock();
+    }
   }
 
   CacheState state;
+
+  // the maximum number of pages in the protected lists (2Q only)
+  size_t max_protected_elements;
 };
 
 } // namespace upscaledb
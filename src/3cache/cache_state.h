@@ -24,8 +24,10 @@
 #include <vector>
 
 #include "ups/types.h"
+#include "ups/upscaledb_int.h"
 
 // Always verify that a file of level N does not include headers > N!
+#include "1base/spinlock.h"
 #include "2page/page.h"
 #include "2page/page_collection.h"
 #include "2config/env_config.h"
@@ -36,38 +38,47 @@
 
 namespace upscaledb {
 
-struct CacheState
+struct CacheShard
 {
   typedef PageCollection<Page::kListBucket> CacheLine;
 
   enum {
     // The number of buckets should be a prime number or similar, as it
     // is used in a MODULO hash scheme
-    kBucketSize = 10317,
+    kBucketSize = 1031,
   };
 
-  CacheState(const EnvConfig &config)
-    : capacity_bytes(ISSET(config.flags, UPS_CACHE_UNLIMITED)
-                            ? std::numeric_limits<uint64_t>::max()
-                            : config.cache_size_bytes),
-      page_size_bytes(config.page_size_bytes), alloc_elements(0),
-      buckets(kBucketSize), cache_hits(0), cache_misses(0) {
-    assert(capacity_bytes > 0);
+  CacheShard()
+    : alloc_elements(0), image_elements(0), buckets(kBucketSize),
+      cache_hits(0),
+      cache_misses(0) {
   }
 
-  // the capacity (in bytes)
-  uint64_t capacity_bytes;
+  // Returns the number of cached pages
+  size_t size() const {
+    return totallist.size() + probation.size();
+  }
 
-  // the current page size (in bytes)
-  uint64_t page_size_bytes;
+  // protects the lists, the buckets and the counters of this shard
+  Spinlock mutex;
 
   // the current number of cached elements that were allocated (and not
   // mapped)
   size_t alloc_elements;
 
-  // linked list of ALL cached pages
+  // the number of cached pages which keep a copy of their data on disk
+  // (see Page::keep_disk_image); each copy is charged like another page
+  size_t image_elements;
+
+  // linked list of cached pages, ordered by their last access; with the
+  // 2Q policy this is the "protected" queue of pages which were accessed
+  // more than once
   PageCollection<Page::kListCache> totallist;
 
+  // the "probationary" queue: pages which were accessed only once (2Q
+  // policy) and pages which were read by a scan
+  PageCollection<Page::kListProbation> probation;
+
   // The hash table buckets - each is a linked list of Page pointers
   std::vector<CacheLine> buckets;
 
@@ -78,6 +89,35 @@ struct CacheState
   uint64_t cache_misses;
 };
 
+struct CacheState
+{
+  enum {
+    // The number of independent shards
+    kShards = UPS_CACHE_SHARDS,
+  };
+
+  CacheState(const EnvConfig &config)
+    : capacity_bytes(ISSET(config.flags, UPS_CACHE_UNLIMITED)
+                            ? std::numeric_limits<uint64_t>::max()
+                            : config.cache_size_bytes),
+      page_size_bytes(config.page_size_bytes),
+      policy(config.cache_policy) {
+    assert(capacity_bytes > 0);
+  }
+
+  // the capacity (in bytes)
+  uint64_t capacity_bytes;
+
+  // the current page size (in bytes)
+  uint64_t page_size_bytes;
+
+  // the eviction policy (UPS_CACHE_POLICY_LRU or UPS_CACHE_POLICY_2Q)
+  int policy;
+
+  // the shards; each page is assigned to a shard by its address
+  CacheShard shards[kShards];
+};
+
 } // namespace upscaledb
 
 #endif /* UPS_CACHE_STATE_H */
@@ -20,6 +20,8 @@
 
 #include "0root/root.h"
 
+#include <algorithm>
+
 // Always verify that a file of level N does not include headers > N!
 #include "1base/signal.h"
 #include "1errorinducer/errorinducer.h"
@@ -39,6 +41,10 @@ namespace upscaledb {
 /* a unittest hook for Changeset::flush() */
 void (*g_CHANGESET_POST_LOG_HOOK)(void);
 
+/* a unittest hook for Changeset::flush(); called after the new pages were
+ * written, but before the Changeset is logged */
+void (*g_CHANGESET_PRE_LOG_HOOK)(void);
+
 struct UnlockPage {
   bool operator()(Page *page) {
 #ifdef UPS_ENABLE_HELGRIND
@@ -90,6 +96,67 @@ flush_changeset_to_file(std::vector<Page *> list, Device *device,
     device->flush();
 
   UPS_INDUCE_ERROR(ErrorInducer::kChangesetFlush);
+
+  /* the journal no longer has to recover this changeset */
+  journal->changeset_flushed(lsn);
+}
+
+struct PageAddressComparator {
+  bool operator()(const Page *lhs, const Page *rhs) const {
+    return lhs->address() < rhs->address();
+  }
+};
+
+// Writes the pages which were appended to the file in this Changeset
+// (UPS_PARAM_UNLOGGED_NEW_PAGES), and removes them from |list|. Nothing on
+// disk refers to these pages, therefore they are written directly instead
+// of being logged. They are synced before the other pages are logged.
+static void
+flush_new_pages(LocalEnv *env, std::vector<Page *> &list, uint64_t lsn)
+{
+  std::vector<Page *> pages;
+  std::vector<Page *>::iterator out = list.begin();
+  for (std::vector<Page *>::iterator it = list.begin();
+                  it != list.end();
+                  it++) {
+    if ((*it)->is_new())
+      pages.push_back(*it);
+    else
+      *out++ = *it;
+  }
+  list.erase(out, list.end());
+
+  if (pages.empty())
+    return;
+
+  std::sort(pages.begin(), pages.end(), PageAddressComparator());
+
+  try {
+    for (std::vector<Page *>::iterator it = pages.begin();
+                    it != pages.end();
+                    it++) {
+      if (likely((*it)->is_without_header() == false))
+        (*it)->set_lsn(lsn);
+      // the journal logs deltas the next time the page is modified
+      if (env->config.journal_page_deltas)
+        env->page_manager->keep_disk_image(*it);
+    }
+
+    for (size_t i = 0; i < pages.size(); i += Page::kMaxFlushBatch)
+      Page::flush(&pages[i], std::min(pages.size() - i,
+                              (size_t)Page::kMaxFlushBatch));
+
+    if (ISSET(env->config.flags, UPS_ENABLE_FSYNC))
+      env->device->flush();
+  }
+  catch (Exception &) {
+    UnlockPage unlocker;
+    std::for_each(pages.begin(), pages.end(), unlocker);
+    throw;
+  }
+
+  UnlockPage unlocker;
+  std::for_each(pages.begin(), pages.end(), unlocker);
 }
 
 void
@@ -116,6 +183,18 @@ Changeset::flush(uint64_t lsn)
   if (visitor.list.empty())
     return;
 
+  // Write the new pages directly; only the other pages are logged
+  if (env->config.unlogged_new_pages) {
+    size_t size = visitor.list.size();
+    flush_new_pages(env, visitor.list, lsn);
+    if (visitor.list.empty())
+      return;
+
+    if (unlikely(g_CHANGESET_PRE_LOG_HOOK != 0
+          && visitor.list.size() < size))
+      g_CHANGESET_PRE_LOG_HOOK();
+  }
+
   // Append all changes to the journal. This operation basically
   // "write-ahead logs" all changes.
   env->journal->append_changeset(visitor.list,
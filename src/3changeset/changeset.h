@@ -46,7 +46,7 @@ struct LocalEnv;
 
 struct Changeset {
   Changeset(LocalEnv *env_)
-  : env(env_) {
+  : env(env_), is_shared(false) {
   }
 
   /*
@@ -57,8 +57,11 @@ struct Changeset {
     return collection.get(address);
   }
 
-  /* Append a new page to the changeset. The page is locked. */
+  /* Append a new page to the changeset. The page is locked. Pages of a
+   * shared changeset are neither locked nor stored. */
   void put(Page *page) {
+    if (unlikely(is_shared))
+      return;
     if (!has(page))
       page->mutex().lock();
     collection.put(page);
@@ -95,6 +98,11 @@ struct Changeset {
 
   /* The pages which were added to this Changeset */
   PageCollection<Page::kListChangeset> collection;
+
+  /* True if this changeset belongs to a lookup which runs in parallel to
+   * other lookups (UPS_ENABLE_CONCURRENT_READS). Such lookups do not modify
+   * pages, and a page can only be locked by a single changeset. */
+  bool is_shared;
 };
 
 } // namespace upscaledb
@@ -22,15 +22,20 @@
 #ifndef WIN32
 #  include <libgen.h>
 #endif
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include "1base/error.h"
+#include "1base/signal.h"
 #include "1errorinducer/errorinducer.h"
+#include "1globals/globals.h"
 #include "1os/os.h"
 #include "2device/device.h"
 #include "2compressor/compressor_factory.h"
 #include "3journal/journal.h"
 #include "3page_manager/page_manager.h"
 #include "4db/db.h"
+#include "4cursor/cursor.h"
 #include "4txn/txn_local.h"
 #include "4env/env_local.h"
 #include "4context/context.h"
@@ -44,25 +49,12 @@
 namespace upscaledb {
 
 enum {
-  // switch log file after |kSwitchTxnThreshold| transactions
-  kSwitchTxnThreshold = 32,
-
   // flush buffers if this limit is exceeded
   kBufferLimit = 1024 * 1024, // 1 mb
 };
 
-static inline void
-clear_file(JournalState &state, int idx)
-{
-  if (state.files[idx].is_open()) {
-    state.files[idx].truncate(0);
-
-    // after truncate, the file pointer is far beyond the new end of file;
-    // reset the file pointer, or the next write will resize the file to
-    // the original size
-    state.files[idx].seek(0, File::kSeekSet);
-  }
-}
+// Maps the Txn IDs of a replication stream to the Txns which replay them
+typedef std::map<uint64_t, Txn *> ReplayTxnMap;
 
 static inline std::string
 log_file_path(JournalState &state, int i)
@@ -86,26 +78,530 @@ log_file_path(JournalState &state, int i)
     path += ::basename((char *)state.env->config.filename.c_str());
 #endif
   }
-  if (i == 0)
-    path += ".jrn0";
-  else if (i == 1)
-    path += ".jrn1";
-  else
-    assert(!"invalid index");
-  return (path);
+
+  char suffix[32];
+  ::snprintf(suffix, sizeof(suffix), ".jrn%d", i);
+  return path + suffix;
+}
+
+// Adds a segment to the journal; takes ownership of |file|
+static inline void
+add_segment(JournalState &state, File &file)
+{
+  JournalSegment *segment = new JournalSegment;
+  segment->file = std::move(file);
+
+  ScopedLock lock(state.sync_mutex);
+  state.segments.push_back(segment);
+}
+
+// Returns the segment with the |sequence| number, or null
+static inline JournalSegment *
+find_segment(JournalState &state, uint64_t sequence)
+{
+  for (size_t i = 0; i < state.segments.size(); i++) {
+    if (state.segments[i]->sequence == sequence)
+      return state.segments[i];
+  }
+  return 0;
+}
+
+// Returns the oldest segment which is newer than |sequence|, or null
+static inline JournalSegment *
+next_segment(JournalState &state, uint64_t sequence)
+{
+  JournalSegment *next = 0;
+  for (size_t i = 0; i < state.segments.size(); i++) {
+    JournalSegment *segment = state.segments[i];
+    if (segment->sequence > sequence
+          && (!next || segment->sequence < next->sequence))
+      next = segment;
+  }
+  return next;
+}
+
+// Writes the header of a segment; the header is followed by an empty
+// entry which terminates the (not yet existing) list of entries
+static inline void
+write_segment_header(JournalState &state, JournalSegment *segment,
+                bool terminate = false)
+{
+  uint8_t buffer[sizeof(PJournalSegmentHeader) + sizeof(PJournalEntry)] = {0};
+  PJournalSegmentHeader *header = (PJournalSegmentHeader *)&buffer[0];
+  header->magic = Journal::kMagic;
+  header->version = Journal::kVersion;
+  header->sequence = segment->sequence;
+  header->checkpoint_sequence = state.checkpoint_sequence;
+  header->checkpoint_offset = state.checkpoint_offset;
+  header->checkpoint_lsn = state.checkpoint_lsn;
+  header->replay_sequence = state.replay_sequence;
+  header->replay_offset = state.replay_offset;
+  header->file_size = state.logged_file_size;
+
+  segment->file.pwrite(0, buffer, terminate
+                            ? sizeof(buffer)
+                            : sizeof(PJournalSegmentHeader));
 }
 
+// Returns the size of the database file; in-memory Environments do not
+// have a file
+static inline uint64_t
+database_file_size(JournalState &state)
+{
+  if (ISSET(state.env->flags(), UPS_IN_MEMORY))
+    return 0;
+  return state.env->device->file_size();
+}
+
+// Reads the header of a segment file, and scans the entries to find the
+// end of the segment. Throws UPS_LOG_INV_FILE_HEADER if the header is
+// corrupt. An empty file is an unused segment. If the segment stores the
+// compressor's dictionary then it is returned in |dictionary|. The file
+// size of the newest Changeset is returned in |header->file_size|.
 static inline void
-flush_buffer(JournalState &state, int idx, bool fsync = false)
+read_segment_header(JournalSegment *segment, PJournalSegmentHeader *header,
+                ByteArray *dictionary)
+{
+  uint64_t file_size = segment->file.file_size();
+  if (file_size == 0)
+    return;
+
+  if (file_size < sizeof(PJournalSegmentHeader))
+    throw Exception(UPS_LOG_INV_FILE_HEADER);
+
+  segment->file.pread(0, header, sizeof(*header));
+  if (header->magic != Journal::kMagic
+        || header->version != Journal::kVersion
+        || header->sequence == 0)
+    throw Exception(UPS_LOG_INV_FILE_HEADER);
+
+  segment->sequence = header->sequence;
+  segment->offset = sizeof(PJournalSegmentHeader);
+
+  // skip all entries; stop at the terminating entry or at the end of file
+  PJournalEntry entry;
+  while (segment->offset + sizeof(entry) <= file_size) {
+    segment->file.pread(segment->offset, &entry, sizeof(entry));
+    if (entry.lsn == 0
+          || segment->offset + sizeof(entry) + entry.followup_size > file_size)
+      break;
+    if (entry.type == Journal::kEntryTypeDictionary) {
+      dictionary->resize((uint32_t)entry.followup_size);
+      segment->file.pread(segment->offset + sizeof(entry), dictionary->data(),
+                      (size_t)entry.followup_size);
+      segment->has_dictionary = true;
+    }
+    // the entry is complete, therefore it is more recent than the header
+    if (entry.type == Journal::kEntryTypeChangeset) {
+      PJournalEntryChangeset changeset;
+      segment->file.pread(segment->offset + sizeof(entry), &changeset,
+                      sizeof(changeset));
+      header->file_size = changeset.file_size;
+    }
+    segment->offset += sizeof(entry) + entry.followup_size;
+  }
+}
+
+// Returns the oldest segment with Txns which were not yet flushed to the
+// Btree, or null
+static inline JournalSegment *
+oldest_open_segment(JournalState &state)
+{
+  JournalSegment *oldest = 0;
+  for (size_t i = 0; i < state.segments.size(); i++) {
+    JournalSegment *segment = state.segments[i];
+    if (segment->open_txns > 0
+          && (!oldest || segment->sequence < oldest->sequence))
+      oldest = segment;
+  }
+  return oldest;
+}
+
+// Returns the number of bytes which are replayed by the logical recovery
+static inline uint64_t
+replay_bytes(JournalState &state)
+{
+  JournalSegment *oldest = oldest_open_segment(state);
+  if (!oldest)
+    return 0;
+
+  uint64_t bytes = state.buffer.size();
+  for (size_t i = 0; i < state.segments.size(); i++) {
+    JournalSegment *segment = state.segments[i];
+    if (segment->sequence >= oldest->sequence)
+      bytes += segment->offset - sizeof(PJournalSegmentHeader);
+  }
+  return bytes;
+}
+
+// Removes the Changesets which were written to the database file, and
+// returns true if the checkpoint moved. The checkpoint is "fuzzy": it does
+// not wait for pending writes, it just records the oldest Changeset and
+// the oldest Txn which still have to be recovered.
+static inline bool
+update_checkpoint(JournalState &state)
+{
+  uint64_t completed_lsn = state.completed_lsn.load();
+  while (!state.changesets.empty()
+          && state.changesets.front().lsn <= completed_lsn)
+    state.changesets.pop_front();
+
+  uint64_t sequence, offset;
+  if (!state.changesets.empty()) {
+    sequence = state.changesets.front().sequence;
+    offset = state.changesets.front().offset;
+  }
+  // all Changesets were written: recovery can start at the end of the
+  // current segment
+  else {
+    JournalSegment *segment = state.segments[state.current];
+    sequence = segment->sequence;
+    offset = segment->offset + state.buffer.size();
+  }
+
+  // the logical recovery starts with the oldest Txn which was not yet
+  // flushed; if there is none then it starts at the end of the current
+  // segment
+  uint64_t replay_sequence, replay_offset;
+  JournalSegment *oldest = oldest_open_segment(state);
+  if (oldest) {
+    replay_sequence = oldest->sequence;
+    replay_offset = sizeof(PJournalSegmentHeader);
+  }
+  else {
+    JournalSegment *segment = state.segments[state.current];
+    replay_sequence = segment->sequence;
+    replay_offset = segment->offset + state.buffer.size();
+  }
+
+  if (sequence == state.checkpoint_sequence
+        && offset == state.checkpoint_offset
+        && completed_lsn == state.checkpoint_lsn
+        && replay_sequence == state.replay_sequence
+        && replay_offset == state.replay_offset)
+    return false;
+
+  state.checkpoint_sequence = sequence;
+  state.checkpoint_offset = offset;
+  state.checkpoint_lsn = completed_lsn;
+  state.replay_sequence = replay_sequence;
+  state.replay_offset = replay_offset;
+  return true;
+}
+
+// Returns true if a segment can be recycled
+static inline bool
+is_recyclable(JournalState &state, JournalSegment *segment)
+{
+  return segment->sequence != 0
+          && (state.current < 0 || segment != state.segments[state.current])
+          && segment->open_txns == 0
+          && segment->sequence < state.checkpoint_sequence;
+}
+
+// Takes a segment into use: preallocates the file and writes the header
+static inline void
+activate_segment(JournalState &state, int idx)
+{
+  JournalSegment *segment = state.segments[idx];
+
+  // the commits of a recycled segment can no longer be replicated
+  if (segment->sequence != 0 && segment->last_lsn > state.truncated_lsn)
+    state.truncated_lsn = segment->last_lsn;
+
+  segment->file.preallocate(state.segment_size);
+  segment->sequence = state.next_sequence++;
+  segment->offset = sizeof(PJournalSegmentHeader);
+  segment->open_txns = 0;
+  segment->has_dictionary = false;
+  segment->last_lsn = 0;
+
+  state.current = idx;
+  state.num_transactions = 0;
+  update_checkpoint(state);
+  write_segment_header(state, segment, true);
+
+  // a recycled segment still contains the entries of its previous use;
+  // the new header must be durable before they are overwritten
+  if (ISSET(state.env->flags(), UPS_ENABLE_FSYNC))
+    segment->file.flush();
+}
+
+// Switches to the next segment: recycles the oldest segment, or uses an
+// unused one, or creates a new one
+static inline void
+switch_segment(JournalState &state)
+{
+  JournalSegment *oldest = 0;
+  int oldest_idx = -1;
+  int unused_idx = -1;
+
+  if (state.current >= 0)
+    update_checkpoint(state);
+
+  for (int i = 0; i < (int)state.segments.size(); i++) {
+    JournalSegment *segment = state.segments[i];
+    if (segment->sequence == 0) {
+      if (unused_idx == -1)
+        unused_idx = i;
+    }
+    else if (i != state.current
+          && (!oldest || segment->sequence < oldest->sequence)) {
+      oldest = segment;
+      oldest_idx = i;
+    }
+  }
+
+  if (oldest && is_recyclable(state, oldest)) {
+    activate_segment(state, oldest_idx);
+    return;
+  }
+
+  if (unused_idx == -1) {
+    unused_idx = (int)state.segments.size();
+    File file;
+    std::string path = log_file_path(state, unused_idx);
+    file.create(path.c_str(), 0644);
+    add_segment(state, file);
+  }
+
+  activate_segment(state, unused_idx);
+}
+
+// Returns the index of the current segment; takes a segment into use if
+// the journal is still empty
+static inline int
+current_segment(JournalState &state)
+{
+  if (unlikely(state.current < 0))
+    switch_segment(state);
+  return state.current;
+}
+
+static inline void
+flush_buffer(JournalState &state, bool fsync = false)
 {
   if (likely(state.buffer.size() > 0)) {
-    state.files[idx].write(state.buffer.data(), state.buffer.size());
-    state.count_bytes_flushed += state.buffer.size();
+    JournalSegment *segment = state.segments[current_segment(state)];
+    size_t size = state.buffer.size();
+
+    // append an empty entry; it terminates the list of entries, and is
+    // overwritten by the next write
+    PJournalEntry terminator;
+    state.buffer.append((uint8_t *)&terminator, sizeof(terminator));
+    segment->file.pwrite(segment->offset, state.buffer.data(),
+                    state.buffer.size());
+    segment->offset += size;
+    state.count_bytes_flushed += size;
 
     state.buffer.clear();
     if (unlikely(fsync))
-      state.files[idx].flush();
+      segment->file.flush();
+  }
+}
+
+// Remembers that the commits in [first_lsn, last_lsn] are not durable.
+// Requires |sync_mutex|. Consecutive failures are merged.
+static inline void
+add_sync_error(JournalState &state, uint64_t first_lsn, uint64_t last_lsn,
+                ups_status_t status)
+{
+  if (!state.sync_errors.empty()) {
+    SyncError &last = state.sync_errors.back();
+    if (last.last_lsn + 1 == first_lsn && last.status == status) {
+      last.last_lsn = last_lsn;
+      return;
+    }
   }
+
+  state.sync_errors.push_back(SyncError(first_lsn, last_lsn, status));
+  if (state.sync_errors.size() > Journal::kMaxSyncErrors)
+    state.sync_errors.pop_front();
+}
+
+// Returns the result of the sync of the commit with the |lsn|. Requires
+// |sync_mutex|.
+static inline ups_status_t
+sync_status(JournalState &state, uint64_t lsn)
+{
+  for (std::deque<SyncError>::reverse_iterator it
+                  = state.sync_errors.rbegin();
+          it != state.sync_errors.rend() && it->last_lsn >= lsn;
+          it++) {
+    if (it->first_lsn <= lsn)
+      return it->status;
+  }
+  return 0;
+}
+
+// The log writer thread. Syncs the files for all commits which were
+// written since the last sync, then wakes up the waiting threads
+static void
+run_log_writer(JournalState *state)
+{
+  ScopedLock lock(state->sync_mutex);
+
+  while (true) {
+    while (state->written_lsn == state->durable_lsn
+            && !state->stop_log_writer)
+      state->sync_cond.wait(lock);
+
+    // shut down, but only after all commits were synced
+    if (state->written_lsn == state->durable_lsn)
+      break;
+
+    uint64_t lsn = state->written_lsn;
+    std::vector<File *> files;
+    for (size_t i = 0; i < state->segments.size(); i++) {
+      if (state->segments[i]->unsynced) {
+        state->segments[i]->unsynced = false;
+        files.push_back(&state->segments[i]->file);
+      }
+    }
+    lock.unlock();
+
+    ups_status_t st = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+      try {
+        files[i]->flush();
+      }
+      catch (Exception &ex) {
+        st = ex.code;
+      }
+    }
+
+    lock.lock();
+    if (st)
+      add_sync_error(*state, state->durable_lsn + 1, lsn, st);
+    state->durable_lsn = lsn;
+    state->durable_cond.notify_all();
+
+    // invoke the callbacks of the asynchronous commits without holding
+    // the lock
+    std::vector<CommitCallback>::iterator end = state->callbacks.begin();
+    while (end != state->callbacks.end() && end->lsn <= lsn)
+      end++;
+    if (end != state->callbacks.begin()) {
+      std::vector<CommitCallback> ready(state->callbacks.begin(), end);
+      state->callbacks.erase(state->callbacks.begin(), end);
+      std::vector<ups_status_t> status(ready.size());
+      for (size_t i = 0; i < ready.size(); i++)
+        status[i] = sync_status(*state, ready[i].lsn);
+      lock.unlock();
+      for (size_t i = 0; i < ready.size(); i++)
+        ready[i].callback(status[i], ready[i].context);
+      lock.lock();
+    }
+  }
+}
+
+static inline void
+start_log_writer(JournalState &state)
+{
+  if (NOTSET(state.env->flags(), UPS_ENABLE_FSYNC) || state.log_writer.get())
+    return;
+
+  state.stop_log_writer = false;
+  state.log_writer.reset(new Thread(boost::bind(&run_log_writer, &state)));
+}
+
+static inline void
+stop_log_writer(JournalState &state)
+{
+  if (!state.log_writer.get())
+    return;
+
+  {
+    ScopedLock lock(state.sync_mutex);
+    state.stop_log_writer = true;
+    state.sync_cond.notify_one();
+  }
+
+  state.log_writer->join();
+  state.log_writer.reset(0);
+}
+
+// Writes a fuzzy checkpoint: flushes the committed Txns if the recovery
+// would take too long, then stores the checkpoint in the header of the
+// current segment. Skipped if the Environment is busy.
+static inline void
+write_checkpoint(JournalState &state)
+{
+  ScopedEnvLock lock;
+  if (!lock.try_acquire(state.env))
+    return;
+
+  if (state.current < 0 || state.disable_logging)
+    return;
+
+  try {
+    LocalTxnManager *txn_manager =
+            (LocalTxnManager *)state.env->txn_manager.get();
+    if (NOTSET(state.env->flags(), UPS_DONT_FLUSH_TRANSACTIONS)
+          && txn_manager->is_recovery_target_exceeded())
+      txn_manager->flush_committed_txns();
+
+    if (update_checkpoint(state))
+      write_segment_header(state, state.segments[state.current]);
+  }
+  catch (Exception &ex) {
+    ups_log(("failed to write journal checkpoint (error %d)", ex.code));
+  }
+}
+
+// The checkpointer thread. Periodically writes a fuzzy checkpoint
+static void
+run_checkpointer(JournalState *state)
+{
+  ScopedLock lock(state->checkpoint_mutex);
+
+  while (!state->stop_checkpointer) {
+    state->checkpoint_cond.timed_wait(lock,
+            boost::posix_time::milliseconds(state->checkpoint_interval));
+    if (state->stop_checkpointer)
+      break;
+
+    lock.unlock();
+    write_checkpoint(*state);
+    lock.lock();
+  }
+}
+
+static inline void
+start_checkpointer(JournalState &state)
+{
+  if (state.checkpointer.get())
+    return;
+
+  state.stop_checkpointer = false;
+  state.checkpointer.reset(new Thread(boost::bind(&run_checkpointer, &state)));
+}
+
+static inline void
+stop_checkpointer(JournalState &state)
+{
+  if (!state.checkpointer.get())
+    return;
+
+  {
+    ScopedLock lock(state.checkpoint_mutex);
+    state.stop_checkpointer = true;
+    state.checkpoint_cond.notify_one();
+  }
+
+  state.checkpointer->join();
+  state.checkpointer.reset(0);
+}
+
+// Hands the commit with the |lsn| (which was written to the current segment)
+// over to the log writer
+static inline void
+request_sync(JournalState &state, uint64_t lsn)
+{
+  ScopedLock lock(state.sync_mutex);
+  state.written_lsn = lsn;
+  state.segments[state.current]->unsynced = true;
+  state.sync_cond.notify_one();
 }
 
 // Sequentially returns the next journal entry, starting with
@@ -122,43 +618,26 @@ read_entry(JournalState &state, Journal::Iterator *iter, PJournalEntry *entry,
 {
   auxbuffer->clear();
 
-  // if iter->offset is 0, then the iterator was created from scratch
-  // and we start reading from the first (oldest) entry.
-  //
-  // The oldest of the two logfiles is always the "other" one (the one
-  // NOT in current_fd).
-  if (iter->offset == 0) {
-    iter->fdstart = iter->fdidx =
-                        state.current_fd == 0
-                            ? 1
-                            : 0;
-  }
-
-  // get the size of the journal file
-  uint64_t filesize = state.files[iter->fdidx].file_size();
-
-  // reached EOF? then either skip to the next file or we're done
-  if (filesize == iter->offset) {
-    if (iter->fdstart == iter->fdidx) {
-      iter->fdidx = iter->fdidx == 1 ? 0 : 1;
-      iter->offset = 0;
-      filesize = state.files[iter->fdidx].file_size();
-    }
-    else {
+  // if iter->sequence is 0, then the iterator was created from scratch
+  // and we start reading from the first entry of the oldest segment
+  JournalSegment *segment = iter->sequence == 0
+                                ? 0
+                                : find_segment(state, iter->sequence);
+
+  // reached the end of the segment? then skip to the next one
+  while (!segment || iter->offset >= segment->offset) {
+    segment = next_segment(state, iter->sequence);
+    if (!segment) {
       entry->lsn = 0;
       return;
     }
-  }
-
-  // second file is also empty? then return
-  if (filesize == iter->offset) {
-    entry->lsn = 0;
-    return;
+    iter->sequence = segment->sequence;
+    iter->offset = sizeof(PJournalSegmentHeader);
   }
 
   // now try to read the next entry
   try {
-    state.files[iter->fdidx].pread(iter->offset, entry, sizeof(*entry));
+    segment->file.pread(iter->offset, entry, sizeof(*entry));
 
     iter->offset += sizeof(*entry);
 
@@ -166,7 +645,7 @@ read_entry(JournalState &state, Journal::Iterator *iter, PJournalEntry *entry,
     if (entry->followup_size) {
       auxbuffer->resize((uint32_t)entry->followup_size);
 
-      state.files[iter->fdidx].pread(iter->offset, auxbuffer->data(),
+      segment->file.pread(iter->offset, auxbuffer->data(),
                       (size_t)entry->followup_size);
       iter->offset += entry->followup_size;
     }
@@ -178,9 +657,10 @@ read_entry(JournalState &state, Journal::Iterator *iter, PJournalEntry *entry,
 }
 
 
-// Appends an entry to the journal
+// Appends an entry to a buffer; either to the journal's buffer, or to the
+// buffer of a Txn
 static inline void
-append_entry(JournalState &state, int idx,
+append_entry(ByteArray &buffer,
             const uint8_t *ptr1 = 0, size_t ptr1_size = 0,
             const uint8_t *ptr2 = 0, size_t ptr2_size = 0,
             const uint8_t *ptr3 = 0, size_t ptr3_size = 0,
@@ -188,35 +668,201 @@ append_entry(JournalState &state, int idx,
             const uint8_t *ptr5 = 0, size_t ptr5_size = 0)
 {
   if (ptr1_size)
-    state.buffer.append(ptr1, ptr1_size);
+    buffer.append(ptr1, ptr1_size);
   if (ptr2_size)
-    state.buffer.append(ptr2, ptr2_size);
+    buffer.append(ptr2, ptr2_size);
   if (ptr3_size)
-    state.buffer.append(ptr3, ptr3_size);
+    buffer.append(ptr3, ptr3_size);
   if (ptr4_size)
-    state.buffer.append(ptr4, ptr4_size);
+    buffer.append(ptr4, ptr4_size);
   if (ptr5_size)
-    state.buffer.append(ptr5, ptr5_size);
+    buffer.append(ptr5, ptr5_size);
 }
 
-// Switches the log file if necessary; returns the new log descriptor in the
-// transaction
-static inline int
-switch_files_maybe(JournalState &state)
+// Returns true if the current segment is full
+static inline bool
+is_segment_full(JournalState &state)
 {
-  int other = state.current_fd ? 0 : 1;
+  return (state.threshold && state.num_transactions > state.threshold)
+          || state.segments[state.current]->offset + state.buffer.size()
+                >= state.segment_size;
+}
+
+// Assigns a transaction to the current segment; the segment is not
+// recycled before the transaction was flushed to the Btree. Segments are
+// only switched between transactions.
+static inline void
+register_txn(JournalState &state, LocalTxn *txn)
+{
+  if (txn->log_descriptor >= 0)
+    return;
+
+  // the checkpointer is started when the first Txn is written, and not
+  // already when the journal is opened - it must not run during recovery
+  if (unlikely(!state.checkpointer.get() && state.recovery_budget != 0))
+    start_checkpointer(state);
+
+  // if the current segment is full then flush the buffered entries and
+  // continue with the next segment
+  current_segment(state);
+  if (unlikely(is_segment_full(state))) {
+    flush_buffer(state);
+    switch_segment(state);
+  }
+
+  txn->log_descriptor = state.current;
+  state.segments[state.current]->open_txns++;
+  state.num_transactions++;
+}
+
+// Adds the first bytes of a key or record to the samples for the
+// compressor's dictionary. The dictionary is set on the borrowed
+// compressor |jc| as soon as enough samples were collected; the other
+// compressors pick it up when they are borrowed the next time. Txns are
+// encoded in parallel, therefore the samples are protected by a mutex
+// till the training is finished.
+static inline void
+train_dictionary(JournalState &state, JournalCompressor *jc,
+                const void *data, uint32_t size)
+{
+  if (likely(state.is_dictionary_trained))
+    return;
+
+  ScopedLock lock(state.dictionary_mutex);
+  if (state.is_dictionary_trained)
+    return;
+
+  size_t remaining = Journal::kDictionarySize - state.dictionary.size();
+  size = std::min(size, (uint32_t)Journal::kDictionarySampleSize);
+  state.dictionary.append((const uint8_t *)data,
+                  std::min((size_t)size, remaining));
+
+  if (state.dictionary.size() == Journal::kDictionarySize) {
+    if (jc->compressor->set_dictionary(state.dictionary.data(),
+                            state.dictionary.size()))
+      jc->has_dictionary = true;
+    else
+      state.dictionary.clear();
+    state.is_dictionary_trained = true;
+  }
+}
+
+// Sets the trained dictionary on the journal's own compressor, which
+// compresses the Changesets. Requires the Environment lock. Returns true
+// if the compressor uses the dictionary.
+static inline bool
+install_dictionary(JournalState &state)
+{
+  if (unlikely(!state.compressor_has_dictionary
+              && state.is_dictionary_trained
+              && !state.dictionary.is_empty())) {
+    state.compressor->set_dictionary(state.dictionary.data(),
+                    state.dictionary.size());
+    state.compressor_has_dictionary = true;
+  }
+  return state.compressor_has_dictionary;
+}
+
+// Appends the compressor's dictionary to the current segment, unless it
+// is already stored there. Each segment stores a copy, because older
+// segments are recycled.
+static inline void
+append_dictionary(JournalState &state, uint64_t lsn)
+{
+  JournalSegment *segment = state.segments[current_segment(state)];
+  if (likely(segment->has_dictionary
+              || !state.is_dictionary_trained
+              || state.dictionary.is_empty()))
+    return;
+
+  PJournalEntry entry;
+  entry.lsn = lsn;
+  entry.type = Journal::kEntryTypeDictionary;
+  entry.followup_size = state.dictionary.size();
+  append_entry(state.buffer, (uint8_t *)&entry, sizeof(entry),
+                  state.dictionary.data(), state.dictionary.size());
+  segment->has_dictionary = true;
+}
 
-  // determine the journal file which is used for this transaction 
-  // if the "current" file is not yet full, continue to write to this file
-  //
-  // otherwise delete the other file and use the other file as the current file
-  if (unlikely(state.num_transactions > state.threshold)) {
-    clear_file(state, other);
-    state.current_fd = other;
-    state.num_transactions = 0;
+// Borrows one of the journal's compressors while a Txn is encoded; the
+// compressors are not thread-safe
+struct ScopedCompressor {
+  ScopedCompressor(JournalState &state_)
+    : state(state_), jc(0) {
+    if (!state.compressor.get())
+      return;
+
+    {
+      ScopedLock lock(state.compressor_mutex);
+      if (!state.compressors.empty()) {
+        jc = state.compressors.back();
+        state.compressors.pop_back();
+      }
+    }
+    if (!jc)
+      jc = new JournalCompressor(CompressorFactory::create(
+                              state.env->config.journal_compressor));
+
+    // the dictionary is immutable after the training
+    if (unlikely(!jc->has_dictionary
+                && state.is_dictionary_trained
+                && !state.dictionary.is_empty())) {
+      jc->compressor->set_dictionary(state.dictionary.data(),
+                      state.dictionary.size());
+      jc->has_dictionary = true;
+    }
+  }
+
+  ~ScopedCompressor() {
+    if (jc) {
+      ScopedLock lock(state.compressor_mutex);
+      state.compressors.push_back(jc);
+    }
   }
 
-  return state.current_fd;
+  JournalState &state;
+  JournalCompressor *jc;
+};
+
+// Compresses a key or record. Returns the compressed size, or |size| if
+// the data does not shrink (then it is stored uncompressed). The
+// compressed data is stored in the compressor's arena.
+static inline uint32_t
+compress_payload(JournalCompressor *jc, JournalBuffer &buffer,
+                const void *data, uint32_t size)
+{
+  boost::posix_time::ptime start
+          = boost::posix_time::microsec_clock::universal_time();
+  uint32_t len = jc->compressor->compress((const uint8_t *)data, size);
+  buffer.count_compression_usec += (boost::posix_time::microsec_clock
+                  ::universal_time() - start).total_microseconds();
+
+  buffer.count_bytes_before_compression += size;
+  if (len >= size)
+    len = size;
+  else if (jc->has_dictionary)
+    buffer.uses_dictionary = true;
+  buffer.count_bytes_after_compression += len;
+  return len;
+}
+
+// Appends the entries of a Txn to the journal. They are preceded by the
+// compressor's dictionary if they were compressed with it, and if the
+// current segment does not yet store it.
+static inline void
+append_buffer(JournalState &state, LocalTxn *txn, JournalBuffer &buffer)
+{
+  register_txn(state, txn);
+
+  if (buffer.uses_dictionary)
+    append_dictionary(state, buffer.first_lsn);
+  if (!buffer.data.is_empty())
+    state.buffer.append(buffer.data.data(), buffer.data.size());
+
+  state.count_bytes_before_compression += buffer.count_bytes_before_compression;
+  state.count_bytes_after_compression += buffer.count_bytes_after_compression;
+  state.count_compression_usec += buffer.count_compression_usec;
+  buffer.clear();
 }
 
 // Returns a pointer to database. If the database was not yet opened then
@@ -229,6 +875,11 @@ get_db(JournalState &state, uint16_t dbname)
   if (it != state.database_map.end())
     return it->second;
 
+  // a standby can also replay to a database which was opened by the user
+  Env::DatabaseMap::iterator it2 = state.env->_database_map.find(dbname);
+  if (it2 != state.env->_database_map.end())
+    return it2->second;
+
   // not found - open it
   DbConfig config;
   config.db_name = dbname;
@@ -237,11 +888,17 @@ get_db(JournalState &state, uint16_t dbname)
   return db;
 }
 
-// Returns a pointer to a Txn object.
+// Returns a pointer to a Txn object. When replaying a replication stream,
+// the Txns are looked up in |txn_map| because their IDs are not patched.
 static inline Txn *
 get_txn(JournalState &state, LocalTxnManager *txn_manager,
-                uint64_t txn_id)
+                ReplayTxnMap *txn_map, uint64_t txn_id)
 {
+  if (txn_map) {
+    ReplayTxnMap::iterator it = txn_map->find(txn_id);
+    return it != txn_map->end() ? it->second : 0;
+  }
+
   Txn *txn = txn_manager->oldest_txn();
   while (txn) {
     if (txn->id == txn_id)
@@ -283,190 +940,663 @@ abort_uncommitted_txns(JournalState &state, LocalTxnManager *txn_manager)
   }
 }
 
-// Helper function which adds a single page from the changeset to
-// the Journal; returns the page size (or compressed size, if compression
-// was enabled)
+// Stores the byte ranges in which |data| differs from |base| in
+// |state.delta_arena|. Returns the size of the delta, or 0 if the delta
+// would not be much smaller than the full page
+static inline uint32_t
+compute_page_delta(JournalState &state, const uint8_t *base,
+                const uint8_t *data, uint32_t page_size)
+{
+  // pages are compared word by word; ranges with a gap of less than
+  // |kMinGap| equal bytes are merged, because a new range costs
+  // sizeof(PJournalPageDelta) bytes
+  const uint32_t kWord = sizeof(uint64_t);
+  const uint32_t kMinGap = 2 * sizeof(PJournalPageDelta);
+  const uint32_t limit = page_size / 2;
+
+  state.delta_arena.resize(limit);
+  uint8_t *p = state.delta_arena.data();
+  uint32_t size = 0;
+
+  uint32_t i = 0;
+  while (i < page_size) {
+    // skip the unmodified words
+    while (i < page_size && ::memcmp(base + i, data + i, kWord) == 0)
+      i += kWord;
+    if (i == page_size)
+      break;
+
+    // extend the range till the next gap
+    uint32_t start = i;
+    uint32_t end = i + kWord;
+    for (i = end; i < page_size; i += kWord) {
+      if (::memcmp(base + i, data + i, kWord) != 0)
+        end = i + kWord;
+      else if (i + kWord - end >= kMinGap)
+        break;
+    }
+
+    PJournalPageDelta range;
+    range.offset = start;
+    range.size = end - start;
+    if (size + sizeof(range) + range.size > limit)
+      return 0;
+    ::memcpy(p + size, &range, sizeof(range));
+    ::memcpy(p + size + sizeof(range), data + start, range.size);
+    size += sizeof(range) + range.size;
+    i = end;
+  }
+
+  return size;
+}
+
+// Appends a single page (or its delta) to the Journal; returns the page
+// size (or compressed size, if compression was enabled)
 static inline uint32_t
 append_changeset_page(JournalState &state, Page *page, uint32_t page_size)
 {
   PJournalEntryPageHeader header(page->address());
 
+  const uint8_t *data = (const uint8_t *)page->data();
+  uint32_t size = page_size;
+
+  if (state.page_deltas) {
+    // the page was already written to disk: only log the modified ranges
+    const uint8_t *base = page->disk_image();
+    if (base) {
+      header.delta_size = compute_page_delta(state, base, data, page_size);
+      if (header.delta_size > 0) {
+        data = state.delta_arena.data();
+        size = header.delta_size;
+      }
+      // the page was rewritten too much; the copy is not worth its memory
+      else
+        state.env->page_manager->release_disk_image(page);
+    }
+    // otherwise log the full image; the next time a delta is logged
+    else
+      state.env->page_manager->keep_disk_image(page);
+  }
+
   if (state.compressor.get()) {
-    state.count_bytes_before_compression += page_size;
-    header.compressed_size = state.compressor->compress((uint8_t *)page->data(),
-                    page_size);
-    append_entry(state, state.current_fd, (uint8_t *)&header, sizeof(header),
+    state.count_bytes_before_compression += size;
+    header.compressed_size = state.compressor->compress(data, size);
+    append_entry(state.buffer, (uint8_t *)&header, sizeof(header),
                     state.compressor->arena.data(),
                     header.compressed_size);
     state.count_bytes_after_compression += header.compressed_size;
     return header.compressed_size + sizeof(header);
   }
 
-  append_entry(state, state.current_fd, (uint8_t *)&header, sizeof(header),
-                (uint8_t *)page->data(), page_size);
-  return page_size + sizeof(header);
+  append_entry(state.buffer, (uint8_t *)&header, sizeof(header), data, size);
+  return size + sizeof(header);
 }
 
-// Scans a file for the oldest changeset. Returns the lsn of this
-// changeset.
+// Applies a page delta to |page|
+static inline void
+apply_page_delta(Page *page, const uint8_t *delta, uint32_t delta_size,
+                uint32_t page_size)
+{
+  uint8_t *data = (uint8_t *)page->data();
+  const uint8_t *end = delta + delta_size;
+
+  while (delta < end) {
+    PJournalPageDelta range;
+    ::memcpy(&range, delta, sizeof(range));
+    delta += sizeof(range);
+    if (range.offset + range.size > page_size
+          || delta + range.size > end) {
+      ups_log(("invalid page delta or journal is corrupt"));
+      throw Exception(UPS_INTEGRITY_VIOLATED);
+    }
+    ::memcpy(data + range.offset, delta, range.size);
+    delta += range.size;
+  }
+}
+
+// Redo all Changesets of a segment, in chronological order, starting at
+// the file |offset|
+// Returns the highest lsn of the last changeset applied
 static inline uint64_t
-scan_for_oldest_changeset(JournalState &state, File *file)
+redo_all_changesets(JournalState &state, JournalSegment *segment,
+                uint64_t offset)
 {
   Journal::Iterator it;
   PJournalEntry entry;
   ByteArray buffer;
+  uint64_t max_lsn = 0;
+
+  it.offset = offset;
 
-  // get the next entry
+  // for each entry...
   try {
-    uint64_t filesize = file->file_size();
+    while (it.offset < segment->offset) {
+      segment->file.pread(it.offset, &entry, sizeof(entry));
 
-    while (it.offset < filesize) {
-      file->pread(it.offset, &entry, sizeof(entry));
+      // Skip all log entries which are NOT from a changeset
+      if (entry.type != Journal::kEntryTypeChangeset) {
+        it.offset += sizeof(entry) + entry.followup_size;
+        continue;
+      }
 
-      if (entry.lsn == 0)
-        break;
+      max_lsn = entry.lsn;
 
-      if (entry.type == Journal::kEntryTypeChangeset) {
-        return entry.lsn;
-      }
+      it.offset += sizeof(entry);
+
+      // Read the Changeset header
+      PJournalEntryChangeset changeset;
+      segment->file.pread(it.offset, &changeset, sizeof(changeset));
+      it.offset += sizeof(changeset);
+
+      uint32_t page_size = state.env->config.page_size_bytes;
+      ByteArray arena(page_size);
+      ByteArray tmp;
+
+      uint64_t file_size = state.env->device->file_size();
+
+      state.env->page_manager->set_last_blob_page_id(changeset.last_blob_page);
+
+      // for each page in this changeset...
+      for (uint32_t i = 0; i < changeset.num_pages; i++) {
+        PJournalEntryPageHeader page_header;
+        segment->file.pread(it.offset, &page_header, sizeof(page_header));
+        it.offset += sizeof(page_header);
+
+        // a delta is smaller than the page
+        uint32_t size = page_header.delta_size
+                            ? page_header.delta_size
+                            : page_size;
+        if (page_header.compressed_size > 0) {
+          tmp.resize(page_size);
+          segment->file.pread(it.offset, tmp.data(),
+                        page_header.compressed_size);
+          it.offset += page_header.compressed_size;
+          state.compressor->decompress(tmp.data(),
+                        page_header.compressed_size, size, &arena);
+        }
+        else {
+          segment->file.pread(it.offset, arena.data(), size);
+          it.offset += size;
+        }
+
+        Page *page;
+
+        // a delta is applied to the page on disk
+        if (page_header.delta_size > 0) {
+          if (page_header.address + page_size > file_size) {
+            ups_log(("page delta for a page beyond the end of the file"));
+            throw Exception(UPS_INTEGRITY_VIOLATED);
+          }
+
+          if (page_header.address == 0)
+            page = state.env->header->header_page;
+          else
+            page = new Page(state.env->device.get());
+          page->fetch(page_header.address);
+
+          apply_page_delta(page, arena.data(), page_header.delta_size,
+                          page_size);
+        }
+        // otherwise write the page image to disk
+        else if (page_header.address == file_size) {
+          file_size += page_size;
+
+          page = new Page(state.env->device.get());
+          page->alloc(0);
+        }
+        else if (page_header.address > file_size) {
+          file_size = (size_t)page_header.address + page_size;
+          state.env->device->truncate(file_size);
 
-      // increment the offset
-      it.offset += sizeof(entry) + entry.followup_size;
+          page = new Page(state.env->device.get());
+          page->fetch(page_header.address);
+        }
+        else {
+          if (page_header.address == 0)
+            page = state.env->header->header_page;
+          else
+            page = new Page(state.env->device.get());
+          page->fetch(page_header.address);
+        }
+        assert(page->address() == page_header.address);
+
+        // overwrite the page data
+        if (page_header.delta_size == 0)
+          ::memcpy(page->data(), arena.data(), page_size);
+
+        // flush the modified page to disk
+        page->set_dirty(true);
+        page->flush();
+
+        if (page_header.address != 0)
+          delete page;
+      }
     }
   }
-  catch (Exception &ex) {
-    ups_log(("exception (error %d) while reading journal", ex.code));
+  catch (Exception &) {
+    ups_trace(("Exception when applying changeset"));
+    // propagate error
+    throw;
   }
 
-  return 0;
+  return max_lsn;
 }
 
-// Redo all Changesets of a log file, in chronological order
-// Returns the highest lsn of the last changeset applied
+// Recovers (re-applies) the physical changelog; returns the lsn of the
+// newest Changeset
 static inline uint64_t
-redo_all_changesets(JournalState &state, int fdidx)
+recover_changeset(JournalState &state)
 {
-  Journal::Iterator it;
-  PJournalEntry entry;
-  ByteArray buffer;
-  uint64_t max_lsn = 0;
+  // the newest segment stores the checkpoint: the position of the oldest
+  // Changeset which was maybe not yet written to the database file. All
+  // older segments are skipped. If the checkpoint is unknown then
+  // all Changesets are reapplied.
+  JournalSegment *segment = find_segment(state, state.checkpoint_sequence);
+  uint64_t offset = state.checkpoint_offset;
+  if (!segment) {
+    segment = next_segment(state, 0);
+    offset = sizeof(PJournalSegmentHeader);
+  }
 
-  // for each entry...
-  try {
-    uint64_t log_file_size = state.files[fdidx].file_size();
+  // if there are no Changesets after the checkpoint then the checkpoint's
+  // lsn is the lsn of the newest Changeset
+  uint64_t max_lsn = state.checkpoint_lsn;
 
-    while (it.offset < log_file_size) {
-      state.files[fdidx].pread(it.offset, &entry, sizeof(entry));
+  // now redo all changesets chronologically
+  for (; segment != 0; segment = next_segment(state, segment->sequence)) {
+    uint64_t lsn = redo_all_changesets(state, segment, offset);
+    if (lsn > max_lsn)
+      max_lsn = lsn;
+    offset = sizeof(PJournalSegmentHeader);
+  }
 
-      // Skip all log entries which are NOT from a changeset
-      if (entry.type != Journal::kEntryTypeChangeset) {
-        it.offset += sizeof(entry) + entry.followup_size;
-        continue;
+  return max_lsn;
+}
+
+// Decodes the key (and the record) of an insert or erase entry; they are
+// decompressed if necessary
+static inline void
+decode_entry(JournalState &state, JournalRecoveryEntry *e)
+{
+  switch (e->entry.type) {
+    case Journal::kEntryTypeInsert: {
+      PJournalEntryInsert *ins = (PJournalEntryInsert *)e->buffer.data();
+      if (!ins) {
+        e->status = UPS_IO_ERROR;
+        return;
+      }
+
+      uint8_t *payload = ins->key_data();
+
+      // extract the key - it can be compressed or uncompressed
+      if (ins->compressed_key_size != 0) {
+        state.compressor->decompress(payload, ins->compressed_key_size,
+                        ins->key_size, &e->key_arena);
+        e->key.data = e->key_arena.data();
+        payload += ins->compressed_key_size;
+      }
+      else {
+        e->key.data = payload;
+        payload += ins->key_size;
+      }
+      e->key.size = ins->key_size;
+
+      // extract the record - it can be compressed or uncompressed
+      if (ins->compressed_record_size != 0) {
+        state.compressor->decompress(payload, ins->compressed_record_size,
+                        ins->record_size, &e->record_arena);
+        e->record.data = e->record_arena.data();
+      }
+      else
+        e->record.data = payload;
+      e->record.size = ins->record_size;
+      break;
+    }
+    case Journal::kEntryTypeErase: {
+      PJournalEntryErase *er = (PJournalEntryErase *)e->buffer.data();
+      if (!er) {
+        e->status = UPS_IO_ERROR;
+        return;
       }
 
-      max_lsn = entry.lsn;
+      if (er->compressed_key_size != 0) {
+        state.compressor->decompress(er->key_data(), er->compressed_key_size,
+                        er->key_size, &e->key_arena);
+        e->key.data = e->key_arena.data();
+      }
+      else
+        e->key.data = er->key_data();
+      e->key.size = er->key_size;
+      break;
+    }
+  }
+}
+
+// Decodes all entries of a single database, in lsn order
+static void
+decode_partition(JournalState *state,
+                std::vector<JournalRecoveryEntry *> *entries,
+                boost::atomic<size_t> *pending, Signal *signal)
+{
+  for (std::vector<JournalRecoveryEntry *>::iterator it = entries->begin();
+                  it != entries->end();
+                  it++) {
+    try {
+      decode_entry(*state, *it);
+    }
+    catch (Exception &ex) {
+      (*it)->status = ex.code;
+    }
+  }
+
+  if (pending && pending->fetch_sub(1) == 1)
+    signal->notify();
+}
+
+// Decodes the insert and erase entries of a batch. The entries are
+// partitioned by database, and the partitions of a compressed journal are
+// decompressed in parallel. Only the decoding runs in parallel; the
+// entries are re-applied by the caller
+static inline void
+decode_batch(JournalState &state, std::vector<JournalRecoveryEntry *> &batch,
+                size_t count, uint64_t start_lsn)
+{
+  state.partition_map.clear();
+  for (size_t i = 0; i < count; i++) {
+    JournalRecoveryEntry *e = batch[i];
+    e->status = 0;
+    if ((e->entry.type == Journal::kEntryTypeInsert
+              || e->entry.type == Journal::kEntryTypeErase)
+          && e->entry.lsn > start_lsn)
+      state.partition_map[e->entry.dbname].push_back(e);
+  }
+
+  if (state.partition_map.empty())
+    return;
+
+  JournalState::PartitionMap::iterator it = state.partition_map.begin();
+
+  // uncompressed entries are cheap to decode; do it in this thread
+  if (!state.decode_pool.get() || state.partition_map.size() == 1) {
+    for (; it != state.partition_map.end(); it++)
+      decode_partition(&state, &it->second, 0, 0);
+    return;
+  }
+
+  // the first partition is decoded by this thread, the others are
+  // dispatched to the pool
+  Signal signal;
+  boost::atomic<size_t> pending(state.partition_map.size() - 1);
+  std::vector<JournalRecoveryEntry *> *first = &it->second;
+  for (it++; it != state.partition_map.end(); it++)
+    state.decode_pool->enqueue_parallel(boost::bind(&decode_partition,
+                            &state, &it->second, &pending, &signal));
+
+  decode_partition(&state, first, 0, 0);
+  signal.wait();
+}
+
+// Closes a Cursor which was created for replaying an insert;
+// ups_cursor_close would acquire the lock of the Environment
+static inline void
+close_cursor(Cursor *cursor)
+{
+  cursor->close();
+  if (cursor->txn)
+    cursor->txn->release();
+  cursor->db->remove_cursor(cursor);
+  delete cursor;
+}
+
+// Re-applies a single journal entry. |txn_map| is null during recovery;
+// otherwise it stores the Txns of a replication stream which are replayed
+static inline ups_status_t
+redo_entry(JournalState &state, LocalTxnManager *txn_manager,
+                JournalRecoveryEntry *e, uint64_t start_lsn,
+                ReplayTxnMap *txn_map = 0)
+{
+  PJournalEntry &entry = e->entry;
+  ups_status_t st = 0;
+
+  switch (entry.type) {
+    case Journal::kEntryTypeTxnBegin: {
+      Txn *txn = 0;
+      st = ups_txn_begin((ups_txn_t **)&txn, (ups_env_t *)state.env, 
+              (const char *)e->buffer.data(), 0, UPS_DONT_LOCK);
+      if (st != 0)
+        break;
+      // a standby has its own Txn IDs; otherwise patch the txn ID
+      if (txn_map) {
+        (*txn_map)[entry.txn_id] = txn;
+      }
+      else {
+        txn->id = entry.txn_id;
+        txn_manager->set_txn_id(entry.txn_id);
+      }
+      break;
+    }
+    case Journal::kEntryTypeTxnAbort: {
+      Txn *txn = get_txn(state, txn_manager, txn_map, entry.txn_id);
+      st = ups_txn_abort((ups_txn_t *)txn, UPS_DONT_LOCK);
+      if (txn_map)
+        txn_map->erase(entry.txn_id);
+      break;
+    }
+    case Journal::kEntryTypeTxnCommit: {
+      Txn *txn = get_txn(state, txn_manager, txn_map, entry.txn_id);
+      st = ups_txn_commit((ups_txn_t *)txn, UPS_DONT_LOCK);
+      if (txn_map)
+        txn_map->erase(entry.txn_id);
+      break;
+    }
+    case Journal::kEntryTypeInsert: {
+      // do not insert if the key was already flushed to disk
+      if (entry.lsn <= start_lsn)
+        break;
+      if (e->status)
+        return e->status;
+
+      PJournalEntryInsert *ins = (PJournalEntryInsert *)e->buffer.data();
+      Txn *txn = 0;
+      if (entry.txn_id)
+        txn = get_txn(state, txn_manager, txn_map, entry.txn_id);
+      Db *db = get_db(state, entry.dbname);
+
+      // always use a cursor; otherwise flags like UPS_DUPLICATE_INSERT_FIRST
+      // will cause errors
+      ups_cursor_t *cursor;
+      st = ups_cursor_create(&cursor, (ups_db_t *)db, (ups_txn_t *)txn,
+                      UPS_DONT_LOCK);
+      if (unlikely(st))
+        break;
+      st = ups_cursor_insert(cursor, &e->key, &e->record,
+                      ins->insert_flags | UPS_DONT_LOCK);
+      close_cursor((Cursor *)cursor);
+      if (st == UPS_DUPLICATE_KEY) // ok if key already exists
+        st = 0;
+      break;
+    }
+    case Journal::kEntryTypeErase: {
+      // do not erase if the key was already erased from disk
+      if (entry.lsn <= start_lsn)
+        break;
+      if (e->status)
+        return e->status;
+
+      PJournalEntryErase *er = (PJournalEntryErase *)e->buffer.data();
+      Txn *txn = 0;
+      if (entry.txn_id)
+        txn = get_txn(state, txn_manager, txn_map, entry.txn_id);
+      Db *db = get_db(state, entry.dbname);
+      st = ups_db_erase((ups_db_t *)db, (ups_txn_t *)txn, &e->key,
+                      er->erase_flags | UPS_DONT_LOCK);
+      // key might have already been erased when the changeset
+      // was flushed
+      if (st == UPS_KEY_NOT_FOUND)
+        st = 0;
+      break;
+    }
+    case Journal::kEntryTypeChangeset: {
+      // skip this; the changeset was already applied
+      break;
+    }
+    case Journal::kEntryTypeDictionary: {
+      // skip this; the dictionary was loaded when the journal was opened
+      break;
+    }
+    default:
+      ups_log(("invalid journal entry type or journal is corrupt"));
+      st = UPS_IO_ERROR;
+  }
+
+  return st;
+}
 
-      it.offset += sizeof(entry);
+// Reads the entries from the journal files (for the recovery)
+struct SegmentReader {
+  SegmentReader(JournalState &state_, Journal::Iterator &it_)
+    : state(state_), it(it_) {
+  }
 
-      // Read the Changeset header
-      PJournalEntryChangeset changeset;
-      state.files[fdidx].pread(it.offset, &changeset, sizeof(changeset));
-      it.offset += sizeof(changeset);
+  // Reads the next entry; returns false after the last entry
+  bool next(PJournalEntry *entry, ByteArray *buffer) {
+    read_entry(state, &it, entry, buffer);
+    return entry->lsn != 0;
+  }
 
-      uint32_t page_size = state.env->config.page_size_bytes;
-      ByteArray arena(page_size);
-      ByteArray tmp;
+  JournalState &state;
+  Journal::Iterator &it;
+};
 
-      uint64_t file_size = state.env->device->file_size();
+// Reads the entries from a replication stream (ups_env_apply_journal)
+struct StreamReader {
+  StreamReader(const uint8_t *data, uint32_t size)
+    : p(data), end(data + size) {
+  }
 
-      state.env->page_manager->set_last_blob_page_id(changeset.last_blob_page);
+  // Reads the next entry; returns false after the last entry
+  bool next(PJournalEntry *entry, ByteArray *buffer) {
+    buffer->clear();
+    if (p == end)
+      return false;
 
-      // for each page in this changeset...
-      for (uint32_t i = 0; i < changeset.num_pages; i++) {
-        PJournalEntryPageHeader page_header;
-        state.files[fdidx].pread(it.offset, &page_header,
-                        sizeof(page_header));
-        it.offset += sizeof(page_header);
-        if (page_header.compressed_size > 0) {
-          tmp.resize(page_size);
-          state.files[fdidx].pread(it.offset, tmp.data(),
-                        page_header.compressed_size);
-          it.offset += page_header.compressed_size;
-          state.compressor->decompress(tmp.data(),
-                        page_header.compressed_size, page_size, &arena);
-        }
-        else {
-          state.files[fdidx].pread(it.offset, arena.data(), page_size);
-          it.offset += page_size;
-        }
+    if ((size_t)(end - p) < sizeof(*entry)) {
+      ups_trace(("replication stream is truncated"));
+      throw Exception(UPS_INV_PARAMETER);
+    }
+    ::memcpy(entry, p, sizeof(*entry));
+    p += sizeof(*entry);
 
-        Page *page;
+    if (entry->lsn == 0 || entry->followup_size > (uint64_t)(end - p)) {
+      ups_trace(("replication stream is corrupt"));
+      throw Exception(UPS_INV_PARAMETER);
+    }
+    if (entry->followup_size) {
+      buffer->resize((uint32_t)entry->followup_size);
+      ::memcpy(buffer->data(), p, (size_t)entry->followup_size);
+      p += entry->followup_size;
+    }
+    return true;
+  }
 
-        // now write the page to disk
-        if (page_header.address == file_size) {
-          file_size += page_size;
+  const uint8_t *p;
+  const uint8_t *end;
+};
 
-          page = new Page(state.env->device.get());
-          page->alloc(0);
-        }
-        else if (page_header.address > file_size) {
-          file_size = (size_t)page_header.address + page_size;
-          state.env->device->truncate(file_size);
+// Re-applies all entries of |reader|. The entries are read in batches;
+// the keys and records of each batch are decoded first (in parallel if
+// the journal is compressed), then this thread re-applies the entries in
+// lsn order.
+template<typename Reader>
+static inline ups_status_t
+redo_all_entries(JournalState &state, LocalTxnManager *txn_manager,
+                Reader &reader, uint64_t start_lsn, ReplayTxnMap *txn_map)
+{
+  ups_status_t st = 0;
+  std::vector<JournalRecoveryEntry *> batch;
 
-          page = new Page(state.env->device.get());
-          page->fetch(page_header.address);
-        }
-        else {
-          if (page_header.address == 0)
-            page = state.env->header->header_page;
-          else
-            page = new Page(state.env->device.get());
-          page->fetch(page_header.address);
+  try {
+    bool eof = false;
+    while (!eof && st == 0) {
+      // read the next batch of entries
+      size_t count = 0;
+      for (; count < Journal::kRecoveryBatchSize; count++) {
+        if (count == batch.size())
+          batch.push_back(new JournalRecoveryEntry);
+
+        JournalRecoveryEntry *e = batch[count];
+        if (!reader.next(&e->entry, &e->buffer)) {
+          eof = true;
+          break;
         }
-        assert(page->address() == page_header.address);
-
-        // overwrite the page data
-        ::memcpy(page->data(), arena.data(), page_size);
+      }
 
-        // flush the modified page to disk
-        page->set_dirty(true);
-        page->flush();
+      decode_batch(state, batch, count, start_lsn);
 
-        if (page_header.address != 0)
-          delete page;
-      }
+      // re-apply the operations
+      for (size_t i = 0; i < count && st == 0; i++)
+        st = redo_entry(state, txn_manager, batch[i], start_lsn, txn_map);
     }
   }
-  catch (Exception &) {
-    ups_trace(("Exception when applying changeset"));
-    // propagate error
-    throw;
+  catch (Exception &ex) {
+    st = ex.code;
   }
 
-  return max_lsn;
+  for (size_t i = 0; i < batch.size(); i++)
+    delete batch[i];
+  state.partition_map.clear();
+  return st;
 }
 
-// Recovers (re-applies) the physical changelog; returns the lsn of the
-// Changelog
-static inline uint64_t
-recover_changeset(JournalState &state)
+// Appends a Txn (or the operation of a temporary Txn) to a replication
+// stream. The keys and records are decoded; the stream is not compressed.
+static inline void
+append_to_stream(JournalState &state, ByteArray &stream,
+                const uint8_t *data, uint32_t size)
 {
-  // scan through both files, look for the file with the oldest changeset.
-  uint64_t lsn1 = scan_for_oldest_changeset(state, &state.files[0]);
-  uint64_t lsn2 = scan_for_oldest_changeset(state, &state.files[1]);
-
-  // both files are empty or do not contain a changeset?
-  if (lsn1 == 0 && lsn2 == 0)
-    return 0;
-
-  // now redo all changesets chronologically
-  state.current_fd = lsn1 < lsn2 ? 0 : 1;
-
-  uint64_t max_lsn1 = redo_all_changesets(state, state.current_fd);
-  uint64_t max_lsn2 = redo_all_changesets(state, state.current_fd == 0 ? 1 : 0);
-
-  // return the lsn of the newest changeset
-  return std::max(max_lsn1, max_lsn2);
+  StreamReader reader(data, size);
+  JournalRecoveryEntry e;
+  while (reader.next(&e.entry, &e.buffer)) {
+    PJournalEntry entry = e.entry;
+    switch (entry.type) {
+      case Journal::kEntryTypeInsert: {
+        decode_entry(state, &e);
+        if (e.status)
+          throw Exception(e.status);
+        PJournalEntryInsert *ins = (PJournalEntryInsert *)e.buffer.data();
+        PJournalEntryInsert insert;
+        insert.key_size = ins->key_size;
+        insert.record_size = ins->record_size;
+        insert.insert_flags = ins->insert_flags;
+        entry.followup_size = sizeof(PJournalEntryInsert) - 1
+                                + e.key.size + e.record.size;
+        append_entry(stream, (uint8_t *)&entry, sizeof(entry),
+                (uint8_t *)&insert, sizeof(PJournalEntryInsert) - 1,
+                (uint8_t *)e.key.data, e.key.size,
+                (uint8_t *)e.record.data, e.record.size);
+        break;
+      }
+      case Journal::kEntryTypeErase: {
+        decode_entry(state, &e);
+        if (e.status)
+          throw Exception(e.status);
+        PJournalEntryErase *er = (PJournalEntryErase *)e.buffer.data();
+        PJournalEntryErase erase;
+        erase.key_size = er->key_size;
+        erase.erase_flags = er->erase_flags;
+        erase.duplicate = er->duplicate;
+        entry.followup_size = sizeof(PJournalEntryErase) - 1 + e.key.size;
+        append_entry(stream, (uint8_t *)&entry, sizeof(entry),
+                (uint8_t *)&erase, sizeof(PJournalEntryErase) - 1,
+                (uint8_t *)e.key.data, e.key.size);
+        break;
+      }
+      default:
+        append_entry(stream, (uint8_t *)&entry, sizeof(entry),
+                e.buffer.data(), e.buffer.size());
+        break;
+    }
+  }
 }
 
 // Recovers the logical journal
@@ -474,16 +1604,15 @@ static inline void
 recover_journal(JournalState &state, Context *context,
                 LocalTxnManager *txn_manager, uint64_t start_lsn)
 {
-  ups_status_t st = 0;
   Journal::Iterator it;
-  ByteArray buffer;
 
   /* recovering the journal is rather simple - we iterate over the
    * files and re-apply EVERY operation (incl. txn_begin and txn_abort),
    * that was not yet flushed with a Changeset.
    *
-   * Basically we iterate over both log files and skip everything with
-   * a sequence number (lsn) smaller the one of the last Changeset.
+   * Basically we iterate over the segments (starting at the checkpoint)
+   * and skip everything with a sequence number (lsn) smaller the one of
+   * the last Changeset.
    *
    * When done then auto-abort all transactions that were not yet
    * committed.
@@ -497,149 +1626,25 @@ recover_journal(JournalState &state, Context *context,
   // do not append to the journal during recovery
   state.disable_logging = true;
 
-  do {
-    PJournalEntry entry;
-
-    // get the next entry
-    read_entry(state, &it, &entry, &buffer);
-
-    // reached end of logfile?
-    if (!entry.lsn)
-      break;
-
-    // re-apply this operation
-    switch (entry.type) {
-      case Journal::kEntryTypeTxnBegin: {
-        Txn *txn = 0;
-        st = ups_txn_begin((ups_txn_t **)&txn, (ups_env_t *)state.env, 
-                (const char *)buffer.data(), 0, UPS_DONT_LOCK);
-        // on success: patch the txn ID
-        if (st == 0) {
-          txn->id = entry.txn_id;
-          txn_manager->set_txn_id(entry.txn_id);
-        }
-        break;
-      }
-      case Journal::kEntryTypeTxnAbort: {
-        Txn *txn = get_txn(state, txn_manager, entry.txn_id);
-        st = ups_txn_abort((ups_txn_t *)txn, UPS_DONT_LOCK);
-        break;
-      }
-      case Journal::kEntryTypeTxnCommit: {
-        Txn *txn = get_txn(state, txn_manager, entry.txn_id);
-        st = ups_txn_commit((ups_txn_t *)txn, UPS_DONT_LOCK);
-        break;
-      }
-      case Journal::kEntryTypeInsert: {
-        PJournalEntryInsert *ins = (PJournalEntryInsert *)buffer.data();
-        Txn *txn = 0;
-        Db *db;
-        ups_key_t key = {0};
-        ups_record_t record = {0};
-        if (!ins) {
-          st = UPS_IO_ERROR;
-          goto bail;
-        }
-
-        // do not insert if the key was already flushed to disk
-        if (entry.lsn <= start_lsn)
-          continue;
-
-        uint8_t *payload = ins->key_data();
-
-        // extract the key - it can be compressed or uncompressed
-        ByteArray keyarena;
-        if (ins->compressed_key_size != 0) {
-          state.compressor->decompress(payload, ins->compressed_key_size,
-                          ins->key_size);
-          keyarena.append(state.compressor->arena.data(), ins->key_size);
-          key.data = keyarena.data();
-          payload += ins->compressed_key_size;
-        }
-        else {
-          key.data = payload;
-          payload += ins->key_size;
-        }
-        key.size = ins->key_size;
-        // extract the record - it can be compressed or uncompressed
-        ByteArray recarena;
-        if (ins->compressed_record_size != 0) {
-          state.compressor->decompress(payload, ins->compressed_record_size,
-                          ins->record_size);
-          recarena.append(state.compressor->arena.data(), ins->record_size);
-          record.data = recarena.data();
-          payload += ins->compressed_record_size;
-        }
-        else {
-          record.data = payload;
-          payload += ins->record_size;
-        }
-        record.size = ins->record_size;
-        if (entry.txn_id)
-          txn = get_txn(state, txn_manager, entry.txn_id);
-        db = get_db(state, entry.dbname);
-
-        // always use a cursor; otherwise flags like UPS_DUPLICATE_INSERT_FIRST
-        // will cause errors
-        ups_cursor_t *cursor;
-        st = ups_cursor_create(&cursor, (ups_db_t *)db, (ups_txn_t *)txn, 0);
-        if (unlikely(st))
-          break;
-        st = ups_cursor_insert(cursor, &key, &record,
-                        ins->insert_flags | UPS_DONT_LOCK);
-        ups_cursor_close(cursor);
-        if (st == UPS_DUPLICATE_KEY) // ok if key already exists
-          st = 0;
-        break;
-      }
-      case Journal::kEntryTypeErase: {
-        PJournalEntryErase *e = (PJournalEntryErase *)buffer.data();
-        Txn *txn = 0;
-        Db *db;
-        ups_key_t key = {0};
-        if (!e) {
-          st = UPS_IO_ERROR;
-          goto bail;
-        }
+  // start with the oldest Txn which was not yet flushed when the last
+  // checkpoint was written
+  if (find_segment(state, state.replay_sequence)) {
+    it.sequence = state.replay_sequence;
+    it.offset = state.replay_offset;
+  }
 
-        // do not erase if the key was already erased from disk
-        if (entry.lsn <= start_lsn)
-          continue;
-
-        if (entry.txn_id)
-          txn = get_txn(state, txn_manager, entry.txn_id);
-        db = get_db(state, entry.dbname);
-        key.data = e->key_data();
-        if (e->compressed_key_size != 0) {
-          state.compressor->decompress(e->key_data(), e->compressed_key_size,
-                          e->key_size);
-          key.data = state.compressor->arena.data();
-        }
-        else
-          key.data = e->key_data();
-        key.size = e->key_size;
-        st = ups_db_erase((ups_db_t *)db, (ups_txn_t *)txn, &key,
-                        e->erase_flags | UPS_DONT_LOCK);
-        // key might have already been erased when the changeset
-        // was flushed
-        if (st == UPS_KEY_NOT_FOUND)
-          st = 0;
-        break;
-      }
-      case Journal::kEntryTypeChangeset: {
-        // skip this; the changeset was already applied
-        break;
-      }
-      default:
-        ups_log(("invalid journal entry type or journal is corrupt"));
-        st = UPS_IO_ERROR;
-      }
+  // decompressing is expensive; use a thread pool for decoding if the
+  // journal is compressed
+  size_t num_threads = Globals::ms_recovery_decode_threads > 0
+                          ? (size_t)Globals::ms_recovery_decode_threads
+                          : boost::thread::hardware_concurrency();
+  if (state.compressor.get() && num_threads > 1)
+    state.decode_pool.reset(new WorkerPool(num_threads - 1));
 
-      if (st)
-        goto bail;
-  } while (1);
+  SegmentReader reader(state, it);
+  ups_status_t st = redo_all_entries(state, txn_manager, reader, start_lsn, 0);
+  state.decode_pool.reset(0);
 
-bail:
   // all transactions which are not yet committed will be aborted
   abort_uncommitted_txns(state, txn_manager);
 
@@ -659,13 +1664,22 @@ bail:
 
 
 JournalState::JournalState(LocalEnv *env_)
-  : env(env_), current_fd(0), num_transactions(0),
-    threshold(env_->config.journal_switch_threshold),
+  : env(env_), current(-1), next_sequence(1),
+    segment_size(Journal::kSegmentSize), num_transactions(0),
+    threshold(env_->config.journal_switch_threshold), completed_lsn(0),
+    checkpoint_sequence(0), checkpoint_offset(0), checkpoint_lsn(0),
+    replay_sequence(0), replay_offset(0), logged_file_size(0),
+    recovery_budget((uint64_t)env_->config.recovery_target_sec
+                    * Journal::kReplayBytesPerSecond),
     disable_logging(false), count_bytes_flushed(0),
-    count_bytes_before_compression(0), count_bytes_after_compression(0)
+    count_bytes_before_compression(0), count_bytes_after_compression(0),
+    count_compression_usec(0), is_dictionary_trained(false),
+    compressor_has_dictionary(false),
+    page_deltas(env_->config.journal_page_deltas), commit_lsn(0), written_lsn(0), durable_lsn(0),
+    stop_log_writer(false), stop_checkpointer(false),
+    checkpoint_interval(1000), truncated_lsn(0), tail_lsn(0),
+    tail_sequence(0), tail_offset(0)
 {
-  if (threshold == 0)
-    threshold = kSwitchTxnThreshold;
 }
 
 Journal::Journal(LocalEnv *env)
@@ -676,31 +1690,121 @@ Journal::Journal(LocalEnv *env)
     state.compressor.reset(CompressorFactory::create(algo));
 }
 
+Journal::~Journal()
+{
+  stop_checkpointer(state);
+  stop_log_writer(state);
+
+  for (size_t i = 0; i < state.segments.size(); i++)
+    delete state.segments[i];
+
+  for (size_t i = 0; i < state.compressors.size(); i++)
+    delete state.compressors[i];
+}
+
 void
 Journal::create()
 {
-  // create the two files
+  // create the first two segments; they are taken into use when the
+  // first entry is written
   for (int i = 0; i < 2; i++) {
+    File file;
+    std::string path = log_file_path(state, i);
+    file.create(path.c_str(), 0644);
+    add_segment(state, file);
+  }
+
+  // more segments might exist from a previous Environment with the same
+  // name; truncate them, otherwise they would be recovered
+  for (int i = 2; ; i++) {
     std::string path = log_file_path(state, i);
-    state.files[i].create(path.c_str(), 0644);
+    if (!File::exists(path.c_str()))
+      break;
+    File file;
+    file.open(path.c_str(), false);
+    file.truncate(0);
+    add_segment(state, file);
   }
+
+  state.logged_file_size = database_file_size(state);
+  start_log_writer(state);
 }
 
 void
 Journal::open()
 {
-  // open the two files
+  // open all segments; the first one is mandatory
   try {
-    std::string path = log_file_path(state, 0);
-    state.files[0].open(path.c_str(), false);
-    path = log_file_path(state, 1);
-    state.files[1].open(path.c_str(), 0);
+    for (int i = 0; ; i++) {
+      std::string path = log_file_path(state, i);
+      if (i > 0 && !File::exists(path.c_str()))
+        break;
+      File file;
+      file.open(path.c_str(), false);
+      add_segment(state, file);
+
+      // read the header; the newest segment is the current one, and its
+      // header stores the checkpoint for the recovery
+      PJournalSegmentHeader header;
+      JournalSegment *segment = state.segments[i];
+      read_segment_header(segment, &header, &state.dictionary);
+      if (segment->sequence >= state.next_sequence) {
+        state.next_sequence = segment->sequence + 1;
+        state.current = i;
+        state.checkpoint_sequence = header.checkpoint_sequence;
+        state.checkpoint_offset = header.checkpoint_offset;
+        state.checkpoint_lsn = header.checkpoint_lsn;
+        state.replay_sequence = header.replay_sequence;
+        state.replay_offset = header.replay_offset;
+        state.logged_file_size = header.file_size;
+      }
+    }
   }
-  catch (Exception &ex) {
-    state.files[1].close();
-    state.files[0].close();
-    throw ex;
+  catch (Exception &) {
+    close(true);
+    throw;
+  }
+
+  // an empty journal does not know the file size
+  if (state.logged_file_size == 0)
+    state.logged_file_size = database_file_size(state);
+
+  // all segments store the same dictionary; it is required for
+  // decompressing the entries during recovery
+  if (!state.dictionary.is_empty()) {
+    if (!state.compressor.get()
+          || !state.compressor->set_dictionary(state.dictionary.data(),
+                                state.dictionary.size())) {
+      ups_log(("journal was compressed with a dictionary, but the compressor "
+               "does not support it"));
+      close(true);
+      throw Exception(UPS_INV_PARAMETER);
+    }
+    state.is_dictionary_trained = true;
+    state.compressor_has_dictionary = true;
   }
+
+  start_log_writer(state);
+}
+
+bool
+Journal::is_recovery_target_exceeded()
+{
+  return state.recovery_budget != 0
+          && replay_bytes(state) > state.recovery_budget;
+}
+
+void
+Journal::release_txn(LocalTxn *txn)
+{
+  if (txn->log_descriptor < 0
+        || txn->log_descriptor >= (int)state.segments.size())
+    return;
+
+  JournalSegment *segment = state.segments[txn->log_descriptor];
+  if (segment->open_txns > 0)
+    segment->open_txns--;
+  txn->log_descriptor = -1;
 }
 
 void
@@ -718,15 +1822,15 @@ Journal::append_txn_begin(LocalTxn *txn, const char *name, uint64_t lsn)
   if (name)
     entry.followup_size = ::strlen(name) + 1;
 
-  int cur = txn->log_descriptor = switch_files_maybe(state);
+  JournalBuffer &buffer = txn->journal_buffer;
+  if (buffer.first_lsn == 0)
+    buffer.first_lsn = lsn;
 
   if (unlikely(txn->name.size()))
-    append_entry(state, cur, (uint8_t *)&entry, (uint32_t)sizeof(entry),
+    append_entry(buffer.data, (uint8_t *)&entry, (uint32_t)sizeof(entry),
                 (uint8_t *)txn->name.c_str(), (uint32_t)txn->name.size() + 1);
   else
-    append_entry(state, cur, (uint8_t *)&entry, (uint32_t)sizeof(entry));
-
-  state.num_transactions++;
+    append_entry(buffer.data, (uint8_t *)&entry, (uint32_t)sizeof(entry));
 }
 
 void
@@ -742,15 +1846,52 @@ Journal::append_txn_commit(LocalTxn *txn, uint64_t lsn)
   entry.txn_id = txn->id;
   entry.type = Journal::kEntryTypeTxnCommit;
 
-  append_entry(state, txn->log_descriptor, (uint8_t *)&entry, sizeof(entry));
+  // the entries of the Txn were already encoded; append them, followed
+  // by the commit
+  append_buffer(state, txn, txn->journal_buffer);
+  append_entry(state.buffer, (uint8_t *)&entry, sizeof(entry));
+  state.segments[state.current]->last_lsn = lsn;
+
+  // flush after commit; the file is synced by the log writer, and the
+  // caller waits for it after releasing the Environment lock
+  if (likely(state.log_writer.get() != 0)) {
+    flush_buffer(state);
+    request_sync(state, lsn);
+    state.commit_lsn = lsn;
+  }
+  else
+    flush_buffer(state, ISSET(state.env->flags(), UPS_ENABLE_FSYNC));
+}
+
+void
+Journal::wait_for_commit(uint64_t lsn)
+{
+  ScopedLock lock(state.sync_mutex);
+  while (state.durable_lsn < lsn)
+    state.durable_cond.wait(lock);
+
+  ups_status_t st = sync_status(state, lsn);
+  if (unlikely(st != 0))
+    throw Exception(st);
+}
+
+bool
+Journal::notify_commit(uint64_t lsn, ups_txn_commit_callback_t callback,
+                void *context, ups_status_t *status)
+{
+  ScopedLock lock(state.sync_mutex);
+  if (state.durable_lsn < lsn) {
+    state.callbacks.push_back(CommitCallback(lsn, callback, context));
+    return true;
+  }
 
-  // flush after commit
-  flush_buffer(state, state.current_fd,
-                  ISSET(state.env->flags(), UPS_ENABLE_FSYNC));
+  // already durable
+  *status = sync_status(state, lsn);
+  return false;
 }
 
 void
-Journal::append_insert(Db *db, LocalTxn *txn,
+Journal::append_insert(uint16_t dbname, LocalTxn *txn,
                 ups_key_t *key, ups_record_t *record, uint32_t flags,
                 uint64_t lsn)
 {
@@ -762,84 +1903,82 @@ Journal::append_insert(Db *db, LocalTxn *txn,
   PJournalEntry entry;
 
   entry.lsn = lsn;
-  entry.dbname = db->name();
+  entry.dbname = dbname;
   entry.type = Journal::kEntryTypeInsert;
+  entry.txn_id = ISSET(txn->flags, UPS_TXN_TEMPORARY) ? 0 : txn->id;
   // the followup_size will be filled in later when we know whether
   // compression is used
   entry.followup_size = sizeof(PJournalEntryInsert) - 1;
 
-  int idx;
-  if (ISSET(txn->flags, UPS_TXN_TEMPORARY)) {
-    entry.txn_id = 0;
-    idx = switch_files_maybe(state);
-    state.num_transactions++;
-  }
-  else {
-    entry.txn_id = txn->id;
-    idx = txn->log_descriptor;
-  }
-
   PJournalEntryInsert insert;
   insert.key_size = key->size;
   insert.record_size = record->size;
   insert.insert_flags = flags;
 
-  // we need the current position in the file buffer. if compression is enabled
-  // then we do not know the actual followup-size of this entry. it will be
-  // patched in later.
-  uint32_t entry_position = state.buffer.size();
+  JournalBuffer &buffer = txn->journal_buffer;
+  if (buffer.first_lsn == 0)
+    buffer.first_lsn = lsn;
+
+  // we need the current position in the Txn's buffer. if compression is
+  // enabled then we do not know the actual followup-size of this entry. it
+  // will be patched in later.
+  uint32_t entry_position = buffer.data.size();
 
   // write the header information
-  append_entry(state, idx, (uint8_t *)&entry, sizeof(entry),
+  append_entry(buffer.data, (uint8_t *)&entry, sizeof(entry),
               (uint8_t *)&insert, sizeof(PJournalEntryInsert) - 1);
 
   // try to compress the payload; if the compressed result is smaller than
   // the original (uncompressed) payload then use it
+  ScopedCompressor sc(state);
+  if (sc.jc) {
+    train_dictionary(state, sc.jc, key->data, key->size);
+    train_dictionary(state, sc.jc, record->data, record->size);
+  }
+
   const void *key_data = key->data;
   uint32_t key_size = key->size;
-  if (state.compressor.get()) {
-    state.count_bytes_before_compression += key_size;
-    uint32_t len = state.compressor->compress((uint8_t *)key->data, key->size);
+  if (sc.jc) {
+    uint32_t len = compress_payload(sc.jc, buffer, key->data, key->size);
     if (len < key->size) {
       key_size = len;
-      key_data = state.compressor->arena.data();
+      key_data = sc.jc->compressor->arena.data();
       insert.compressed_key_size = len;
     }
-    state.count_bytes_after_compression += key_size;
   }
-  append_entry(state, idx, (uint8_t *)key_data, key_size);
+  append_entry(buffer.data, (uint8_t *)key_data, key_size);
   entry.followup_size += key_size;
 
   // and now the same for the record data
   const void *record_data = record->data;
   uint32_t record_size = record->size;
-  if (state.compressor.get()) {
-    state.count_bytes_before_compression += record_size;
-    uint32_t len = state.compressor->compress((uint8_t *)record->data,
-                    record_size);
+  if (sc.jc) {
+    uint32_t len = compress_payload(sc.jc, buffer, record->data, record_size);
     if (len < record_size) {
       record_size = len;
-      record_data = state.compressor->arena.data();
+      record_data = sc.jc->compressor->arena.data();
       insert.compressed_record_size = len;
     }
-    state.count_bytes_after_compression += record_size;
   }
-  append_entry(state, idx, (uint8_t *)record_data, record_size);
+  append_entry(buffer.data, (uint8_t *)record_data, record_size);
   entry.followup_size += record_size;
 
   // now overwrite the patched entry
-  state.buffer.overwrite(entry_position,
+  buffer.data.overwrite(entry_position,
                   (uint8_t *)&entry, sizeof(entry));
-  state.buffer.overwrite(entry_position + sizeof(entry),
+  buffer.data.overwrite(entry_position + sizeof(entry),
                   (uint8_t *)&insert, sizeof(PJournalEntryInsert) - 1);
 
-  if (ISSET(txn->flags, UPS_TXN_TEMPORARY))
-    flush_buffer(state, state.current_fd,
-                    ISSET(state.env->flags(), UPS_ENABLE_FSYNC));
+  // a temporary Txn is not committed; its entries are flushed immediately
+  if (ISSET(txn->flags, UPS_TXN_TEMPORARY)) {
+    append_buffer(state, txn, buffer);
+    state.segments[state.current]->last_lsn = lsn;
+    flush_buffer(state, ISSET(state.env->flags(), UPS_ENABLE_FSYNC));
+  }
 }
 
 void
-Journal::append_erase(Db *db, LocalTxn *txn, ups_key_t *key,
+Journal::append_erase(uint16_t dbname, LocalTxn *txn, ups_key_t *key,
                 int duplicate_index, uint32_t flags, uint64_t lsn)
 {
   if (unlikely(state.disable_logging))
@@ -850,46 +1989,44 @@ Journal::append_erase(Db *db, LocalTxn *txn, ups_key_t *key,
   const void *payload_data = key->data;
   uint32_t payload_size = key->size;
 
+  JournalBuffer &buffer = txn->journal_buffer;
+  if (buffer.first_lsn == 0)
+    buffer.first_lsn = lsn;
+
   // try to compress the payload; if the compressed result is smaller than
   // the original (uncompressed) payload then use it
-  if (state.compressor.get()) {
-    state.count_bytes_before_compression += payload_size;
-    uint32_t len = state.compressor->compress((uint8_t *)key->data, key->size);
+  ScopedCompressor sc(state);
+  if (sc.jc) {
+    train_dictionary(state, sc.jc, key->data, key->size);
+
+    uint32_t len = compress_payload(sc.jc, buffer, key->data, key->size);
     if (len < key->size) {
-      payload_data = state.compressor->arena.data();
+      payload_data = sc.jc->compressor->arena.data();
       payload_size = len;
       erase.compressed_key_size = len;
     }
-    state.count_bytes_after_compression += payload_size;
   }
 
   entry.lsn = lsn;
-  entry.dbname = db->name();
+  entry.dbname = dbname;
   entry.type = Journal::kEntryTypeErase;
+  entry.txn_id = ISSET(txn->flags, UPS_TXN_TEMPORARY) ? 0 : txn->id;
   entry.followup_size = sizeof(PJournalEntryErase) + payload_size - 1;
   erase.key_size = key->size;
   erase.erase_flags = flags;
   erase.duplicate = duplicate_index;
 
-  int idx;
-  if (ISSET(txn->flags, UPS_TXN_TEMPORARY)) {
-    entry.txn_id = 0;
-    idx = switch_files_maybe(state);
-    state.num_transactions++;
-  }
-  else {
-    entry.txn_id = txn->id;
-    idx = txn->log_descriptor;
-  }
-
-  // append the entry to the logfile
-  append_entry(state, idx, (uint8_t *)&entry, sizeof(entry),
+  // append the entry to the Txn's buffer
+  append_entry(buffer.data, (uint8_t *)&entry, sizeof(entry),
                 (uint8_t *)&erase, sizeof(PJournalEntryErase) - 1,
                 (uint8_t *)payload_data, payload_size);
 
-  if (ISSET(txn->flags, UPS_TXN_TEMPORARY))
-    flush_buffer(state, state.current_fd,
-                    ISSET(state.env->flags(), UPS_ENABLE_FSYNC));
+  // a temporary Txn is not committed; its entries are flushed immediately
+  if (ISSET(txn->flags, UPS_TXN_TEMPORARY)) {
+    append_buffer(state, txn, buffer);
+    state.segments[state.current]->last_lsn = lsn;
+    flush_buffer(state, ISSET(state.env->flags(), UPS_ENABLE_FSYNC));
+  }
 }
 
 int
@@ -901,6 +2038,11 @@ Journal::append_changeset(std::vector<Page *> &pages,
   if (unlikely(state.disable_logging))
     return -1;
 
+  // the pages are compressed with the dictionary, therefore the current
+  // segment has to store it before the Changeset
+  if (state.compressor.get() && install_dictionary(state))
+    append_dictionary(state, lsn);
+
   PJournalEntry entry;
   PJournalEntryChangeset changeset;
   
@@ -912,14 +2054,22 @@ Journal::append_changeset(std::vector<Page *> &pages,
   entry.followup_size = sizeof(PJournalEntryChangeset);
   changeset.num_pages = pages.size();
   changeset.last_blob_page = last_blob_page;
+  changeset.file_size = database_file_size(state);
+  state.logged_file_size = changeset.file_size;
 
   // we need the current position in the file buffer. if compression is enabled
   // then we do not know the actual followup-size of this entry. it will be
   // patched in later.
   uint32_t entry_position = state.buffer.size();
 
+  // remember the position of the changeset; it is the checkpoint for the
+  // recovery until the pages were written to the database file
+  JournalSegment *segment = state.segments[current_segment(state)];
+  state.changesets.push_back(JournalChangeset(lsn, segment->sequence,
+                          segment->offset + entry_position));
+
   // write the data to the file
-  append_entry(state, state.current_fd, (uint8_t *)&entry, sizeof(entry),
+  append_entry(state.buffer, (uint8_t *)&entry, sizeof(entry),
                 (uint8_t *)&changeset, sizeof(PJournalEntryChangeset));
 
   size_t page_size = state.env->config.page_size_bytes;
@@ -936,29 +2086,165 @@ Journal::append_changeset(std::vector<Page *> &pages,
 
   UPS_INDUCE_ERROR(ErrorInducer::kChangesetFlush);
 
+  // update the checkpoint in the segment header; it is synced together
+  // with the changeset
+  if (update_checkpoint(state))
+    write_segment_header(state, segment);
+
   // and flush the file
-  flush_buffer(state, state.current_fd,
-                  ISSET(state.env->flags(), UPS_ENABLE_FSYNC));
+  flush_buffer(state, ISSET(state.env->flags(), UPS_ENABLE_FSYNC));
+
+  // the database file is modified next; commits in the older segments must
+  // be durable even if the log writer did not yet sync them
+  if (unlikely(state.log_writer.get() != 0)) {
+    std::vector<File *> files;
+    {
+      ScopedLock lock(state.sync_mutex);
+      for (size_t i = 0; i < state.segments.size(); i++) {
+        if (state.segments[i] != segment && state.segments[i]->unsynced)
+          files.push_back(&state.segments[i]->file);
+      }
+    }
+    for (size_t i = 0; i < files.size(); i++)
+      files[i]->flush();
+  }
 
   UPS_INDUCE_ERROR(ErrorInducer::kChangesetFlush);
 
-  return state.current_fd;
+  // switch to the next segment if this one is full; the segment with the
+  // Transactions which were just flushed can then be recycled
+  if (unlikely(is_segment_full(state)))
+    switch_segment(state);
+
+  return state.current;
+}
+
+uint64_t
+Journal::read_committed(uint64_t lsn, ByteArray *stream)
+{
+  stream->clear();
+
+  // the lsn's are not persistent; an lsn which was not yet assigned is
+  // from a previous session. And the commits of recycled segments are lost.
+  if (lsn >= state.env->lsn_manager.current.load()
+        || lsn < state.truncated_lsn) {
+    ups_trace(("journal no longer stores the commits after lsn %llu",
+                (unsigned long long)lsn));
+    throw Exception(UPS_LIMITS_REACHED);
+  }
+
+  // only commits which are durable are replicated
+  uint64_t durable_lsn = ~(uint64_t)0;
+  if (state.log_writer.get()) {
+    ScopedLock lock(state.sync_mutex);
+    durable_lsn = state.durable_lsn;
+  }
+
+  // the dictionary might have been trained after the journal was opened
+  if (state.compressor.get())
+    install_dictionary(state);
+
+  // continue where the previous call stopped, otherwise start with the
+  // oldest segment
+  Journal::Iterator it;
+  if (state.tail_sequence != 0 && lsn == state.tail_lsn
+        && find_segment(state, state.tail_sequence)) {
+    it.sequence = state.tail_sequence;
+    it.offset = state.tail_offset;
+  }
+
+  // the entries of a Txn are stored en bloc, followed by the commit;
+  // the entries of temporary Txns are committed immediately
+  Journal::Iterator tail = it;
+  uint64_t last_lsn = lsn;
+  PJournalEntry entry;
+  ByteArray buffer;
+  ByteArray txn_entries;
+  while (stream->size() < Journal::kMaxStreamSize) {
+    read_entry(state, &it, &entry, &buffer);
+    if (!entry.lsn)
+      break;
+
+    if (entry.type == Journal::kEntryTypeTxnAbort) {
+      txn_entries.clear();
+      continue;
+    }
+    if (entry.type == Journal::kEntryTypeTxnBegin)
+      txn_entries.clear();
+    else if (entry.type == Journal::kEntryTypeTxnCommit) {
+      // stop at the first commit which is not yet durable
+      if (entry.lsn > durable_lsn)
+        break;
+    }
+    // skip changesets and dictionaries
+    else if (entry.type != Journal::kEntryTypeInsert
+          && entry.type != Journal::kEntryTypeErase)
+      continue;
+
+    append_entry(txn_entries, (uint8_t *)&entry, sizeof(entry),
+                buffer.data(), buffer.size());
+
+    // wait for the commit; the operation of a temporary Txn is committed
+    // immediately
+    if (entry.type != Journal::kEntryTypeTxnCommit && entry.txn_id != 0)
+      continue;
+
+    if (entry.lsn > lsn) {
+      append_to_stream(state, *stream, txn_entries.data(),
+                      txn_entries.size());
+      last_lsn = entry.lsn;
+    }
+    txn_entries.clear();
+    tail = it;
+  }
+
+  state.tail_lsn = last_lsn;
+  state.tail_sequence = tail.sequence;
+  state.tail_offset = tail.offset;
+  return last_lsn;
+}
+
+void
+Journal::apply_committed(LocalTxnManager *txn_manager, const uint8_t *data,
+                uint32_t size)
+{
+  ReplayTxnMap txn_map;
+  StreamReader reader(data, size);
+  ups_status_t st = redo_all_entries(state, txn_manager, reader, 0,
+                          &txn_map);
+
+  // the stream might end in the middle of a Txn, or an operation failed
+  for (ReplayTxnMap::iterator it = txn_map.begin(); it != txn_map.end(); it++)
+    ups_txn_abort((ups_txn_t *)it->second, UPS_DONT_LOCK);
+
+  // close the databases which were opened in get_db()
+  close_all_databases(state);
+
+  if (st)
+    throw Exception(st);
 }
 
 void
 Journal::close(bool noclear)
 {
+  stop_checkpointer(state);
+
+  // sync all pending commits
+  stop_log_writer(state);
+
   // the noclear flag is set during testing, for checking whether the files
   // contain the correct data. Flush the buffers, otherwise the tests will
   // fail because data is missing
   if (unlikely(noclear))
-    flush_buffer(state, 0);
+    flush_buffer(state);
 
   if (likely(!noclear))
     clear();
 
-  for (int i = 0; i < 2; i++)
-    state.files[i].close();
+  for (size_t i = 0; i < state.segments.size(); i++)
+    delete state.segments[i];
+  state.segments.clear();
+  state.current = -1;
 
   state.buffer.clear();
 }
@@ -971,6 +2257,12 @@ Journal::recover(LocalTxnManager *txn_manager)
   // first redo the changesets
   uint64_t start_lsn = recover_changeset(state);
 
+  // the new pages which were written after the newest Changeset was logged
+  // are not referenced (UPS_PARAM_UNLOGGED_NEW_PAGES); they are removed
+  if (state.logged_file_size != 0
+        && state.env->device->file_size() > state.logged_file_size)
+    state.env->device->truncate(state.logged_file_size);
+
   // load the state of the PageManager; the PageManager state is loaded AFTER
   // physical recovery because its page might have been restored in
   // recover_changeset()
@@ -984,20 +2276,45 @@ Journal::recover(LocalTxnManager *txn_manager)
 
   // clear the journal files
   clear();
+  state.logged_file_size = database_file_size(state);
 }
 
 void
 Journal::clear()
 {
-  for (int i = 0; i < 2; i++)
-    clear_file(state, i);
+  for (size_t i = 0; i < state.segments.size(); i++) {
+    JournalSegment *segment = state.segments[i];
+    if (segment->file.is_open())
+      segment->file.truncate(0);
+    segment->sequence = 0;
+    segment->offset = 0;
+    segment->open_txns = 0;
+    segment->has_dictionary = false;
+    segment->last_lsn = 0;
+  }
+
+  state.current = -1;
+  state.num_transactions = 0;
+  state.changesets.clear();
+  state.checkpoint_sequence = 0;
+  state.checkpoint_offset = 0;
+  state.checkpoint_lsn = 0;
+  state.replay_sequence = 0;
+  state.replay_offset = 0;
+  state.tail_lsn = 0;
+  state.tail_sequence = 0;
+  state.tail_offset = 0;
+
+  // the commits of the cleared segments can no longer be replicated
+  uint64_t lsn = state.env->lsn_manager.current.load() - 1;
+  if (lsn > state.truncated_lsn)
+    state.truncated_lsn = lsn;
 }
 
 void
 Journal::test_flush_buffers()
 {
-  flush_buffer(state, 0);
-  flush_buffer(state, 1);
+  flush_buffer(state);
 }
 
 void
@@ -27,16 +27,30 @@
  * "Undo" information is not required because aborted Txns are never
  * written to disk. The journal only can "redo" operations.
  *
- * The journal is organized in two files. If one of the files grows too large
- * then all new Txns are stored in the other file
- * ("Log file switching"). When all Txns from file #0 are committed,
- * and file #1 exceeds a limit, then the files are switched back again.
+ * The journal is organized in segments: numbered files with a fixed size,
+ * which are preallocated when they are taken into use. Each segment starts
+ * with a header (PJournalSegmentHeader) which stores a sequence number.
+ * If the current segment is full (or has more Txns than the switch
+ * threshold) then the journal switches to the next segment ("Log file
+ * switching"). The oldest segment is recycled if all its Txns were flushed
+ * to the Btree, and if all its Changesets were written to the database file;
+ * otherwise a new segment is created.
+ *
+ * The entries of a Txn are first encoded (and compressed) into a buffer
+ * of the Txn (JournalBuffer); ups_txn_commit does this before it acquires
+ * the Environment lock. When the Txn is committed, its buffer is appended
+ * to the journal.
  *
  * For writing, files are buffered. The buffers are flushed when they
  * exceed a certain threshold, when a Txn is committed or a Changeset
  * was written. In case of a commit or a changeset there will also be an
  * fsync, if UPS_ENABLE_FSYNC is enabled.
  *
+ * Commits are synced with a "group commit": the committing thread writes
+ * its entries, releases the Environment lock and then waits till the log
+ * writer thread synced the file. All commits which arrive while a sync is
+ * in progress are made durable with the next sync.
+ *
  * The physical information is a collection of pages which are modified in
  * one or more database operations (i.e. ups_db_erase). This collection is
  * called a "changeset" and implemented in changeset.h/.cc. As soon as the
@@ -45,19 +59,52 @@
  * Otherwise the whole changeset is appended to the journal, and afterwards
  * the database file is modified.
  *
+ * With UPS_PARAM_JOURNAL_PAGE_DELTAS, a page which was already written to
+ * disk is logged as a "delta": only the byte ranges which differ from
+ * its copy on disk. The first time a page is logged, its full image is
+ * written. The ranges are applied to whatever is stored on disk. Every byte
+ * outside the ranges is the same in the old and new version of the page,
+ * therefore this also repairs a torn write.
+ *
+ * With UPS_PARAM_UNLOGGED_NEW_PAGES, the pages which were appended to the
+ * file are not logged at all: nothing on disk refers to them, therefore they
+ * are written (and synced) before the remaining pages are logged.
+ *
+ * If the journal is compressed (UPS_PARAM_JOURNAL_COMPRESSION) then each key
+ * and record is compressed separately. Small keys and records do not
+ * compress well on their own. Therefore the first keys and records are used
+ * to train a "dictionary" for the compressor (if the library supports
+ * it, currently only zlib). The dictionary is stored in the journal before
+ * the first entry which uses it, and again in each new segment. Recovery
+ * loads it when the journal is opened.
+ *
+ * The journal is also the source for replicating an Environment to a
+ * "standby" (UPS_STANDBY). ups_env_read_journal returns the entries of the
+ * Txns which were committed after a given lsn; their keys and records are
+ * decompressed. ups_env_apply_journal replays them on the standby with the
+ * same code as the recovery. The position is the lsn of the last commit
+ * in the stream. It becomes invalid if its segment is recycled, or if the
+ * Environment is closed (the journal is then cleared).
+ *
  * For recovery to work, each page stores the lsn of its last modification.
  *
- * When recovering, the Journal first extracts the newest/latest entry.
- * If this entry is a changeset then the changeset is reapplied, because
+ * The header of the current segment also stores the "checkpoint": the
+ * position of the oldest Changeset which is maybe not yet written to the
+ * database file, and the position of the oldest Txn which was not yet
+ * flushed to the Btree. The checkpoint is updated whenever a Changeset is
+ * appended, and by a background thread ("fuzzy checkpoints") if
+ * UPS_PARAM_RECOVERY_TARGET_SEC is set. This thread (and ups_txn_commit)
+ * also flushes the committed Txns if their replay would exceed the target
+ * recovery time. When recovering, the Journal reads the header of the newest
+ * segment and reapplies all Changesets starting at the checkpoint, because
  * we assume that there was a crash immediately AFTER the changeset was
  * written, but BEFORE the database file was modified. (The changeset is
  * idempotent; if the database file was successfully modified then the
  * changes are re-applied; this is not a problem.)
  *
  * Afterwards, upscaledb uses the lsn's to figure out whether an update
- * was already applied or not. If the journal's last entry is a changeset then
- * this changeset's lsn marks the beginning of the sequence. Otherwise the lsn
- * is fetched from the journal file headers. All journal entries with an lsn
+ * was already applied or not. The lsn of the newest changeset marks the
+ * beginning of the sequence. All journal entries with an lsn
  * *older* than this start-lsn will be skipped, all others are re-applied.
  *
  * In this phase all changesets are skipped because the newest changeset was
@@ -128,7 +175,45 @@ struct Journal
     kEntryTypeErase      = 5,
 
     // marks a whole changeset operation (writes modified pages)
-    kEntryTypeChangeset  = 6
+    kEntryTypeChangeset  = 6,
+
+    // stores the dictionary of the compressor
+    kEntryTypeDictionary = 7
+  };
+
+  enum {
+    // the magic cookie of a segment header ("jrn\0")
+    kMagic = ('j' << 24) | ('r' << 16) | ('n' << 8),
+
+    // the version of the file format
+    kVersion = 3,
+
+    // the default size of a segment
+    kSegmentSize = 4 * 1024 * 1024, // 4 mb
+
+    // a (conservative) estimate of the logical recovery's throughput; used
+    // to convert UPS_PARAM_RECOVERY_TARGET_SEC to a number of bytes
+    kReplayBytesPerSecond = 4 * 1024 * 1024, // 4 mb
+
+    // the number of entries which are read (and decoded) at once during
+    // recovery
+    kRecoveryBatchSize = 4096,
+
+    // the size of the compressor's dictionary; the dictionary is trained
+    // with the first keys and records which are compressed
+    kDictionarySize = 4 * 1024,
+
+    // the maximum number of bytes of a single key or record which are
+    // added to the dictionary
+    kDictionarySampleSize = 64,
+
+    // a replication stream (ups_env_read_journal) stops with the first
+    // commit after this many bytes; the next call continues there
+    kMaxStreamSize = 1024 * 1024, // 1 mb
+
+    // the number of failed syncs which are remembered; a thread which
+    // waits for an older commit no longer sees the error
+    kMaxSyncErrors = 16
   };
 
   //
@@ -136,14 +221,11 @@ struct Journal
   //
   struct Iterator {
     Iterator()
-      : fdidx(0), fdstart(0), offset(0) {
+      : sequence(0), offset(0) {
     }
 
-    // selects the file descriptor [0..1]
-    int fdidx;
-
-    // which file descriptor did we start with? [0..1]
-    int fdstart;
+    // the sequence number of the current segment; 0 before the first call
+    uint64_t sequence;
 
     // the offset in the file of the NEXT entry
     uint64_t offset;
@@ -152,6 +234,9 @@ struct Journal
   // Constructor
   Journal(LocalEnv *env);
 
+  // Destructor; stops the log writer thread
+  ~Journal();
+
   // Creates a new journal
   void create();
 
@@ -160,12 +245,8 @@ struct Journal
 
   // Returns true if the journal is empty
   bool is_empty() const {
-    if (!state.files[0].is_open() && !state.files[1].is_open())
-      return true;
-
-    for (int i = 0; i < 2; i++) {
-      uint64_t size = state.files[i].file_size();
-      if (size > 0)
+    for (size_t i = 0; i < state.segments.size(); i++) {
+      if (state.segments[i]->offset > sizeof(PJournalSegmentHeader))
         return false;
     }
 
@@ -179,22 +260,59 @@ struct Journal
   // Appends a journal entry for ups_txn_commit/kEntryTypeTxnCommit
   void append_txn_commit(LocalTxn *txn, uint64_t lsn);
 
+  // Returns the lsn of the last commit which is not yet durable (or 0),
+  // and resets it
+  uint64_t pending_commit_lsn() {
+    uint64_t lsn = state.commit_lsn;
+    state.commit_lsn = 0;
+    return lsn;
+  }
+
+  // Waits till the log writer synced the commit with the |lsn|. Must not
+  // be called while the Environment is locked.
+  void wait_for_commit(uint64_t lsn);
+
+  // Invokes |callback| as soon as the log writer synced the commit with
+  // the |lsn|. Returns false if the commit is already durable; then
+  // |callback| is not invoked, and |*status| is the result of the sync.
+  bool notify_commit(uint64_t lsn, ups_txn_commit_callback_t callback,
+                  void *context, ups_status_t *status);
+
   // Appends a journal entry for ups_insert/kEntryTypeInsert
-  void append_insert(Db *db, LocalTxn *txn,
+  void append_insert(uint16_t dbname, LocalTxn *txn,
                   ups_key_t *key, ups_record_t *record, uint32_t flags,
                   uint64_t lsn);
 
   // Appends a journal entry for ups_erase/kEntryTypeErase
-  void append_erase(Db *db, LocalTxn *txn,
+  void append_erase(uint16_t dbname, LocalTxn *txn,
                   ups_key_t *key, int duplicate_index, uint32_t flags,
                   uint64_t lsn);
 
   // Appends a journal entry for a whole changeset/kEntryTypeChangeset
-  // Returns the current file descriptor, which is the parameter for
-  // on_changeset_flush()
+  // Returns the index of the current segment
   int append_changeset(std::vector<Page *> &pages, uint64_t last_blob_page,
                   uint64_t lsn);
 
+  // Called by the worker thread after the Changeset with the |lsn| was
+  // written to the database file
+  void changeset_flushed(uint64_t lsn) {
+    state.completed_lsn.store(lsn);
+  }
+
+  // Called when the Txn is flushed to the Btree and removed; its segment
+  // can then be recycled
+  void release_txn(LocalTxn *txn);
+
+  // Returns true if the recovery would take longer than the target
+  // recovery time (UPS_PARAM_RECOVERY_TARGET_SEC); then the committed
+  // Txns should be flushed
+  bool is_recovery_target_exceeded();
+
+  // Returns true while the journal is recovered
+  bool is_recovering() const {
+    return state.disable_logging;
+  }
+
   // Empties the journal, removes all entries
   void clear();
 
@@ -205,6 +323,16 @@ struct Journal
   // all others are automatically aborted
   void recover(LocalTxnManager *txn_manager);
 
+  // Returns the entries of the Txns which were committed after the |lsn|,
+  // in commit order (ups_env_read_journal). The keys and records are
+  // decoded. Returns the lsn of the last commit in the |stream|.
+  uint64_t read_committed(uint64_t lsn, ByteArray *stream);
+
+  // Re-applies the Txns of a stream which was returned by read_committed()
+  // (ups_env_apply_journal)
+  void apply_committed(LocalTxnManager *txn_manager, const uint8_t *data,
+                  uint32_t size);
+
   // Fills the metrics
   void fill_metrics(ups_env_metrics_t *metrics) {
     metrics->journal_bytes_flushed = state.count_bytes_flushed;
@@ -212,6 +340,10 @@ struct Journal
             = state.count_bytes_before_compression;
     metrics->journal_bytes_after_compression
             = state.count_bytes_after_compression;
+    metrics->journal_compression_usec = state.count_compression_usec;
+    metrics->journal_dictionary_size = state.is_dictionary_trained
+            ? state.dictionary.size()
+            : 0;
   }
 
   // Flushes all buffers to disk. Used for testing.
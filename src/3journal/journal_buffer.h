@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2005-2017 Christoph Rupp (chris@crupp.de).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See the file COPYING for License information.
+ */
+
+/*
+ * A buffer for the journal entries of a single Txn.
+ *
+ * Each Txn encodes its entries into its own buffer; the committing thread
+ * can do this before it acquires the Environment lock. The buffers are
+ * appended to the journal in the order of the commits.
+ *
+ * @exception_safe: nothrow
+ * @thread_safe: no
+ */
+
+#ifndef UPS_JOURNAL_BUFFER_H
+#define UPS_JOURNAL_BUFFER_H
+
+#include "0root/root.h"
+
+// Always verify that a file of level N does not include headers > N!
+#include "1base/dynamic_array.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+// The entries of a single Txn. They are encoded (and compressed) into
+// this buffer, possibly without holding the Environment lock, and then
+// appended to the journal when the Txn is committed.
+struct JournalBuffer {
+  JournalBuffer() {
+    clear();
+  }
+
+  // Discards the entries and resets the counters
+  void clear() {
+    data.clear();
+    first_lsn = 0;
+    uses_dictionary = false;
+    is_complete = false;
+    count_bytes_before_compression = 0;
+    count_bytes_after_compression = 0;
+    count_compression_usec = 0;
+  }
+
+  // The encoded entries
+  ByteArray data;
+
+  // The lsn of the first entry
+  uint64_t first_lsn;
+
+  // True if an entry was compressed with the compressor's dictionary
+  bool uses_dictionary;
+
+  // True if all entries of the Txn (except the commit) were encoded
+  bool is_complete;
+
+  // The metrics of the compression; added to the JournalState when the
+  // entries are appended to the journal
+  uint64_t count_bytes_before_compression;
+  uint64_t count_bytes_after_compression;
+  uint64_t count_compression_usec;
+};
+
+} // namespace upscaledb
+
+#endif /* UPS_JOURNAL_BUFFER_H */
@@ -36,6 +36,58 @@
 
 namespace upscaledb {
 
+#include "1base/packstart.h"
+
+/*
+ * The header of a journal segment
+ *
+ * Each segment file starts with this header. It is followed by the journal
+ * entries; the last entry is followed by an empty entry (lsn is zero),
+ * because recycled segments still contain data of the previous use.
+ */
+UPS_PACK_0 struct UPS_PACK_1 PJournalSegmentHeader {
+  // Constructor - sets all fields to 0
+  PJournalSegmentHeader()
+    : magic(0), version(0), sequence(0), checkpoint_sequence(0),
+      checkpoint_offset(0), checkpoint_lsn(0), replay_sequence(0),
+      replay_offset(0), file_size(0) {
+  }
+
+  // the magic cookie (kMagic)
+  uint32_t magic;
+
+  // the version of the file format
+  uint32_t version;
+
+  // the sequence number of this segment; segments with a higher number
+  // are newer
+  uint64_t sequence;
+
+  // the sequence number of the segment with the oldest Changeset which is
+  // (maybe) not yet written to the database file
+  uint64_t checkpoint_sequence;
+
+  // the file offset of this Changeset in its segment
+  uint64_t checkpoint_offset;
+
+  // the lsn of the newest Changeset which was written to the database file
+  uint64_t checkpoint_lsn;
+
+  // the sequence number of the oldest segment with Txns which were not yet
+  // flushed to the Btree; the logical recovery starts in this segment
+  uint64_t replay_sequence;
+
+  // the file offset in this segment where the logical recovery starts
+  uint64_t replay_offset;
+
+  // the size of the database file when the newest Changeset was logged;
+  // the Changesets in this segment store their own size
+  uint64_t file_size;
+} UPS_PACK_2;
+
+#include "1base/packstop.h"
+
+
 #include "1base/packstart.h"
 
 /*
@@ -168,7 +220,7 @@ UPS_PACK_0 struct UPS_PACK_1 PJournalEntryErase {
 UPS_PACK_0 struct UPS_PACK_1 PJournalEntryChangeset {
   // Constructor - sets all fields to 0
   PJournalEntryChangeset()
-    : num_pages(0), last_blob_page(0) {
+    : num_pages(0), last_blob_page(0), file_size(0) {
   }
 
   // number of pages in this changeset
@@ -176,6 +228,10 @@ UPS_PACK_0 struct UPS_PACK_1 PJournalEntryChangeset {
 
   // address of the last blob page
   uint64_t last_blob_page;
+
+  // the size of the database file, including the new pages which were
+  // written without being logged (UPS_PARAM_UNLOGGED_NEW_PAGES)
+  uint64_t file_size;
 } UPS_PACK_2;
 
 #include "1base/packstop.h"
@@ -189,7 +245,7 @@ UPS_PACK_0 struct UPS_PACK_1 PJournalEntryChangeset {
 UPS_PACK_0 struct UPS_PACK_1 PJournalEntryPageHeader {
   // Constructor - sets all fields to 0
   PJournalEntryPageHeader(uint64_t _address = 0)
-    : address(_address), compressed_size(0) {
+    : address(_address), compressed_size(0), delta_size(0) {
   }
 
   // the page address
@@ -197,6 +253,26 @@ UPS_PACK_0 struct UPS_PACK_1 PJournalEntryPageHeader {
 
   // the compressed size, if compression is enabled
   uint32_t compressed_size;
+
+  // the size of the delta (a sequence of PJournalPageDelta ranges) if only
+  // the modified ranges of the page were logged; 0 for a full page image
+  uint32_t delta_size;
+} UPS_PACK_2;
+
+#include "1base/packstop.h"
+
+
+#include "1base/packstart.h"
+
+//
+// a modified range of a page; followed by |size| bytes of page data
+//
+UPS_PACK_0 struct UPS_PACK_1 PJournalPageDelta {
+  // the offset of the range in the page
+  uint32_t offset;
+
+  // the size of the range
+  uint32_t size;
 } UPS_PACK_2;
 
 #include "1base/packstop.h"
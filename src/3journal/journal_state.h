@@ -21,16 +21,23 @@
 
 #include "0root/root.h"
 
+#include <map>
+#include <deque>
 #include <vector>
 #include <string>
+#include <boost/atomic.hpp>
 
-#include "ups/types.h" // for metrics
+#include "ups/upscaledb.h"
 
 #include "1base/dynamic_array.h"
+#include "1base/mutex.h"
 #include "1base/scoped_ptr.h"
 #include "1os/file.h"
 #include "2page/page_collection.h"
 #include "2compressor/compressor.h"
+#include "2worker/worker.h"
+#include "3journal/journal_entries.h"
+#include "3journal/journal_buffer.h"
 
 // Always verify that a file of level N does not include headers > N!
 
@@ -43,28 +50,176 @@ namespace upscaledb {
 struct Db;
 struct LocalEnv;
 
+// An insert or erase operation which is replayed during recovery. The key
+// and the record are decoded (and decompressed) before the operation is
+// applied
+struct JournalRecoveryEntry {
+  JournalRecoveryEntry()
+    : status(0) {
+    ::memset(&key, 0, sizeof(key));
+    ::memset(&record, 0, sizeof(record));
+  }
+
+  // The header of the journal entry
+  PJournalEntry entry;
+
+  // The payload of the journal entry (PJournalEntryInsert etc)
+  ByteArray buffer;
+
+  // The decoded key and record; they point into |buffer| or into the
+  // arenas below
+  ups_key_t key;
+  ups_record_t record;
+
+  // Storage for the decompressed key and record
+  ByteArray key_arena;
+  ByteArray record_arena;
+
+  // The error if the entry could not be decoded
+  ups_status_t status;
+};
+
+// A compressor for encoding the entries of a Txn; used by a single thread
+// at a time
+struct JournalCompressor {
+  JournalCompressor(Compressor *compressor_)
+    : compressor(compressor_), has_dictionary(false) {
+  }
+
+  // The compressor
+  ScopedPtr<Compressor> compressor;
+
+  // True if the compressor's dictionary was set
+  bool has_dictionary;
+};
+
+// A callback of ups_txn_commit_async which waits for the log writer
+struct CommitCallback {
+  CommitCallback(uint64_t lsn_, ups_txn_commit_callback_t callback_,
+                  void *context_)
+    : lsn(lsn_), callback(callback_), context(context_) {
+  }
+
+  uint64_t lsn;
+  ups_txn_commit_callback_t callback;
+  void *context;
+};
+
+// A sync of the log writer which failed; the commits with an lsn in
+// [first_lsn, last_lsn] are not durable
+struct SyncError {
+  SyncError(uint64_t first_lsn_, uint64_t last_lsn_, ups_status_t status_)
+    : first_lsn(first_lsn_), last_lsn(last_lsn_), status(status_) {
+  }
+
+  uint64_t first_lsn;
+  uint64_t last_lsn;
+  ups_status_t status;
+};
+
+// A segment of the journal; one file with a fixed (preallocated) size
+struct JournalSegment {
+  JournalSegment()
+    : sequence(0), offset(0), open_txns(0), unsynced(false),
+      has_dictionary(false), last_lsn(0) {
+  }
+
+  // The file handle
+  File file;
+
+  // The sequence number of this segment, or 0 if the segment is unused
+  uint64_t sequence;
+
+  // The file offset where the next entry is written
+  uint64_t offset;
+
+  // Counts the Txns with entries in this segment which were not yet
+  // flushed to the Btree
+  uint32_t open_txns;
+
+  // True if the segment was written, but not yet synced (protected by
+  // JournalState::sync_mutex)
+  bool unsynced;
+
+  // True if the compressor's dictionary was written to this segment
+  bool has_dictionary;
+
+  // The lsn of the newest commit in this segment
+  uint64_t last_lsn;
+};
+
+// A Changeset which was appended to the journal, but which is maybe
+// not yet written to the database file
+struct JournalChangeset {
+  JournalChangeset(uint64_t lsn_, uint64_t sequence_, uint64_t offset_)
+    : lsn(lsn_), sequence(sequence_), offset(offset_) {
+  }
+
+  // The lsn of the Changeset
+  uint64_t lsn;
+
+  // The sequence number of the segment which stores the Changeset
+  uint64_t sequence;
+
+  // The file offset in this segment
+  uint64_t offset;
+};
+
 struct JournalState {
   JournalState(LocalEnv *env_);
 
   // References the Environment this journal file is for
   LocalEnv *env;
 
-  // The index of the file descriptor we are currently writing to (0 or 1)
-  uint32_t current_fd;
+  // All segments; the index is also the suffix of the file name
+  // (".jrn<index>"). The vector is modified while the |sync_mutex| is
+  // held, because the log writer thread iterates over it.
+  std::vector<JournalSegment *> segments;
+
+  // The index of the segment we are currently writing to, or -1
+  int current;
 
-  // The two file descriptors
-  File files[2];
+  // The sequence number of the next segment
+  uint64_t next_sequence;
+
+  // The size of a segment; segments are switched when they are full
+  uint64_t segment_size;
 
   // Buffer for writing data to the files
   ByteArray buffer;
 
-  // Counts all transactions in the current file
+  // Counts all transactions in the current segment
   uint32_t num_transactions;
 
-  // When having more than these Txns in one file, we
-  // swap the files
+  // When having more than these Txns in one segment, we switch to the
+  // next segment (0: unlimited)
   uint32_t threshold;
 
+  // The Changesets which are maybe not yet written to the database file,
+  // sorted by lsn; the oldest one is the checkpoint for the recovery
+  std::deque<JournalChangeset> changesets;
+
+  // The lsn of the newest Changeset which was written to the database file;
+  // set by the worker thread
+  boost::atomic<uint64_t> completed_lsn;
+
+  // The checkpoint which is stored in the header of the current segment
+  // (see PJournalSegmentHeader)
+  uint64_t checkpoint_sequence;
+  uint64_t checkpoint_offset;
+  uint64_t checkpoint_lsn;
+  uint64_t replay_sequence;
+  uint64_t replay_offset;
+
+  // The size of the database file when the newest Changeset was logged.
+  // Pages beyond this size are not referenced by the logged data; the
+  // recovery truncates them
+  uint64_t logged_file_size;
+
+  // The logical recovery should not replay more than these bytes
+  // (see UPS_PARAM_RECOVERY_TARGET_SEC); 0 if there is no limit
+  uint64_t recovery_budget;
+
   // Set to false to disable logging; used during recovery
   bool disable_logging;
 
@@ -77,12 +232,113 @@ struct JournalState {
   // Counting the bytes after compression (for ups_env_get_metrics)
   uint64_t count_bytes_after_compression;
 
+  // Counting the time spent compressing (for ups_env_get_metrics)
+  uint64_t count_compression_usec;
+
   // A map of all opened databases
   typedef std::map<uint16_t, Db *> DatabaseMap;
   DatabaseMap database_map;
 
-  // The compressor; can be null
+  // The entries of the current recovery batch, partitioned by database
+  typedef std::map<uint16_t, std::vector<JournalRecoveryEntry *> > PartitionMap;
+  PartitionMap partition_map;
+
+  // The threads which decode the partitions during recovery; only created
+  // if the journal is compressed. The entries are re-applied by a single
+  // thread
+  ScopedPtr<WorkerPool> decode_pool;
+
+  // The compressor; can be null. Decompresses the entries during recovery.
   ScopedPtr<Compressor> compressor;
+
+  // The unused compressors for encoding Txns; Txns are encoded in
+  // parallel, therefore each one borrows its own compressor
+  std::vector<JournalCompressor *> compressors;
+
+  // Serializes access to |compressors|
+  Mutex compressor_mutex;
+
+  // The dictionary of the compressor; while it is not yet trained, this
+  // collects the samples. Protected by |dictionary_mutex| till the
+  // training is finished.
+  ByteArray dictionary;
+
+  // Serializes the training of the dictionary
+  Mutex dictionary_mutex;
+
+  // True if the training of the dictionary is finished; the |dictionary|
+  // is empty if the compressor does not support dictionaries
+  boost::atomic<bool> is_dictionary_trained;
+
+  // True if |compressor| uses the dictionary; it compresses the
+  // Changesets and is only modified with the Environment lock
+  bool compressor_has_dictionary;
+
+  // True if Changesets log page deltas (UPS_PARAM_JOURNAL_PAGE_DELTAS)
+  bool page_deltas;
+
+  // Temporary storage for a page delta
+  ByteArray delta_arena;
+
+  // The lsn of the last commit which was written, but which is not yet
+  // durable. Reset by the committing thread before it waits for the
+  // log writer.
+  uint64_t commit_lsn;
+
+  // Group commit (only with UPS_ENABLE_FSYNC): serializes access to the
+  // fields below
+  Mutex sync_mutex;
+
+  // Wakes up the log writer thread
+  Condition sync_cond;
+
+  // Wakes up the threads which wait for their commit to become durable
+  Condition durable_cond;
+
+  // The highest lsn of a commit which was written to the files
+  uint64_t written_lsn;
+
+  // The highest lsn of a commit which is durable
+  uint64_t durable_lsn;
+
+  // The most recent syncs which failed, sorted by lsn; reported to the
+  // threads which wait for a commit in one of them
+  std::deque<SyncError> sync_errors;
+
+  // Callbacks of asynchronous commits which are not yet durable, sorted
+  // by lsn
+  std::vector<CommitCallback> callbacks;
+
+  // Set to true to shut down the log writer thread
+  bool stop_log_writer;
+
+  // The log writer thread; syncs the files for all pending commits
+  ScopedPtr<Thread> log_writer;
+
+  // Serializes access to |stop_checkpointer|
+  Mutex checkpoint_mutex;
+
+  // Wakes up the checkpointer thread
+  Condition checkpoint_cond;
+
+  // Set to true to shut down the checkpointer thread
+  bool stop_checkpointer;
+
+  // The checkpointer thread wakes up in this interval (in milliseconds)
+  uint32_t checkpoint_interval;
+
+  // The checkpointer thread; writes fuzzy checkpoints in the background
+  ScopedPtr<Thread> checkpointer;
+
+  // The lsn of the newest commit in a recycled segment; a replication
+  // stream cannot continue at an older commit (ups_env_read_journal)
+  uint64_t truncated_lsn;
+
+  // The position after the commit with the |tail_lsn|; the next call of
+  // ups_env_read_journal continues here instead of scanning all segments
+  uint64_t tail_lsn;
+  uint64_t tail_sequence;
+  uint64_t tail_offset;
 };
 
 } // namespace upscaledb
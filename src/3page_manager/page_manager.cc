@@ -21,6 +21,8 @@
 #include "0root/root.h"
 
 #include <string.h>
+#include <algorithm>
+#include <boost/atomic.hpp>
 
 #include "3rdparty/murmurhash3/MurmurHash3.h"
 // Always verify that a file of level N does not include headers > N!
@@ -67,13 +69,75 @@ struct AsyncFlushMessage
   Signal *signal;
   boost::atomic<bool> in_progress;
   std::vector<uint64_t> page_ids;
+
+  // the locked dirty pages, sorted by address; cached to avoid memory
+  // allocations
+  std::vector<Page *> pages;
+
+  // boundaries of the page ranges which are flushed in parallel
+  std::vector<Page **> ranges;
 };
 
+struct AsyncPrefetchMessage
+{
+  AsyncPrefetchMessage(PageManagerState *state_, uint32_t cache_flags_)
+    : state(state_), cache_flags(cache_flags_), count(0) {
+  }
+
+  PageManagerState *state;
+  uint32_t cache_flags;
+  size_t count;
+  Page *pages[Page::kMaxFlushBatch];
+  uint64_t page_ids[Page::kMaxFlushBatch];
+};
+
+// Writes a range of locked dirty pages (sorted by address) to disk, then
+// unlocks them. The Device coalesces adjacent pages.
+static void
+flush_page_range(Page **begin, Page **end)
+{
+  while (begin < end) {
+    Page **batch_end = end - begin > Page::kMaxFlushBatch
+                          ? begin + Page::kMaxFlushBatch
+                          : end;
+
+    try {
+      Page::flush(begin, batch_end - begin);
+    }
+    catch (Exception &) {
+      // ignore pages, fall through
+    }
+
+    for (; begin < batch_end; begin++)
+      (*begin)->mutex().unlock();
+  }
+}
+
+// Flushes a range of pages in a flusher thread; wakes up the coordinating
+// thread after the last range was written
+static void
+async_flush_page_range(Page **begin, Page **end,
+                boost::atomic<size_t> *pending, Signal *signal)
+{
+  flush_page_range(begin, end);
+  if (pending->fetch_sub(1) == 1)
+    signal->notify();
+}
+
 static void
 async_flush_pages(AsyncFlushMessage *message)
 {
-  for (std::vector<uint64_t>::iterator it = message->page_ids.begin();
-                  it != message->page_ids.end();
+  std::vector<uint64_t> &page_ids = message->page_ids;
+  std::vector<Page *> &pages = message->pages;
+
+  // sort the candidates by address to find adjacent pages
+  std::sort(page_ids.begin(), page_ids.end());
+  page_ids.erase(std::unique(page_ids.begin(), page_ids.end()),
+                  page_ids.end());
+
+  pages.clear();
+  for (std::vector<uint64_t>::iterator it = page_ids.begin();
+                  it != page_ids.end();
                   it++) {
     // skip page if it's already in use
     Page *page = message->page_manager->try_lock_purge_candidate(*it);
@@ -82,16 +146,43 @@ async_flush_pages(AsyncFlushMessage *message)
     assert(page->mutex().try_lock() == false);
 
     // flush page if it's dirty
-    if (page->is_dirty()) {
-      try {
-        page->flush();
-      }
-      catch (Exception &) {
-        // ignore page, fall through
-      }
-    }
-    page->mutex().unlock();
+    if (page->is_dirty())
+      pages.push_back(page);
+    else
+      page->mutex().unlock();
+  }
+
+  if (!pages.empty()) {
+    Page **begin = &pages[0];
+    Page **end = begin + pages.size();
+
+    // split the pages into ranges of similar size, one per thread. The
+    // size is a multiple of |kMaxFlushBatch| because the pages are written
+    // in batches of this size anyway. The first range is written by this
+    // thread, all others are dispatched to the remaining threads of the
+    // pool
+    WorkerPool *worker = message->page_manager->state->worker.get();
+    size_t range_size = (pages.size() + worker->size() - 1) / worker->size();
+    range_size = ((range_size + Page::kMaxFlushBatch - 1)
+                    / Page::kMaxFlushBatch) * Page::kMaxFlushBatch;
+
+    std::vector<Page **> &ranges = message->ranges;
+    ranges.clear();
+    for (size_t i = 0; i < pages.size(); i += range_size)
+      ranges.push_back(begin + i);
+    ranges.push_back(end);
+
+    Signal signal;
+    boost::atomic<size_t> pending(ranges.size() - 2);
+    for (size_t i = 1; i < ranges.size() - 1; i++)
+      worker->enqueue_parallel(boost::bind(&async_flush_page_range,
+                              ranges[i], ranges[i + 1], &pending, &signal));
+
+    flush_page_range(ranges[0], ranges[1]);
+    if (ranges.size() > 2)
+      signal.wait();
   }
+
   if (message->in_progress)
     message->in_progress = false;
   if (message->signal)
@@ -112,11 +203,102 @@ verify_crc32(Page *page)
   }
 }
 
+// Creates a Page object for each address which is neither cached nor
+// already prefetched, and registers the address in |state->prefetching|.
+// Returns the number of pages. The caller holds |state->mutex|.
+static size_t
+begin_prefetch(PageManagerState *state, Context *context,
+                const uint64_t *addresses, size_t count, Page **pages,
+                uint64_t *page_ids)
+{
+  size_t n = 0;
+
+  if (count > Page::kMaxFlushBatch)
+    count = Page::kMaxFlushBatch;
+
+  for (size_t i = 0; i < count; i++) {
+    uint64_t address = addresses[i];
+    if (address == 0
+          || (state->state_page && address == state->state_page->address())
+          || state->cache.peek(address)
+          || !state->prefetching.insert(address).second)
+      continue;
+    pages[n] = new Page(state->device, context->db);
+    page_ids[n] = address;
+    n++;
+  }
+  return n;
+}
+
+// Reads the pages with a single batched request (without holding the lock),
+// then stores them in the cache. A page is discarded if its address was
+// removed from |state->prefetching| in the meantime, because then it was
+// cached (and possibly modified) by someone else
+static void
+finish_prefetch(PageManagerState *state, uint32_t cache_flags, Page **pages,
+                uint64_t *page_ids, size_t n)
+{
+  bool failed = false;
+  try {
+    state->device->read_pages(pages, page_ids, n);
+  }
+  catch (Exception &) {
+    failed = true;
+  }
+
+  ScopedSpinlock lock(state->mutex);
+
+  for (size_t i = 0; i < n; i++) {
+    Page *page = pages[i];
+    if (state->prefetching.erase(page_ids[i]) == 0 || failed) {
+      delete page;
+      continue;
+    }
+
+    page->set_address(page_ids[i]);
+
+    if (ISSET(state->config.flags, UPS_ENABLE_CRC32)) {
+      try {
+        verify_crc32(page);
+      }
+      catch (Exception &) {
+        delete page;
+        continue;
+      }
+    }
+
+    state->cache.put(page, cache_flags);
+    state->page_count_fetched++;
+  }
+}
+
+static void
+async_prefetch_pages(AsyncPrefetchMessage *message)
+{
+  PageManagerState *state = message->state;
+  finish_prefetch(state, message->cache_flags, message->pages,
+                  message->page_ids, message->count);
+  delete message;
+
+  ScopedLock lock(state->prefetch_mutex);
+  if (--state->prefetches_pending == 0)
+    state->prefetch_cond.notify_all();
+}
+
+// Waits till all asynchronous prefetch requests are completed
+static void
+wait_for_prefetches(PageManagerState *state)
+{
+  ScopedLock lock(state->prefetch_mutex);
+  while (state->prefetches_pending > 0)
+    state->prefetch_cond.wait(lock);
+}
+
 static inline Page *
 add_to_changeset(Changeset *changeset, Page *page)
 {
   changeset->put(page);
-  assert(page->mutex().try_lock() == false);
+  assert(changeset->is_shared || page->mutex().try_lock() == false);
   return page;
 }
 
@@ -226,22 +408,23 @@ maybe_store_state(PageManagerState *state, Context *context, bool force)
 }
 
 static inline Page *
-fetch_unlocked(PageManagerState *state, Context *context, uint64_t address,
+fetch_page(PageManagerState *state, Context *context, uint64_t address,
                 uint32_t flags)
 {
   /* fetch the page from the cache */
   Page *page;
+  uint32_t cache_flags = context->scan ? Cache::kStreaming : 0;
   
   if (address == 0)
     page = state->header->header_page;
   else if (state->state_page && address == state->state_page->address())
     page = state->state_page;
   else
-    page = state->cache.get(address);
+    page = state->cache.get(address, cache_flags);
 
   if (page) {
     page->set_without_header(ISSET(flags, PageManager::kNoHeader));
-    return add_to_changeset(&context->changeset, page);
+    return page;
   }
 
   if (ISSET(flags, PageManager::kOnlyFromCache)
@@ -259,22 +442,35 @@ fetch_unlocked(PageManagerState *state, Context *context, uint64_t address,
 
   assert(page->data());
 
-  /* store the page in the list */
-  state->cache.put(page);
+  /* store the page in the list; concurrent lookups can pick it up
+   * immediately, therefore the flags are set first */
+  page->set_without_header(ISSET(flags, PageManager::kNoHeader));
+  state->cache.put(page, cache_flags);
+  if (unlikely(!state->prefetching.empty()))
+    state->prefetching.erase(address);
 
-  /* write state to disk (if necessary) */
+  /* write state to disk (if necessary); shared lookups leave this to
+   * the next update */
   if (NOTSET(flags, PageManager::kDisableStoreState)
-          && NOTSET(flags, PageManager::kReadOnly))
+          && NOTSET(flags, PageManager::kReadOnly)
+          && !context->changeset.is_shared)
     maybe_store_state(state, context, false);
 
   /* only verify crc if the page has a header */
-  page->set_without_header(ISSET(flags, PageManager::kNoHeader));
   if (!page->is_without_header()
           && ISSET(state->config.flags, UPS_ENABLE_CRC32))
     verify_crc32(page);
 
   state->page_count_fetched++;
-  return add_to_changeset(&context->changeset, page);
+  return page;
+}
+
+static inline Page *
+fetch_unlocked(PageManagerState *state, Context *context, uint64_t address,
+                uint32_t flags)
+{
+  Page *page = fetch_page(state, context, address, flags);
+  return page ? add_to_changeset(&context->changeset, page) : 0;
 }
 
 static inline Page *
@@ -338,6 +534,8 @@ done:
 
   /* store the page in the cache and the Changeset */
   state->cache.put(page);
+  if (unlikely(!state->prefetching.empty()))
+    state->prefetching.erase(page->address());
   add_to_changeset(&context->changeset, page);
 
   /* write to disk (if necessary) */
@@ -373,7 +571,7 @@ PageManagerState::PageManagerState(LocalEnv *_env)
     state_page(0), last_blob_page(0), last_blob_page_id(0),
     page_count_fetched(0), page_count_index(0), page_count_blob(0),
     page_count_page_manager(0), cache_hits(0), cache_misses(0), message(0),
-    worker(new WorkerPool(1))
+    prefetches_pending(0), worker(new WorkerPool(config.flush_threads))
 {
 }
 
@@ -430,10 +628,87 @@ PageManager::initialize(uint64_t pageid)
 Page *
 PageManager::fetch(Context *context, uint64_t address, uint32_t flags)
 {
+  // If updates run in parallel to lookups then the page is latched after
+  // the spinlock was released; otherwise the update could deadlock with
+  // a lookup which holds the latch and waits for the spinlock
+  if (unlikely(context->latch_pages)) {
+    // Cached pages are not evicted while pages are latched; a cache hit
+    // therefore only requires the lock of the cache shard. The hit is
+    // counted once, even if the header flag of the page has to be updated
+    Page *page = 0;
+    if (address != 0)
+      page = state->cache.get(address, Cache::kIgnoreMiss
+                            | (context->scan ? Cache::kStreaming : 0));
+    if (page) {
+      if (page->is_without_header() != ISSET(flags, PageManager::kNoHeader)) {
+        ScopedSpinlock lock(state->mutex);
+        page->set_without_header(ISSET(flags, PageManager::kNoHeader));
+      }
+      return add_to_changeset(&context->changeset, page);
+    }
+
+    {
+      ScopedSpinlock lock(state->mutex);
+      page = fetch_page(state.get(), context, address, flags);
+    }
+    return page ? add_to_changeset(&context->changeset, page) : 0;
+  }
+
   ScopedSpinlock lock(state->mutex);
   return fetch_unlocked(state.get(), context, address, flags);
 }
 
+void
+PageManager::prefetch(Context *context, const uint64_t *addresses,
+                size_t count)
+{
+  if (ISSET(state->config.flags, UPS_IN_MEMORY))
+    return;
+
+  Page *pages[Page::kMaxFlushBatch];
+  uint64_t page_ids[Page::kMaxFlushBatch];
+  size_t n;
+
+  {
+    ScopedSpinlock lock(state->mutex);
+    n = begin_prefetch(state.get(), context, addresses, count,
+                    pages, page_ids);
+  }
+
+  if (n > 0)
+    finish_prefetch(state.get(), context->scan ? Cache::kStreaming : 0,
+                    pages, page_ids, n);
+}
+
+void
+PageManager::prefetch_async(Context *context, const uint64_t *addresses,
+                size_t count)
+{
+  if (ISSET(state->config.flags, UPS_IN_MEMORY))
+    return;
+
+  AsyncPrefetchMessage *message = new AsyncPrefetchMessage(state.get(),
+                  context->scan ? Cache::kStreaming : 0);
+
+  {
+    ScopedSpinlock lock(state->mutex);
+    message->count = begin_prefetch(state.get(), context, addresses, count,
+                    message->pages, message->page_ids);
+  }
+
+  if (message->count == 0) {
+    delete message;
+    return;
+  }
+
+  {
+    ScopedLock lock(state->prefetch_mutex);
+    state->prefetches_pending++;
+  }
+  state->worker->enqueue_parallel(boost::bind(&async_prefetch_pages,
+                          message));
+}
+
 Page *
 PageManager::alloc(Context *context, uint32_t page_type, uint32_t flags)
 {
@@ -549,6 +824,26 @@ PageManager::flush_all_pages()
   delete message;
 }
 
+bool
+PageManager::is_cache_full()
+{
+  ScopedSpinlock lock(state->mutex);
+  return NOTSET(state->config.flags, UPS_IN_MEMORY)
+            && state->cache.is_cache_full();
+}
+
+void
+PageManager::keep_disk_image(Page *page)
+{
+  state->cache.keep_disk_image(page);
+}
+
+void
+PageManager::release_disk_image(Page *page)
+{
+  state->cache.release_disk_image(page);
+}
+
 void
 PageManager::purge_cache(Context *context)
 {
@@ -611,7 +906,7 @@ PageManager::reclaim_space(Context *context)
     for (uint64_t page_id = address;
             page_id <= file_size - page_size;
             page_id += page_size) {
-      Page *page = state->cache.get(page_id);
+      Page *page = state->cache.peek(page_id);
       if (page) {
         state->cache.del(page);
         delete page;
@@ -657,6 +952,9 @@ PageManager::close_database(Context *context, LocalDb *db)
 
   CloseDatabaseVisitor visitor(db, message);
 
+  // prefetched pages must not be added while the database is closed
+  wait_for_prefetches(state.get());
+
   {
     ScopedSpinlock lock(state->mutex);
 
@@ -707,7 +1005,7 @@ PageManager::del(Context *context, Page *page, size_t page_count)
   if (page_count > 1) {
     uint32_t page_size = state->config.page_size_bytes;
     for (size_t i = 1; i < page_count; i++) {
-      Page *p = state->cache.get(page->address() + i * page_size);
+      Page *p = state->cache.peek(page->address() + i * page_size);
       if (p && context->changeset.has(p))
         context->changeset.del(p);
     }
@@ -730,6 +1028,7 @@ void
 PageManager::close(Context *context)
 {
   // no need to lock the mutex; this method is called during shutdown
+  wait_for_prefetches(state.get());
 
   // cut off unused space at the end of the file; this space is managed
   // by the device
@@ -826,7 +1125,7 @@ PageManager::try_lock_purge_candidate(uint64_t address)
   else if (state->state_page && address == state->state_page->address())
     page = state->state_page;
   else
-    page = state->cache.get(address);
+    page = state->cache.peek(address);
 
   if (!page || !page->mutex().try_lock())
     return 0;
@@ -88,6 +88,17 @@ struct PageManager
   // The page is locked and stored in |context->changeset|.
   Page *fetch(Context *context, uint64_t address, uint32_t flags = 0);
 
+  // Reads up to |Page::kMaxFlushBatch| pages which are not yet cached with
+  // a single batched request and stores them in the cache. The pages are
+  // neither locked nor added to |context->changeset|. Errors are ignored;
+  // they are reported when the page is fetched.
+  void prefetch(Context *context, const uint64_t *addresses, size_t count);
+
+  // Same as |prefetch|, but the pages are read by the worker pool; returns
+  // immediately
+  void prefetch_async(Context *context, const uint64_t *addresses,
+                  size_t count);
+
   // Allocates a new page. |page_type| is one of Page::kType* in page.h.
   // |flags| are either 0 or kClearWithZero
   // The page is locked and stored in |context->changeset|.
@@ -102,6 +113,16 @@ struct PageManager
   // Flushes all pages to disk
   void flush_all_pages();
 
+  // Returns true if the cache limits are exceeded
+  bool is_cache_full();
+
+  // Lets |page| keep a copy of its data on disk; the copy is charged to
+  // the cache (see UPS_PARAM_JOURNAL_PAGE_DELTAS)
+  void keep_disk_image(Page *page);
+
+  // Releases the copy of the page data
+  void release_disk_image(Page *page);
+
   // Asks the worker thread to purge the cache if the cache limits are
   // exceeded
   void purge_cache(Context *context);
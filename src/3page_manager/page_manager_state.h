@@ -30,9 +30,10 @@
 
 #include "0root/root.h"
 
-#include <boost/atomic.hpp>
+#include <set>
 
 // Always verify that a file of level N does not include headers > N!
+#include "1base/mutex.h"
 #include "1base/spinlock.h"
 #include "2config/env_config.h"
 #include "3cache/cache.h"
@@ -124,6 +125,21 @@ struct PageManagerState {
   // For collecting unused pages; cached to avoid memory allocations
   std::vector<Page *> garbage;
 
+  // The addresses of the pages which are currently read by a prefetch
+  // request. If a page is stored in the cache by anyone else then its
+  // address is removed, and the prefetched copy is discarded
+  std::set<uint64_t> prefetching;
+
+  // The number of asynchronous prefetch requests which are not yet
+  // completed; protected by |prefetch_mutex|
+  size_t prefetches_pending;
+
+  // Protects |prefetches_pending|
+  Mutex prefetch_mutex;
+
+  // Signalled when the last pending prefetch request is completed
+  Condition prefetch_cond;
+
   // The worker thread which flushes dirty pages
   ScopedPtr<WorkerPool> worker;
 };
@@ -32,7 +32,7 @@ struct LocalEnv;
 
 struct Context {
   Context(LocalEnv *env, LocalTxn *txn = 0, LocalDb *db = 0)
-    : txn(txn), db(db), changeset(env) {
+    : txn(txn), db(db), changeset(env), latch_pages(false), scan(false) {
   }
 
   ~Context() {
@@ -44,6 +44,16 @@ struct Context {
 
   // Each operation has its own changeset which stores all locked pages
   Changeset changeset;
+
+  // True if lookups and updates of the same Database run in parallel
+  // (UPS_ENABLE_CONCURRENT_READS); the btree then latches its pages
+  // while descending the tree
+  bool latch_pages;
+
+  // True if the operation scans the Database (i.e. uqi_select_range or
+  // ups_db_count); the fetched pages are "streamed" through the cache and
+  // do not evict the working set
+  bool scan;
 };
 
 } // namespace upscaledb
@@ -96,6 +96,8 @@ append_txn_duplicates(LocalCursor *cursor, Context *context)
     // from conflicting transactions)
     if (unlikely(optxn->is_aborted()))
       continue;
+    if (unlikely(is_hidden_from_snapshot(cursor->txn, op)))
+      continue;
 
     // a normal (overwriting) insert will overwrite ALL duplicates,
     // but an overwrite of a duplicate will only overwrite
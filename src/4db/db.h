@@ -123,20 +123,52 @@ struct Db
   // Removes a cursor from the linked list of cursors
   void remove_cursor(Cursor *cursor);
 
+  // Returns true if lookups in this Database can run in parallel
+  // (see UPS_ENABLE_CONCURRENT_READS). Compressed keys and records are
+  // decoded through a shared buffer of the Compressor, and lookups in
+  // transactional Databases start a temporary Txn; therefore these
+  // Databases are excluded.
+  bool allows_concurrent_lookups() const {
+    return ISSET(env->flags(), UPS_ENABLE_CONCURRENT_READS)
+              && NOTSET(flags(), UPS_ENABLE_TRANSACTIONS)
+              && config.key_compressor == 0
+              && config.record_compressor == 0;
+  }
+
+  // Returns true if a lookup w/o Cursor can run in parallel to inserts
+  // and erases, which requires the lookup to latch the btree pages.
+  // Approximate matching and duplicate keys are not supported.
+  bool allows_latched_lookup(uint32_t lookup_flags) const {
+    return lookup_flags == 0
+              && allows_concurrent_lookups()
+              && NOTSET(flags(), UPS_ENABLE_DUPLICATE_KEYS);
+  }
+
   // Returns the memory buffer for the key data: the per-database buffer
   // if |txn| is null or temporary, otherwise the buffer from the |txn|
   ByteArray &key_arena(Txn *txn) {
-    return (txn == 0 || ISSET(txn->flags, UPS_TXN_TEMPORARY))
-               ? _key_arena
-               : txn->key_arena;
+    if (txn == 0 || ISSET(txn->flags, UPS_TXN_TEMPORARY))
+      return per_thread_arena(_key_arena, _tls_key_arena);
+    return txn->key_arena;
   }
 
   // Returns the memory buffer for the record data: the per-database buffer
   // if |txn| is null or temporary, otherwise the buffer from the |txn|
   ByteArray &record_arena(Txn *txn) {
-    return (txn == 0 || ISSET(txn->flags, UPS_TXN_TEMPORARY))
-               ? _record_arena
-               : txn->record_arena;
+    if (txn == 0 || ISSET(txn->flags, UPS_TXN_TEMPORARY))
+      return per_thread_arena(_record_arena, _tls_record_arena);
+    return txn->record_arena;
+  }
+
+  // Returns |arena|, or a thread-local buffer if concurrent lookups
+  // are enabled
+  ByteArray &per_thread_arena(ByteArray &arena,
+                  boost::thread_specific_ptr<ByteArray> &tls) {
+    if (likely(NOTSET(env->flags(), UPS_ENABLE_CONCURRENT_READS)))
+      return arena;
+    if (unlikely(!tls.get()))
+      tls.reset(new ByteArray());
+    return *tls;
   }
 
   // the current Environment
@@ -158,6 +190,11 @@ struct Db
   // This is where record->data points to when returning a
   // record to the user; used if Txns are disabled
   ByteArray _record_arena;
+
+  // Replace |_key_arena| and |_record_arena| if UPS_ENABLE_CONCURRENT_READS
+  // is set
+  boost::thread_specific_ptr<ByteArray> _tls_key_arena;
+  boost::thread_specific_ptr<ByteArray> _tls_record_arena;
 };
 
 } // namespace upscaledb
@@ -30,6 +30,7 @@
 #include "4cursor/cursor_local.h"
 #include "4txn/txn_local.h"
 #include "4txn/txn_cursor.h"
+#include "4txn/txn_factory.h"
 #include "4uqi/statements.h"
 #include "4uqi/scanvisitorfactory.h"
 #include "4uqi/result.h"
@@ -83,6 +84,27 @@ copy_key(LocalDb *db, Txn *txn, ups_key_t *source, ups_key_t *key)
     ::memcpy(key->data, source->data, source->size);
 }
 
+// Prepares the Context of a lookup. Lookups which run in parallel
+// (UPS_ENABLE_CONCURRENT_READS) neither lock their pages nor purge the
+// cache; the caller purges the cache after the shared lock was released.
+static inline void
+prepare_lookup(LocalDb *db, Context *context)
+{
+  if (db->allows_concurrent_lookups())
+    context->changeset.is_shared = true;
+  else
+    lenv(db)->page_manager->purge_cache(context);
+}
+
+// Returns true if an insert or erase runs in parallel to lookups and
+// therefore has to latch its pages (UPS_ENABLE_CONCURRENT_READS). The
+// caller purges the cache after the operation was completed.
+static inline bool
+is_latched_update(LocalDb *db, LocalCursor *cursor)
+{
+  return !cursor && db->allows_concurrent_lookups();
+}
+
 static inline LocalTxn *
 begin_temp_txn(LocalEnv *env)
 {
@@ -145,7 +167,7 @@ is_key_erased(Context *context, TxnIndex *txn_index, ups_key_t *key)
                   op != 0;
                   op = op->previous_in_node) {
     Txn *optxn = op->txn;
-    if (optxn->is_aborted())
+    if (optxn->is_aborted() || is_hidden_from_snapshot(context->txn, op))
       continue;
     if (optxn->is_committed() || context->txn == optxn) {
       if (ISSET(op->flags, TxnOperation::kIsFlushed))
@@ -333,7 +355,7 @@ retry:
 
   for (; op != 0; op = op->previous_in_node) {
     Txn *optxn = op->txn;
-    if (optxn->is_aborted())
+    if (optxn->is_aborted() || is_hidden_from_snapshot(context->txn, op))
       continue;
 
     if (optxn->is_committed() || context->txn == optxn) {
@@ -410,6 +432,21 @@ retry:
     return UPS_TXN_CONFLICT;
   }
 
+  // all operations of this node are hidden from a snapshot; if an
+  // approximate match is requested then move to the next or previous node
+  if (unlikely(node && op == 0 && context->txn
+          && ISSET(context->txn->flags, UPS_TXN_READ_ONLY)
+          && ISSETANY(flags, UPS_FIND_LT_MATCH | UPS_FIND_GT_MATCH))) {
+    node = ISSET(flags, UPS_FIND_LT_MATCH)
+              ? node->previous_sibling()
+              : node->next_sibling();
+    if (node) {
+      ups_key_set_intflags(key,
+          (ups_key_get_intflags(key) | BtreeKey::kApproximate));
+      goto retry;
+    }
+  }
+
   // if there was an approximate match: check if the btree provides
   // a better match
   if (unlikely(op
@@ -576,7 +613,7 @@ erase_txn(LocalDb *db, Context *context, ups_key_t *key, uint32_t flags,
     if (unlikely(st)) {
       if (node_created) {
         db->txn_index->remove(node);
-        delete node;
+        TxnFactory::destroy_node(db->txn_index.get(), node);
       }
       return st;
     }
@@ -655,6 +692,7 @@ LocalDb::create(Context *context, PBtreeHeader *btree_header)
   uint32_t persistent_flags = flags();
   persistent_flags &= ~(UPS_CACHE_UNLIMITED
             | UPS_DISABLE_MMAP
+            | UPS_ENABLE_DIRECT_IO
             | UPS_ENABLE_FSYNC
             | UPS_READ_ONLY
             | UPS_AUTO_RECOVERY
@@ -908,9 +946,10 @@ LocalDb::count(Txn *htxn, bool distinct)
   LocalTxn *txn = dynamic_cast<LocalTxn *>(htxn);
 
   Context context(lenv(this), txn, this);
+  context.scan = true;
 
   // purge cache if necessary
-  lenv(this)->page_manager->purge_cache(&context);
+  prepare_lookup(this, &context);
 
   // call the btree function - this will retrieve the number of keys
   // in the btree
@@ -918,7 +957,7 @@ LocalDb::count(Txn *htxn, bool distinct)
 
   // if transactions are enabled, then also sum up the number of keys
   // from the transaction tree
-  if (ISSET(flags(), UPS_ENABLE_TRANSACTIONS))
+  if (ISSET(flags(), UPS_ENABLE_TRANSACTIONS) && txn_index->num_operations > 0)
     keycount += txn_index->count(&context, txn, distinct);
 
   return keycount;
@@ -1008,7 +1047,7 @@ insert_txn(LocalDb *db, Context *context, ups_key_t *key, ups_record_t *record,
   if (unlikely(st)) {
     if (node_created) {
       db->txn_index->remove(node);
-      delete node;
+      TxnFactory::destroy_node(db->txn_index.get(), node);
     }
     return st;
   }
@@ -1147,7 +1186,10 @@ LocalDb::insert(Cursor *hcursor, Txn *txn, ups_key_t *key,
   }
 
   // purge the cache
-  lenv(this)->page_manager->purge_cache(&context);
+  if (is_latched_update(this, cursor))
+    context.latch_pages = true;
+  else
+    lenv(this)->page_manager->purge_cache(&context);
 
   ups_status_t st = insert_impl(this, &context, cursor, key, record, flags);
   return finalize(lenv(this), &context, st, local_txn);
@@ -1172,6 +1214,7 @@ LocalDb::erase(Cursor *hcursor, Txn *txn, ups_key_t *key, uint32_t flags)
 
   LocalTxn *local_txn = 0;
   Context context(lenv(this), (LocalTxn *)txn, this);
+  context.latch_pages = is_latched_update(this, cursor);
 
   if (!txn && ISSET(this->flags(), UPS_ENABLE_TRANSACTIONS)) {
     local_txn = begin_temp_txn(lenv(this));
@@ -1202,8 +1245,13 @@ LocalDb::find(Cursor *hcursor, Txn *txn, ups_key_t *key,
   LocalCursor *cursor = (LocalCursor *)hcursor;
 
   // Transactions require a Cursor because only Cursors can build lists
-  // of duplicates.
+  // of duplicates. But if there are no pending Txn operations then the
+  // lookup reads from the Btree, like without Transactions.
+  bool skip_txn_index = !cursor
+          && ISSET(this->flags(), UPS_ENABLE_TRANSACTIONS)
+          && txn_index->num_operations == 0;
   if (!cursor
+          && !skip_txn_index
           && ISSET(this->flags(), UPS_ENABLE_TRANSACTIONS
                                     | UPS_ENABLE_DUPLICATES)) {
     ScopedPtr<LocalCursor> c(new LocalCursor(this, txn));
@@ -1213,10 +1261,15 @@ LocalDb::find(Cursor *hcursor, Txn *txn, ups_key_t *key,
   Context context(lenv(this), (LocalTxn *)txn, this);
 
   // purge cache if necessary
-  lenv(this)->page_manager->purge_cache(&context);
+  prepare_lookup(this, &context);
+
+  // lookups without Cursor run in parallel to updates, and therefore
+  // latch the btree pages
+  if (!cursor && allows_latched_lookup(flags))
+    context.latch_pages = true;
 
   // if Transactions are disabled then read from the Btree
-  if (NOTSET(this->flags(), UPS_ENABLE_TRANSACTIONS)) {
+  if (NOTSET(this->flags(), UPS_ENABLE_TRANSACTIONS) || skip_txn_index) {
     ups_status_t st = btree_index->find(&context, cursor, key, &key_arena(txn),
                           record, &record_arena(txn), flags);
     if (likely(st == 0) && cursor)
@@ -1362,7 +1415,7 @@ LocalDb::cursor_move(Cursor *hcursor, ups_key_t *key,
   Context context(lenv(this), (LocalTxn *)cursor->txn, this);
 
   // purge cache if necessary
-  lenv(this)->page_manager->purge_cache(&context);
+  prepare_lookup(this, &context);
 
   //
   // if the cursor was never used before and the user requests a NEXT then
@@ -1463,6 +1516,7 @@ LocalDb::select_range(SelectStatement *stmt, LocalCursor *begin,
     return UPS_PARSER_ERROR;
 
   Context context(lenv(this), 0, this);
+  context.scan = true;
 
   Result *result = new Result;
 
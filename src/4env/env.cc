@@ -95,14 +95,19 @@ Env::close(uint32_t flags)
 {
   ups_status_t st = 0;
 
-  ScopedLock lock(mutex);
+  ScopedEnvLock lock(this);
 
   /* auto-abort (or commit) all pending transactions */
   if (txn_manager.get()) {
     Txn *t;
 
     while ((t = txn_manager->oldest_txn())) {
-      if (!t->is_aborted() && !t->is_committed()) {
+      // an active read-only Txn defers the flush of Txns which were
+      // committed after it began; therefore look for the oldest one which
+      // is still active
+      while (t && (t->is_aborted() || t->is_committed()))
+        t = t->next();
+      if (t) {
         if (ISSET(flags, UPS_TXN_AUTO_COMMIT))
           st = txn_manager->commit(t);
         else /* if (flags & UPS_TXN_AUTO_ABORT) */
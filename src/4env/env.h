@@ -135,9 +135,65 @@ struct Env
   // Closes the Environment (ups_env_close)
   ups_status_t close(uint32_t flags);
 
+  // Purges the cache if it is full. Lookups which run in parallel
+  // (UPS_ENABLE_CONCURRENT_READS) must not evict pages; they call this
+  // function after they released their shared lock.
+  virtual void purge_cache() {
+  }
+
+  // Prepares the commit of a Txn, i.e. encodes its journal entries.
+  // Called by ups_txn_commit before the lock is acquired, therefore other
+  // threads can continue in the meantime.
+  virtual void prepare_commit(Txn *txn) {
+  }
+
+  // Returns the lsn of the last commit which is not yet durable (or 0).
+  // Called by ups_txn_commit while the lock is held.
+  virtual uint64_t pending_commit_lsn() {
+    return 0;
+  }
+
+  // Waits till the commit with the |lsn| is durable. Called by
+  // ups_txn_commit after the lock was released, therefore other threads
+  // can commit in the meantime and are synced together (group commit).
+  virtual void wait_for_commit(uint64_t lsn) {
+  }
+
+  // Invokes |callback| as soon as the commit with the |lsn| is durable.
+  // Called by ups_txn_commit_async while the lock is held. Returns false
+  // if the commit is already durable; then the caller invokes |callback|
+  // with |*status| after releasing the lock.
+  virtual bool notify_commit(uint64_t lsn, ups_txn_commit_callback_t callback,
+                  void *context, ups_status_t *status) {
+    *status = 0;
+    return false;
+  }
+
+  // Returns the journal entries of the Txns which were committed after
+  // the |lsn| (ups_env_read_journal); returns the lsn of the last commit
+  virtual uint64_t read_journal(uint64_t lsn, const uint8_t **data,
+                  uint32_t *size) {
+    throw Exception(UPS_NOT_IMPLEMENTED);
+  }
+
+  // Re-applies the journal entries of another Environment
+  // (ups_env_apply_journal)
+  virtual void apply_journal(const uint8_t *data, uint32_t size) {
+    throw Exception(UPS_NOT_IMPLEMENTED);
+  }
+
   // A mutex to serialize access to this Environment
   Mutex mutex;
 
+  // Replaces |mutex| if UPS_ENABLE_CONCURRENT_READS is set: lookups
+  // acquire it in shared mode, all other operations exclusively
+  SharedMutex shared_mutex;
+
+  // Serializes inserts and erases which run in parallel to lookups
+  // (UPS_ENABLE_CONCURRENT_READS); lookups which do not latch their pages
+  // acquire it in shared mode
+  SharedMutex update_mutex;
+
   // The Environment's configuration
   EnvConfig config;
 
@@ -149,6 +205,109 @@ struct Env
   DatabaseMap _database_map;
 };
 
+//
+// Locks the Environment for the duration of a public API call. Without
+// UPS_ENABLE_CONCURRENT_READS all calls are serialized through |Env::mutex|.
+// Otherwise |Env::shared_mutex| is used, and lookups (kShared, kLatched)
+// can run in parallel to each other. Inserts and erases (kUpdate) are
+// serialized through |Env::update_mutex|, but they run in parallel to
+// lookups which latch their pages (kLatched).
+//
+struct ScopedEnvLock
+{
+  enum {
+    // The lock is held exclusively
+    kExclusive = 0,
+
+    // The lock is shared with other lookups
+    kShared = 1,
+
+    // The lock is shared with other lookups and with an update; the btree
+    // pages are latched
+    kLatched = 2,
+
+    // The lock is shared with latched lookups; the btree pages are latched
+    kUpdate = 3
+  };
+
+  // Constructor; does not acquire a lock (see acquire())
+  ScopedEnvLock()
+    : env_(0), mode_(kExclusive) {
+  }
+
+  // Constructor; acquires the lock
+  ScopedEnvLock(Env *env, int mode = kExclusive)
+    : env_(0), mode_(kExclusive) {
+    acquire(env, mode);
+  }
+
+  // Destructor; releases the lock
+  ~ScopedEnvLock() {
+    release();
+  }
+
+  // Acquires the lock of |env|
+  void acquire(Env *env, int mode = kExclusive) {
+    assert(env_ == 0);
+    if (NOTSET(env->flags(), UPS_ENABLE_CONCURRENT_READS)) {
+      env->mutex.lock();
+    }
+    else if (mode == kExclusive) {
+      env->shared_mutex.lock();
+    }
+    else {
+      env->shared_mutex.lock_shared();
+      if (mode == kShared)
+        env->update_mutex.lock_shared();
+      else if (mode == kUpdate)
+        env->update_mutex.lock();
+    }
+    env_ = env;
+    mode_ = mode;
+  }
+
+  // Tries to acquire the lock of |env| exclusively; returns false if the
+  // lock is held by another thread
+  bool try_acquire(Env *env) {
+    assert(env_ == 0);
+    if (NOTSET(env->flags(), UPS_ENABLE_CONCURRENT_READS)) {
+      if (!env->mutex.try_lock())
+        return false;
+    }
+    else if (!env->shared_mutex.try_lock())
+      return false;
+    env_ = env;
+    mode_ = kExclusive;
+    return true;
+  }
+
+  // Releases the lock (if it is held)
+  void release() {
+    if (!env_)
+      return;
+    if (NOTSET(env_->flags(), UPS_ENABLE_CONCURRENT_READS)) {
+      env_->mutex.unlock();
+    }
+    else if (mode_ == kExclusive) {
+      env_->shared_mutex.unlock();
+    }
+    else {
+      if (mode_ == kShared)
+        env_->update_mutex.unlock_shared();
+      else if (mode_ == kUpdate)
+        env_->update_mutex.unlock();
+      env_->shared_mutex.unlock_shared();
+    }
+    env_ = 0;
+  }
+
+  // The locked Environment; null if the lock is not held
+  Env *env_;
+
+  // The lock mode (kExclusive, kShared, kLatched or kUpdate)
+  int mode_;
+};
+
 } // namespace upscaledb
 
 #endif /* UPS_ENV_H */
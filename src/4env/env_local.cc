@@ -228,6 +228,15 @@ LocalEnv::open()
 
     config.page_size_bytes = header->page_size();
 
+    /* direct I/O requires aligned pages */
+    if (ISSET(config.flags, UPS_ENABLE_DIRECT_IO)
+          && config.page_size_bytes % File::kDirectIoAlignment != 0) {
+      ups_log(("page size %u is not aligned for direct I/O",
+                  (unsigned)config.page_size_bytes));
+      st = UPS_INV_PAGESIZE;
+      goto fail_with_fake_cleansing;
+    }
+
     /** check the file magic */
     if (unlikely(!header->verify_magic('H', 'A', 'M', '\0'))) {
       ups_log(("invalid file type"));
@@ -347,6 +356,27 @@ LocalEnv::get_parameters(ups_parameter_t *param)
       case UPS_PARAM_POSIX_FADVISE:
         p->value = config.posix_advice;
         break;
+      case UPS_PARAM_CACHE_POLICY:
+        p->value = config.cache_policy;
+        break;
+      case UPS_PARAM_FLUSH_THREADS:
+        p->value = config.flush_threads;
+        break;
+      case UPS_PARAM_IO_ENGINE:
+        p->value = config.io_engine;
+        break;
+      case UPS_PARAM_RECOVERY_TARGET_SEC:
+        p->value = config.recovery_target_sec;
+        break;
+      case UPS_PARAM_JOURNAL_PAGE_DELTAS:
+        p->value = config.journal_page_deltas ? 1 : 0;
+        break;
+      case UPS_PARAM_UNLOGGED_NEW_PAGES:
+        p->value = config.unlogged_new_pages ? 1 : 0;
+        break;
+      case UPS_PARAM_TXN_FLUSH_THRESHOLD:
+        p->value = config.txn_flush_threshold_bytes;
+        break;
       default:
         ups_trace(("unknown parameter %d", (int)p->name));
         return (UPS_INV_PARAMETER);
@@ -782,9 +812,11 @@ LocalEnv::do_close(uint32_t flags)
 {
   Context context(this);
 
-  /* flush all committed transactions */
-  if (likely(txn_manager.get() != 0))
+  /* stop the background flushes, then flush all committed transactions */
+  if (likely(txn_manager.get() != 0)) {
+    ((LocalTxnManager *)txn_manager.get())->stop_background_flushes();
     txn_manager->flush_committed_txns(&context);
+  }
 
   /* flush all pages and the freelist, reduce the file size */
   if (likely(page_manager.get() != 0))
@@ -813,6 +845,78 @@ LocalEnv::do_close(uint32_t flags)
   return 0;
 }
 
+void
+LocalEnv::purge_cache()
+{
+  if (likely(!page_manager->is_cache_full()))
+    return;
+
+  ScopedEnvLock lock(this);
+  Context context(this);
+  page_manager->purge_cache(&context);
+}
+
+void
+LocalEnv::prepare_commit(Txn *txn)
+{
+  if (journal.get())
+    ((LocalTxnManager *)txn_manager.get())->prepare_commit(txn);
+}
+
+uint64_t
+LocalEnv::pending_commit_lsn()
+{
+  return journal.get() ? journal->pending_commit_lsn() : 0;
+}
+
+void
+LocalEnv::wait_for_commit(uint64_t lsn)
+{
+  journal->wait_for_commit(lsn);
+}
+
+bool
+LocalEnv::notify_commit(uint64_t lsn, ups_txn_commit_callback_t callback,
+                void *context, ups_status_t *status)
+{
+  return journal->notify_commit(lsn, callback, context, status);
+}
+
+uint64_t
+LocalEnv::read_journal(uint64_t lsn, const uint8_t **data, uint32_t *size)
+{
+  if (unlikely(!journal.get())) {
+    ups_trace(("Environment does not have a journal"));
+    throw Exception(UPS_INV_PARAMETER);
+  }
+
+  uint64_t last_lsn = journal->read_committed(lsn, &journal_stream);
+  *data = journal_stream.data();
+  *size = journal_stream.size();
+  return last_lsn;
+}
+
+void
+LocalEnv::apply_journal(const uint8_t *data, uint32_t size)
+{
+  if (unlikely(NOTSET(flags(), UPS_STANDBY))) {
+    ups_trace(("Environment is not a standby (see UPS_STANDBY)"));
+    throw Exception(UPS_INV_PARAMETER);
+  }
+
+  LocalTxnManager *ltm = (LocalTxnManager *)txn_manager.get();
+
+  // the replayed Txns are also written to the standby's own journal (if
+  // it has one)
+  if (journal.get()) {
+    journal->apply_committed(ltm, data, size);
+  }
+  else {
+    Journal replay(this);
+    replay.apply_committed(ltm, data, size);
+  }
+}
+
 void
 LocalEnv::fill_metrics(ups_env_metrics_t *metrics)
 {
@@ -100,6 +100,31 @@ struct LocalEnv : public Env
   // Closes the Environment (ups_env_close)
   virtual ups_status_t do_close(uint32_t flags);
 
+  // Purges the cache if it is full
+  virtual void purge_cache();
+
+  // Encodes the journal entries of a Txn before it is committed
+  virtual void prepare_commit(Txn *txn);
+
+  // Returns the lsn of the last commit which is not yet durable (or 0)
+  virtual uint64_t pending_commit_lsn();
+
+  // Waits till the commit with the |lsn| is durable
+  virtual void wait_for_commit(uint64_t lsn);
+
+  // Invokes |callback| as soon as the commit with the |lsn| is durable;
+  // returns false if it is already durable
+  virtual bool notify_commit(uint64_t lsn, ups_txn_commit_callback_t callback,
+                  void *context, ups_status_t *status);
+
+  // Returns the journal entries of the Txns which were committed after
+  // the |lsn|
+  virtual uint64_t read_journal(uint64_t lsn, const uint8_t **data,
+                  uint32_t *size);
+
+  // Re-applies the journal entries of another Environment
+  virtual void apply_journal(const uint8_t *data, uint32_t size);
+
   // The Environment's header page/configuration
   ScopedPtr<EnvHeader> header;
 
@@ -117,6 +142,9 @@ struct LocalEnv : public Env
 
   // The lsn manager
   LsnManager lsn_manager;
+
+  // The stream which was returned by ups_env_read_journal
+  ByteArray journal_stream;
 };
 
 } // namespace upscaledb
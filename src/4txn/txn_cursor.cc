@@ -76,6 +76,11 @@ move_top_in_node(TxnCursor *cursor, TxnNode *node, bool ignore_conflicts,
                   op != 0;
                   op = op->previous_in_node) {
     Txn *optxn = op->txn;
+    // a snapshot ignores the ops of Txns which were committed after
+    // it began
+    if (is_hidden_from_snapshot(state_.parent->txn, op))
+      continue;
+
     // only look at ops from the current transaction and from
     // committed transactions
     if (optxn == state_.parent->txn || optxn->is_committed()) {
@@ -137,8 +142,10 @@ TxnCursor::set_to_nil()
 {
   if (likely(!is_nil())) {
     TxnOperation *op = get_coupled_op();
-    if (likely(op != 0))
+    if (likely(op != 0)) {
+      ScopedSpinlock lock(db(state_)->txn_index->cursor_mutex);
       remove_cursor_from_op(this, op);
+    }
     state_.coupled_op = 0;
   }
 }
@@ -147,6 +154,8 @@ void
 TxnCursor::couple_to(TxnOperation *op)
 {
   set_to_nil();
+
+  ScopedSpinlock lock(db(state_)->txn_index->cursor_mutex);
   state_.coupled_op = op;
   state_.coupled_next = op->cursor_list;
   state_.coupled_previous = 0;
@@ -168,19 +177,28 @@ TxnCursor::move(uint32_t flags)
   if (ISSET(flags, UPS_CURSOR_FIRST)) {
     set_to_nil();
 
-    node = db(state_)->txn_index->first();
-    if (unlikely(!node))
-      return UPS_KEY_NOT_FOUND;
-    return move_top_in_node(this, node, false, flags);
+    // skip the nodes which are hidden from a snapshot
+    for (node = db(state_)->txn_index->first();
+                    node != 0;
+                    node = node->next_sibling()) {
+      st = move_top_in_node(this, node, false, flags);
+      if (st != UPS_KEY_NOT_FOUND)
+        return st;
+    }
+    return UPS_KEY_NOT_FOUND;
   }
 
   if (ISSET(flags, UPS_CURSOR_LAST)) {
     set_to_nil();
 
-    node = db(state_)->txn_index->last();
-    if (unlikely(!node))
-      return UPS_KEY_NOT_FOUND;
-    return move_top_in_node(this, node, false, flags);
+    for (node = db(state_)->txn_index->last();
+                    node != 0;
+                    node = node->previous_sibling()) {
+      st = move_top_in_node(this, node, false, flags);
+      if (st != UPS_KEY_NOT_FOUND)
+        return st;
+    }
+    return UPS_KEY_NOT_FOUND;
   }
 
   if (ISSET(flags, UPS_CURSOR_NEXT)) {
@@ -241,11 +259,11 @@ TxnCursor::find(ups_key_t *key, uint32_t flags)
   while (1) {
     // and then move to the newest insert*-op
     ups_status_t st = move_top_in_node(this, node, false, 0);
-    if (unlikely(st != UPS_KEY_ERASED_IN_TXN))
+    if (unlikely(st != UPS_KEY_ERASED_IN_TXN && st != UPS_KEY_NOT_FOUND))
       return st;
 
-    // if the key was erased and approx. matching is enabled, then move
-    // next/prev till we found a valid key.
+    // if the key was erased (or is hidden from a snapshot) and approx.
+    // matching is enabled, then move next/prev till we found a valid key.
     if (ISSET(flags, UPS_FIND_GT_MATCH))
       node = node->next_sibling();
     else if (ISSET(flags, UPS_FIND_LT_MATCH))
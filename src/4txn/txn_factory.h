@@ -25,11 +25,13 @@
 
 #include "0root/root.h"
 
+#include <new>
+
 #include "ups/types.h"
 
 // Always verify that a file of level N does not include headers > N!
 #include "1mem/mem.h"
-#include "4txn/txn.h"
+#include "4txn/txn_local.h"
 
 #ifndef UPS_ROOT_H
 #  error "root.h was not included"
@@ -38,22 +40,35 @@
 namespace upscaledb {
 
 struct TxnFactory {
-  // Creates a new TxnOperation
+  // Creates a new TxnOperation; the memory is allocated from the arena
+  // of the Txn
   static TxnOperation *create_operation(LocalTxn *txn,
             TxnNode *node, uint32_t flags, uint32_t orig_flags,
             uint64_t lsn, ups_key_t *key, ups_record_t *record) {
     TxnOperation *op;
-    op = Memory::allocate<TxnOperation>(sizeof(*op)
+    op = (TxnOperation *)txn->arena.allocate(sizeof(*op)
                                             + (record ? record->size : 0)
                                             + (key ? key->size : 0));
     op->initialize(txn, node, flags, orig_flags, lsn, key, record);
     return op;
   }
 
-  // Destroys a TxnOperation
+  // Destroys a TxnOperation; the memory is released when the arena of
+  // the Txn is cleared
   static void destroy_operation(TxnOperation *op) {
     op->destroy();
   }
+
+  // Creates a new TxnNode
+  static TxnNode *create_node(TxnIndex *index, ups_key_t *key) {
+    return new (index->node_pool.allocate()) TxnNode(index->db, key);
+  }
+
+  // Destroys a TxnNode
+  static void destroy_node(TxnIndex *index, TxnNode *node) {
+    node->~TxnNode();
+    index->node_pool.release(node);
+  }
 };
 
 } // namespace upscaledb
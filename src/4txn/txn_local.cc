@@ -18,8 +18,12 @@
 
 #include "0root/root.h"
 
+#include <limits>
+#include <boost/bind.hpp>
+
 // Always verify that a file of level N does not include headers > N!
 #include "3btree/btree_index.h"
+#include "3btree/btree_node_proxy.h"
 #include "3journal/journal.h"
 #include "4db/db_local.h"
 #include "4txn/txn_local.h"
@@ -45,34 +49,96 @@ typedef int bool;
 #define false (!true)
 #endif // __cpluscplus
 
-static int
-compare(void *vlhs, void *vrhs)
-{
-  TxnNode *lhs = (TxnNode *)vlhs;
-  TxnNode *rhs = (TxnNode *)vrhs;
-  LocalDb *db = lhs->db;
+// The functions of the red-black tree. They are generated for each
+// comparator of the btree (see btree_node_proxy.h), which is then inlined
+// in the tree operations instead of calling BtreeIndex::compare_keys for
+// each visited node.
+struct TxnIndexTraits {
+  int (*compare)(TxnNode *lhs, TxnNode *rhs);
+  void (*clear)(TxnIndex *index);
+  TxnNode *(*first)(TxnIndex *index);
+  TxnNode *(*last)(TxnIndex *index);
+  TxnNode *(*next)(TxnIndex *index, TxnNode *node);
+  TxnNode *(*prev)(TxnIndex *index, TxnNode *node);
+  TxnNode *(*search)(TxnIndex *index, TxnNode *key);
+  TxnNode *(*nsearch)(TxnIndex *index, TxnNode *key);
+  TxnNode *(*psearch)(TxnIndex *index, TxnNode *key);
+  void (*insert)(TxnIndex *index, TxnNode *node);
+  void (*remove)(TxnIndex *index, TxnNode *node);
+};
 
-  if (unlikely(lhs == rhs))
-    return 0;
+template<typename Compare>
+struct TxnIndexImpl {
+  static int compare(TxnNode *lhs, TxnNode *rhs) {
+    if (unlikely(lhs == rhs))
+      return 0;
+
+    ups_key_t *lhskey = lhs->key();
+    ups_key_t *rhskey = rhs->key();
+    assert(lhskey && rhskey);
+    Compare cmp(lhs->db);
+    return cmp(lhskey->data, lhskey->size, rhskey->data, rhskey->size);
+  }
 
-  ups_key_t *lhskey = lhs->key();
-  ups_key_t *rhskey = rhs->key();
-  assert(lhskey && rhskey);
-  return db->btree_index->compare_keys(lhskey, rhskey);
-}
+  rb_gen(static, rbt_, TxnIndex, TxnNode, node, compare)
+
+  static const TxnIndexTraits traits;
+};
 
-rb_proto(static, rbt_, TxnIndex, TxnNode)
-rb_gen(static, rbt_, TxnIndex, TxnNode, node, compare)
+template<typename Compare>
+const TxnIndexTraits TxnIndexImpl<Compare>::traits = {
+  TxnIndexImpl<Compare>::compare,
+  TxnIndexImpl<Compare>::rbt_new,
+  TxnIndexImpl<Compare>::rbt_first,
+  TxnIndexImpl<Compare>::rbt_last,
+  TxnIndexImpl<Compare>::rbt_next,
+  TxnIndexImpl<Compare>::rbt_prev,
+  TxnIndexImpl<Compare>::rbt_search,
+  TxnIndexImpl<Compare>::rbt_nsearch,
+  TxnIndexImpl<Compare>::rbt_psearch,
+  TxnIndexImpl<Compare>::rbt_insert,
+  TxnIndexImpl<Compare>::rbt_remove
+};
+
+// Returns the tree functions for the key type of a Database; this mirrors
+// the choice of the comparator in BtreeIndexFactory
+static inline const TxnIndexTraits *
+select_traits(LocalDb *db)
+{
+  switch (db->config.key_type) {
+    case UPS_TYPE_UINT8:
+      return &TxnIndexImpl<NumericCompare<uint8_t> >::traits;
+    case UPS_TYPE_UINT16:
+      return &TxnIndexImpl<NumericCompare<uint16_t> >::traits;
+    case UPS_TYPE_UINT32:
+      return &TxnIndexImpl<NumericCompare<uint32_t> >::traits;
+    case UPS_TYPE_UINT64:
+      return &TxnIndexImpl<NumericCompare<uint64_t> >::traits;
+    case UPS_TYPE_REAL32:
+      return &TxnIndexImpl<NumericCompare<float> >::traits;
+    case UPS_TYPE_REAL64:
+      return &TxnIndexImpl<NumericCompare<double> >::traits;
+    case UPS_TYPE_CUSTOM:
+      return &TxnIndexImpl<CallbackCompare>::traits;
+    default:
+      // fixed length keys have the same size; then VariableSizeCompare
+      // is identical to FixedSizeCompare
+      return &TxnIndexImpl<VariableSizeCompare>::traits;
+  }
+}
 
 static inline int
 count_flushable_transactions(LocalTxnManager *tm)
 {
   int to_flush = 0;
+  uint64_t snapshot_lsn = tm->oldest_snapshot_lsn();
 
   LocalTxn *oldest = (LocalTxn *)tm->oldest_txn();
   for (; oldest; oldest = (LocalTxn *)oldest->next()) {
     // a transaction can be flushed if it's committed or aborted, and if there
     // are no cursors coupled to it
+    if (oldest->is_committed() && oldest->commit_lsn > snapshot_lsn)
+      return to_flush;
     if (oldest->is_committed() || oldest->is_aborted()) {
       for (TxnOperation *op = oldest->oldest_op;
                       op != 0; op = op->next_in_txn)
@@ -87,18 +153,38 @@ count_flushable_transactions(LocalTxnManager *tm)
   return to_flush;
 }
 
+// Returns the lsn which keeps the oldest Txn from being flushed: its begin
+// lsn if it is still active, or the lsn of the oldest snapshot which must
+// not see it. Returns 0 if the oldest Txn can be flushed.
+static inline uint64_t
+pinning_lsn(LocalTxnManager *tm)
+{
+  LocalTxn *oldest = (LocalTxn *)tm->oldest_txn();
+  if (!oldest || oldest->is_aborted())
+    return 0;
+  if (!oldest->is_committed())
+    return oldest->lsn;
+  uint64_t snapshot_lsn = tm->oldest_snapshot_lsn();
+  return oldest->commit_lsn > snapshot_lsn ? snapshot_lsn : 0;
+}
+
 static inline void
 flush_committed_txns_impl(LocalTxnManager *tm, Context *context)
 {
   LocalTxn *oldest;
   uint64_t highest_lsn = 0;
+  uint64_t snapshot_lsn = tm->oldest_snapshot_lsn();
 
   assert(context->changeset.is_empty());
 
   // always get the oldest transaction; if it was committed: flush
-  // it; if it was aborted: discard it; otherwise return
+  // it; if it was aborted: discard it; otherwise return. A Txn which was
+  // committed after an active snapshot began remains in memory till
+  // the snapshot ends.
   while ((oldest = (LocalTxn *)tm->oldest_txn())) {
     if (oldest->is_committed()) {
+      if (oldest->commit_lsn > snapshot_lsn)
+        break;
       uint64_t lsn = tm->flush_txn_to_changeset(context, (LocalTxn *)oldest);
       if (lsn > highest_lsn)
         highest_lsn = lsn;
@@ -109,6 +195,13 @@ flush_committed_txns_impl(LocalTxnManager *tm, Context *context)
     else
       break;
 
+    // the journal can now recycle the segment with the txn's entries
+    if (tm->lenv()->journal.get())
+      tm->lenv()->journal->release_txn(oldest);
+
+    if (oldest->is_committed())
+      tm->committed_bytes -= oldest->memory_usage();
+
     // now remove the txn from the linked list
     tm->remove_txn_from_head(oldest);
 
@@ -122,6 +215,115 @@ flush_committed_txns_impl(LocalTxnManager *tm, Context *context)
   else
     context->changeset.clear();
   assert(context->changeset.is_empty());
+
+  // if the recovery target is still exceeded then the oldest journal
+  // segment is pinned by a Txn which cannot be flushed yet
+  Journal *journal = tm->lenv()->journal.get();
+  if (journal && journal->is_recovery_target_exceeded())
+    tm->recovery_pinned_lsn = pinning_lsn(tm);
+  else
+    tm->recovery_pinned_lsn = 0;
+}
+
+// The flusher thread. Flushes the committed Txns whenever a flush is
+// requested. It never waits for the Environment lock, because the
+// Environment joins this thread while it holds the lock; if the
+// Environment is busy then the flush is retried shortly afterwards.
+static void
+run_flusher(LocalTxnManager *tm)
+{
+  ScopedLock lock(tm->flusher_mutex);
+
+  while (!tm->stop_flusher) {
+    if (!tm->flush_requested) {
+      tm->flusher_cond.wait(lock);
+      continue;
+    }
+
+    lock.unlock();
+    bool acquired;
+    {
+      ScopedEnvLock env_lock;
+      acquired = env_lock.try_acquire(tm->env);
+      if (acquired) {
+        try {
+          tm->flush_committed_txns();
+        }
+        catch (Exception &ex) {
+          ups_log(("failed to flush committed transactions (error %d)",
+                      ex.code));
+          tm->flush_error = ex.code;
+        }
+      }
+    }
+    lock.lock();
+
+    if (acquired)
+      tm->flush_requested = false;
+    else
+      tm->flusher_cond.timed_wait(lock, boost::posix_time::milliseconds(1));
+  }
+}
+
+// Asks the flusher thread to flush the committed Txns; starts the thread
+// if required
+static inline void
+request_background_flush(LocalTxnManager *tm)
+{
+  ScopedLock lock(tm->flusher_mutex);
+  if (!tm->flusher.get())
+    tm->flusher.reset(new Thread(boost::bind(&run_flusher, tm)));
+  tm->flush_requested = true;
+  tm->flusher_cond.notify_one();
+}
+
+// Flushes the committed Txns if they use more memory than the
+// flush threshold (UPS_PARAM_TXN_FLUSH_THRESHOLD). Usually they are
+// flushed in the background, but the committing thread flushes them if
+// they exceed the threshold by far, and during recovery.
+static inline void
+maybe_flush_committed_txns(LocalTxnManager *tm, Context *context)
+{
+  LocalEnv *env = tm->lenv();
+  if (unlikely(ISSET(env->flags(), UPS_DONT_FLUSH_TRANSACTIONS)))
+    return;
+
+  uint64_t threshold = env->config.txn_flush_threshold_bytes;
+  if (unlikely(ISSET(env->flags(), UPS_FLUSH_TRANSACTIONS_IMMEDIATELY)
+          || tm->committed_bytes / LocalTxnManager::kSyncFlushFactor
+                        >= threshold
+          || (Globals::ms_flush_threshold > 0
+                && count_flushable_transactions(tm)
+                        >= Globals::ms_flush_threshold)
+          || tm->is_recovery_target_exceeded())) {
+    flush_committed_txns_impl(tm, context);
+    return;
+  }
+
+  if (tm->committed_bytes < threshold)
+    return;
+
+  if (unlikely(env->journal.get() && env->journal->is_recovering())) {
+    flush_committed_txns_impl(tm, context);
+    return;
+  }
+
+  request_background_flush(tm);
+}
+
+// Ends a read-only Txn. A snapshot has no operations, therefore it is
+// unlinked and released right away, even if older Txns are not yet
+// flushed. Afterwards the committed Txns which were held back by the
+// snapshot can be flushed.
+static inline void
+end_snapshot(LocalTxnManager *tm, LocalTxn *txn)
+{
+  tm->num_snapshots--;
+  tm->list.del(txn);
+  delete txn;
+
+  Context context(tm->lenv(), 0, 0);
+  maybe_flush_committed_txns(tm, &context);
 }
 
 void
@@ -136,6 +338,7 @@ TxnOperation::initialize(LocalTxn *txn_, TxnNode *node_,
   lsn = lsn_;
   flags = flags_;
   original_flags = original_flags_;
+  dbname = node_->db->name();
 
   // copy the key data
   if (key_) {
@@ -186,22 +389,24 @@ TxnOperation::destroy()
   if (previous_in_txn)
     previous_in_txn->next_in_txn = next_in_txn;
 
-  if (delete_node)
-    delete node;
+  node->db->txn_index->num_operations--;
 
-  Memory::release(this);
+  if (delete_node)
+    TxnFactory::destroy_node(node->db->txn_index.get(), node);
 }
 
 TxnNode *
 TxnNode::next_sibling()
 {
-  return rbt_next(db->txn_index.get(), this);
+  TxnIndex *index = db->txn_index.get();
+  return index->traits->next(index, this);
 }
 
 TxnNode *
 TxnNode::previous_sibling()
 {
-  return rbt_prev(db->txn_index.get(), this);
+  TxnIndex *index = db->txn_index.get();
+  return index->traits->prev(index, this);
 }
 
 TxnNode::TxnNode(LocalDb *db_, ups_key_t *key)
@@ -215,12 +420,14 @@ TxnNode::append(LocalTxn *txn, uint32_t orig_flags, uint32_t flags,
 {
   TxnOperation *op = TxnFactory::create_operation(txn, this, flags,
                         orig_flags, lsn, key, record);
+  db->txn_index->num_operations++;
 
   // store it in the chronological list which is managed by the node
   if (!newest_op) {
     assert(oldest_op == 0);
     newest_op = op;
     oldest_op = op;
+    txn->index_bytes += sizeof(TxnNode);
   }
   else {
     TxnOperation *newest = newest_op;
@@ -255,9 +462,9 @@ TxnIndex::store(ups_key_t *key, bool *node_created)
   *node_created = false;
   TxnNode *node = get(key, 0);
   if (!node) {
-    node = new TxnNode(db, key);
+    node = TxnFactory::create_node(this, key);
     *node_created = true;
-    rbt_insert(this, node);
+    traits->insert(this, node);
   }
 
   return node;
@@ -266,18 +473,19 @@ TxnIndex::store(ups_key_t *key, bool *node_created)
 void
 TxnIndex::remove(TxnNode *node)
 {
-  rbt_remove(this, node);
+  traits->remove(this, node);
 }
 
+// Encodes the journal entries of a Txn (except the commit) into the
+// Txn's journal buffer. Entries of a temporary Txn are flushed immediately.
+// This can run without the Environment lock (see prepare_commit()),
+// therefore only the operations of |txn| are read, but not the TxnIndex:
+// each operation has its own copy of the key.
 static inline void
-flush_transaction_to_journal(LocalTxn *txn)
+encode_transaction(Journal *journal, LocalTxn *txn)
 {
-  LocalEnv *lenv = (LocalEnv *)txn->env;
-  Journal *journal = lenv->journal.get();
+  txn->journal_buffer.clear();
 
-  if (unlikely(journal == 0))
-    return;
- 
   if (NOTSET(txn->flags, UPS_TXN_TEMPORARY))
     journal->append_txn_begin(txn, txn->name.empty() ? 0 : txn->name.c_str(),
                     txn->lsn);
@@ -286,38 +494,58 @@ flush_transaction_to_journal(LocalTxn *txn)
                   op != 0;
                   op = op->next_in_txn) {
     if (ISSET(op->flags, TxnOperation::kErase)) {
-      journal->append_erase(op->node->db, txn,
-                      op->node->key(), op->referenced_duplicate,
+      journal->append_erase(op->dbname, txn,
+                      &op->key, op->referenced_duplicate,
                       op->original_flags, op->lsn);
       continue;
     }
     if (ISSET(op->flags, TxnOperation::kInsert)) {
-      journal->append_insert(op->node->db, txn,
-                      op->node->key(), &op->record,
+      journal->append_insert(op->dbname, txn,
+                      &op->key, &op->record,
                       op->original_flags, op->lsn);
       continue;
     }
     if (ISSET(op->flags, TxnOperation::kInsertOverwrite)) {
-      journal->append_insert(op->node->db, txn,
-                      op->node->key(), &op->record,
+      journal->append_insert(op->dbname, txn,
+                      &op->key, &op->record,
                       op->original_flags | UPS_OVERWRITE, op->lsn);
       continue;
     }
     if (ISSET(op->flags, TxnOperation::kInsertDuplicate)) {
-      journal->append_insert(op->node->db, txn,
-                    op->node->key(), &op->record,
+      journal->append_insert(op->dbname, txn,
+                      &op->key, &op->record,
                       op->original_flags | UPS_DUPLICATE, op->lsn);
       continue;
     }
     assert(!"shouldn't be here");
   }
 
+  txn->journal_buffer.is_complete = true;
+}
+
+static inline void
+flush_transaction_to_journal(LocalTxn *txn)
+{
+  LocalEnv *lenv = (LocalEnv *)txn->env;
+  Journal *journal = lenv->journal.get();
+
+  // a read-only Txn has nothing to log
+  if (unlikely(journal == 0) || ISSET(txn->flags, UPS_TXN_READ_ONLY))
+    return;
+
+  // the entries were maybe already encoded in prepare_commit()
+  if (!txn->journal_buffer.is_complete)
+    encode_transaction(journal, txn);
+
   if (NOTSET(txn->flags, UPS_TXN_TEMPORARY))
-    journal->append_txn_commit(txn, lenv->lsn_manager.next());
+    journal->append_txn_commit(txn, txn->commit_lsn);
 }
 
 LocalTxn::LocalTxn(LocalEnv *env, const char *name, uint32_t flags)
-  : Txn(env, name, flags), log_descriptor(0), oldest_op(0), newest_op(0)
+  : Txn(env, name, flags),
+    arena(&((LocalTxnManager *)env->txn_manager.get())->arena_pool),
+    index_bytes(0), log_descriptor(-1), commit_lsn(0), oldest_op(0),
+    newest_op(0)
 {
   LocalTxnManager *ltm = (LocalTxnManager *)env->txn_manager.get();
   id = ltm->incremented_txn_id();
@@ -340,6 +568,7 @@ LocalTxn::commit()
 
   // this transaction is now committed!
   flags |= kStateCommitted;
+  commit_lsn = ((LocalEnv *)env)->lsn_manager.next();
 }
 
 void
@@ -371,25 +600,30 @@ LocalTxn::free_operations()
 
   oldest_op = 0;
   newest_op = 0;
+
+  // the operations are unlinked; now release their memory in one go
+  arena.clear();
+  index_bytes = 0;
 }
 
 TxnIndex::TxnIndex(LocalDb *db)
-  : db(db)
+  : db(db), num_operations(0), traits(select_traits(db)),
+    node_pool(sizeof(TxnNode), sizeof(void *))
 {
-  rbt_new(this);
+  traits->clear(this);
 }
 
 TxnIndex::~TxnIndex()
 {
   TxnNode *node;
 
-  while ((node = rbt_last(this))) {
+  while ((node = traits->last(this))) {
     remove(node);
-    delete node;
+    TxnFactory::destroy_node(this, node);
   }
 
   // re-initialize the tree
-  rbt_new(this);
+  traits->clear(this);
 }
 
 TxnNode *
@@ -403,33 +637,33 @@ TxnIndex::get(ups_key_t *key, uint32_t flags)
 
   // search if node already exists - if yes, return it
   if (ISSET(flags, UPS_FIND_GEQ_MATCH)) {
-    node = rbt_nsearch(this, &tmp);
+    node = traits->nsearch(this, &tmp);
     if (node)
-      match = compare(&tmp, node);
+      match = traits->compare(&tmp, node);
   }
   else if (ISSET(flags, UPS_FIND_LEQ_MATCH)) {
-    node = rbt_psearch(this, &tmp);
+    node = traits->psearch(this, &tmp);
     if (node)
-      match = compare(&tmp, node);
+      match = traits->compare(&tmp, node);
   }
   else if (ISSET(flags, UPS_FIND_GT_MATCH)) {
-    node = rbt_search(this, &tmp);
+    node = traits->search(this, &tmp);
     if (node)
       node = node->next_sibling();
     else
-      node = rbt_nsearch(this, &tmp);
+      node = traits->nsearch(this, &tmp);
     match = 1;
   }
   else if (ISSET(flags, UPS_FIND_LT_MATCH)) {
-    node = rbt_search(this, &tmp);
+    node = traits->search(this, &tmp);
     if (node)
       node = node->previous_sibling();
     else
-      node = rbt_psearch(this, &tmp);
+      node = traits->psearch(this, &tmp);
     match = -1;
   }
   else
-    return rbt_search(this, &tmp);
+    return traits->search(this, &tmp);
 
   // Nothing found?
   if (!node)
@@ -449,23 +683,23 @@ TxnIndex::get(ups_key_t *key, uint32_t flags)
 TxnNode *
 TxnIndex::first()
 {
-  return rbt_first(this);
+  return traits->first(this);
 }
 
 TxnNode *
 TxnIndex::last()
 {
-  return rbt_last(this);
+  return traits->last(this);
 }
 
 void
 TxnIndex::enumerate(Context *context, TxnIndex::Visitor *visitor)
 {
-  TxnNode *node = rbt_first(this);
+  TxnNode *node = traits->first(this);
 
   while (node) {
     visitor->visit(context, node);
-    node = rbt_next(this, node);
+    node = traits->next(this, node);
   }
 }
 
@@ -494,16 +728,18 @@ struct KeyCounter : TxnIndex::Visitor {
                     op != 0;
                     op = op->previous_in_node) {
       LocalTxn *optxn = op->txn;
-      if (optxn->is_aborted())
+      if (optxn->is_aborted() || is_hidden_from_snapshot(txn, op))
         continue;
 
       if (optxn->is_committed() || txn == optxn) {
         if (ISSET(op->flags, TxnOperation::kIsFlushed))
           continue;
 
-        // if key was erased then it doesn't exist
+        // if key was erased then it doesn't exist; it is only subtracted
+        // if it was counted in the btree
         if (ISSET(op->flags, TxnOperation::kErase)) {
-          counter--;
+          if (0 == be->find(context, 0, node->key(), 0, 0, 0, 0))
+            counter--;
           return;
         }
 
@@ -513,8 +749,7 @@ struct KeyCounter : TxnIndex::Visitor {
         }
 
         // key exists - include it
-        if (ISSET(op->flags, TxnOperation::kInsert)
-            || (ISSET(op->flags, TxnOperation::kInsertOverwrite))) {
+        if (ISSET(op->flags, TxnOperation::kInsertOverwrite)) {
           // check if the key already exists in the btree - if yes,
           // we do not count it (it will be counted later)
           if (UPS_KEY_NOT_FOUND
@@ -567,33 +802,86 @@ TxnIndex::count(Context *context, LocalTxn *txn, bool distinct)
 void
 LocalTxnManager::begin(Txn *txn)
 {
+  if (ISSET(txn->flags, UPS_TXN_READ_ONLY))
+    num_snapshots++;
   append_txn_at_tail(txn);
 }
 
+bool
+LocalTxnManager::is_recovery_target_exceeded()
+{
+  Journal *journal = lenv()->journal.get();
+  if (!journal || !journal->is_recovery_target_exceeded())
+    return false;
+
+  // a flush is pointless as long as the same lsn pins the oldest segment
+  return recovery_pinned_lsn == 0 || recovery_pinned_lsn != pinning_lsn(this);
+}
+
+uint64_t
+LocalTxnManager::oldest_snapshot_lsn()
+{
+  if (likely(num_snapshots == 0))
+    return std::numeric_limits<uint64_t>::max();
+
+  // the list is sorted by the begin lsn
+  for (Txn *txn = oldest_txn(); txn != 0; txn = txn->next()) {
+    if (ISSET(txn->flags, UPS_TXN_READ_ONLY)
+          && !txn->is_committed() && !txn->is_aborted())
+      return ((LocalTxn *)txn)->lsn;
+  }
+  return std::numeric_limits<uint64_t>::max();
+}
+
+void
+LocalTxnManager::prepare_commit(Txn *htxn)
+{
+  LocalTxn *txn = dynamic_cast<LocalTxn *>(htxn);
+  Journal *journal = lenv()->journal.get();
+
+  // the Env lock is not held, therefore |txn->refcounter| is not checked;
+  // if cursors are still attached then the commit fails and the entries
+  // are discarded
+  if (journal != 0
+        && NOTSET(txn->flags, UPS_TXN_TEMPORARY | UPS_TXN_READ_ONLY))
+    encode_transaction(journal, txn);
+}
+
 ups_status_t
 LocalTxnManager::commit(Txn *htxn)
 {
   LocalTxn *txn = dynamic_cast<LocalTxn *>(htxn);
   Context context(lenv(), txn, 0);
 
+  // a failed background flush is reported to the next commit; the Txn
+  // remains active and can be committed again
+  if (unlikely(flush_error != 0)) {
+    ups_status_t st = flush_error;
+    flush_error = 0;
+    txn->journal_buffer.clear();
+    return st;
+  }
+
   try {
     txn->commit();
+    if (ISSET(txn->flags, UPS_TXN_READ_ONLY)) {
+      end_snapshot(this, txn);
+      return 0;
+    }
+
+    committed_bytes += txn->memory_usage();
 
     // if this transaction can NOT be flushed immediately then write its
     // operations to the journal; otherwise skip this step
     flush_transaction_to_journal(txn);
 
     // flush committed transactions
-    if (likely(NOTSET(lenv()->flags(), UPS_DONT_FLUSH_TRANSACTIONS))) {
-      if (unlikely(ISSET(lenv()->flags(), UPS_FLUSH_TRANSACTIONS_IMMEDIATELY)
-                || count_flushable_transactions(this)
-                        >= Globals::ms_flush_threshold)) {
-        flush_committed_txns_impl(this, &context);
-        return 0;
-      }
-    }
+    maybe_flush_committed_txns(this, &context);
   }
   catch (Exception &ex) {
+    // discard the encoded entries; they are encoded again if the commit
+    // is retried
+    txn->journal_buffer.clear();
     return ex.code;
   }
 
@@ -608,16 +896,13 @@ LocalTxnManager::abort(Txn *htxn)
 
   try {
     txn->abort();
+    if (ISSET(txn->flags, UPS_TXN_READ_ONLY)) {
+      end_snapshot(this, txn);
+      return 0;
+    }
 
     // flush committed transactions
-    if (likely(NOTSET(lenv()->flags(), UPS_DONT_FLUSH_TRANSACTIONS))) {
-      if (unlikely(ISSET(lenv()->flags(), UPS_FLUSH_TRANSACTIONS_IMMEDIATELY)
-                || count_flushable_transactions(this)
-                        >= Globals::ms_flush_threshold)) {
-        flush_committed_txns_impl(this, &context);
-        return 0;
-      }
-    }
+    maybe_flush_committed_txns(this, &context);
   }
   catch (Exception &ex) {
     return ex.code;
@@ -628,6 +913,10 @@ LocalTxnManager::abort(Txn *htxn)
 void
 LocalTxnManager::flush_committed_txns(Context *context /* = 0 */)
 {
+  // the Txns of a failed background flush are flushed again; if this
+  // fails then the error is thrown to the caller
+  flush_error = 0;
+
   if (!context) {
     Context new_context(lenv(), 0, 0);
     flush_committed_txns_impl(this, &new_context);
@@ -636,6 +925,22 @@ LocalTxnManager::flush_committed_txns(Context *context /* = 0 */)
     flush_committed_txns_impl(this, context);
 }
 
+void
+LocalTxnManager::stop_background_flushes()
+{
+  if (!flusher.get())
+    return;
+
+  {
+    ScopedLock lock(flusher_mutex);
+    stop_flusher = true;
+    flusher_cond.notify_one();
+  }
+
+  flusher->join();
+  flusher.reset(0);
+}
+
 uint64_t
 LocalTxnManager::flush_txn_to_changeset(Context *context, LocalTxn *txn)
 {
@@ -22,7 +22,13 @@
 #include "0root/root.h"
 
 // Always verify that a file of level N does not include headers > N!
+#include "1base/mutex.h"
+#include "1base/scoped_ptr.h"
+#include "1base/spinlock.h"
+#include "1mem/aligned_pool.h"
+#include "1mem/arena.h"
 #include "1rb/rb.h"
+#include "3journal/journal_buffer.h"
 #include "4txn/txn.h"
 
 #ifndef UPS_ROOT_H
@@ -34,6 +40,7 @@ namespace upscaledb {
 struct Context;
 struct TxnNode;
 struct TxnIndex;
+struct TxnIndexTraits;
 struct TxnCursor;
 struct LocalTxn;
 struct LocalDb;
@@ -71,12 +78,12 @@ struct TxnOperation {
   }
 
   // Initialization
-  // TODO use placement new??
   void initialize(LocalTxn *txn, TxnNode *node,
                   uint32_t flags, uint32_t orig_flags, uint64_t lsn,
                   ups_key_t *key, ups_record_t *record);
 
-  // Destructor
+  // Unlinks the operation from its node and its Txn. The memory is
+  // owned by the arena of the Txn.
   void destroy();
 
   // the Txn of this operation
@@ -99,6 +106,10 @@ struct TxnOperation {
   // this is 1-based (like dupecache-index, which is also 1-based)
   uint32_t referenced_duplicate;
 
+  // the name of the Database; a copy of |node->db->name()|, which allows
+  // encoding the journal entries without touching the TxnIndex
+  uint16_t dbname;
+
   // the log serial number (lsn) of this operation
   uint64_t lsn;
 
@@ -232,9 +243,25 @@ struct TxnIndex {
   // TODO is this required?
   LocalDb *db;
 
+  // the number of TxnOperations in this tree; lookups skip the tree
+  // if it is empty
+  uint64_t num_operations;
+
+  // the functions of the red-black tree, specialized for the key type
+  // of the Database
+  const TxnIndexTraits *traits;
+
   // stuff for rb.h
   TxnNode *rbt_root;
   TxnNode rbt_nil;
+
+  // protects the cursor lists of the TxnOperations if lookups run
+  // in parallel (UPS_ENABLE_CONCURRENT_READS)
+  Spinlock cursor_mutex;
+
+  // the memory for the TxnNodes; a node is shared by the operations of
+  // several Txns and therefore outlives the Txn which created it
+  AlignedPool node_pool;
 };
 
 
@@ -261,12 +288,35 @@ struct LocalTxn : Txn {
   // (before it's deleted by the Environment).
   void free_operations();
 
-  // index of the log file descriptor for this transaction [0..1]
+  // Returns the memory which is released when this Txn is flushed: its
+  // operations and the TxnNodes which were created for them
+  size_t memory_usage() const {
+    return arena.allocated_bytes() + index_bytes;
+  }
+
+  // the memory of the TxnOperations (including the copied keys and
+  // records); released in one go when the operations are freed
+  Arena arena;
+
+  // the memory of the TxnNodes which were created for the operations
+  // of this Txn
+  size_t index_bytes;
+
+  // index of the journal segment with the entries of this transaction,
+  // or -1
   int log_descriptor;
 
-  // the lsn of the "txn begin" operation
+  // the journal entries of this transaction; appended to the journal
+  // when the transaction is committed
+  JournalBuffer journal_buffer;
+
+  // the lsn of the "txn begin" operation; a read-only Txn reads the
+  // snapshot of all Txns which were committed before this lsn
   uint64_t lsn;
 
+  // the lsn of the "txn commit" operation
+  uint64_t commit_lsn;
+
   // the linked list of operations - head is oldest operation
   TxnOperation *oldest_op;
 
@@ -279,14 +329,40 @@ struct LocalTxn : Txn {
 // A TxnManager for local Txns
 //
 struct LocalTxnManager : TxnManager {
+  enum {
+    // the size of a chunk in the arena of a Txn
+    kArenaChunkSize = 4096,
+
+    // the committed Txns are flushed in the background when they exceed
+    // the flush threshold (UPS_PARAM_TXN_FLUSH_THRESHOLD); if they exceed
+    // it by this factor then the committing thread flushes them
+    kSyncFlushFactor = 4
+  };
+
   // Constructor
   LocalTxnManager(Env *env)
-    : TxnManager(env), _txn_id(0) {
+    : TxnManager(env), _txn_id(0), num_snapshots(0),
+      arena_pool(kArenaChunkSize, Arena::kAlignment), committed_bytes(0),
+      recovery_pinned_lsn(0), flush_error(0), flush_requested(false),
+      stop_flusher(false) {
+  }
+
+  // Destructor; stops the flusher thread
+  ~LocalTxnManager() {
+    stop_background_flushes();
   }
 
+  // Stops the flusher thread; a pending background flush is discarded.
+  // Called when the Environment is closed
+  void stop_background_flushes();
+
   // Begins a new Txn
   virtual void begin(Txn *txn);
 
+  // Encodes the journal entries of a Txn which is about to be committed.
+  // Called without holding the Environment lock.
+  void prepare_commit(Txn *txn);
+
   // Commits a Txn; the derived subclass has to take care of
   // flushing and/or releasing memory
   virtual ups_status_t commit(Txn *txn);
@@ -317,10 +393,66 @@ struct LocalTxnManager : TxnManager {
     return (LocalEnv *)env;
   }
 
+  // Returns the lsn of the oldest active read-only Txn, or the largest
+  // possible lsn if there is none. Txns which were committed after this
+  // lsn are not flushed to the btree, otherwise the snapshot would see them.
+  uint64_t oldest_snapshot_lsn();
+
+  // Returns true if the journal's recovery would exceed the target
+  // recovery time (UPS_PARAM_RECOVERY_TARGET_SEC), and if flushing the
+  // committed Txns can improve this
+  bool is_recovery_target_exceeded();
+
   // The current transaction ID
   uint64_t _txn_id;
+
+  // The number of active read-only Txns (snapshots)
+  int num_snapshots;
+
+  // The chunks of the Txn arenas; recycled when a Txn is deleted
+  AlignedPool arena_pool;
+
+  // The memory of the committed Txns which are not yet flushed
+  uint64_t committed_bytes;
+
+  // The lsn which kept the last flush from releasing the oldest journal
+  // segment, or 0; the recovery target does not trigger another flush
+  // until this lsn has moved
+  uint64_t recovery_pinned_lsn;
+
+  // The error of a failed background flush; returned by the next commit.
+  // Protected by the Environment lock
+  ups_status_t flush_error;
+
+  // Protects |flush_requested| and |stop_flusher|
+  Mutex flusher_mutex;
+
+  // Wakes up the flusher thread
+  Condition flusher_cond;
+
+  // True if the flusher thread has to flush the committed Txns
+  bool flush_requested;
+
+  // Set when the flusher thread is stopped
+  bool stop_flusher;
+
+  // The flusher thread; flushes the committed Txns in the background.
+  // Started with the first background flush
+  ScopedPtr<Thread> flusher;
 };
 
+// Returns true if |op| is hidden from |txn|. A read-only Txn does not see
+// the operations of Txns which were committed after it began, or which
+// are still active; it therefore never runs into a UPS_TXN_CONFLICT.
+static inline bool
+is_hidden_from_snapshot(Txn *txn, TxnOperation *op)
+{
+  if (likely(txn == 0 || NOTSET(txn->flags, UPS_TXN_READ_ONLY)))
+    return false;
+  LocalTxn *optxn = op->txn;
+  return !optxn->is_committed() || optxn->commit_lsn > ((LocalTxn *)txn)->lsn;
+}
+
 } // namespace upscaledb
 
 #endif /* UPS_TXN_LOCAL_H */
@@ -138,7 +138,7 @@ uqi_select_range(ups_env_t *henv, const char *query, ups_cursor_t *begin,
   }
 
   Env *env = (Env *)henv;
-  ScopedLock lock(env->mutex);
+  ScopedEnvLock lock(env);
 
   try {
     return env->select_range(query,
@@ -28,6 +28,7 @@
 #include "1base/dynamic_array.h"
 #include "1globals/callbacks.h"
 #include "1mem/mem.h"
+#include "1os/file.h"
 #include "2config/db_config.h"
 #include "2config/env_config.h"
 #include "2page/page.h"
@@ -89,6 +90,41 @@ prepare_record(ups_record_t *record)
   return true;
 }
 
+static inline int
+lookup_lock_mode(Db *db)
+{
+  return db->allows_concurrent_lookups()
+            ? ScopedEnvLock::kShared
+            : ScopedEnvLock::kExclusive;
+}
+
+static inline int
+find_lock_mode(Db *db, uint32_t flags)
+{
+  return db->allows_latched_lookup(flags)
+            ? ScopedEnvLock::kLatched
+            : lookup_lock_mode(db);
+}
+
+static inline int
+update_lock_mode(Db *db)
+{
+  return db->allows_concurrent_lookups()
+            ? ScopedEnvLock::kUpdate
+            : ScopedEnvLock::kExclusive;
+}
+
+// A standby (UPS_STANDBY) is only modified by ups_env_apply_journal, which
+// replays the operations with UPS_DONT_LOCK. A read-only Txn reads from
+// a snapshot and cannot modify the Database.
+static inline bool
+is_write_protected(Db *db, Txn *txn, uint32_t flags)
+{
+  return ISSET(db->flags(), UPS_READ_ONLY)
+          || (ISSET(db->flags(), UPS_STANDBY) && NOTSET(flags, UPS_DONT_LOCK))
+          || (txn != 0 && ISSET(txn->flags, UPS_TXN_READ_ONLY));
+}
+
 static inline ups_status_t
 check_recno_key(ups_key_t *key, uint32_t flags)
 {
@@ -134,9 +170,9 @@ ups_txn_begin(ups_txn_t **htxn, ups_env_t *henv, const char *name,
   Env *env = (Env *)henv;
 
   try {
-    ScopedLock lock;
+    ScopedEnvLock lock;
     if (NOTSET(flags, UPS_DONT_LOCK))
-      lock = ScopedLock(env->mutex);
+      lock.acquire(env);
 
     if (unlikely(NOTSET(env->config.flags, UPS_ENABLE_TRANSACTIONS))) {
       ups_trace(("transactions are disabled (see UPS_ENABLE_TRANSACTIONS)"));
@@ -176,8 +212,67 @@ ups_txn_commit(ups_txn_t *htxn, uint32_t flags)
   Env *env = txn->env;
 
   try {
-    ScopedLock lock(env->mutex);
-    return env->txn_commit(txn, flags);
+    // encode the journal entries before the lock is acquired
+    env->prepare_commit(txn);
+
+    uint64_t lsn;
+    {
+      ScopedEnvLock lock;
+      if (likely(NOTSET(flags, UPS_DONT_LOCK)))
+        lock.acquire(env);
+      ups_status_t st = env->txn_commit(txn, flags);
+      if (unlikely(st != 0))
+        return st;
+      lsn = env->pending_commit_lsn();
+    }
+
+    // wait for the log writer without holding the lock
+    if (lsn)
+      env->wait_for_commit(lsn);
+    return 0;
+  }
+  catch (Exception &ex) {
+    return ex.code;
+  }
+}
+
+ups_status_t
+ups_txn_commit_async(ups_txn_t *htxn, uint32_t flags,
+                ups_txn_commit_callback_t callback, void *context)
+{
+  Txn *txn = (Txn *)htxn;
+  if (unlikely(!txn)) {
+    ups_trace(("parameter 'txn' must not be NULL"));
+    return UPS_INV_PARAMETER;
+  }
+  if (unlikely(!callback)) {
+    ups_trace(("parameter 'callback' must not be NULL"));
+    return UPS_INV_PARAMETER;
+  }
+
+  Env *env = txn->env;
+
+  try {
+    // encode the journal entries before the lock is acquired
+    env->prepare_commit(txn);
+
+    bool is_pending = false;
+    ups_status_t status = 0;
+    {
+      ScopedEnvLock lock(env);
+      ups_status_t st = env->txn_commit(txn, flags);
+      if (unlikely(st != 0))
+        return st;
+      uint64_t lsn = env->pending_commit_lsn();
+      if (lsn)
+        is_pending = env->notify_commit(lsn, callback, context, &status);
+    }
+
+    // the commit is already durable; the callback is invoked without the
+    // lock, therefore it can call other functions of the Environment
+    if (!is_pending)
+      callback(status, context);
+    return 0;
   }
   catch (Exception &ex) {
     return ex.code;
@@ -195,7 +290,9 @@ ups_txn_abort(ups_txn_t *htxn, uint32_t flags)
   Txn *txn = (Txn *)htxn;
   Env *env = txn->env;
   try {
-    ScopedLock lock(env->mutex);
+    ScopedEnvLock lock;
+    if (likely(NOTSET(flags, UPS_DONT_LOCK)))
+      lock.acquire(env);
     return env->txn_abort(txn, flags);
   }
   catch (Exception &ex) {
@@ -312,6 +409,12 @@ ups_env_create(ups_env_t **henv, const char *filename,
     return UPS_INV_PARAMETER;
   }
 
+  /* a standby is a copy of another Environment */
+  if (unlikely(ISSET(flags, UPS_STANDBY))) {
+    ups_trace(("cannot create a standby (see ups_env_open)"));
+    return UPS_INV_PARAMETER;
+  }
+
   /* in-memory? crc32 is not possible */
   if (unlikely(ISSET(flags, UPS_IN_MEMORY) && ISSET(flags, UPS_ENABLE_CRC32))) {
     ups_trace(("combination of UPS_IN_MEMORY and UPS_ENABLE_CRC32 "
@@ -319,6 +422,18 @@ ups_env_create(ups_env_t **henv, const char *filename,
     return UPS_INV_PARAMETER;
   }
 
+  /* in-memory? direct I/O is not possible */
+  if (unlikely(ISSET(flags, UPS_IN_MEMORY)
+          && ISSET(flags, UPS_ENABLE_DIRECT_IO))) {
+    ups_trace(("combination of UPS_IN_MEMORY and UPS_ENABLE_DIRECT_IO "
+            "not allowed"));
+    return UPS_INV_PARAMETER;
+  }
+
+  /* flag UPS_ENABLE_DIRECT_IO implies UPS_DISABLE_MMAP */
+  if (ISSET(flags, UPS_ENABLE_DIRECT_IO))
+    flags |= UPS_DISABLE_MMAP;
+
   /* flag UPS_AUTO_RECOVERY implies UPS_ENABLE_TRANSACTIONS */
   if (ISSET(flags, UPS_AUTO_RECOVERY))
     flags |= UPS_ENABLE_TRANSACTIONS;
@@ -388,6 +503,42 @@ ups_env_create(ups_env_t **henv, const char *filename,
       case UPS_PARAM_POSIX_FADVISE:
         config.posix_advice = (int)param->value;
         break;
+      case UPS_PARAM_CACHE_POLICY:
+        if (param->value != UPS_CACHE_POLICY_LRU
+              && param->value != UPS_CACHE_POLICY_2Q) {
+          ups_trace(("unknown cache policy %d", (int)param->value));
+          return UPS_INV_PARAMETER;
+        }
+        config.cache_policy = (int)param->value;
+        break;
+      case UPS_PARAM_FLUSH_THREADS:
+        if (param->value == 0 || param->value > 64) {
+          ups_trace(("invalid number of flush threads %u",
+                      (unsigned)param->value));
+          return UPS_INV_PARAMETER;
+        }
+        config.flush_threads = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_IO_ENGINE:
+        if (param->value != UPS_IO_ENGINE_DEFAULT
+              && param->value != UPS_IO_ENGINE_IO_URING) {
+          ups_trace(("unknown i/o engine %d", (int)param->value));
+          return UPS_INV_PARAMETER;
+        }
+        config.io_engine = (int)param->value;
+        break;
+      case UPS_PARAM_RECOVERY_TARGET_SEC:
+        config.recovery_target_sec = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_PAGE_DELTAS:
+        config.journal_page_deltas = param->value != 0;
+        break;
+      case UPS_PARAM_UNLOGGED_NEW_PAGES:
+        config.unlogged_new_pages = param->value != 0;
+        break;
+      case UPS_PARAM_TXN_FLUSH_THRESHOLD:
+        config.txn_flush_threshold_bytes = param->value;
+        break;
       default:
         ups_trace(("unknown parameter %d", (int)param->name));
         return UPS_INV_PARAMETER;
@@ -400,6 +551,21 @@ ups_env_create(ups_env_t **henv, const char *filename,
     return UPS_INV_PARAMETER;
   }
 
+  /* direct I/O requires aligned pages; the encryption buffers are not
+   * aligned */
+  if (ISSET(flags, UPS_ENABLE_DIRECT_IO)) {
+    if (unlikely(config.page_size_bytes % File::kDirectIoAlignment != 0)) {
+      ups_trace(("invalid page size - must be a multiple of %d for "
+              "UPS_ENABLE_DIRECT_IO", (int)File::kDirectIoAlignment));
+      return UPS_INV_PAGESIZE;
+    }
+    if (unlikely(config.is_encryption_enabled)) {
+      ups_trace(("combination of UPS_ENABLE_DIRECT_IO and "
+              "UPS_PARAM_ENCRYPTION_KEY not allowed"));
+      return UPS_INV_PARAMETER;
+    }
+  }
+
   config.flags = flags;
 
   /*
@@ -420,6 +586,11 @@ ups_env_create(ups_env_t **henv, const char *filename,
 #ifndef UPS_ENABLE_REMOTE
     return UPS_NOT_IMPLEMENTED;
 #else // UPS_ENABLE_REMOTE
+    if (unlikely(ISSET(config.flags, UPS_ENABLE_CONCURRENT_READS))) {
+      ups_trace(("UPS_ENABLE_CONCURRENT_READS not supported for remote "
+              "Environments"));
+      return UPS_INV_PARAMETER;
+    }
     env = new RemoteEnv(config);
 #endif
   }
@@ -486,6 +657,19 @@ ups_env_open(ups_env_t **henv, const char *filename, uint32_t flags,
   if (ISSET(flags, UPS_AUTO_RECOVERY))
     flags |= UPS_ENABLE_TRANSACTIONS;
 
+  /* flag UPS_ENABLE_DIRECT_IO implies UPS_DISABLE_MMAP */
+  if (ISSET(flags, UPS_ENABLE_DIRECT_IO))
+    flags |= UPS_DISABLE_MMAP;
+
+  /* a standby replays Txns, and it is modified by doing so */
+  if (unlikely(ISSET(flags, UPS_STANDBY)
+          && (NOTSET(flags, UPS_ENABLE_TRANSACTIONS)
+              || ISSET(flags, UPS_READ_ONLY)))) {
+    ups_trace(("UPS_STANDBY requires UPS_ENABLE_TRANSACTIONS and is not "
+          "allowed with UPS_READ_ONLY"));
+    return UPS_INV_PARAMETER;
+  }
+
   if (unlikely(config.filename.empty() && NOTSET(flags, UPS_IN_MEMORY))) {
     ups_trace(("filename is missing"));
     return UPS_INV_PARAMETER;
@@ -534,6 +718,42 @@ ups_env_open(ups_env_t **henv, const char *filename, uint32_t flags,
       case UPS_PARAM_POSIX_FADVISE:
         config.posix_advice = (int)param->value;
         break;
+      case UPS_PARAM_CACHE_POLICY:
+        if (param->value != UPS_CACHE_POLICY_LRU
+              && param->value != UPS_CACHE_POLICY_2Q) {
+          ups_trace(("unknown cache policy %d", (int)param->value));
+          return UPS_INV_PARAMETER;
+        }
+        config.cache_policy = (int)param->value;
+        break;
+      case UPS_PARAM_FLUSH_THREADS:
+        if (param->value == 0 || param->value > 64) {
+          ups_trace(("invalid number of flush threads %u",
+                      (unsigned)param->value));
+          return UPS_INV_PARAMETER;
+        }
+        config.flush_threads = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_IO_ENGINE:
+        if (param->value != UPS_IO_ENGINE_DEFAULT
+              && param->value != UPS_IO_ENGINE_IO_URING) {
+          ups_trace(("unknown i/o engine %d", (int)param->value));
+          return UPS_INV_PARAMETER;
+        }
+        config.io_engine = (int)param->value;
+        break;
+      case UPS_PARAM_RECOVERY_TARGET_SEC:
+        config.recovery_target_sec = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_PAGE_DELTAS:
+        config.journal_page_deltas = param->value != 0;
+        break;
+      case UPS_PARAM_UNLOGGED_NEW_PAGES:
+        config.unlogged_new_pages = param->value != 0;
+        break;
+      case UPS_PARAM_TXN_FLUSH_THRESHOLD:
+        config.txn_flush_threshold_bytes = param->value;
+        break;
       default:
         ups_trace(("unknown parameter %d", (int)param->name));
         return UPS_INV_PARAMETER;
@@ -541,6 +761,15 @@ ups_env_open(ups_env_t **henv, const char *filename, uint32_t flags,
     }
   }
 
+  /* the encryption buffers are not aligned for direct I/O */
+  if (unlikely(ISSET(flags, UPS_ENABLE_DIRECT_IO)
+          && config.is_encryption_enabled)) {
+    ups_trace(("combination of UPS_ENABLE_DIRECT_IO and "
+            "UPS_PARAM_ENCRYPTION_KEY not allowed"));
+    return UPS_INV_PARAMETER;
+  }
+
+
   config.flags = flags;
 
   Env *env = 0;
@@ -552,6 +781,11 @@ ups_env_open(ups_env_t **henv, const char *filename, uint32_t flags,
 #ifndef UPS_ENABLE_REMOTE
     return UPS_NOT_IMPLEMENTED;
 #else // UPS_ENABLE_REMOTE
+    if (unlikely(ISSET(config.flags, UPS_ENABLE_CONCURRENT_READS))) {
+      ups_trace(("UPS_ENABLE_CONCURRENT_READS not supported for remote "
+              "Environments"));
+      return UPS_INV_PARAMETER;
+    }
     env = new RemoteEnv(config);
 #endif
   }
@@ -608,9 +842,9 @@ ups_env_create_db(ups_env_t *henv, ups_db_t **hdb, uint16_t db_name,
   config.flags = flags;
 
   try {
-    ScopedLock lock(env->mutex);
+    ScopedEnvLock lock(env);
 
-    if (unlikely(ISSET(env->flags(), UPS_READ_ONLY))) {
+    if (unlikely(ISSETANY(env->flags(), UPS_READ_ONLY | UPS_STANDBY))) {
       ups_trace(("cannot create database in a read-only environment"));
       return UPS_WRITE_PROTECTED;
     }
@@ -650,7 +884,7 @@ ups_env_open_db(ups_env_t *henv, ups_db_t **hdb, uint16_t db_name,
   config.db_name = db_name;
 
   try {
-    ScopedLock lock(env->mutex);
+    ScopedEnvLock lock(env);
 
     if (unlikely(ISSET(env->flags(), UPS_IN_MEMORY))) {
       ups_trace(("cannot open a Database in an In-Memory Environment"));
@@ -692,9 +926,14 @@ ups_env_rename_db(ups_env_t *henv, uint16_t oldname, uint16_t newname,
   if (unlikely(oldname == newname))
     return 0;
 
+  if (unlikely(ISSET(env->flags(), UPS_STANDBY))) {
+    ups_trace(("cannot rename a database of a standby"));
+    return UPS_WRITE_PROTECTED;
+  }
+
   /* rename the database */
   try {
-    ScopedLock lock(env->mutex);
+    ScopedEnvLock lock(env);
     return env->rename_db(oldname, newname, flags);
   }
   catch (Exception &ex) {
@@ -715,9 +954,14 @@ ups_env_erase_db(ups_env_t *henv, uint16_t name, uint32_t flags)
     return UPS_INV_PARAMETER;
   }
 
+  if (unlikely(ISSET(env->flags(), UPS_STANDBY))) {
+    ups_trace(("cannot erase a database of a standby"));
+    return UPS_WRITE_PROTECTED;
+  }
+
   /* erase the database */
   try {
-    ScopedLock lock(env->mutex);
+    ScopedEnvLock lock(env);
     return env->erase_db(name, flags);
   }
   catch (Exception &ex) {
@@ -744,7 +988,7 @@ ups_env_get_database_names(ups_env_t *henv, uint16_t *names, uint32_t *length)
 
   /* get all database names */
   try {
-    ScopedLock lock(env->mutex);
+    ScopedEnvLock lock(env);
 
     std::vector<uint16_t> vec = env->get_database_names();
     if (unlikely(vec.size() > *length)) {
@@ -779,7 +1023,7 @@ ups_env_get_parameters(ups_env_t *henv, ups_parameter_t *param)
 
   /* get the parameters */
   try {
-    ScopedLock lock(env->mutex);
+    ScopedEnvLock lock(env);
     return env->get_parameters(param);
   }
   catch (Exception &ex) {
@@ -801,7 +1045,7 @@ ups_env_flush(ups_env_t *henv, uint32_t flags)
   }
 
   try {
-    ScopedLock lock(env->mutex);
+    ScopedEnvLock lock(env);
     return env->flush(flags);
   }
   catch (Exception &ex) {
@@ -833,6 +1077,55 @@ ups_env_close(ups_env_t *henv, uint32_t flags)
   }
 }
 
+ups_status_t UPS_CALLCONV
+ups_env_read_journal(ups_env_t *henv, uint64_t lsn, const void **data,
+                uint32_t *size, uint64_t *last_lsn)
+{
+  Env *env = (Env *)henv;
+
+  if (unlikely(!env)) {
+    ups_trace(("parameter 'env' must not be NULL"));
+    return UPS_INV_PARAMETER;
+  }
+  if (unlikely(!data || !size || !last_lsn)) {
+    ups_trace(("parameters 'data', 'size' and 'last_lsn' must not be NULL"));
+    return UPS_INV_PARAMETER;
+  }
+
+  try {
+    ScopedEnvLock lock(env);
+    *last_lsn = env->read_journal(lsn, (const uint8_t **)data, size);
+    return 0;
+  }
+  catch (Exception &ex) {
+    return ex.code;
+  }
+}
+
+ups_status_t UPS_CALLCONV
+ups_env_apply_journal(ups_env_t *henv, const void *data, uint32_t size)
+{
+  Env *env = (Env *)henv;
+
+  if (unlikely(!env)) {
+    ups_trace(("parameter 'env' must not be NULL"));
+    return UPS_INV_PARAMETER;
+  }
+  if (unlikely(size && !data)) {
+    ups_trace(("parameter 'data' must not be NULL"));
+    return UPS_INV_PARAMETER;
+  }
+
+  try {
+    ScopedEnvLock lock(env);
+    env->apply_journal((const uint8_t *)data, size);
+    return 0;
+  }
+  catch (Exception &ex) {
+    return ex.code;
+  }
+}
+
 UPS_EXPORT ups_status_t UPS_CALLCONV
 ups_db_get_parameters(ups_db_t *hdb, ups_parameter_t *param)
 {
@@ -849,7 +1142,7 @@ ups_db_get_parameters(ups_db_t *hdb, ups_parameter_t *param)
 
   /* get the parameters */
   try {
-    ScopedLock lock(db->env->mutex);
+    ScopedEnvLock lock(db->env);
     return db->get_parameters(param);
   }
   catch (Exception &ex) {
@@ -884,7 +1177,7 @@ ups_db_set_compare_func(ups_db_t *hdb, ups_compare_func_t foo)
     return UPS_INV_PARAMETER; 
   }
 
-  ScopedLock lock(ldb->env->mutex);
+  ScopedEnvLock lock(ldb->env);
 
   if (unlikely(db->config.key_type != UPS_TYPE_CUSTOM)) {
     ups_trace(("ups_set_compare_func only allowed for UPS_TYPE_CUSTOM "
@@ -922,8 +1215,6 @@ ups_db_find(ups_db_t *hdb, ups_txn_t *htxn, ups_key_t *key,
   Env *env = db->env;
 
   try {
-    ScopedLock lock(env->mutex);
-  
     if (unlikely(ISSETANY(db->flags(),
                             UPS_RECORD_NUMBER32 | UPS_RECORD_NUMBER64)
           && !key->data)) {
@@ -931,7 +1222,12 @@ ups_db_find(ups_db_t *hdb, ups_txn_t *htxn, ups_key_t *key,
       return UPS_INV_PARAMETER;
     }
 
-    return db->find(0, txn, key, record, flags);
+    ScopedEnvLock lock(env, find_lock_mode(db, flags));
+    ups_status_t st = db->find(0, txn, key, record, flags);
+    lock.release();
+
+    env->purge_cache();
+    return st;
   }
   catch (Exception &ex) {
     return ex.code;
@@ -983,11 +1279,11 @@ ups_db_insert(ups_db_t *hdb, ups_txn_t *htxn, ups_key_t *key,
   Env *env = db->env;
 
   try {
-    ScopedLock lock;
+    ScopedEnvLock lock;
     if (likely(NOTSET(flags, UPS_DONT_LOCK)))
-      lock = ScopedLock(env->mutex);
+      lock.acquire(env, update_lock_mode(db));
 
-    if (unlikely(ISSET(db->flags(), UPS_READ_ONLY))) {
+    if (unlikely(is_write_protected(db, txn, flags))) {
       ups_trace(("cannot insert in a read-only database"));
       return UPS_WRITE_PROTECTED;
     }
@@ -1005,7 +1301,12 @@ ups_db_insert(ups_db_t *hdb, ups_txn_t *htxn, ups_key_t *key,
 
     flags &= ~UPS_DONT_LOCK;
 
-    return db->insert(0, txn, key, record, flags);
+    ups_status_t st = db->insert(0, txn, key, record, flags);
+    if (lock.env_) {
+      lock.release();
+      env->purge_cache();
+    }
+    return st;
   }
   catch (Exception &ex) {
     return ex.code;
@@ -1032,18 +1333,23 @@ ups_db_erase(ups_db_t *hdb, ups_txn_t *htxn, ups_key_t *key, uint32_t flags)
   Env *env = db->env;
 
   try {
-    ScopedLock lock;
+    ScopedEnvLock lock;
     if (likely(NOTSET(flags, UPS_DONT_LOCK)))
-      lock = ScopedLock(env->mutex);
+      lock.acquire(env, update_lock_mode(db));
 
-    if (unlikely(ISSET(db->flags(), UPS_READ_ONLY))) {
+    if (unlikely(is_write_protected(db, txn, flags))) {
       ups_trace(("cannot erase from a read-only database"));
       return UPS_WRITE_PROTECTED;
     }
 
     flags &= ~UPS_DONT_LOCK;
 
-    return db->erase(0, txn, key, flags);
+    ups_status_t st = db->erase(0, txn, key, flags);
+    if (lock.env_) {
+      lock.release();
+      env->purge_cache();
+    }
+    return st;
   }
   catch (Exception &ex) {
     return ex.code;
@@ -1065,7 +1371,7 @@ ups_db_check_integrity(ups_db_t *hdb, uint32_t flags)
   }
 
   try {
-    ScopedLock lock(db->env->mutex);
+    ScopedEnvLock lock(db->env);
     return db->check_integrity(flags);
   }
   catch (Exception &ex) {
@@ -1098,9 +1404,9 @@ ups_db_close(ups_db_t *hdb, uint32_t flags)
   }
 
   try {
-    ScopedLock lock;
+    ScopedEnvLock lock;
     if (likely(NOTSET(flags, UPS_DONT_LOCK)))
-      lock = ScopedLock(env->mutex);
+      lock.acquire(env);
 
     // auto-cleanup cursors?
     if (ISSET(flags, UPS_AUTO_CLEANUP)) {
@@ -1145,9 +1451,9 @@ ups_cursor_create(ups_cursor_t **hcursor, ups_db_t *hdb, ups_txn_t *htxn,
   Env *env = db->env;
 
   try {
-    ScopedLock lock;
+    ScopedEnvLock lock;
     if (likely(NOTSET(flags, UPS_DONT_LOCK)))
-      lock = ScopedLock(env->mutex);
+      lock.acquire(env);
 
     *cursor = db->cursor_create(txn, flags);
     db->add_cursor(*cursor);
@@ -1178,7 +1484,7 @@ ups_cursor_clone(ups_cursor_t *hsrc, ups_cursor_t **hdest)
   Db *db = src->db;
 
   try {
-    ScopedLock lock(db->env->mutex);
+    ScopedEnvLock lock(db->env);
 
     *dest = db->cursor_clone(src);
     (*dest)->previous = 0;
@@ -1217,9 +1523,9 @@ ups_cursor_overwrite(ups_cursor_t *hcursor, ups_record_t *record,
   Db *db = cursor->db;
 
   try {
-    ScopedLock lock(db->env->mutex);
+    ScopedEnvLock lock(db->env);
 
-    if (unlikely(ISSET(db->flags(), UPS_READ_ONLY))) {
+    if (unlikely(is_write_protected(db, cursor->txn, flags))) {
       ups_trace(("cannot overwrite in a read-only database"));
       return UPS_WRITE_PROTECTED;
     }
@@ -1256,8 +1562,12 @@ ups_cursor_move(ups_cursor_t *hcursor, ups_key_t *key,
   Env *env = db->env;
 
   try {
-    ScopedLock lock(env->mutex);
-    return db->cursor_move(cursor, key, record, flags);
+    ScopedEnvLock lock(env, lookup_lock_mode(db));
+    ups_status_t st = db->cursor_move(cursor, key, record, flags);
+    lock.release();
+
+    env->purge_cache();
+    return st;
   }
   catch (Exception &ex) {
     return ex.code;
@@ -1287,13 +1597,18 @@ ups_cursor_find(ups_cursor_t *hcursor, ups_key_t *key, ups_record_t *record,
   Env *env = db->env;
 
   try {
-    ScopedLock lock;
+    ScopedEnvLock lock;
     if (likely(NOTSET(flags, UPS_DONT_LOCK)))
-      lock = ScopedLock(env->mutex);
+      lock.acquire(env, lookup_lock_mode(db));
 
     flags &= ~UPS_DONT_LOCK;
 
-    return db->find(cursor, cursor->txn, key, record, flags);
+    ups_status_t st = db->find(cursor, cursor->txn, key, record, flags);
+    if (lock.env_) {
+      lock.release();
+      env->purge_cache();
+    }
+    return st;
   }
   catch (Exception &ex) {
     return ex.code;
@@ -1328,9 +1643,11 @@ ups_cursor_insert(ups_cursor_t *hcursor, ups_key_t *key, ups_record_t *record,
   Db *db = cursor->db;
 
   try {
-    ScopedLock lock(db->env->mutex);
+    ScopedEnvLock lock;
+    if (likely(NOTSET(flags, UPS_DONT_LOCK)))
+      lock.acquire(db->env);
 
-    if (unlikely(ISSET(db->flags(), UPS_READ_ONLY))) {
+    if (unlikely(is_write_protected(db, cursor->txn, flags))) {
       ups_trace(("cannot insert to a read-only database"));
       return UPS_WRITE_PROTECTED;
     }
@@ -1376,9 +1693,9 @@ ups_cursor_erase(ups_cursor_t *hcursor, uint32_t flags)
   Db *db = cursor->db;
 
   try {
-    ScopedLock lock(db->env->mutex);
+    ScopedEnvLock lock(db->env);
 
-    if (ISSET(db->flags(), UPS_READ_ONLY)) {
+    if (is_write_protected(db, cursor->txn, flags)) {
       ups_trace(("cannot erase from a read-only database"));
       return UPS_WRITE_PROTECTED;
     }
@@ -1408,7 +1725,7 @@ ups_cursor_get_duplicate_count(ups_cursor_t *hcursor, uint32_t *count,
   Db *db = cursor->db;
 
   try {
-    ScopedLock lock(db->env->mutex);
+    ScopedEnvLock lock(db->env);
     *count = cursor->get_duplicate_count(flags);
     return 0;
   }
@@ -1435,7 +1752,7 @@ ups_cursor_get_duplicate_position(ups_cursor_t *hcursor, uint32_t *position)
   Db *db = cursor->db;
 
   try {
-    ScopedLock lock(db->env->mutex);
+    ScopedEnvLock lock(db->env);
     *position = cursor->get_duplicate_position();
     return 0;
   }
@@ -1462,7 +1779,7 @@ ups_cursor_get_record_size(ups_cursor_t *hcursor, uint32_t *size)
   Db *db = cursor->db;
 
   try {
-    ScopedLock lock(db->env->mutex);
+    ScopedEnvLock lock(db->env);
     *size = cursor->get_record_size();
     return 0;
   }
@@ -1485,7 +1802,7 @@ ups_cursor_close(ups_cursor_t *hcursor)
   Db *db = cursor->db;
 
   try {
-    ScopedLock lock(db->env->mutex);
+    ScopedEnvLock lock(db->env);
     cursor->close();
     if (cursor->txn)
       cursor->txn->release();
@@ -1505,7 +1822,7 @@ ups_set_context_data(ups_db_t *hdb, void *data)
   if (unlikely(!db))
     return;
 
-  ScopedLock lock(db->env->mutex);
+  ScopedEnvLock lock(db->env);
   db->context = data;
 }
 
@@ -1519,7 +1836,7 @@ ups_get_context_data(ups_db_t *hdb, ups_bool_t dont_lock)
   if (dont_lock)
     return db->context;
 
-  ScopedLock lock(db->env->mutex);
+  ScopedEnvLock lock(db->env);
   return db->context;
 }
 
@@ -1580,9 +1897,11 @@ ups_db_count(ups_db_t *hdb, ups_txn_t *htxn, uint32_t flags,
   }
 
   try {
-    ScopedLock lock(db->env->mutex);
-
+    ScopedEnvLock lock(db->env, lookup_lock_mode(db));
     *count = db->count(txn, ISSET(flags, UPS_SKIP_DUPLICATES));
+    lock.release();
+
+    db->env->purge_cache();
     return 0;
   }
   catch (Exception &ex) {
@@ -1700,8 +2019,17 @@ ups_db_bulk_operations(ups_db_t *hdb, ups_txn_t *txn,
   }
 
   Db *db = (Db *)hdb;
+  if (unlikely(ISSET(db->flags(), UPS_STANDBY))) {
+    for (size_t i = 0; i < operations_length; i++) {
+      if (operations[i].type != UPS_OP_FIND) {
+        ups_trace(("cannot modify a database of a standby"));
+        return UPS_WRITE_PROTECTED;
+      }
+    }
+  }
+
   try {
-    ScopedLock lock = ScopedLock(db->env->mutex);
+    ScopedEnvLock lock(db->env);
     return db->bulk_operations((Txn *)txn, operations,
                     operations_length, flags);
   }
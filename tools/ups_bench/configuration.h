@@ -93,7 +93,9 @@ struct Configuration
       journal_compression(0), record_compression(0), key_compression(0),
       read_only(false), enable_crc32(false), record_number32(false),
       record_number64(false), posix_fadvice(UPS_POSIX_FADVICE_NORMAL),
-      simulate_crashes(false), flush_txn_immediately(false) {
+      simulate_crashes(false), flush_txn_immediately(false),
+      cache_policy(UPS_CACHE_POLICY_LRU), flush_threads(1),
+      io_engine(UPS_IO_ENGINE_DEFAULT), direct_io(false) {
   }
 
   const char *
@@ -209,6 +211,18 @@ struct Configuration
                                ? "random"
                                : "??unknown??")
                 << " ";
+    if (cache_policy)
+      std::cout << "--cache-policy="
+                << (cache_policy == UPS_CACHE_POLICY_2Q
+                               ? "2q"
+                               : "??unknown??")
+                << " ";
+    if (flush_threads > 1)
+      std::cout << "--flush-threads=" << flush_threads << " ";
+    if (io_engine == UPS_IO_ENGINE_IO_URING)
+      std::cout << "--io-engine=io_uring ";
+    if (direct_io)
+      std::cout << "--direct-io ";
     if (simulate_crashes)
       std::cout << "--simulate-crashes ";
     if (flush_txn_immediately)
@@ -312,6 +326,10 @@ struct Configuration
   int posix_fadvice;
   bool simulate_crashes;
   bool flush_txn_immediately;
+  int cache_policy;
+  uint32_t flush_threads;
+  int io_engine;
+  bool direct_io;
 };
 
 #endif /* UPS_BENCH_CONFIGURATION_H */
@@ -91,6 +91,10 @@
 #define ARG_POSIX_FADVICE                       71
 #define ARG_SIMULATE_CRASHES                    72
 #define ARG_FLUSH_TXN_IMMEDIATELY               73
+#define ARG_CACHE_POLICY                        74
+#define ARG_FLUSH_THREADS                       75
+#define ARG_IO_ENGINE                           76
+#define ARG_DIRECT_IO                           77
 
 /*
  * command line parameters
@@ -427,6 +431,30 @@ static option_t opts[] = {
     "flush-txn-immediately",
     "Immediately flushes transactions after they are committed",
     0 },
+  {
+    ARG_CACHE_POLICY,
+    0,
+    "cache-policy",
+    "Sets the eviction policy of the cache: 'lru' (default), '2q'",
+    GETOPTS_NEED_ARGUMENT },
+  {
+    ARG_FLUSH_THREADS,
+    0,
+    "flush-threads",
+    "Sets the number of threads which flush dirty pages (default: 1)",
+    GETOPTS_NEED_ARGUMENT },
+  {
+    ARG_IO_ENGINE,
+    0,
+    "io-engine",
+    "Sets the I/O backend: 'default', 'io_uring'",
+    GETOPTS_NEED_ARGUMENT },
+  {
+    ARG_DIRECT_IO,
+    0,
+    "direct-io",
+    "Bypasses the operating system's file cache (O_DIRECT)",
+    0 },
   {0, 0}
 };
 
@@ -821,6 +849,36 @@ parse_config(int argc, char **argv, Configuration *c)
     else if (opt == ARG_FLUSH_TXN_IMMEDIATELY) {
       c->flush_txn_immediately = true;
     }
+    else if (opt == ARG_CACHE_POLICY) {
+      if (!strcmp(param, "lru"))
+        c->cache_policy = UPS_CACHE_POLICY_LRU;
+      else if (!strcmp(param, "2q"))
+        c->cache_policy = UPS_CACHE_POLICY_2Q;
+      else {
+        printf("[FAIL] invalid parameter for 'cache-policy'\n");
+        exit(-1);
+      }
+    }
+    else if (opt == ARG_FLUSH_THREADS) {
+      c->flush_threads = strtoul(param, 0, 0);
+      if (c->flush_threads == 0) {
+        printf("[FAIL] invalid parameter for 'flush-threads'\n");
+        exit(-1);
+      }
+    }
+    else if (opt == ARG_IO_ENGINE) {
+      if (!strcmp(param, "default"))
+        c->io_engine = UPS_IO_ENGINE_DEFAULT;
+      else if (!strcmp(param, "io_uring"))
+        c->io_engine = UPS_IO_ENGINE_IO_URING;
+      else {
+        printf("[FAIL] invalid parameter for 'io-engine'\n");
+        exit(-1);
+      }
+    }
+    else if (opt == ARG_DIRECT_IO) {
+      c->direct_io = true;
+    }
     else if (opt == ARG_READ_ONLY) {
       c->read_only = true;
     }
@@ -980,6 +1038,10 @@ print_metrics(Metrics *metrics, Configuration *conf)
           (long unsigned int)metrics->upscaledb_metrics.extended_duptables);
   printf("\tupscaledb journal_bytes_flushed       %lu\n",
           (long unsigned int)metrics->upscaledb_metrics.journal_bytes_flushed);
+  printf("\tupscaledb journal_compression_usec    %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.journal_compression_usec);
+  printf("\tupscaledb journal_dictionary_size     %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.journal_dictionary_size);
 }
 
 struct Callable {
@@ -73,7 +73,7 @@ UpscaleDatabase::do_create_env()
 {
   ups_status_t st = 0;
   uint32_t flags = 0;
-  ups_parameter_t params[6] = {{0, 0}};
+  ups_parameter_t params[9] = {{0, 0}};
 
   ScopedLock lock(ms_mutex);
 
@@ -93,6 +93,21 @@ UpscaleDatabase::do_create_env()
     params[p].name = UPS_PARAM_POSIX_FADVISE;
     params[p].value = m_config->posix_fadvice;
     p++;
+    if (m_config->cache_policy) {
+      params[p].name = UPS_PARAM_CACHE_POLICY;
+      params[p].value = m_config->cache_policy;
+      p++;
+    }
+    if (m_config->flush_threads > 1) {
+      params[p].name = UPS_PARAM_FLUSH_THREADS;
+      params[p].value = m_config->flush_threads;
+      p++;
+    }
+    if (m_config->io_engine) {
+      params[p].name = UPS_PARAM_IO_ENGINE;
+      params[p].value = m_config->io_engine;
+      p++;
+    }
     if (m_config->use_encryption) {
       params[p].name = UPS_PARAM_ENCRYPTION_KEY;
       params[p].value = (uint64_t)"1234567890123456";
@@ -106,6 +121,7 @@ UpscaleDatabase::do_create_env()
 
     flags |= m_config->inmemory ? UPS_IN_MEMORY : 0; 
     flags |= m_config->no_mmap ? UPS_DISABLE_MMAP : 0; 
+    flags |= m_config->direct_io ? UPS_ENABLE_DIRECT_IO : 0;
     flags |= m_config->cacheunlimited ? UPS_CACHE_UNLIMITED : 0;
     flags |= m_config->use_transactions ? UPS_ENABLE_TRANSACTIONS : 0;
     flags |= m_config->flush_txn_immediately ? UPS_FLUSH_TRANSACTIONS_IMMEDIATELY : 0;
@@ -156,7 +172,7 @@ UpscaleDatabase::do_open_env()
 {
   ups_status_t st = 0;
   uint32_t flags = 0;
-  ups_parameter_t params[6] = {{0, 0}};
+  ups_parameter_t params[8] = {{0, 0}};
 
   ScopedLock lock(ms_mutex);
 
@@ -174,6 +190,21 @@ UpscaleDatabase::do_open_env()
     params[p].name = UPS_PARAM_POSIX_FADVISE;
     params[p].value = m_config->posix_fadvice;
     p++;
+    if (m_config->cache_policy) {
+      params[p].name = UPS_PARAM_CACHE_POLICY;
+      params[p].value = m_config->cache_policy;
+      p++;
+    }
+    if (m_config->flush_threads > 1) {
+      params[p].name = UPS_PARAM_FLUSH_THREADS;
+      params[p].value = m_config->flush_threads;
+      p++;
+    }
+    if (m_config->io_engine) {
+      params[p].name = UPS_PARAM_IO_ENGINE;
+      params[p].value = m_config->io_engine;
+      p++;
+    }
     if (m_config->use_encryption) {
       params[p].name = UPS_PARAM_ENCRYPTION_KEY;
       params[p].value = (uint64_t)"1234567890123456";
@@ -181,6 +212,7 @@ UpscaleDatabase::do_open_env()
     }
 
     flags |= m_config->no_mmap ? UPS_DISABLE_MMAP : 0; 
+    flags |= m_config->direct_io ? UPS_ENABLE_DIRECT_IO : 0;
     flags |= m_config->cacheunlimited ? UPS_CACHE_UNLIMITED : 0;
     flags |= m_config->use_transactions
                 ? (UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY)
@@ -22,6 +22,7 @@
 
 #include "1base/dynamic_array.h"
 #include "2compressor/compressor_factory.h"
+#include "3journal/journal.h"
 
 using namespace upscaledb;
 
@@ -134,6 +135,74 @@ TEST_CASE("Compression/LzfJournal", "")
   complex_journal_test(UPS_COMPRESSOR_LZF);
 }
 
+TEST_CASE("Compression/zlibDictionary", "")
+{
+#ifdef HAVE_ZLIB_H
+  const char *dict = "{\"name\": \"customer\", \"status\": \"active\"}";
+  const char *data = "{\"name\": \"customer\", \"status\": \"inactive\"}";
+  uint32_t size = (uint32_t)::strlen(data) + 1;
+
+  ScopedPtr<Compressor> c(CompressorFactory::create(UPS_COMPRESSOR_ZLIB));
+  uint32_t len1 = c->compress((uint8_t *)data, size);
+
+  REQUIRE(c->set_dictionary((uint8_t *)dict, (uint32_t)::strlen(dict)));
+  uint32_t len2 = c->compress((uint8_t *)data, size);
+  REQUIRE(len2 < len1);
+
+  ByteArray tmp;
+  tmp.append(c->arena.data(), len2);
+  c->decompress(tmp.data(), len2, size);
+  REQUIRE(0 == ::strcmp(data, (const char *)c->arena.data()));
+#endif
+
+  ScopedPtr<Compressor> lzf(CompressorFactory::create(UPS_COMPRESSOR_LZF));
+  REQUIRE(false == lzf->set_dictionary((uint8_t *)"hello", 5));
+}
+
+TEST_CASE("Compression/ZlibJournalDictionary", "")
+{
+#ifdef HAVE_ZLIB_H
+  ups_parameter_t p[] = {
+      { UPS_PARAM_JOURNAL_COMPRESSION, UPS_COMPRESSOR_ZLIB },
+      { 0, 0 }
+  };
+
+  BaseFixture f;
+  f.require_create(UPS_DONT_FLUSH_TRANSACTIONS | UPS_ENABLE_TRANSACTIONS, p);
+
+  // small records of a similar shape; they do not compress well on
+  // their own
+  const int kCount = 500;
+  char kbuf[32];
+  char rbuf[128];
+  DbProxy db(f.db);
+  for (int i = 0; i < kCount; i++) {
+    ::sprintf(kbuf, "customer-%06d", i);
+    ::sprintf(rbuf, "{\"id\": %d, \"status\": \"active\", "
+                    "\"country\": \"de\"}", i);
+    db.require_insert(kbuf, rbuf);
+  }
+
+  ups_env_metrics_t metrics = {0};
+  REQUIRE(0 == ups_env_get_metrics(f.env, &metrics));
+  REQUIRE(metrics.journal_dictionary_size == Journal::kDictionarySize);
+  REQUIRE(metrics.journal_bytes_after_compression
+                  < metrics.journal_bytes_before_compression / 2);
+
+  // reopen, perform recovery; the dictionary is loaded from the journal
+  f.close(UPS_AUTO_CLEANUP | UPS_DONT_CLEAR_LOG)
+   .require_open(UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY);
+  db = DbProxy(f.db);
+
+  for (int i = 0; i < kCount; i++) {
+    ::sprintf(kbuf, "customer-%06d", i);
+    ::sprintf(rbuf, "{\"id\": %d, \"status\": \"active\", "
+                    "\"country\": \"de\"}", i);
+    db.require_find(kbuf, rbuf);
+  }
+#endif
+}
+
 static void
 simple_record_test(int library)
 {
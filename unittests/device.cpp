@@ -19,6 +19,8 @@
 #include "3rdparty/catch/catch.hpp"
 
 #include "2device/device.h"
+#include "2device/device_disk.h"
+#include "2device/device_uring.h"
 
 #include "os.hpp"
 #include "fixture.hpp"
@@ -26,8 +28,13 @@
 using namespace upscaledb;
 
 struct DeviceFixture : BaseFixture {
-  DeviceFixture(bool inmemory) {
-    require_create(inmemory ? UPS_IN_MEMORY : 0);
+  DeviceFixture(bool inmemory, int io_engine = UPS_IO_ENGINE_DEFAULT,
+                  uint32_t flags = 0) {
+    ups_parameter_t params[] = {
+        { UPS_PARAM_IO_ENGINE, (uint64_t)io_engine },
+        { 0, 0 }
+    };
+    require_create(flags | (inmemory ? UPS_IN_MEMORY : 0), params);
   }
 
   void createCloseTest() {
@@ -178,6 +185,123 @@ struct DeviceFixture : BaseFixture {
       pp.require_payload(temp, page_size - Page::kSizeofPersistentHeader);
     }
   }
+
+  void growMappingTest() {
+    uint32_t page_size = UPS_DEFAULT_PAGE_SIZE;
+    uint64_t increment = DiskDevice::kMinMappingIncrement;
+    DiskDevice *dev = (DiskDevice *)device();
+    DeviceProxy dp(lenv());
+
+    // a new file is not mapped; a small growth does not map a segment
+    REQUIRE(dev->mapped_segment_count() == 0);
+    dp.require_truncate(page_size * 4);
+    PageProxy pp1(lenv(), ldb());
+    dp.require_read_page(pp1, page_size * 3);
+    pp1.require_allocated(true);
+    REQUIRE(dev->mapped_segment_count() == 0);
+
+    // the file grew far enough; the page is now read from the mapping
+    uint64_t first_end = increment + page_size * 2;
+    dp.require_truncate(first_end);
+    PageProxy pp2(lenv(), ldb());
+    dp.require_read_page(pp2, increment);
+    pp2.require_allocated(false);
+    REQUIRE(dev->mapped_segment_count() == 1);
+    REQUIRE(dev->is_mapped(0, page_size));
+    REQUIRE(dev->mapped_pointer(increment) == (uint8_t *)pp2.page->data());
+
+    // the next segment is mapped behind the first one
+    dp.require_truncate(increment * 3);
+    PageProxy pp3(lenv(), ldb());
+    dp.require_read_page(pp3, increment * 2);
+    pp3.require_allocated(false);
+    REQUIRE(dev->mapped_segment_count() == 2);
+    REQUIRE(dev->is_mapped(first_end, page_size));
+    REQUIRE(dev->mapped_pointer(increment * 2)
+                    == (uint8_t *)pp3.page->data());
+
+    // a range which spans both segments is not mapped
+    REQUIRE(false == dev->is_mapped(first_end - page_size, page_size * 2));
+    REQUIRE(false == dev->is_mapped(increment * 3, page_size));
+  }
+
+  void directIoTest() {
+    uint32_t page_size = UPS_DEFAULT_PAGE_SIZE;
+    REQUIRE(ISSET(lenv()->config.flags, UPS_DISABLE_MMAP));
+
+    DeviceProxy dp(lenv());
+    dp.require_open()
+      .require_truncate(page_size * 4);
+
+    // page buffers are aligned, even if the file system does not support
+    // direct I/O
+    PageProxy pp(lenv(), ldb());
+    dp.alloc_page(pp);
+    REQUIRE((size_t)pp.page->data() % File::kDirectIoAlignment == 0);
+    ::memset(pp.page->payload(), 0x13,
+                    page_size - Page::kSizeofPersistentHeader);
+    pp.set_dirty(true);
+    pp.require_flush();
+
+    // unaligned reads and writes are bounced
+    uint8_t buffer[100];
+    uint64_t address = pp.page->address();
+    dp.require_read(address + 1000, buffer, sizeof(buffer));
+    for (size_t i = 0; i < sizeof(buffer); i++)
+      REQUIRE(buffer[i] == 0x13);
+    ::memset(buffer, 0x14, sizeof(buffer));
+    dp.require_write(address + 1000, buffer, sizeof(buffer));
+
+    PageProxy copy(lenv(), ldb());
+    dp.require_read_page(copy, address);
+    REQUIRE((size_t)copy.page->data() % File::kDirectIoAlignment == 0);
+    uint8_t *p = (uint8_t *)copy.page->data();
+    REQUIRE(p[999] == 0x13);
+    REQUIRE(p[1000] == 0x14);
+    REQUIRE(p[1099] == 0x14);
+    REQUIRE(p[1100] == 0x13);
+
+    dp.free_page(pp)
+      .free_page(copy);
+  }
+
+  void readWritePagesTest() {
+    uint32_t page_size = UPS_DEFAULT_PAGE_SIZE;
+    uint64_t addresses[] = {0, 1, 2, 5, 6};
+    size_t count = sizeof(addresses) / sizeof(addresses[0]);
+    std::vector<Page *> pages;
+
+    EnvConfig &cfg = const_cast<EnvConfig &>(lenv()->config);
+    cfg.flags |= UPS_DISABLE_MMAP;
+
+    DeviceProxy dp(lenv());
+    dp.require_open()
+      .require_truncate(page_size * 8);
+
+    // write the pages; pages 0-2 and 5-6 are coalesced
+    for (size_t i = 0; i < count; i++) {
+      addresses[i] *= page_size;
+      Page *page = new Page(device(), ldb());
+      page->assign_allocated_buffer(Memory::allocate<uint8_t>(page_size),
+                      addresses[i]);
+      ::memset(page->raw_payload(), (int)i + 1, page_size);
+      pages.push_back(page);
+    }
+    device()->write_pages(&pages[0], count);
+
+    // and read them again
+    std::vector<Page *> copies;
+    for (size_t i = 0; i < count; i++)
+      copies.push_back(new Page(device(), ldb()));
+    device()->read_pages(&copies[0], addresses, count);
+
+    for (size_t i = 0; i < count; i++) {
+      REQUIRE(0 == ::memcmp(copies[i]->raw_payload(), pages[i]->raw_payload(),
+                              page_size));
+      delete pages[i];
+      delete copies[i];
+    }
+  }
 };
 
 TEST_CASE("Device/newDelete", "")
@@ -234,6 +358,72 @@ TEST_CASE("Device/readWritePage", "")
   f.readWritePageTest();
 }
 
+TEST_CASE("Device/readWritePages", "")
+{
+  DeviceFixture f(false);
+  f.readWritePagesTest();
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+TEST_CASE("Device/uring/createUringDevice", "")
+{
+  DeviceFixture f(false, UPS_IO_ENGINE_IO_URING);
+  if (IoUring::is_supported())
+    REQUIRE(dynamic_cast<UringDevice *>(f.device()) != 0);
+  f.require_parameter(UPS_PARAM_IO_ENGINE, UPS_IO_ENGINE_IO_URING);
+}
+
+TEST_CASE("Device/uring/readWritePage", "")
+{
+  DeviceFixture f(false, UPS_IO_ENGINE_IO_URING);
+  f.readWritePageTest();
+}
+
+TEST_CASE("Device/uring/readWritePages", "")
+{
+  DeviceFixture f(false, UPS_IO_ENGINE_IO_URING);
+  f.readWritePagesTest();
+}
+#endif
+
+// Win32 does not grow the mapping
+#ifndef WIN32
+TEST_CASE("Device/growMapping", "")
+{
+  DeviceFixture f(false);
+  f.growMappingTest();
+}
+#endif
+
+TEST_CASE("Device/directio/directIo", "")
+{
+  DeviceFixture f(false, UPS_IO_ENGINE_DEFAULT, UPS_ENABLE_DIRECT_IO);
+  f.directIoTest();
+}
+
+TEST_CASE("Device/directio/readWrite", "")
+{
+  DeviceFixture f(false, UPS_IO_ENGINE_DEFAULT, UPS_ENABLE_DIRECT_IO);
+  f.readWriteTest();
+}
+
+TEST_CASE("Device/directio/readWritePage", "")
+{
+  DeviceFixture f(false, UPS_IO_ENGINE_DEFAULT, UPS_ENABLE_DIRECT_IO);
+  f.readWritePageTest();
+}
+
+TEST_CASE("Device/directio/invalidPageSize", "")
+{
+  ups_parameter_t params[] = {
+      { UPS_PARAM_PAGE_SIZE, 1024 },
+      { 0, 0 }
+  };
+  BaseFixture f;
+  f.require_create(UPS_ENABLE_DIRECT_IO, params, UPS_INV_PAGESIZE);
+  f.require_create(UPS_ENABLE_DIRECT_IO | UPS_IN_MEMORY, 0,
+                  UPS_INV_PARAMETER);
+}
 
 TEST_CASE("Device/inmem/newDelete", "")
 {
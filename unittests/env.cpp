@@ -20,6 +20,8 @@
 
 #include <stdint.h>
 
+#include <boost/thread.hpp>
+
 #include "4db/db_local.h"
 #include "4env/env_local.h"
 
@@ -843,6 +845,173 @@ struct EnvFixture {
     }
   }
 
+  static void concurrentReader(ups_db_t *db, int num_keys, int *errors) {
+    for (int i = 0; i < num_keys; i++) {
+      uint32_t k = (uint32_t)i;
+      ups_key_t key = ups_make_key(&k, sizeof(k));
+      ups_record_t rec = {0};
+      if (ups_db_find(db, 0, &key, &rec, 0) != 0
+          || rec.size != sizeof(k)
+          || *(uint32_t *)rec.data != k)
+        (*errors)++;
+    }
+
+    ups_cursor_t *cursor;
+    if (ups_cursor_create(&cursor, db, 0, 0) != 0) {
+      (*errors)++;
+      return;
+    }
+    ups_key_t key = {0};
+    ups_record_t rec = {0};
+    uint32_t expected = 0;
+    while (ups_cursor_move(cursor, &key, &rec, UPS_CURSOR_NEXT) == 0) {
+      if (*(uint32_t *)key.data != expected
+          || *(uint32_t *)rec.data != expected)
+        (*errors)++;
+      if (++expected == (uint32_t)num_keys)
+        break;
+    }
+    if (expected != (uint32_t)num_keys)
+      (*errors)++;
+    ups_cursor_close(cursor);
+
+    uint64_t count;
+    if (ups_db_count(db, 0, 0, &count) != 0 || count < (uint64_t)num_keys)
+      (*errors)++;
+  }
+
+  static void concurrentWriter(ups_db_t *db, int num_keys, int *errors) {
+    for (int i = num_keys; i < 2 * num_keys; i++) {
+      uint32_t k = (uint32_t)i;
+      ups_key_t key = ups_make_key(&k, sizeof(k));
+      ups_record_t rec = ups_make_record(&k, sizeof(k));
+      if (ups_db_insert(db, 0, &key, &rec, 0) != 0)
+        (*errors)++;
+    }
+  }
+
+  void concurrentReadsTest() {
+    const int kNumKeys = 20000;
+    const int kNumReaders = 4;
+    ups_parameter_t params[] = {
+        { UPS_PARAM_CACHE_SIZE, 64 * 1024 },
+        { UPS_PARAM_PAGE_SIZE, 1024 },
+        { 0, 0 }
+    };
+    ups_parameter_t db_params[] = {
+        { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+        { 0, 0 }
+    };
+    BaseFixture bf;
+    bf.require_create(m_flags | UPS_ENABLE_CONCURRENT_READS, params,
+                    0, db_params);
+
+    for (int i = 0; i < kNumKeys; i++) {
+      uint32_t k = (uint32_t)i;
+      ups_key_t key = ups_make_key(&k, sizeof(k));
+      ups_record_t rec = ups_make_record(&k, sizeof(k));
+      REQUIRE(0 == ups_db_insert(bf.db, 0, &key, &rec, 0));
+    }
+
+    int errors[kNumReaders + 1] = {0};
+    boost::thread_group threads;
+    for (int i = 0; i < kNumReaders; i++)
+      threads.create_thread(boost::bind(&EnvFixture::concurrentReader,
+                              bf.db, kNumKeys, &errors[i]));
+    threads.create_thread(boost::bind(&EnvFixture::concurrentWriter,
+                              bf.db, kNumKeys, &errors[kNumReaders]));
+    threads.join_all();
+
+    for (int i = 0; i <= kNumReaders; i++)
+      REQUIRE(errors[i] == 0);
+
+    uint64_t count;
+    REQUIRE(0 == ups_db_count(bf.db, 0, 0, &count));
+    REQUIRE(count == (uint64_t)(2 * kNumKeys));
+    REQUIRE(0 == ups_db_check_integrity(bf.db, 0));
+  }
+
+  static void latchedReader(ups_db_t *db, int num_keys, int loops,
+                  uint32_t record_size, int *errors) {
+    char buffer[64];
+    for (int l = 0; l < loops; l++) {
+      for (int i = 0; i < num_keys; i++) {
+        uint32_t k = (uint32_t)i;
+        ups_key_t key = ups_make_key(&k, sizeof(k));
+        ups_record_t rec = {0};
+        ::memset(buffer, (char)i, sizeof(buffer));
+        if (ups_db_find(db, 0, &key, &rec, 0) != 0
+            || rec.size != record_size
+            || ::memcmp(rec.data, buffer, record_size))
+          (*errors)++;
+      }
+    }
+  }
+
+  static void latchedWriter(ups_db_t *db, int num_keys,
+                  uint32_t record_size, int *errors) {
+    char buffer[64];
+    for (int i = num_keys; i < 4 * num_keys; i++) {
+      uint32_t k = (uint32_t)i;
+      ups_key_t key = ups_make_key(&k, sizeof(k));
+      ::memset(buffer, (char)i, sizeof(buffer));
+      ups_record_t rec = ups_make_record(buffer, record_size);
+      if (ups_db_insert(db, 0, &key, &rec, 0) != 0)
+        (*errors)++;
+    }
+    for (int i = 2 * num_keys; i < 4 * num_keys; i++) {
+      uint32_t k = (uint32_t)i;
+      ups_key_t key = ups_make_key(&k, sizeof(k));
+      if (ups_db_erase(db, 0, &key, 0) != 0)
+        (*errors)++;
+    }
+  }
+
+  void concurrentUpdatesTest(uint32_t record_size) {
+    const int kNumKeys = 5000;
+    const int kNumReaders = 3;
+    ups_parameter_t params[] = {
+        { UPS_PARAM_CACHE_SIZE, 128 * 1024 },
+        { UPS_PARAM_PAGE_SIZE, 1024 },
+        { 0, 0 }
+    };
+    ups_parameter_t db_params[] = {
+        { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+        { UPS_PARAM_RECORD_SIZE, record_size },
+        { 0, 0 }
+    };
+    BaseFixture bf;
+    bf.require_create(m_flags | UPS_ENABLE_CONCURRENT_READS, params,
+                    0, db_params);
+
+    char buffer[64];
+    for (int i = 0; i < kNumKeys; i++) {
+      uint32_t k = (uint32_t)i;
+      ups_key_t key = ups_make_key(&k, sizeof(k));
+      ::memset(buffer, (char)i, sizeof(buffer));
+      ups_record_t rec = ups_make_record(buffer, record_size);
+      REQUIRE(0 == ups_db_insert(bf.db, 0, &key, &rec, 0));
+    }
+
+    int errors[kNumReaders + 1] = {0};
+    boost::thread_group threads;
+    for (int i = 0; i < kNumReaders; i++)
+      threads.create_thread(boost::bind(&EnvFixture::latchedReader,
+                              bf.db, kNumKeys, 3, record_size, &errors[i]));
+    threads.create_thread(boost::bind(&EnvFixture::latchedWriter,
+                              bf.db, kNumKeys, record_size,
+                              &errors[kNumReaders]));
+    threads.join_all();
+
+    for (int i = 0; i <= kNumReaders; i++)
+      REQUIRE(errors[i] == 0);
+
+    uint64_t count;
+    REQUIRE(0 == ups_db_count(bf.db, 0, 0, &count));
+    REQUIRE(count == (uint64_t)(2 * kNumKeys));
+    REQUIRE(0 == ups_db_check_integrity(bf.db, 0));
+  }
+
   void memoryDbTest() {
     ups_db_t *db[10];
     BaseFixture bf;
@@ -1022,6 +1191,24 @@ TEST_CASE("Env/createOpenEmptyTest", "")
 }
 
 
+TEST_CASE("Env/concurrentReadsTest", "")
+{
+  EnvFixture f;
+  f.concurrentReadsTest();
+}
+
+TEST_CASE("Env/concurrentUpdatesTest", "")
+{
+  EnvFixture f;
+  f.concurrentUpdatesTest(64);
+}
+
+TEST_CASE("Env/concurrentUpdatesInlineRecordsTest", "")
+{
+  EnvFixture f;
+  f.concurrentUpdatesTest(8);
+}
+
 TEST_CASE("Env/inmem/createCloseTest", "")
 {
   EnvFixture f(UPS_IN_MEMORY);
@@ -165,6 +165,21 @@ struct BaseFixture {
   ups_env_t *env;
 };
 
+// Changes the flush threshold of the committed Txns; the previous value
+// is restored when the guard goes out of scope
+struct ScopedFlushThreshold {
+  ScopedFlushThreshold(int threshold)
+    : old_threshold(Globals::ms_flush_threshold) {
+    Globals::ms_flush_threshold = threshold;
+  }
+
+  ~ScopedFlushThreshold() {
+    Globals::ms_flush_threshold = old_threshold;
+  }
+
+  int old_threshold;
+};
+
 struct PageProxy {
   PageProxy()
     : page(nullptr) {
@@ -29,6 +29,31 @@ using namespace upscaledb;
 
 namespace upscaledb {
 
+// unittest hooks of Changeset::flush()
+extern void (*g_CHANGESET_POST_LOG_HOOK)(void);
+extern void (*g_CHANGESET_PRE_LOG_HOOK)(void);
+
+// backs up the files while a Changeset is logged, but not yet written
+static void
+backup_in_flight_changeset()
+{
+  REQUIRE(true == os::copy("test.db", "test.db.bak"));
+  REQUIRE(true == os::copy("test.db.jrn0", "test.db.bak0"));
+  REQUIRE(true == os::copy("test.db.jrn1", "test.db.bak1"));
+  g_CHANGESET_POST_LOG_HOOK = 0;
+}
+
+// backs up the files after the new pages were written, but before the
+// Changeset is logged
+static void
+backup_unlogged_new_pages()
+{
+  REQUIRE(true == os::copy("test.db", "test.db.bak"));
+  REQUIRE(true == os::copy("test.db.jrn0", "test.db.bak0"));
+  REQUIRE(true == os::copy("test.db.jrn1", "test.db.bak1"));
+  g_CHANGESET_PRE_LOG_HOOK = 0;
+}
+
 struct JournalEntry {
   JournalEntry(uint64_t lsn_, uint64_t txnid_, uint32_t dbid_,
                   uint32_t type_, const char *key_, const char *record_,
@@ -224,14 +249,16 @@ struct JournalProxy {
     ups_key_t k = ups_make_key((void *)key, (uint16_t)(::strlen(key) + 1));
     ups_record_t r = ups_make_record((void *)record,
                             (uint32_t)(::strlen(record) + 1));
-    journal->append_insert((Db *)db, (LocalTxn *)txn, &k, &r, flags, lsn);
+    journal->append_insert(((Db *)db)->name(), (LocalTxn *)txn, &k, &r,
+                    flags, lsn);
     return *this;
   }
 
   JournalProxy &append_erase(ups_db_t *db, ups_txn_t *txn, const char *key,
                   uint32_t duplicate, uint32_t flags, uint64_t lsn) {
     ups_key_t k = ups_make_key((void *)key, (uint16_t)(::strlen(key) + 1));
-    journal->append_erase((Db *)db, (LocalTxn *)txn, &k, duplicate, flags, lsn);
+    journal->append_erase(((Db *)db)->name(), (LocalTxn *)txn, &k,
+                    duplicate, flags, lsn);
     return *this;
   }
 
@@ -365,10 +392,16 @@ struct JournalFixture : BaseFixture {
     TxnProxy tp(env);
     jp.append_insert(db, tp.txn, "key1", "rec1", UPS_OVERWRITE, next_lsn());
     require_current_lsn(4);
-    jp.require_close(true)
+
+    // the entry is buffered in the Txn till it is committed
+    jp.flush_buffers()
+      .require_empty(true)
+      .append_txn_commit(tp.txn, next_lsn())
+      .require_close(true)
       .require_open()
       .require_entries( {
-        { 3, 1, 1, Journal::kEntryTypeInsert, "key1", "rec1", UPS_OVERWRITE }
+        { 3, 1, 1, Journal::kEntryTypeInsert, "key1", "rec1", UPS_OVERWRITE },
+        { 4, 1, 0, Journal::kEntryTypeTxnCommit, nullptr, nullptr, 0 }
       });
   }
 
@@ -377,10 +410,16 @@ struct JournalFixture : BaseFixture {
     TxnProxy tp(env);
     jp.append_erase(db, tp.txn, "key1", 1, 0, next_lsn());
     require_current_lsn(4);
-    jp.require_close(true)
+
+    // the entry is buffered in the Txn till it is committed
+    jp.flush_buffers()
+      .require_empty(true)
+      .append_txn_commit(tp.txn, next_lsn())
+      .require_close(true)
       .require_open()
       .require_entries( {
-        { 3, 1, 1, Journal::kEntryTypeErase, "key1", 1 }
+        { 3, 1, 1, Journal::kEntryTypeErase, "key1", 1 },
+        { 4, 1, 0, Journal::kEntryTypeTxnCommit, nullptr, nullptr, 0 }
       });
   }
 
@@ -473,13 +512,11 @@ struct JournalFixture : BaseFixture {
   }
 
   void verifyJournalIsEmpty() {
-    uint64_t size;
     Journal *j = lenv()->journal.get();
     REQUIRE(j != 0);
-    size = j->state.files[0].file_size();
-    REQUIRE(0 == size);
-    size = j->state.files[1].file_size();
-    REQUIRE(0 == size);
+    REQUIRE(j->state.segments.size() >= 2);
+    for (size_t i = 0; i < j->state.segments.size(); i++)
+      REQUIRE(0 == j->state.segments[i]->file.file_size());
   }
 
   void recoverVerifyTxnIdsTest() {
@@ -1062,9 +1099,10 @@ struct JournalFixture : BaseFixture {
     // close the environment
     close(UPS_AUTO_CLEANUP | UPS_DONT_CLEAR_LOG);
 
-    // verify the journal file sizes
-    require_file_size("test.db.jrn0", 33664);
-    require_file_size("test.db.jrn1", 51168);
+    // verify the journal file sizes; all entries fit into the first
+    // (preallocated) segment
+    require_file_size("test.db.jrn0", Journal::kSegmentSize);
+    require_file_size("test.db.jrn1", 0);
   }
 
   void recoverWithCrc32Test() {
@@ -1107,6 +1145,593 @@ struct JournalFixture : BaseFixture {
     require_flags(UPS_ENABLE_CRC32, true);
     require_flags(UPS_ENABLE_FSYNC, true);
   }
+
+  static void groupCommitter(ups_env_t *env, ups_db_t *db, uint32_t first,
+                  uint32_t count, int *errors) {
+    for (uint32_t i = first; i < first + count; i++) {
+      ups_txn_t *txn;
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      if (ups_txn_begin(&txn, env, 0, 0, 0) != 0
+          || ups_db_insert(db, txn, &key, &rec, 0) != 0
+          || ups_txn_commit(txn, 0) != 0)
+        (*errors)++;
+    }
+  }
+
+  void groupCommitTest() {
+    const int kNumThreads = 8;
+    const uint32_t kNumTxns = 50;
+    ups_parameter_t db_params[] = {
+        { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+        { 0, 0 }
+    };
+    close();
+    uint32_t flags = UPS_ENABLE_TRANSACTIONS | UPS_ENABLE_FSYNC;
+    require_create(flags, 0, 0, db_params);
+
+    JournalState &state = lenv()->journal->state;
+    REQUIRE(state.log_writer.get() != 0);
+
+    int errors[kNumThreads] = {0};
+    boost::thread_group threads;
+    for (int i = 0; i < kNumThreads; i++)
+      threads.create_thread(boost::bind(&JournalFixture::groupCommitter,
+                              env, db, i * kNumTxns, kNumTxns, &errors[i]));
+    threads.join_all();
+
+    for (int i = 0; i < kNumThreads; i++)
+      REQUIRE(errors[i] == 0);
+
+    // all commits are durable
+    REQUIRE(state.written_lsn > 0);
+    REQUIRE(state.durable_lsn == state.written_lsn);
+    REQUIRE(state.commit_lsn == 0);
+
+    // recover the committed transactions
+    close(UPS_AUTO_CLEANUP | UPS_DONT_CLEAR_LOG);
+    require_open(flags | UPS_AUTO_RECOVERY);
+
+    DbProxy dbp(db);
+    for (uint32_t i = 0; i < kNumThreads * kNumTxns; i++) {
+      std::vector<uint8_t> record((uint8_t *)&i, (uint8_t *)&i + sizeof(i));
+      dbp.require_find(i, record);
+    }
+
+    // without UPS_ENABLE_FSYNC there is no log writer
+    close();
+    require_create(UPS_ENABLE_TRANSACTIONS);
+    REQUIRE(lenv()->journal->state.log_writer.get() == 0);
+  }
+
+  void syncErrorTest() {
+    close();
+    require_create(UPS_ENABLE_TRANSACTIONS | UPS_ENABLE_FSYNC);
+    DbProxy dbp(db);
+    std::vector<uint8_t> record(8, 'x');
+
+    // the sync of the first commit fails
+    ErrorInducer::activate(true);
+    ErrorInducer::add(ErrorInducer::kFileFlush, 1, UPS_IO_ERROR);
+
+    ups_txn_t *txn;
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    dbp.require_insert(txn, 1u, record);
+    REQUIRE(UPS_IO_ERROR == ups_txn_commit(txn, 0));
+    ErrorInducer::activate(false);
+
+    // the error is not reported for the following commits
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    dbp.require_insert(txn, 2u, record);
+    REQUIRE(0 == ups_txn_commit(txn, 0));
+  }
+
+  static void lsnAllocator(LsnManager *lsn_manager, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++)
+      lsn_manager->next();
+  }
+
+  void prepareCommitTest() {
+    const int kNumThreads = 4;
+    const uint32_t kNumLsns = 1000;
+
+    // lsns are allocated without holding the lock
+    uint64_t lsn = current_lsn();
+    boost::thread_group threads;
+    for (int i = 0; i < kNumThreads; i++)
+      threads.create_thread(boost::bind(&JournalFixture::lsnAllocator,
+                              &lenv()->lsn_manager, kNumLsns));
+    threads.join_all();
+    require_current_lsn(lsn + kNumThreads * kNumLsns);
+
+    // the entries are encoded before the commit, but not yet written
+    // to the journal
+    Journal *j = lenv()->journal.get();
+    std::vector<uint8_t> record1(8, 1);
+    std::vector<uint8_t> record2(8, 2);
+    ups_txn_t *txn;
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    DbProxy(db).require_insert(txn, 1, record1)
+               .require_insert(txn, 2, record2);
+    j->test_flush_buffers();
+    uint64_t flushed = j->state.count_bytes_flushed;
+    lenv()->prepare_commit((Txn *)txn);
+    LocalTxn *ltxn = (LocalTxn *)txn;
+    REQUIRE(ltxn->journal_buffer.is_complete == true);
+    REQUIRE(ltxn->journal_buffer.data.size() > 0);
+    j->test_flush_buffers();
+    REQUIRE(j->state.count_bytes_flushed == flushed);
+
+    // the commit appends them; recover them
+    REQUIRE(0 == ups_txn_commit(txn, 0));
+    close(UPS_AUTO_CLEANUP | UPS_DONT_CLEAR_LOG);
+    require_open(UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY);
+    DbProxy(db).require_find(1, record1)
+               .require_find(2, record2);
+  }
+
+  void segmentRecyclingTest() {
+    ups_parameter_t db_params[] = {
+        { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+        { 0, 0 }
+    };
+    close();
+    require_create(UPS_ENABLE_TRANSACTIONS, 0, 0, db_params);
+
+    JournalState &state = lenv()->journal->state;
+    state.segment_size = 64 * 1024;
+
+    const uint32_t kNumKeys = 2000;
+    DbProxy dbp(db);
+    std::vector<uint8_t> record(64, 'x');
+
+    // flush the committed Txns frequently, otherwise the segments are
+    // not released
+    {
+      ScopedFlushThreshold threshold(10);
+      for (uint32_t i = 0; i < kNumKeys; i++)
+        dbp.require_insert(i, record);
+    }
+
+    // the journal switched segments, and recycled the old ones
+    REQUIRE(state.next_sequence > state.segments.size() + 1);
+    REQUIRE(state.segments.size() < state.next_sequence / 2);
+
+    // the current segment stores the checkpoint
+    JournalSegment *current = state.segments[state.current];
+    PJournalSegmentHeader header;
+    current->file.pread(0, &header, sizeof(header));
+    REQUIRE(header.magic == (uint32_t)Journal::kMagic);
+    REQUIRE(header.sequence == current->sequence);
+    REQUIRE(header.checkpoint_sequence == state.checkpoint_sequence);
+    REQUIRE(header.checkpoint_offset == state.checkpoint_offset);
+
+    // recover from the segments
+    close(UPS_AUTO_CLEANUP | UPS_DONT_CLEAR_LOG);
+    require_open(UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY);
+
+    DbProxy dbp2(db);
+    for (uint32_t i = 0; i < kNumKeys; i++)
+      dbp2.require_find(i, record);
+    verifyJournalIsEmpty();
+  }
+
+  void recoveryTargetTest() {
+    ups_parameter_t env_params[] = {
+        { UPS_PARAM_RECOVERY_TARGET_SEC, 5 },
+        { 0, 0 }
+    };
+    ups_parameter_t db_params[] = {
+        { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+        { 0, 0 }
+    };
+    close();
+    require_create(UPS_ENABLE_TRANSACTIONS, env_params, 0, db_params);
+
+    ups_parameter_t query[] = {
+        { UPS_PARAM_RECOVERY_TARGET_SEC, 0 },
+        { 0, 0 }
+    };
+    REQUIRE(0 == ups_env_get_parameters(env, query));
+    REQUIRE(query[0].value == 5);
+
+    JournalState &state = lenv()->journal->state;
+    REQUIRE(state.recovery_budget == 5ull * Journal::kReplayBytesPerSecond);
+    REQUIRE(state.checkpointer.get() == 0);
+
+    const uint32_t kNumKeys = 200;
+    DbProxy dbp(db);
+    std::vector<uint8_t> record(64, 'x');
+
+    // only the recovery target triggers the flush
+    state.recovery_budget = 4096;
+    {
+      ScopedFlushThreshold threshold(1000000);
+      for (uint32_t i = 0; i < kNumKeys; i++)
+        dbp.require_insert(i, record);
+    }
+
+    REQUIRE(state.checkpointer.get() != 0);
+    REQUIRE(lenv()->journal->is_recovery_target_exceeded() == false);
+
+    int num_txns = 0;
+    for (Txn *txn = lenv()->txn_manager->oldest_txn(); txn; txn = txn->next())
+      num_txns++;
+    REQUIRE(num_txns < (int)kNumKeys / 2);
+
+    close();
+  }
+
+  void recoveryTargetPinnedTest() {
+    ups_parameter_t env_params[] = {
+        { UPS_PARAM_RECOVERY_TARGET_SEC, 5 },
+        { 0, 0 }
+    };
+    ups_parameter_t db_params[] = {
+        { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+        { 0, 0 }
+    };
+    close();
+    require_create(UPS_ENABLE_TRANSACTIONS, env_params, 0, db_params);
+
+    JournalState &state = lenv()->journal->state;
+    LocalTxnManager *ltm = (LocalTxnManager *)lenv()->txn_manager.get();
+    state.recovery_budget = 4096;
+    ScopedFlushThreshold threshold(1000000);
+
+    // an active Txn keeps the later Txns from being flushed
+    ups_txn_t *txn;
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    uint64_t lsn = ((LocalTxn *)txn)->lsn;
+
+    const uint32_t kNumKeys = 200;
+    DbProxy dbp(db);
+    std::vector<uint8_t> record(64, 'x');
+    for (uint32_t i = 0; i < kNumKeys; i++)
+      dbp.require_insert(i, record);
+
+    // the flush is not repeated while the Txn pins the journal
+    {
+      ScopedEnvLock lock(lenv());
+      REQUIRE(lenv()->journal->is_recovery_target_exceeded() == true);
+      REQUIRE(ltm->recovery_pinned_lsn == lsn);
+      REQUIRE(ltm->is_recovery_target_exceeded() == false);
+    }
+
+    // as soon as the Txn is committed, all Txns are flushed
+    REQUIRE(0 == ups_txn_commit(txn, 0));
+    {
+      ScopedEnvLock lock(lenv());
+      REQUIRE(ltm->oldest_txn() == 0);
+      REQUIRE(ltm->recovery_pinned_lsn == 0);
+      REQUIRE(lenv()->journal->is_recovery_target_exceeded() == false);
+    }
+
+    close();
+  }
+
+  void fuzzyCheckpointTest() {
+    ups_parameter_t env_params[] = {
+        { UPS_PARAM_RECOVERY_TARGET_SEC, 60 },
+        { 0, 0 }
+    };
+    ups_parameter_t db_params[] = {
+        { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+        { 0, 0 }
+    };
+    close();
+    require_create(UPS_ENABLE_TRANSACTIONS, env_params, 0, db_params);
+
+    JournalState &state = lenv()->journal->state;
+    state.checkpoint_interval = 10;
+
+    const uint32_t kNumKeys = 25;
+    DbProxy dbp(db);
+    std::vector<uint8_t> record(64, 'x');
+    for (uint32_t i = 0; i < kNumKeys; i++)
+      dbp.require_insert(i, record);
+    REQUIRE(state.checkpointer.get() != 0);
+
+    // the remaining Txns are not yet flushed; the replay starts with
+    // the first one
+    REQUIRE(lenv()->txn_manager->oldest_txn() != 0);
+
+    // the checkpointer eventually writes the current checkpoint to the
+    // header, without a new Changeset being appended
+    JournalSegment *current = state.segments[state.current];
+    PJournalSegmentHeader header;
+    for (int i = 0; i < 500; i++) {
+      {
+        ScopedEnvLock lock(lenv());
+        current->file.pread(0, &header, sizeof(header));
+        if (header.checkpoint_lsn == state.completed_lsn
+              && header.replay_sequence == state.replay_sequence
+              && header.replay_offset == state.replay_offset)
+          break;
+      }
+      boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    REQUIRE(header.checkpoint_lsn == state.completed_lsn);
+    REQUIRE(header.replay_sequence == state.replay_sequence);
+    REQUIRE(header.replay_offset == state.replay_offset);
+    REQUIRE(header.replay_sequence == current->sequence);
+
+    // recovery starts at the checkpoint
+    close(UPS_AUTO_CLEANUP | UPS_DONT_CLEAR_LOG);
+    require_open(UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY);
+
+    DbProxy dbp2(db);
+    for (uint32_t i = 0; i < kNumKeys; i++)
+      dbp2.require_find(i, record);
+    verifyJournalIsEmpty();
+  }
+
+  void parallelDecodingTest() {
+    ups_parameter_t env_params[] = {
+        { UPS_PARAM_JOURNAL_COMPRESSION, UPS_COMPRESSOR_LZF },
+        { 0, 0 }
+    };
+    ups_parameter_t db_params[] = {
+        { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+        { 0, 0 }
+    };
+    close();
+    REQUIRE(0 == ups_env_create(&env, "test.db",
+                UPS_DONT_FLUSH_TRANSACTIONS | UPS_ENABLE_TRANSACTIONS,
+                0644, env_params));
+
+    // spread more entries than a single recovery batch over several
+    // databases; every third key is erased again
+    const int kNumDatabases = 8;
+    const uint32_t kNumKeys = 700;
+    std::vector<uint8_t> record(128, 'x');
+    for (int d = 0; d < kNumDatabases; d++) {
+      ups_db_t *hdb;
+      REQUIRE(0 == ups_env_create_db(env, &hdb, (uint16_t)(d + 1), 0,
+                              db_params));
+      DbProxy dbp(hdb);
+      for (uint32_t i = 0; i < kNumKeys; i++) {
+        record[0] = (uint8_t)d;
+        dbp.require_insert(i, record);
+      }
+      for (uint32_t i = 0; i < kNumKeys; i += 3)
+        dbp.require_erase(i);
+    }
+    REQUIRE(kNumDatabases * kNumKeys > Journal::kRecoveryBatchSize);
+
+    // decode the databases with four threads, even on a single core; the
+    // entries are still re-applied by one thread
+    int old_threads = Globals::ms_recovery_decode_threads;
+    Globals::ms_recovery_decode_threads = 4;
+    close(UPS_AUTO_CLEANUP | UPS_DONT_CLEAR_LOG);
+    require_open(UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY);
+    Globals::ms_recovery_decode_threads = old_threads;
+
+    for (int d = 0; d < kNumDatabases; d++) {
+      ups_db_t *hdb = db; // database 1 was opened by require_open()
+      if (d > 0)
+        REQUIRE(0 == ups_env_open_db(env, &hdb, (uint16_t)(d + 1), 0, 0));
+      DbProxy dbp(hdb);
+      record[0] = (uint8_t)d;
+      for (uint32_t i = 0; i < kNumKeys; i++) {
+        if (i % 3 == 0)
+          dbp.require_find(i, record, UPS_KEY_NOT_FOUND);
+        else
+          dbp.require_find(i, record);
+      }
+    }
+    verifyJournalIsEmpty();
+  }
+
+  uint64_t insertWithParameter(uint32_t name, bool enabled,
+                  uint32_t num_keys, std::vector<uint8_t> &record) {
+    ups_parameter_t env_params[] = {
+        { name, enabled ? 1u : 0u },
+        { 0, 0 }
+    };
+    ups_parameter_t db_params[] = {
+        { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+        { 0, 0 }
+    };
+    close();
+    require_create(UPS_ENABLE_TRANSACTIONS, env_params, 0, db_params);
+    require_parameter(name, enabled ? 1 : 0);
+
+    DbProxy dbp(db);
+    for (uint32_t i = 0; i < num_keys; i++)
+      dbp.require_insert(i, record);
+    return lenv()->journal->state.count_bytes_flushed;
+  }
+
+  // Backs up the files while the next Changeset is in flight, then
+  // recovers from the backup
+  void recoverInFlightChangeset(uint32_t num_keys,
+                  std::vector<uint8_t> &record) {
+    g_CHANGESET_POST_LOG_HOOK = backup_in_flight_changeset;
+    DbProxy dbp(db);
+    uint32_t i = num_keys;
+    for (; g_CHANGESET_POST_LOG_HOOK != 0; i++)
+      dbp.require_insert(i, record);
+
+    close(UPS_AUTO_CLEANUP);
+    restore();
+    require_open(UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY);
+
+    DbProxy dbp2(db);
+    for (uint32_t j = 0; j < i; j++)
+      dbp2.require_find(j, record);
+    verifyJournalIsEmpty();
+  }
+
+  void pageDeltasTest() {
+    const uint32_t kNumKeys = 5000;
+    std::vector<uint8_t> record(32, 'x');
+
+    // the committed Txns are flushed frequently, and by the committing
+    // thread
+    ScopedFlushThreshold threshold(10);
+
+    // the deltas are much smaller than the page images
+    uint64_t full_bytes = insertWithParameter(UPS_PARAM_JOURNAL_PAGE_DELTAS,
+                    false, kNumKeys, record);
+    uint64_t delta_bytes = insertWithParameter(UPS_PARAM_JOURNAL_PAGE_DELTAS,
+                    true, kNumKeys, record);
+    REQUIRE(delta_bytes < full_bytes / 2);
+
+    // the deltas are applied to the pages which are already on disk
+    recoverInFlightChangeset(kNumKeys, record);
+  }
+
+  void unloggedNewPagesTest() {
+    const uint32_t kNumKeys = 5000;
+    std::vector<uint8_t> record(1024, 'x');
+
+    // the committed Txns are flushed by the committing thread
+    ScopedFlushThreshold threshold(10);
+
+    // the new pages are not logged
+    uint64_t logged_bytes = insertWithParameter(UPS_PARAM_UNLOGGED_NEW_PAGES,
+                    false, kNumKeys, record);
+    uint64_t unlogged_bytes = insertWithParameter(UPS_PARAM_UNLOGGED_NEW_PAGES,
+                    true, kNumKeys, record);
+    REQUIRE(unlogged_bytes < logged_bytes);
+
+    // the new pages are already on disk
+    recoverInFlightChangeset(kNumKeys, record);
+  }
+
+  void unloggedNewPagesCrashTest() {
+    // the file is small; the device does not allocate excess pages
+    const uint32_t kNumKeys = 200;
+    std::vector<uint8_t> record(1024, 'x');
+
+    // the committed Txns are flushed by the committing thread
+    ScopedFlushThreshold threshold(10);
+
+    insertWithParameter(UPS_PARAM_UNLOGGED_NEW_PAGES, true, kNumKeys, record);
+
+    // crash after the new pages were written, but before they are logged
+    g_CHANGESET_PRE_LOG_HOOK = backup_unlogged_new_pages;
+    DbProxy dbp(db);
+    uint32_t i = kNumKeys;
+    for (; g_CHANGESET_PRE_LOG_HOOK != 0; i++)
+      dbp.require_insert(i, record);
+
+    close(UPS_AUTO_CLEANUP);
+    restore();
+    File f;
+    f.open("test.db", 0);
+    uint64_t crashed_size = f.file_size();
+    f.close();
+
+    // the recovery truncates the pages which are not referenced, and
+    // the replayed Txns allocate them again
+    require_open(UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY);
+    DbProxy dbp2(db);
+    for (uint32_t j = 0; j < i; j++)
+      dbp2.require_find(j, record);
+    REQUIRE(lenv()->device->file_size() <= crashed_size);
+    verifyJournalIsEmpty();
+  }
+
+  // Reads the Txns which were committed after |lsn| and applies them to
+  // the |standby|; returns the position of the stream
+  uint64_t replicate(ups_env_t *standby, uint64_t lsn) {
+    const void *data;
+    uint32_t size;
+    uint64_t last_lsn;
+    REQUIRE(0 == ups_env_read_journal(env, lsn, &data, &size, &last_lsn));
+
+    // the stream is usually sent to another process
+    std::vector<uint8_t> stream((const uint8_t *)data,
+                    (const uint8_t *)data + size);
+    REQUIRE(0 == ups_env_apply_journal(standby, stream.data(), size));
+    return last_lsn;
+  }
+
+  void replicationTest() {
+    ups_parameter_t env_params[] = {
+        { UPS_PARAM_JOURNAL_COMPRESSION, UPS_COMPRESSOR_LZF },
+        { 0, 0 }
+    };
+    ups_parameter_t db_params[] = {
+        { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+        { 0, 0 }
+    };
+    close();
+    require_create(UPS_ENABLE_TRANSACTIONS, env_params, 0, db_params);
+    close();
+
+    // the standby is a copy of the closed primary
+    REQUIRE(true == os::copy("test.db", "test.db.standby"));
+    require_open(UPS_ENABLE_TRANSACTIONS);
+    ups_env_t *standby;
+    REQUIRE(UPS_INV_PARAMETER == ups_env_open(&standby, "test.db.standby",
+                            UPS_STANDBY, 0));
+    REQUIRE(0 == ups_env_open(&standby, "test.db.standby",
+                            UPS_ENABLE_TRANSACTIONS | UPS_STANDBY, 0));
+    ups_db_t *sdb;
+    REQUIRE(0 == ups_env_open_db(standby, &sdb, 1, 0, 0));
+
+    // temporary Txns, a committed and an aborted Txn
+    std::vector<uint8_t> record(64, 'x');
+    DbProxy dbp(db);
+    for (uint32_t i = 0; i < 100; i++)
+      dbp.require_insert(i, record);
+    {
+      TxnProxy txn(env, "committed", true);
+      for (uint32_t i = 100; i < 200; i++)
+        dbp.require_insert(txn.txn, i, record);
+    }
+    {
+      TxnProxy txn(env);
+      dbp.require_insert(txn.txn, 1000, record);
+    }
+    for (uint32_t i = 0; i < 50; i++)
+      dbp.require_erase(i);
+
+    uint64_t lsn = replicate(standby, 0);
+    REQUIRE(lsn > 0);
+
+    DbProxy sdbp(sdb);
+    for (uint32_t i = 50; i < 200; i++)
+      sdbp.require_find(i, record);
+    sdbp.require_find(0u, record, UPS_KEY_NOT_FOUND);
+    sdbp.require_find(1000u, record, UPS_KEY_NOT_FOUND);
+
+    // only the stream modifies the standby
+    sdbp.require_insert(1000, record, UPS_WRITE_PROTECTED);
+    sdbp.require_erase(100, UPS_WRITE_PROTECTED);
+    REQUIRE(UPS_INV_PARAMETER == ups_env_apply_journal(env, 0, 0));
+
+    // nothing new was committed; then continue after the last commit
+    REQUIRE(replicate(standby, lsn) == lsn);
+    for (uint32_t i = 200; i < 300; i++)
+      dbp.require_insert(i, record);
+    uint64_t lsn2 = replicate(standby, lsn);
+    REQUIRE(lsn2 > lsn);
+    for (uint32_t i = 200; i < 300; i++)
+      sdbp.require_find(i, record);
+
+    // the journal does not know these positions
+    const void *data;
+    uint32_t size;
+    uint64_t last_lsn;
+    REQUIRE(UPS_LIMITS_REACHED == ups_env_read_journal(env, lsn2 + 1000000,
+                            &data, &size, &last_lsn));
+    lenv()->journal->state.truncated_lsn = lsn2;
+    REQUIRE(UPS_LIMITS_REACHED == ups_env_read_journal(env, lsn,
+                            &data, &size, &last_lsn));
+
+    // the commits of a cleared journal are lost as well
+    lenv()->journal->state.truncated_lsn = 0;
+    dbp.require_insert(300, record);
+    lenv()->journal->clear();
+    REQUIRE(UPS_LIMITS_REACHED == ups_env_read_journal(env, lsn2,
+                            &data, &size, &last_lsn));
+
+    REQUIRE(0 == ups_env_close(standby, UPS_AUTO_CLEANUP));
+  }
 };
 
 TEST_CASE("Journal/createClose", "")
@@ -1271,11 +1896,82 @@ TEST_CASE("Journal/issue71Test", "")
   f.issue71Test();
 }
 
+TEST_CASE("Journal/groupCommitTest", "")
+{
+  JournalFixture f;
+  f.groupCommitTest();
+}
+
+TEST_CASE("Journal/syncErrorTest", "")
+{
+  JournalFixture f;
+  f.syncErrorTest();
+}
+
 TEST_CASE("Journal/recoverWithCrc32Test", "")
 {
   JournalFixture f;
   f.recoverWithCrc32Test();
 }
 
-} // namespace upscaledb
+TEST_CASE("Journal/prepareCommit", "")
+{
+  JournalFixture f;
+  f.prepareCommitTest();
+}
+
+TEST_CASE("Journal/segmentRecycling", "")
+{
+  JournalFixture f;
+  f.segmentRecyclingTest();
+}
+
+TEST_CASE("Journal/recoveryTarget", "")
+{
+  JournalFixture f;
+  f.recoveryTargetTest();
+}
+
+TEST_CASE("Journal/recoveryTargetPinned", "")
+{
+  JournalFixture f;
+  f.recoveryTargetPinnedTest();
+}
+
+TEST_CASE("Journal/fuzzyCheckpoint", "")
+{
+  JournalFixture f;
+  f.fuzzyCheckpointTest();
+}
+
+TEST_CASE("Journal/parallelDecoding", "")
+{
+  JournalFixture f;
+  f.parallelDecodingTest();
+}
 
+TEST_CASE("Journal/pageDeltas", "")
+{
+  JournalFixture f;
+  f.pageDeltasTest();
+}
+
+TEST_CASE("Journal/unloggedNewPages", "")
+{
+  JournalFixture f;
+  f.unloggedNewPagesTest();
+}
+
+TEST_CASE("Journal/unloggedNewPagesCrash", "")
+{
+  JournalFixture f;
+  f.unloggedNewPagesCrashTest();
+}
+
+TEST_CASE("Journal/replication", "")
+{
+  JournalFixture f;
+  f.replicationTest();
+}
+
+} // namespace upscaledb
@@ -16,12 +16,15 @@
  * See the file COPYING for License information.
  */
 
+#include <algorithm>
+
 #include "3rdparty/catch/catch.hpp"
 
 #include "1base/pickle.h"
 #include "3page_manager/freelist.h"
 #include "3page_manager/page_manager.h"
 #include "4context/context.h"
+#include "4cursor/cursor_local.h"
 
 #include "fixture.hpp"
 
@@ -46,17 +49,22 @@ struct PageManagerProxy {
 struct PageManagerFixture : BaseFixture {
   ScopedPtr<Context> context;
 
-  PageManagerFixture(bool inmemorydb = false, uint32_t cachesize = 0) {
+  PageManagerFixture(bool inmemorydb = false, uint32_t cachesize = 0,
+                  int cache_policy = UPS_CACHE_POLICY_LRU) {
     uint32_t flags = 0;
 
     if (inmemorydb)
       flags |= UPS_IN_MEMORY;
 
-    ups_parameter_t params[2] = {{0, 0}, {0, 0}};
+    ups_parameter_t params[3] = {{0, 0}, {0, 0}, {0, 0}};
     if (cachesize) {
       params[0].name = UPS_PARAM_CACHE_SIZE;
       params[0].value = cachesize;
     }
+    if (cache_policy != UPS_CACHE_POLICY_LRU) {
+      params[1].name = UPS_PARAM_CACHE_POLICY;
+      params[1].value = cache_policy;
+    }
 
     require_create(flags, params);
     context.reset(new Context(lenv(), 0, ldb()));
@@ -76,6 +84,32 @@ struct PageManagerFixture : BaseFixture {
     REQUIRE(page->address() == 16 * 1024ull);
   }
 
+  void latchedFetchTest() {
+    PageManagerProxy pmp(lenv());
+
+    Page *page = pmp.fetch(context.get(), 16 * 1024);
+    REQUIRE(page->is_without_header() == false);
+    context->changeset.clear();
+
+    ups_env_metrics_t before, after;
+    REQUIRE(0 == ups_env_get_metrics(env, &before));
+
+    // a cached page with different header flags is a single cache hit
+    Context latched(lenv(), 0, ldb());
+    latched.latch_pages = true;
+    page = pmp.fetch(&latched, 16 * 1024, PageManager::kNoHeader);
+    REQUIRE(page->address() == 16 * 1024ull);
+    REQUIRE(page->is_without_header() == true);
+    latched.changeset.clear();
+
+    REQUIRE(0 == ups_env_get_metrics(env, &after));
+    REQUIRE(after.cache_hits == before.cache_hits + 1);
+    REQUIRE(after.cache_misses == before.cache_misses);
+
+    page = pmp.fetch(context.get(), 16 * 1024);
+    REQUIRE(page->is_without_header() == false);
+  }
+
   void allocPageTest() {
     PageManagerProxy pmp(lenv());
 
@@ -226,6 +260,361 @@ struct PageManagerFixture : BaseFixture {
     REQUIRE(false == page_manager->state->cache.is_cache_full());
   }
 
+  // Accesses 4 "hot" pages twice, then scans 28 other pages (with the cache
+  // flags |scan_flags|); returns the number of hot pages which were selected
+  // for eviction
+  int cacheScanTest(uint32_t scan_flags = 0) {
+    PageManager *page_manager = lenv()->page_manager.get();
+    uint32_t page_size = lenv()->config.page_size_bytes;
+    Cache &cache = page_manager->state->cache;
+
+    PPageData pers;
+    ::memset(&pers, 0, sizeof(pers));
+    std::vector<Page *> v;
+
+    for (unsigned int i = 0; i < 32; i++) {
+      Page *p = new Page(lenv()->device.get());
+      p->set_without_header(true);
+      p->assign_allocated_buffer(&pers, (i + 100) * page_size);
+      v.push_back(p);
+      // the first 4 pages are accessed again
+      if (i < 4) {
+        cache.put(p);
+        REQUIRE(p == cache.get(p->address()));
+      }
+      // the other pages are read by the scan; a streaming scan accesses
+      // each page twice, but the pages must not be promoted
+      else {
+        cache.put(p, scan_flags);
+        if (scan_flags)
+          REQUIRE(p == cache.get(p->address(), scan_flags));
+      }
+    }
+
+    REQUIRE(true == cache.is_cache_full());
+
+    std::vector<uint64_t> candidates;
+    std::vector<Page *> garbage;
+    cache.purge_candidates(candidates, garbage, 0);
+    REQUIRE(candidates.size() == 0);
+    REQUIRE(garbage.size() > 0);
+
+    int hot = 0;
+    for (std::vector<Page *>::iterator it = garbage.begin();
+            it != garbage.end(); it++) {
+      if (std::find(v.begin(), v.begin() + 4, *it) != v.begin() + 4)
+        hot++;
+    }
+
+    for (std::vector<Page *>::iterator it = v.begin(); it != v.end(); it++) {
+      cache.del(*it);
+      (*it)->set_data(0);
+      delete *it;
+    }
+    return hot;
+  }
+
+  void cacheDiskImageTest() {
+    PageManager *page_manager = lenv()->page_manager.get();
+    uint32_t page_size = lenv()->config.page_size_bytes;
+    Cache &cache = page_manager->state->cache;
+
+    PPageData pers;
+    ::memset(&pers, 0, sizeof(pers));
+    size_t charged = cache.charged_elements();
+
+    Page *p1 = new Page(lenv()->device.get());
+    p1->set_without_header(true);
+    p1->assign_allocated_buffer(&pers, 100 * page_size);
+    cache.put(p1);
+    REQUIRE(cache.charged_elements() == charged + 1);
+
+    // the copy of the page data is charged like another page
+    cache.keep_disk_image(p1);
+    REQUIRE(p1->has_disk_image());
+    REQUIRE(cache.charged_elements() == charged + 2);
+    cache.keep_disk_image(p1);
+    REQUIRE(cache.charged_elements() == charged + 2);
+
+    cache.release_disk_image(p1);
+    REQUIRE(!p1->has_disk_image());
+    REQUIRE(cache.charged_elements() == charged + 1);
+
+    // the copy is no longer charged when the page is evicted
+    cache.keep_disk_image(p1);
+    cache.del(p1);
+    REQUIRE(cache.charged_elements() == charged);
+
+    // a page which is cached later is charged with its copy
+    cache.put(p1);
+    REQUIRE(cache.charged_elements() == charged + 2);
+    cache.del(p1);
+
+    p1->set_data(0);
+    delete p1;
+  }
+
+  void cacheShardMetricsTest() {
+    PageManager *page_manager = lenv()->page_manager.get();
+    uint32_t page_size = lenv()->config.page_size_bytes;
+    Cache &cache = page_manager->state->cache;
+
+    PPageData pers;
+    ::memset(&pers, 0, sizeof(pers));
+    std::vector<Page *> v;
+
+    for (unsigned int i = 0; i < 64; i++) {
+      Page *p = new Page(lenv()->device.get());
+      p->set_without_header(true);
+      p->assign_allocated_buffer(&pers, (i + 100) * page_size);
+      v.push_back(p);
+      cache.put(p);
+      REQUIRE(p == cache.get(p->address()));
+      REQUIRE((Page *)0 == cache.get((i + 1000) * page_size));
+    }
+
+    ups_env_metrics_t metrics;
+    REQUIRE(0 == ups_env_get_metrics(env, &metrics));
+
+    uint64_t hits = 0, misses = 0;
+    int used_shards = 0;
+    for (int i = 0; i < UPS_CACHE_SHARDS; i++) {
+      hits += metrics.cache_shard_hits[i];
+      misses += metrics.cache_shard_misses[i];
+      if (metrics.cache_shard_hits[i] > 0)
+        used_shards++;
+    }
+    REQUIRE(hits == metrics.cache_hits);
+    REQUIRE(misses == metrics.cache_misses);
+    REQUIRE(metrics.cache_hits >= 64);
+    REQUIRE(metrics.cache_misses >= 64);
+    // consecutive pages are distributed over the shards
+    REQUIRE(used_shards > 1);
+
+    for (std::vector<Page *>::iterator it = v.begin(); it != v.end(); it++) {
+      cache.del(*it);
+      (*it)->set_data(0);
+      delete *it;
+    }
+  }
+
+  void cachePolicyParameterTest() {
+    ups_parameter_t bad[] = {
+        { UPS_PARAM_CACHE_POLICY, 99 },
+        { 0, 0 }
+    };
+    ups_parameter_t good[] = {
+        { UPS_PARAM_CACHE_POLICY, UPS_CACHE_POLICY_2Q },
+        { 0, 0 }
+    };
+
+    close();
+    require_create(0, bad, UPS_INV_PARAMETER);
+    require_create(0, good);
+    require_parameter(UPS_PARAM_CACHE_POLICY, UPS_CACHE_POLICY_2Q);
+
+    close();
+    require_open(0, bad, UPS_INV_PARAMETER);
+    require_open(0);
+    require_parameter(UPS_PARAM_CACHE_POLICY, UPS_CACHE_POLICY_LRU);
+  }
+
+  void coalescedFlushTest() {
+    PageManager *page_manager = lenv()->page_manager.get();
+    uint32_t page_size = lenv()->config.page_size_bytes;
+    Page *page[3] = {0};
+
+    for (int i = 0; i < 3; i++) {
+      REQUIRE((page[i] = page_manager->alloc(context.get(), 0)) != 0);
+      if (i > 0)
+        REQUIRE(page[i]->address() == page[i - 1]->address() + page_size);
+      ::memset(page[i]->raw_payload(), 'a' + i, page_size);
+      page[i]->set_dirty(true);
+    }
+
+    uint64_t flushed = Page::ms_page_count_flushed;
+    Page::flush(page, 3);
+    REQUIRE(Page::ms_page_count_flushed == flushed + 3);
+
+    std::vector<uint8_t> buffer(page_size);
+    for (int i = 0; i < 3; i++) {
+      REQUIRE(false == page[i]->is_dirty());
+      lenv()->device->read(page[i]->address(), &buffer[0], page_size);
+      REQUIRE(0 == ::memcmp(&buffer[0], page[i]->raw_payload(), page_size));
+    }
+  }
+
+  void parallelFlushTest() {
+    ups_parameter_t params[] = {
+        { UPS_PARAM_CACHE_SIZE, 256 * UPS_DEFAULT_PAGE_SIZE },
+        { UPS_PARAM_FLUSH_THREADS, 4 },
+        { 0, 0 }
+    };
+    ups_parameter_t bad[] = {
+        { UPS_PARAM_FLUSH_THREADS, 0 },
+        { 0, 0 }
+    };
+
+    context->changeset.clear();
+    close();
+    require_create(0, bad, UPS_INV_PARAMETER);
+    require_create(0, params);
+    require_parameter(UPS_PARAM_FLUSH_THREADS, 4);
+
+    std::vector<uint8_t> data(256);
+    for (uint32_t i = 0; i < 20000; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ::memset(&data[0], (int)i, data.size());
+      ups_record_t record = ups_make_record(&data[0], (uint32_t)data.size());
+      REQUIRE(0 == ups_db_insert(db, 0, &key, &record, 0));
+    }
+
+    ups_env_metrics_t metrics;
+    REQUIRE(0 == ups_env_get_metrics(env, &metrics));
+    REQUIRE(metrics.page_count_flushed > 0);
+
+    close();
+    require_open(0, bad, UPS_INV_PARAMETER);
+    require_open(0, params);
+    require_parameter(UPS_PARAM_FLUSH_THREADS, 4);
+
+    for (uint32_t i = 0; i < 20000; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t record = {0};
+      REQUIRE(0 == ups_db_find(db, 0, &key, &record, 0));
+      ::memset(&data[0], (int)i, data.size());
+      REQUIRE(record.size == data.size());
+      REQUIRE(0 == ::memcmp(record.data, &data[0], data.size()));
+    }
+
+    close();
+    require_open();
+    require_parameter(UPS_PARAM_FLUSH_THREADS, 1);
+    context.reset(new Context(lenv(), 0, ldb()));
+  }
+
+  void prefetchTest(int io_engine) {
+    ups_parameter_t params[] = {
+        { UPS_PARAM_IO_ENGINE, (uint64_t)io_engine },
+        { 0, 0 }
+    };
+
+    context->changeset.clear();
+    close();
+    require_create(0, params);
+
+    for (uint32_t i = 0; i < 20000; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t record = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_db_insert(db, 0, &key, &record, 0));
+    }
+
+    close();
+    require_open(UPS_DISABLE_MMAP, params);
+    context.reset(new Context(lenv(), 0, ldb()));
+
+    PageManager *page_manager = lenv()->page_manager.get();
+    uint32_t page_size = lenv()->config.page_size_bytes;
+
+    // prefetch the first pages after the header and the root
+    uint64_t addresses[] = {2 * page_size, 3 * page_size, 5 * page_size};
+    for (int i = 0; i < 3; i++)
+      REQUIRE((Page *)0 == page_manager->state->cache.peek(addresses[i]));
+    page_manager->prefetch(context.get(), addresses, 3);
+    for (int i = 0; i < 3; i++) {
+      Page *page = page_manager->state->cache.peek(addresses[i]);
+      REQUIRE(page != (Page *)0);
+      REQUIRE(page->address() == addresses[i]);
+      REQUIRE(page == page_manager->fetch(context.get(), addresses[i]));
+    }
+
+    // a full scan prefetches the leaves
+    uint64_t count = 0;
+    REQUIRE(0 == ups_db_count(db, 0, 0, &count));
+    REQUIRE(count == 20000ull);
+
+    context->changeset.clear();
+  }
+
+  void readaheadTest() {
+    std::vector<uint8_t> data(32);
+    ups_parameter_t params[] = {
+        { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+        { 0, 0 }
+    };
+
+    context->changeset.clear();
+    close();
+    require_create(0, 0, 0, params);
+
+    for (uint32_t i = 0; i < 20000; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ::memset(&data[0], (int)i, data.size());
+      ups_record_t record = ups_make_record(&data[0], (uint32_t)data.size());
+      REQUIRE(0 == ups_db_insert(db, 0, &key, &record, 0));
+    }
+
+    close();
+    require_open(UPS_DISABLE_MMAP);
+    context.reset(new Context(lenv(), 0, ldb()));
+
+    PageManagerState *state = lenv()->page_manager->state.get();
+    uint32_t page_size = lenv()->config.page_size_bytes;
+
+    ups_cursor_t *cursor;
+    REQUIRE(0 == ups_cursor_create(&cursor, db, 0, 0));
+    BtreeCursor *btc = &((LocalCursor *)cursor)->btree_cursor;
+
+    // move through the first leaves; then the following leaves (and the
+    // blobs of the next one) are prefetched
+    ups_key_t key = {0};
+    ups_record_t record = {0};
+    REQUIRE(0 == ups_cursor_move(cursor, &key, &record, UPS_CURSOR_FIRST));
+    Page *page = btc->coupled_page();
+    int transitions = 0;
+    uint32_t i = 0;
+    while (transitions < 3) {
+      REQUIRE(0 == ups_cursor_move(cursor, &key, &record, UPS_CURSOR_NEXT));
+      REQUIRE(*(uint32_t *)key.data == ++i);
+      if (btc->coupled_page() != page) {
+        page = btc->coupled_page();
+        transitions++;
+
+        ScopedLock lock(state->prefetch_mutex);
+        while (state->prefetches_pending > 0)
+          state->prefetch_cond.wait(lock);
+      }
+    }
+
+    BtreeNodeProxy *node = ldb()->btree_index->get_node_from_page(page);
+    uint64_t right = node->right_sibling();
+    for (int j = 0; j < BtreeCursor::kReadaheadWindow / 2 && right; j++) {
+      Page *p = state->cache.peek(right);
+      REQUIRE(p != (Page *)0);
+      node = ldb()->btree_index->get_node_from_page(p);
+      if (j == 0) {
+        std::vector<uint64_t> blob_ids;
+        node->blob_ids(&blob_ids);
+        REQUIRE(blob_ids.size() == node->length());
+        REQUIRE(state->cache.peek(blob_ids[0] - blob_ids[0] % page_size)
+                        != (Page *)0);
+      }
+      right = node->right_sibling();
+    }
+
+    // the prefetched pages are identical to those on disk
+    while (0 == ups_cursor_move(cursor, &key, &record, UPS_CURSOR_NEXT)) {
+      REQUIRE(*(uint32_t *)key.data == ++i);
+      ::memset(&data[0], (int)i, data.size());
+      REQUIRE(record.size == data.size());
+      REQUIRE(0 == ::memcmp(record.data, &data[0], data.size()));
+    }
+    REQUIRE(i == 19999);
+
+    REQUIRE(0 == ups_cursor_close(cursor));
+    context->changeset.clear();
+  }
+
   void storeStateTest() {
     PageManagerState *state = lenv()->page_manager->state.get();
     uint32_t page_size = lenv()->config.page_size_bytes;
@@ -412,6 +801,12 @@ TEST_CASE("PageManager/fetchPage", "")
   f.fetchPageTest();
 }
 
+TEST_CASE("PageManager/latchedFetchTest", "")
+{
+  PageManagerFixture f;
+  f.latchedFetchTest();
+}
+
 TEST_CASE("PageManager/allocPage", "")
 {
   PageManagerFixture f;
@@ -466,6 +861,80 @@ TEST_CASE("PageManager/cacheFullTest", "")
   f.cacheFullTest();
 }
 
+TEST_CASE("PageManager/cacheScanLruTest", "")
+{
+  PageManagerFixture f(false, 16 * UPS_DEFAULT_PAGE_SIZE);
+  REQUIRE(f.cacheScanTest() > 0);
+}
+
+TEST_CASE("PageManager/cacheScan2QTest", "")
+{
+  PageManagerFixture f(false, 16 * UPS_DEFAULT_PAGE_SIZE,
+                  UPS_CACHE_POLICY_2Q);
+  REQUIRE(f.cacheScanTest() == 0);
+}
+
+TEST_CASE("PageManager/cacheStreamingLruTest", "")
+{
+  PageManagerFixture f(false, 16 * UPS_DEFAULT_PAGE_SIZE);
+  REQUIRE(f.cacheScanTest(Cache::kStreaming) == 0);
+}
+
+TEST_CASE("PageManager/cacheStreaming2QTest", "")
+{
+  PageManagerFixture f(false, 16 * UPS_DEFAULT_PAGE_SIZE,
+                  UPS_CACHE_POLICY_2Q);
+  REQUIRE(f.cacheScanTest(Cache::kStreaming) == 0);
+}
+
+TEST_CASE("PageManager/cacheDiskImageTest", "")
+{
+  PageManagerFixture f;
+  f.cacheDiskImageTest();
+}
+
+TEST_CASE("PageManager/cacheShardMetricsTest", "")
+{
+  PageManagerFixture f;
+  f.cacheShardMetricsTest();
+}
+
+TEST_CASE("PageManager/cachePolicyParameterTest", "")
+{
+  PageManagerFixture f;
+  f.cachePolicyParameterTest();
+}
+
+TEST_CASE("PageManager/coalescedFlushTest", "")
+{
+  PageManagerFixture f;
+  f.coalescedFlushTest();
+}
+
+TEST_CASE("PageManager/parallelFlushTest", "")
+{
+  PageManagerFixture f;
+  f.parallelFlushTest();
+}
+
+TEST_CASE("PageManager/prefetchTest", "")
+{
+  PageManagerFixture f;
+  f.prefetchTest(UPS_IO_ENGINE_DEFAULT);
+}
+
+TEST_CASE("PageManager/prefetchUringTest", "")
+{
+  PageManagerFixture f;
+  f.prefetchTest(UPS_IO_ENGINE_IO_URING);
+}
+
+TEST_CASE("PageManager/readaheadTest", "")
+{
+  PageManagerFixture f;
+  f.readaheadTest();
+}
+
 TEST_CASE("PageManager/storeStateTest", "")
 {
   PageManagerFixture f(false, 16 * UPS_DEFAULT_PAGE_SIZE);
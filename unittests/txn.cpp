@@ -21,9 +21,15 @@
 
 #include <ups/upscaledb.h>
 
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include "1errorinducer/errorinducer.h"
+
 #include "4db/db_local.h"
 #include "4env/env_local.h"
 #include "4txn/txn_local.h"
+#include "4txn/txn_factory.h"
 
 #include "os.hpp"
 #include "fixture.hpp"
@@ -109,9 +115,9 @@ struct TxnFixture : BaseFixture {
 
     // clean up
     ldb()->txn_index->remove(node1);
-    delete node1;
+    TxnFactory::destroy_node(ldb()->txn_index.get(), node1);
     ldb()->txn_index->remove(node2);
-    delete node2;
+    TxnFactory::destroy_node(ldb()->txn_index.get(), node2);
   }
 
   void txnMultipleNodesTest() {
@@ -128,11 +134,11 @@ struct TxnFixture : BaseFixture {
 
     // clean up
     ldb()->txn_index->remove(node1);
-    delete node1;
+    TxnFactory::destroy_node(ldb()->txn_index.get(), node1);
     ldb()->txn_index->remove(node2);
-    delete node2;
+    TxnFactory::destroy_node(ldb()->txn_index.get(), node2);
     ldb()->txn_index->remove(node3);
-    delete node3;
+    TxnFactory::destroy_node(ldb()->txn_index.get(), node3);
   }
 
   void txnMultipleOpsTest() {
@@ -382,6 +388,66 @@ struct TxnFixture : BaseFixture {
     REQUIRE(0 == ups_txn_commit(txn2, 0));
   }
 
+  static void UPS_CALLCONV commitCallback(ups_status_t status, void *context) {
+    if (status == 0)
+      (*(boost::atomic<int> *)context)++;
+  }
+
+  void commitAsyncTest(uint32_t env_flags) {
+    const int kNumTxns = 20;
+    boost::atomic<int> durable(0);
+
+    close();
+    require_create(UPS_ENABLE_TRANSACTIONS | env_flags);
+
+    ups_txn_t *txn;
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    REQUIRE(UPS_INV_PARAMETER == ups_txn_commit_async(0, 0,
+                            commitCallback, &durable));
+    REQUIRE(UPS_INV_PARAMETER == ups_txn_commit_async(txn, 0, 0, &durable));
+    REQUIRE(0 == ups_txn_abort(txn, 0));
+
+    for (int i = 0; i < kNumTxns; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+      REQUIRE(0 == ups_db_insert(db, txn, &key, &rec, 0));
+      REQUIRE(0 == ups_txn_commit_async(txn, 0, commitCallback, &durable));
+    }
+
+    // without UPS_ENABLE_FSYNC the callbacks are invoked immediately;
+    // otherwise they are invoked before the Environment is closed
+    if (NOTSET(env_flags, UPS_ENABLE_FSYNC))
+      REQUIRE(durable == kNumTxns);
+    close();
+    REQUIRE(durable == kNumTxns);
+
+    require_open(UPS_ENABLE_TRANSACTIONS);
+    uint64_t count = 0;
+    REQUIRE(0 == ups_db_count(db, 0, 0, &count));
+    REQUIRE(count == (uint64_t)kNumTxns);
+  }
+
+  static void UPS_CALLCONV countCallback(ups_status_t status, void *context) {
+    TxnFixture *f = (TxnFixture *)context;
+    uint64_t count = 0;
+    REQUIRE(0 == status);
+    REQUIRE(0 == ups_db_count(f->db, 0, 0, &count));
+    REQUIRE(count == 1u);
+  }
+
+  void commitAsyncReentrantTest() {
+    ups_txn_t *txn;
+    ups_key_t key = ups_make_key((void *)"key", 4);
+    ups_record_t rec = ups_make_record((void *)"rec", 4);
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    REQUIRE(0 == ups_db_insert(db, txn, &key, &rec, 0));
+
+    // the commit is durable immediately; the callback must not run while
+    // the Environment is locked
+    REQUIRE(0 == ups_txn_commit_async(txn, 0, countCallback, this));
+  }
+
   void issue105Test() {
     const int item_count = 50;
     for (int i = 0; i < item_count; i++) {
@@ -427,6 +493,24 @@ TEST_CASE("Txn/beginCommitTest", "")
   f.beginCommitTest();
 }
 
+TEST_CASE("Txn/commitAsyncTest", "")
+{
+  TxnFixture f;
+  f.commitAsyncTest(0);
+}
+
+TEST_CASE("Txn/commitAsyncFsyncTest", "")
+{
+  TxnFixture f;
+  f.commitAsyncTest(UPS_ENABLE_FSYNC);
+}
+
+TEST_CASE("Txn/commitAsyncReentrantTest", "")
+{
+  TxnFixture f;
+  f.commitAsyncReentrantTest();
+}
+
 TEST_CASE("Txn/multipleBeginCommitTest", "")
 {
   TxnFixture f;
@@ -703,6 +787,311 @@ struct HighLevelTxnFixture : BaseFixture {
     REQUIRE(0 == ups_db_erase(db, 0, &key, 0));
   }
 
+  void snapshotReadTest() {
+    ups_txn_t *writer, *snapshot;
+    ups_cursor_t *cursor;
+    ups_key_t key1 = ups_make_key((void *)"key1", 5);
+    ups_key_t key2 = ups_make_key((void *)"key2", 5);
+    ups_record_t rec1 = ups_make_record((void *)"old", 4);
+    ups_record_t rec2 = ups_make_record((void *)"new", 4);
+    ups_record_t rec = {0};
+    uint64_t count;
+
+    require_create(UPS_ENABLE_TRANSACTIONS
+                    | UPS_FLUSH_TRANSACTIONS_IMMEDIATELY);
+    REQUIRE(0 == ups_db_insert(db, 0, &key1, &rec1, 0));
+
+    // the writer begins before the snapshot and commits after it
+    REQUIRE(0 == ups_txn_begin(&writer, env, 0, 0, 0));
+    REQUIRE(0 == ups_db_insert(db, writer, &key1, &rec2, UPS_OVERWRITE));
+    REQUIRE(0 == ups_txn_begin(&snapshot, env, 0, 0, UPS_TXN_READ_ONLY));
+
+    // the snapshot does not conflict with the active writer
+    REQUIRE(UPS_TXN_CONFLICT == ups_db_find(db, 0, &key1, &rec, 0));
+    REQUIRE(0 == ups_db_find(db, snapshot, &key1, &rec, 0));
+    REQUIRE(0 == ::strcmp("old", (const char *)rec.data));
+
+    // the changes which are committed later are not visible, although
+    // they would be flushed immediately
+    REQUIRE(0 == ups_txn_commit(writer, 0));
+    REQUIRE(0 == ups_db_insert(db, 0, &key2, &rec2, 0));
+    REQUIRE(0 == ups_db_find(db, 0, &key1, &rec, 0));
+    REQUIRE(0 == ::strcmp("new", (const char *)rec.data));
+    REQUIRE(0 == ups_db_find(db, snapshot, &key1, &rec, 0));
+    REQUIRE(0 == ::strcmp("old", (const char *)rec.data));
+    REQUIRE(UPS_KEY_NOT_FOUND == ups_db_find(db, snapshot, &key2, &rec, 0));
+
+    // approximate matching skips the hidden keys
+    ups_key_t key0 = ups_make_key((void *)"key0", 5);
+    REQUIRE(0 == ups_db_find(db, snapshot, &key0, &rec, UPS_FIND_GEQ_MATCH));
+    REQUIRE(0 == ::strcmp("key1", (const char *)key0.data));
+    REQUIRE(0 == ::strcmp("old", (const char *)rec.data));
+    ups_key_t key3 = ups_make_key((void *)"key3", 5);
+    REQUIRE(0 == ups_db_find(db, snapshot, &key3, &rec, UPS_FIND_LEQ_MATCH));
+    REQUIRE(0 == ::strcmp("key1", (const char *)key3.data));
+
+    REQUIRE(0 == ups_db_count(db, snapshot, 0, &count));
+    REQUIRE(count == 1u);
+    REQUIRE(0 == ups_db_count(db, 0, 0, &count));
+    REQUIRE(count == 2u);
+
+    REQUIRE(0 == ups_cursor_create(&cursor, db, snapshot, 0));
+    ups_key_t key = {0};
+    REQUIRE(0 == ups_cursor_move(cursor, &key, &rec, UPS_CURSOR_FIRST));
+    REQUIRE(0 == ::strcmp("key1", (const char *)key.data));
+    REQUIRE(0 == ::strcmp("old", (const char *)rec.data));
+    REQUIRE(UPS_KEY_NOT_FOUND == ups_cursor_move(cursor, &key, &rec,
+                            UPS_CURSOR_NEXT));
+    REQUIRE(UPS_WRITE_PROTECTED == ups_cursor_insert(cursor, &key2, &rec2,
+                            UPS_OVERWRITE));
+    REQUIRE(0 == ups_cursor_close(cursor));
+
+    // the snapshot is read-only
+    REQUIRE(UPS_WRITE_PROTECTED == ups_db_insert(db, snapshot, &key2,
+                            &rec2, 0));
+    REQUIRE(UPS_WRITE_PROTECTED == ups_db_erase(db, snapshot, &key1, 0));
+    REQUIRE(0 == ups_txn_commit(snapshot, 0));
+
+    // a new snapshot sees all committed changes
+    REQUIRE(0 == ups_txn_begin(&snapshot, env, 0, 0, UPS_TXN_READ_ONLY));
+    REQUIRE(0 == ups_db_find(db, snapshot, &key1, &rec, 0));
+    REQUIRE(0 == ::strcmp("new", (const char *)rec.data));
+    REQUIRE(0 == ups_db_find(db, snapshot, &key2, &rec, 0));
+
+    // closing the Environment aborts the snapshot and flushes the
+    // deferred Txns
+    REQUIRE(0 == ups_db_erase(db, 0, &key2, 0));
+    close(UPS_AUTO_CLEANUP | UPS_TXN_AUTO_ABORT);
+    require_open(UPS_ENABLE_TRANSACTIONS);
+    REQUIRE(0 == ups_db_find(db, 0, &key1, &rec, 0));
+    REQUIRE(0 == ::strcmp("new", (const char *)rec.data));
+    REQUIRE(UPS_KEY_NOT_FOUND == ups_db_find(db, 0, &key2, &rec, 0));
+  }
+
+  void readOnlyTxnTest() {
+    ups_txn_t *txn;
+    ups_key_t key = ups_make_key((void *)"key", 4);
+    ups_record_t rec = {0};
+
+    require_create(UPS_ENABLE_TRANSACTIONS);
+    LocalDb *ldb = (LocalDb *)db;
+    LocalEnv *lenv = (LocalEnv *)env;
+
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    REQUIRE(0 == ups_db_insert(db, txn, &key, &rec, 0));
+    REQUIRE(ldb->txn_index->num_operations == 1u);
+    REQUIRE(0 == ups_txn_commit(txn, 0));
+    REQUIRE(0 == ups_env_flush(env, UPS_FLUSH_COMMITTED_TRANSACTIONS));
+    REQUIRE(ldb->txn_index->num_operations == 0u);
+
+    // lookups read from the btree
+    REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+
+    // a read-only Txn is released as soon as it ends
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, UPS_TXN_READ_ONLY));
+    REQUIRE(0 == ups_db_find(db, txn, &key, &rec, 0));
+    REQUIRE(lenv->txn_manager->oldest_txn() == (Txn *)txn);
+    REQUIRE(0 == ups_txn_commit(txn, 0));
+    REQUIRE(lenv->txn_manager->oldest_txn() == 0);
+
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, UPS_TXN_READ_ONLY));
+    REQUIRE(0 == ups_txn_abort(txn, 0));
+    REQUIRE(lenv->txn_manager->oldest_txn() == 0);
+
+    // ...also if it is not the oldest Txn
+    ups_txn_t *writer;
+    REQUIRE(0 == ups_txn_begin(&writer, env, 0, 0, 0));
+    for (int i = 0; i < 100; i++) {
+      REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, UPS_TXN_READ_ONLY));
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+    }
+    REQUIRE(lenv->txn_manager->oldest_txn() == (Txn *)writer);
+    REQUIRE(lenv->txn_manager->newest_txn() == (Txn *)writer);
+    REQUIRE(0 == ups_txn_commit(writer, 0));
+  }
+
+  void numericKeyOrderTest() {
+    ups_parameter_t params[] = {
+        {UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32},
+        {0, 0}
+    };
+    require_create(UPS_ENABLE_TRANSACTIONS, 0, 0, params);
+
+    // the byte order of these keys differs from their numeric order
+    uint32_t keys[] = {65536, 1, 256, 2};
+    ups_txn_t *txn;
+    ups_record_t rec = {0};
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    for (int i = 0; i < 4; i++) {
+      ups_key_t key = ups_make_key(&keys[i], sizeof(keys[i]));
+      REQUIRE(0 == ups_db_insert(db, txn, &key, &rec, 0));
+    }
+
+    uint32_t expected[] = {1, 2, 256, 65536};
+    ups_cursor_t *cursor;
+    ups_key_t key = {0};
+    REQUIRE(0 == ups_cursor_create(&cursor, db, txn, 0));
+    for (int i = 0; i < 4; i++) {
+      REQUIRE(0 == ups_cursor_move(cursor, &key, 0, UPS_CURSOR_NEXT));
+      REQUIRE(*(uint32_t *)key.data == expected[i]);
+    }
+    REQUIRE(UPS_KEY_NOT_FOUND == ups_cursor_move(cursor, &key, 0,
+                            UPS_CURSOR_NEXT));
+    REQUIRE(0 == ups_cursor_close(cursor));
+
+    uint32_t k = 255;
+    key = ups_make_key(&k, sizeof(k));
+    REQUIRE(0 == ups_db_find(db, txn, &key, &rec, UPS_FIND_GEQ_MATCH));
+    REQUIRE(*(uint32_t *)key.data == 256u);
+    REQUIRE(0 == ups_txn_commit(txn, 0));
+  }
+
+  void arenaTest() {
+    require_create(UPS_ENABLE_TRANSACTIONS);
+    LocalEnv *lenv = (LocalEnv *)env;
+    LocalTxnManager *ltm = (LocalTxnManager *)lenv->txn_manager.get();
+
+    // the chunks of the arenas are recycled
+    ups_txn_t *txn;
+    std::vector<uint8_t> buffer(LocalTxnManager::kArenaChunkSize * 2, 'x');
+    for (uint32_t i = 0; i < 200; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(buffer.data(), i % 10);
+      // a record which does not fit into a chunk
+      if (i % 50 == 0)
+        rec.size = (uint32_t)buffer.size();
+      REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+      REQUIRE(0 == ups_db_insert(db, txn, &key, &rec, 0));
+      REQUIRE(((LocalTxn *)txn)->arena.allocated_bytes() > rec.size);
+      if (i % 2)
+        REQUIRE(0 == ups_txn_abort(txn, 0));
+      else
+        REQUIRE(0 == ups_txn_commit(txn, 0));
+      REQUIRE(0 == ups_env_flush(env, UPS_FLUSH_COMMITTED_TRANSACTIONS));
+    }
+    REQUIRE(ltm->arena_pool.slab_count() == 1u);
+
+    for (uint32_t i = 0; i < 200; i += 2) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = {0};
+      REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+      REQUIRE(rec.size == (i % 50 == 0 ? buffer.size() : i % 10));
+    }
+  }
+
+  void flushThresholdTest() {
+    const uint32_t threshold = 64 * 1024;
+    ups_parameter_t params[] = {
+        {UPS_PARAM_TXN_FLUSH_THRESHOLD, threshold},
+        {0, 0}
+    };
+    require_create(UPS_ENABLE_TRANSACTIONS, params);
+    LocalEnv *lenv = (LocalEnv *)env;
+    LocalTxnManager *ltm = (LocalTxnManager *)lenv->txn_manager.get();
+
+    ups_parameter_t query[] = {
+        {UPS_PARAM_TXN_FLUSH_THRESHOLD, 0},
+        {0, 0}
+    };
+    REQUIRE(0 == ups_env_get_parameters(env, query));
+    REQUIRE(query[0].value == threshold);
+
+    // small Txns are buffered
+    ups_txn_t *txn;
+    std::vector<uint8_t> buffer(threshold * LocalTxnManager::kSyncFlushFactor,
+                    'x');
+    for (uint32_t i = 0; i < 20; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(buffer.data(), 100);
+      REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+      REQUIRE(0 == ups_db_insert(db, txn, &key, &rec, 0));
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+    }
+    REQUIRE(ltm->committed_bytes > 20 * 100u);
+    REQUIRE(ltm->committed_bytes < threshold);
+    REQUIRE(ltm->oldest_txn() != 0);
+
+    // a Txn which exceeds the threshold by far is flushed immediately
+    uint32_t k = 100;
+    ups_key_t key = ups_make_key(&k, sizeof(k));
+    ups_record_t rec = ups_make_record(buffer.data(), (uint32_t)buffer.size());
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    REQUIRE(0 == ups_db_insert(db, txn, &key, &rec, 0));
+    REQUIRE(0 == ups_txn_commit(txn, 0));
+    REQUIRE(ltm->oldest_txn() == 0);
+    REQUIRE(ltm->committed_bytes == 0u);
+
+    // otherwise the committed Txns are flushed in the background
+    k = 101;
+    rec.size = threshold + 1;
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    REQUIRE(0 == ups_db_insert(db, txn, &key, &rec, 0));
+    REQUIRE(0 == ups_txn_commit(txn, 0));
+    for (int i = 0; i < 500; i++) {
+      {
+        ScopedEnvLock lock(lenv);
+        if (ltm->oldest_txn() == 0)
+          break;
+      }
+      boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    {
+      ScopedEnvLock lock(lenv);
+      REQUIRE(ltm->oldest_txn() == 0);
+      REQUIRE(ltm->committed_bytes == 0u);
+    }
+
+    REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+    REQUIRE(rec.size == threshold + 1);
+  }
+
+  void backgroundFlushErrorTest() {
+    const uint32_t threshold = 64 * 1024;
+    ups_parameter_t params[] = {
+        {UPS_PARAM_TXN_FLUSH_THRESHOLD, threshold},
+        {0, 0}
+    };
+    require_create(UPS_ENABLE_TRANSACTIONS, params);
+    LocalEnv *lenv = (LocalEnv *)env;
+    LocalTxnManager *ltm = (LocalTxnManager *)lenv->txn_manager.get();
+
+    // the background flush fails
+    ErrorInducer::activate(true);
+    ErrorInducer::add(ErrorInducer::kChangesetFlush, 1);
+
+    ups_txn_t *txn;
+    std::vector<uint8_t> buffer(threshold + 1, 'x');
+    uint32_t k = 1;
+    ups_key_t key = ups_make_key(&k, sizeof(k));
+    ups_record_t rec = ups_make_record(buffer.data(), (uint32_t)buffer.size());
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    REQUIRE(0 == ups_db_insert(db, txn, &key, &rec, 0));
+    REQUIRE(0 == ups_txn_commit(txn, 0));
+
+    ups_status_t flush_error = 0;
+    for (int i = 0; i < 500 && flush_error == 0; i++) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+      ScopedEnvLock lock(lenv);
+      flush_error = ltm->flush_error;
+    }
+    ErrorInducer::activate(false);
+    REQUIRE(flush_error == UPS_INTERNAL_ERROR);
+
+    // the error is returned by the next commit; the Txn remains active
+    // and is committed when the commit is retried
+    k = 2;
+    rec.size = 100;
+    REQUIRE(0 == ups_txn_begin(&txn, env, 0, 0, 0));
+    REQUIRE(0 == ups_db_insert(db, txn, &key, &rec, 0));
+    REQUIRE(UPS_INTERNAL_ERROR == ups_txn_commit(txn, 0));
+    REQUIRE(0 == ups_txn_commit(txn, 0));
+
+    for (k = 1; k <= 2; k++) {
+      REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+      REQUIRE(rec.size == (k == 1 ? threshold + 1 : 100));
+    }
+  }
+
   ups_status_t insert(ups_txn_t *txn, const char *keydata,
                   const char *recorddata, int flags) {
     ups_key_t key = ups_make_key((void *)keydata,
@@ -950,6 +1339,42 @@ TEST_CASE("Txn/high/getKeyCountOverwriteTest", "")
   f.getKeyCountOverwriteTest();
 }
 
+TEST_CASE("Txn/high/snapshotReadTest", "")
+{
+  HighLevelTxnFixture f;
+  f.snapshotReadTest();
+}
+
+TEST_CASE("Txn/high/readOnlyTxnTest", "")
+{
+  HighLevelTxnFixture f;
+  f.readOnlyTxnTest();
+}
+
+TEST_CASE("Txn/high/numericKeyOrderTest", "")
+{
+  HighLevelTxnFixture f;
+  f.numericKeyOrderTest();
+}
+
+TEST_CASE("Txn/high/arenaTest", "")
+{
+  HighLevelTxnFixture f;
+  f.arenaTest();
+}
+
+TEST_CASE("Txn/high/flushThresholdTest", "")
+{
+  HighLevelTxnFixture f;
+  f.flushThresholdTest();
+}
+
+TEST_CASE("Txn/high/backgroundFlushErrorTest", "")
+{
+  HighLevelTxnFixture f;
+  f.backgroundFlushErrorTest();
+}
+
 TEST_CASE("Txn/high/insertTxnsWithDelay", "")
 {
   HighLevelTxnFixture f;